@@ -26,6 +26,7 @@ USA.
 #include <dbus/dbus.h>
 
 #include "apptrack.h"
+#include "busmatch.h"
 
 
 /*
@@ -52,18 +53,99 @@ OHM_IMPORTABLE(void, app_query,       (pid_t *pid,
 
 
 static DBusConnection *bus;
+static busmatch_t     *matches;
 static GHashTable     *clients;
 static int             nclient;
 
 
+static int  client_lookup(const char *id);
+static void client_unregister(const char *id);
+
+
+/********************
+ * client_name_checked
+ ********************/
+static void
+client_name_checked(DBusPendingCall *pending, void *data)
+{
+    const char  *id = (const char *)data;
+    DBusMessage *reply;
+    dbus_bool_t  has_owner;
+
+    if ((reply = dbus_pending_call_steal_reply(pending)) != NULL) {
+        if (dbus_message_get_args(reply, NULL,
+                                  DBUS_TYPE_BOOLEAN, &has_owner,
+                                  DBUS_TYPE_INVALID) &&
+            !has_owner && clients != NULL && client_lookup(id)) {
+            OHM_INFO("apptrack: client %s is gone already", id);
+            client_unregister(id);
+        }
+
+        dbus_message_unref(reply);
+    }
+
+    dbus_pending_call_unref(pending);
+}
+
+
+/********************
+ * client_name_tracked
+ ********************/
+static void
+client_name_tracked(busmatch_t *mgr, const char *rule, int success,
+                    void *data)
+{
+    char            *id = (char *)data;
+    const char      *name = id;
+    DBusMessage     *msg;
+    DBusPendingCall *pending;
+
+    (void)mgr;
+    (void)rule;
+
+    /*
+     * Now that the rule is in place we will hear about the client going
+     * away. Check whether it has already gone while the rule was on its
+     * way to the bus daemon.
+     */
+
+    if (!success || clients == NULL || !client_lookup(id)) {
+        free(id);
+        return;
+    }
+
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                       DBUS_INTERFACE_DBUS, "NameHasOwner");
+    pending = NULL;
+
+    if (msg == NULL ||
+        !dbus_message_append_args(msg, DBUS_TYPE_STRING, &name,
+                                  DBUS_TYPE_INVALID) ||
+        !dbus_connection_send_with_reply(bus, msg, &pending, -1) ||
+        pending == NULL ||
+        !dbus_pending_call_set_notify(pending, client_name_checked, id,
+                                      free)) {
+        OHM_ERROR("apptrack: failed to check the presence of client %s", id);
+        if (pending != NULL) {
+            dbus_pending_call_cancel(pending);
+            dbus_pending_call_unref(pending);
+        }
+        free(id);
+    }
+
+    if (msg != NULL)
+        dbus_message_unref(msg);
+}
+
+
 /********************
  * client_track_name
  ********************/
 static void
 client_track_name(const char *name, int track)
 {
-    char       filter[1024];
-    DBusError  error;
+    char  filter[1024];
+    char *id;
 
     snprintf(filter, sizeof(filter),
              "type='signal',"
@@ -73,28 +155,22 @@ client_track_name(const char *name, int track)
     
     /*
      * Notes:
-     *   We block when adding filters, to minimize (= eliminate ?) the time
-     *   window for the client to crash after it has let us know about itself
-     *   but before we managed to install the filter. According to the docs
-     *   we do not re-enter the main loop and all other messages than the
-     *   reply to AddMatch will get queued and processed once we're back in the
-     *   main loop. On the watch removal path we do not care about errors and
-     *   we do not want to block either.
+     *   We do not block waiting for the bus daemon to install the filter,
+     *   a storm of new clients would stall the main loop. Instead, once
+     *   the filter is known to be in place we ask the daemon whether the
+     *   client is still around, which closes the time window for it to
+     *   crash before we managed to install the filter.
      */
 
     if (track) {
-        dbus_error_init(&error);
-
-        dbus_bus_add_match(bus, filter, &error);
-
-        if (dbus_error_is_set(&error)) {
-            OHM_ERROR("apptrack: failed to add match rule \"%s\": %s", filter,
-                      error.message);
-            dbus_error_free(&error);
+        if ((id = strdup(name)) == NULL ||
+            !busmatch_add(matches, filter, client_name_tracked, id)) {
+            OHM_ERROR("apptrack: failed to add match rule \"%s\"", filter);
+            free(id);
         }
     }
     else
-        dbus_bus_remove_match(bus, filter, NULL);
+        busmatch_del(matches, filter);
 }
 
 
@@ -341,6 +417,11 @@ plugin_init(OhmPlugin *plugin)
         exit(1);
     }
 
+    if ((matches = busmatch_create(bus)) == NULL) {
+        OHM_ERROR("apptrack: failed to create match rule manager");
+        exit(1);
+    }
+
     app_subscribe(app_change_cb, NULL);
 }
 
@@ -362,6 +443,9 @@ plugin_exit(OhmPlugin *plugin)
         clients = NULL;
         nclient = 0;
     }
+
+    busmatch_destroy(matches);
+    matches = NULL;
 }
 
 
@@ -39,6 +39,11 @@ typedef struct {
     }     cb;
 } query_t;
 
+OHM_IMPORTABLE(int, query_peer, (DBusBusType type, const char *name,
+                                 void (*callback)(const char *, pid_t, uid_t,
+                                                  void *),
+                                 void *data));
+
 static DBusConnection *sys_conn;   /* D-Bus system bus */
 static DBusConnection *sess_conn;  /* D-Bus session bus */
 
@@ -46,6 +51,8 @@ static void system_bus_init(void);
 static void session_bus_init(const char *);
 static void session_bus_cleanup();
 
+static int  peer_cache(void);
+static void peer_queried(const char *, pid_t, uid_t, void *);
 static void pid_queried(DBusPendingCall *, void *);
 
 
@@ -149,6 +156,12 @@ int dbusif_pid_query(char *bustype, char *addr,
         query->cb.func = func;
         query->cb.data = data;
 
+        /* the dbus plugin usually knows the peer already */
+        if (peer_cache() &&
+            query_peer(conn == sys_conn ? DBUS_BUS_SYSTEM : DBUS_BUS_SESSION,
+                       addr, peer_queried, query))
+            return 0;
+
         msg = dbus_message_new_method_call(DBUS_ADMIN_SERVICE,
                                            DBUS_ADMIN_PATH,
                                            DBUS_ADMIN_INTERFACE,
@@ -264,6 +277,43 @@ static void session_bus_cleanup(void)
 }
 
 
+static int peer_cache(void)
+{
+    static int  checked;
+    char       *signature = (char *)query_peer_SIGNATURE;
+
+    if (!checked) {
+        checked = TRUE;
+
+        ohm_module_find_method("dbus.query_peer", &signature,
+                               (void *)&query_peer);
+
+        if (query_peer == NULL)
+            OHM_INFO("auth: no D-Bus peer cache, "
+                     "querying pids from the bus daemon");
+    }
+
+    return query_peer != NULL;
+}
+
+static void peer_queried(const char *name, pid_t pid, uid_t uid, void *data)
+{
+    query_t *query = (query_t *)data;
+    char    *error = pid ? "OK" : "NameHasNoOwner";
+
+    (void)name;
+    (void)uid;
+
+    OHM_DEBUG(DBG_DBUS, "pid of %s from the peer cache: %u (%s)",
+              query->addr, (unsigned)pid, error);
+
+    query->cb.func(pid, error, query->cb.data);
+
+    free(query->bus);
+    free(query->addr);
+    free(query);
+}
+
 static void pid_queried(DBusPendingCall *pend, void *data)
 {
     query_t       *query   = (query_t *)data;
@@ -27,6 +27,7 @@ USA.
 static void  bus_init(void);
 static void  bus_exit(void);
 static int   bus_query_pid(backlight_context_t *, const char *, DBusMessage *);
+static int   peer_cache(void);
 static void  cache_create(void);
 static void  cache_destroy(void);
 static pid_t cache_lookup(const char *);
@@ -40,6 +41,11 @@ void continue_request(DBusPendingCall *, void *);
 
 static DBusConnection *bus;
 
+OHM_IMPORTABLE(int, query_peer, (DBusBusType type, const char *name,
+                                 void (*callback)(const char *, pid_t, uid_t,
+                                                  void *),
+                                 void *data));
+
 
 /********************
  * mce_init
@@ -338,6 +344,47 @@ bus_exit(void)
 }
 
 
+/********************
+ * peer_cache
+ ********************/
+static int
+peer_cache(void)
+{
+    static int  checked;
+    char       *signature = (char *)query_peer_SIGNATURE;
+
+    if (!checked) {
+        checked = TRUE;
+        ohm_module_find_method("dbus.query_peer", &signature,
+                               (void *)&query_peer);
+    }
+
+    return query_peer != NULL;
+}
+
+
+/********************
+ * peer_queried
+ ********************/
+static void
+peer_queried(const char *name, pid_t pid, uid_t uid, void *data)
+{
+    qry_data_t *qry = (qry_data_t *)data;
+
+    (void)uid;
+
+    OHM_DEBUG(DBG_REQUEST, "pid of client %s is %d", name, pid);
+
+    if (pid != 0)
+        backlight_request(qry->ctx, pid, qry->req);
+    else
+        OHM_ERROR("backlight: failed to get pid of client %s.", qry->client);
+
+    dbus_message_unref(qry->req);
+    FREE(qry);
+}
+
+
 /********************
  * bus_query_pid
  ********************/
@@ -363,6 +410,11 @@ bus_query_pid(backlight_context_t *ctx, const char *client, DBusMessage *req)
     qry->ctx    = ctx;
     qry->req    = dbus_message_ref(req);
     qry->client = client;
+
+    /* the dbus plugin usually knows the client already */
+    if (peer_cache() &&
+        query_peer(DBUS_BUS_SYSTEM, client, peer_queried, qry))
+        return TRUE;
     
     msg = dbus_message_new_method_call(service, path, interface, member);
 
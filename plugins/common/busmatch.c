@@ -0,0 +1,657 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+
+/*
+ * Shared D-BUS match rule manager. This file is not compiled on its own;
+ * each plugin includes it from its own busmatch.c after its plugin
+ * header, which has to provide the OHM logging macros.
+ *
+ * Every rule is kept in a hash table keyed by the rule text, together
+ * with the number of references to it and whether the bus daemon has
+ * been asked to install it. Reference changes that cross zero put the
+ * rule on a queue which is flushed from an idle callback: the flush
+ * compares the wanted state (referenced or not) with the state on the
+ * bus and only sends the calls needed to reconcile the two. All calls
+ * of a flush are queued on the connection back to back, so a batch
+ * costs a single round trip instead of one per rule, and nothing ever
+ * waits for the replies. AddMatch replies are collected asynchronously
+ * to report errors and to run the completion callbacks of busmatch_add.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "busmatch.h"
+
+#define MAX_RETRIES 3                   /* AddMatch attempts per rule */
+
+typedef struct waiter_s {
+    struct waiter_s   *next;
+    busmatch_cb_t      cb;
+    void              *data;
+} waiter_t;
+
+typedef struct request_s request_t;
+
+typedef struct {
+    char              *text;            /* the rule itself */
+    int                refcnt;          /* number of references */
+    int                installed;       /* AddMatch sent, not taken back */
+    int                queued;          /* on the flush queue */
+    int                retries;         /* failed AddMatch attempts */
+    waiter_t          *waiters;         /* waiting for the next AddMatch */
+    request_t         *req;             /* AddMatch in flight, if any */
+} rule_t;
+
+struct request_s {
+    request_t         *prev;
+    request_t         *next;
+    busmatch_t        *mgr;
+    rule_t            *rule;            /* NULL once the rule is gone */
+    char              *text;            /* rule, for reporting */
+    waiter_t          *waiters;         /* completion callbacks */
+    DBusPendingCall   *pending;
+};
+
+struct busmatch_s {
+    DBusConnection    *conn;            /* bus connection, if any */
+    GHashTable        *rules;           /* rule text -> rule_t */
+    GQueue            *queue;           /* rules with pending changes */
+    guint              idle;            /* flush source */
+    request_t         *requests;        /* AddMatch replies outstanding */
+    busmatch_stats_t   stats;
+};
+
+static void       rule_free(gpointer);
+static void       rule_queue(busmatch_t *, rule_t *);
+static void       rule_flush(busmatch_t *, rule_t *);
+static void       rule_drop(busmatch_t *, rule_t *);
+static int        rule_send(busmatch_t *, rule_t *, const char *);
+static request_t *request_create(busmatch_t *, rule_t *);
+static void       request_unlink(request_t *);
+static void       request_destroy(request_t *);
+static void       request_reply(DBusPendingCall *, void *);
+static void       waiter_notify(waiter_t *, busmatch_t *, const char *, int);
+static gboolean   flush_cb(gpointer);
+
+
+busmatch_t *busmatch_create(DBusConnection *conn)
+{
+    busmatch_t *mgr;
+
+    if ((mgr = calloc(1, sizeof(*mgr))) == NULL)
+        return NULL;
+
+    mgr->rules = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                       NULL, rule_free);
+    mgr->queue = g_queue_new();
+
+    if (mgr->rules == NULL || mgr->queue == NULL) {
+        busmatch_destroy(mgr);
+        return NULL;
+    }
+
+    busmatch_set_connection(mgr, conn);
+
+    return mgr;
+}
+
+void busmatch_destroy(busmatch_t *mgr)
+{
+    GHashTableIter  it;
+    gpointer        key, value;
+    rule_t         *rule;
+    waiter_t       *waiters;
+
+    if (mgr == NULL)
+        return;
+
+    if (mgr->idle != 0)
+        g_source_remove(mgr->idle);
+
+    while (mgr->requests != NULL)
+        request_destroy(mgr->requests);
+
+    /* take back whatever we have asked the daemon to install */
+    if (mgr->conn != NULL && !dbus_connection_get_is_connected(mgr->conn)) {
+        dbus_connection_unref(mgr->conn);
+        mgr->conn = NULL;
+    }
+
+    if (mgr->rules != NULL) {
+        g_hash_table_iter_init(&it, mgr->rules);
+        while (g_hash_table_iter_next(&it, &key, &value)) {
+            rule          = (rule_t *)value;
+            waiters       = rule->waiters;
+            rule->waiters = NULL;
+
+            if (rule->installed && mgr->conn != NULL)
+                rule_send(mgr, rule, "RemoveMatch");
+
+            waiter_notify(waiters, mgr, rule->text, FALSE);
+        }
+    }
+
+    if (mgr->conn != NULL)
+        dbus_connection_flush(mgr->conn);
+
+    if (mgr->queue != NULL)
+        g_queue_free(mgr->queue);
+
+    if (mgr->rules != NULL)
+        g_hash_table_destroy(mgr->rules);
+
+    if (mgr->conn != NULL)
+        dbus_connection_unref(mgr->conn);
+
+    free(mgr);
+}
+
+/*
+ * Switch to a new connection (or to none). Whatever has been installed
+ * on the old connection is forgotten and every referenced rule is queued
+ * to be installed again, so this is also the way to restore the rules
+ * after the bus got reconnected.
+ */
+void busmatch_set_connection(busmatch_t *mgr, DBusConnection *conn)
+{
+    GHashTableIter  it;
+    gpointer        key, value;
+    rule_t         *rule;
+    request_t      *req;
+    waiter_t       *w;
+
+    if (conn == mgr->conn)
+        return;
+
+    /* replies on the old connection are of no use, wait for new ones */
+    while ((req = mgr->requests) != NULL) {
+        if ((rule = req->rule) != NULL) {
+            while ((w = req->waiters) != NULL) {
+                req->waiters  = w->next;
+                w->next       = rule->waiters;
+                rule->waiters = w;
+            }
+        }
+
+        request_destroy(req);
+    }
+
+    if (mgr->conn != NULL)
+        dbus_connection_unref(mgr->conn);
+
+    if ((mgr->conn = conn) != NULL)
+        dbus_connection_ref(conn);
+
+    g_hash_table_iter_init(&it, mgr->rules);
+    while (g_hash_table_iter_next(&it, &key, &value)) {
+        rule = (rule_t *)value;
+        rule->installed = FALSE;
+
+        if (!rule->queued)
+            rule_queue(mgr, rule);
+    }
+
+    if (mgr->conn != NULL && mgr->idle == 0 && !g_queue_is_empty(mgr->queue))
+        mgr->idle = g_idle_add(flush_cb, mgr);
+}
+
+/*
+ * Take a reference to a rule. The rule is installed asynchronously once
+ * the first reference has been taken. If cb is given it is called when
+ * the daemon has replied to the AddMatch call, or immediately if the
+ * rule is already known to be installed.
+ */
+int busmatch_add(busmatch_t *mgr, const char *text,
+                 busmatch_cb_t cb, void *data)
+{
+    rule_t   *rule;
+    waiter_t *w = NULL;
+
+    if ((rule = g_hash_table_lookup(mgr->rules, text)) == NULL) {
+        if ((rule = calloc(1, sizeof(*rule))) == NULL ||
+            (rule->text = strdup(text)) == NULL) {
+            OHM_ERROR("busmatch: failed to allocate rule \"%s\"", text);
+            free(rule);
+            return FALSE;
+        }
+
+        g_hash_table_insert(mgr->rules, rule->text, rule);
+    }
+
+    if (cb != NULL && !(rule->installed && rule->req == NULL)) {
+        if ((w = calloc(1, sizeof(*w))) == NULL) {
+            OHM_ERROR("busmatch: failed to allocate callback for \"%s\"",
+                      text);
+            if (rule->refcnt == 0 && !rule->queued)
+                g_hash_table_remove(mgr->rules, rule->text);
+            return FALSE;
+        }
+
+        w->cb   = cb;
+        w->data = data;
+
+        if (rule->req != NULL) {
+            w->next            = rule->req->waiters;
+            rule->req->waiters = w;
+        }
+        else {
+            w->next       = rule->waiters;
+            rule->waiters = w;
+        }
+    }
+
+    if (rule->refcnt++ == 0)
+        mgr->stats.rules++;
+
+    if (!rule->installed && !rule->queued)
+        rule_queue(mgr, rule);
+
+    /* already installed and confirmed, nothing to wait for */
+    if (cb != NULL && w == NULL)
+        cb(mgr, rule->text, TRUE, data);
+
+    return TRUE;
+}
+
+/*
+ * Drop a reference to a rule. The rule is removed from the bus once the
+ * last reference is gone.
+ */
+int busmatch_del(busmatch_t *mgr, const char *text)
+{
+    rule_t *rule;
+
+    if ((rule = g_hash_table_lookup(mgr->rules, text)) == NULL ||
+        rule->refcnt <= 0)
+        return FALSE;
+
+    if (--rule->refcnt == 0) {
+        mgr->stats.rules--;
+
+        if (!rule->queued)
+            rule_queue(mgr, rule);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Send all queued changes now instead of waiting for the idle callback.
+ * Nothing is sent while there is no connection.
+ */
+void busmatch_flush(busmatch_t *mgr)
+{
+    rule_t *rule;
+
+    if (mgr->idle != 0) {
+        g_source_remove(mgr->idle);
+        mgr->idle = 0;
+    }
+
+    if (mgr->conn == NULL || g_queue_is_empty(mgr->queue))
+        return;
+
+    /* callbacks may queue more changes, those go out in this batch too */
+    while ((rule = g_queue_pop_head(mgr->queue)) != NULL)
+        rule_flush(mgr, rule);
+
+    mgr->stats.batches++;
+}
+
+void busmatch_get_stats(busmatch_t *mgr, busmatch_stats_t *stats)
+{
+    *stats = mgr->stats;
+}
+
+
+static void rule_free(gpointer ptr)
+{
+    rule_t   *rule = (rule_t *)ptr;
+    waiter_t *w;
+
+    if (rule->req != NULL)
+        rule->req->rule = NULL;
+
+    while ((w = rule->waiters) != NULL) {
+        rule->waiters = w->next;
+        free(w);
+    }
+
+    free(rule->text);
+    free(rule);
+}
+
+static void rule_queue(busmatch_t *mgr, rule_t *rule)
+{
+    rule->queued = TRUE;
+    g_queue_push_tail(mgr->queue, rule);
+
+    if (mgr->idle == 0 && mgr->conn != NULL)
+        mgr->idle = g_idle_add(flush_cb, mgr);
+}
+
+static void rule_flush(busmatch_t *mgr, rule_t *rule)
+{
+    waiter_t *waiters, *w;
+
+    rule->queued = FALSE;
+
+    if (rule->refcnt > 0) {
+        if (!rule->installed && rule_send(mgr, rule, "AddMatch"))
+            return;
+
+        if (!rule->installed) {
+            rule_drop(mgr, rule);
+            return;
+        }
+
+        if (rule->installed) {
+            mgr->stats.elided++;        /* removed and re-added in time */
+            return;
+        }
+    }
+    else {
+        if (rule->installed) {
+            rule_send(mgr, rule, "RemoveMatch");
+            rule->installed = FALSE;
+
+            /*
+             * An AddMatch still in flight is taken back before anyone
+             * could use it, its callbacks are told it failed.
+             */
+            if (rule->req != NULL) {
+                while ((w = rule->req->waiters) != NULL) {
+                    rule->req->waiters = w->next;
+                    w->next            = rule->waiters;
+                    rule->waiters      = w;
+                }
+                rule->req->rule = NULL;
+                rule->req       = NULL;
+            }
+        }
+        else
+            mgr->stats.elided++;        /* added and removed in time */
+    }
+
+    /*
+     * The rule is not going to be installed now. Let whoever is waiting
+     * for it know and forget the rule unless a callback has taken a new
+     * reference to it meanwhile.
+     */
+    waiters       = rule->waiters;
+    rule->waiters = NULL;
+
+    waiter_notify(waiters, mgr, rule->text, FALSE);
+
+    if (rule->refcnt == 0 && !rule->queued)
+        g_hash_table_remove(mgr->rules, rule->text);
+}
+
+/*
+ * Give up on a rule the daemon would not install. The references to it
+ * stay with their holders, who release them with busmatch_del as usual;
+ * the callbacks waiting for the rule are told about the failure and a
+ * later busmatch_add gives it another go.
+ */
+static void rule_drop(busmatch_t *mgr, rule_t *rule)
+{
+    waiter_t *waiters;
+
+    OHM_ERROR("busmatch: giving up on match rule \"%s\"", rule->text);
+
+    if (rule->queued) {
+        g_queue_remove(mgr->queue, rule);
+        rule->queued = FALSE;
+    }
+
+    rule->retries = 0;
+
+    waiters       = rule->waiters;
+    rule->waiters = NULL;
+
+    waiter_notify(waiters, mgr, rule->text, FALSE);
+}
+
+static int rule_send(busmatch_t *mgr, rule_t *rule, const char *method)
+{
+    DBusMessage *msg;
+    request_t   *req;
+    const char  *text = rule->text;
+    int          add  = !strcmp(method, "AddMatch");
+    int          success;
+
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                       DBUS_INTERFACE_DBUS, method);
+    if (msg == NULL)
+        goto failed;
+
+    if (!dbus_message_append_args(msg, DBUS_TYPE_STRING, &text,
+                                  DBUS_TYPE_INVALID)) {
+        dbus_message_unref(msg);
+        goto failed;
+    }
+
+    if (!add) {
+        dbus_message_set_no_reply(msg, TRUE);
+        success = dbus_connection_send(mgr->conn, msg, NULL);
+        dbus_message_unref(msg);
+
+        if (!success)
+            goto failed;
+
+        mgr->stats.removed++;
+        return TRUE;
+    }
+
+    if ((req = request_create(mgr, rule)) == NULL) {
+        dbus_message_unref(msg);
+        goto failed;
+    }
+
+    success = dbus_connection_send_with_reply(mgr->conn, msg,
+                                              &req->pending, -1);
+    dbus_message_unref(msg);
+
+    if (req->pending != NULL)
+        mgr->stats.inflight++;
+
+    if (!success || req->pending == NULL ||
+        !dbus_pending_call_set_notify(req->pending, request_reply, req,
+                                      NULL)) {
+        request_destroy(req);
+        goto failed;
+    }
+
+    /* the request takes over the callbacks waiting for this AddMatch */
+    req->waiters    = rule->waiters;
+    rule->waiters   = NULL;
+    rule->req       = req;
+    rule->installed = TRUE;
+
+    mgr->stats.added++;
+
+    return TRUE;
+
+ failed:
+    OHM_ERROR("busmatch: failed to send %s for \"%s\"", method, rule->text);
+    return FALSE;
+}
+
+static request_t *request_create(busmatch_t *mgr, rule_t *rule)
+{
+    request_t *req;
+
+    if ((req = calloc(1, sizeof(*req))) == NULL ||
+        (req->text = strdup(rule->text)) == NULL) {
+        free(req);
+        return NULL;
+    }
+
+    req->mgr  = mgr;
+    req->rule = rule;
+
+    if ((req->next = mgr->requests) != NULL)
+        req->next->prev = req;
+    mgr->requests = req;
+
+    return req;
+}
+
+static void request_unlink(request_t *req)
+{
+    busmatch_t *mgr = req->mgr;
+
+    if (req->prev != NULL)
+        req->prev->next = req->next;
+    else
+        mgr->requests = req->next;
+    if (req->next != NULL)
+        req->next->prev = req->prev;
+
+    req->prev = req->next = NULL;
+
+    if (req->rule != NULL) {
+        req->rule->req = NULL;
+        req->rule      = NULL;
+    }
+
+    if (req->pending != NULL) {
+        dbus_pending_call_cancel(req->pending);
+        dbus_pending_call_unref(req->pending);
+        req->pending = NULL;
+        mgr->stats.inflight--;
+    }
+}
+
+/*
+ * Unlink and free a request, failing the callbacks still waiting for it.
+ */
+static void request_destroy(request_t *req)
+{
+    request_unlink(req);
+    waiter_notify(req->waiters, req->mgr, req->text, FALSE);
+
+    free(req->text);
+    free(req);
+}
+
+static void request_reply(DBusPendingCall *pending, void *data)
+{
+    request_t   *req  = (request_t *)data;
+    busmatch_t  *mgr  = req->mgr;
+    rule_t      *rule = req->rule;
+    DBusMessage *reply;
+    waiter_t    *w;
+    int          success, retry;
+
+    reply   = dbus_pending_call_steal_reply(pending);
+    success = (reply != NULL &&
+               dbus_message_get_type(reply) != DBUS_MESSAGE_TYPE_ERROR);
+    retry   = FALSE;
+
+    if (!success) {
+        OHM_ERROR("busmatch: failed to add match rule \"%s\" (%s)",
+                  req->text, reply ? dbus_message_get_error_name(reply) :
+                  "no reply");
+        mgr->stats.failed++;
+
+        /*
+         * A timeout or a lost connection (both reported by libdbus as
+         * NoReply) or a daemon out of memory is worth another try,
+         * anything else (typically a malformed rule) is not.
+         */
+        if (rule != NULL) {
+            rule->installed = FALSE;
+
+            if (rule->refcnt > 0)
+                retry = (reply == NULL ||
+                         dbus_message_is_error(reply, DBUS_ERROR_NO_REPLY) ||
+                         dbus_message_is_error(reply, DBUS_ERROR_NO_MEMORY)) &&
+                    ++rule->retries < MAX_RETRIES;
+        }
+    }
+    else if (rule != NULL)
+        rule->retries = 0;
+
+    if (reply != NULL)
+        dbus_message_unref(reply);
+
+    dbus_pending_call_unref(req->pending);
+    req->pending = NULL;
+    mgr->stats.inflight--;
+
+    /* unlink first, the callbacks are free to call us back */
+    request_unlink(req);
+
+    if (retry) {
+        /* the callbacks keep waiting for the next attempt */
+        while ((w = req->waiters) != NULL) {
+            req->waiters  = w->next;
+            w->next       = rule->waiters;
+            rule->waiters = w;
+        }
+
+        if (!rule->queued)
+            rule_queue(mgr, rule);
+    }
+    else if (!success && rule != NULL && rule->refcnt > 0)
+        rule_drop(mgr, rule);
+
+    waiter_notify(req->waiters, mgr, req->text, success);
+
+    free(req->text);
+    free(req);
+}
+
+static void waiter_notify(waiter_t *waiters, busmatch_t *mgr,
+                          const char *text, int success)
+{
+    waiter_t *w;
+
+    while ((w = waiters) != NULL) {
+        waiters = w->next;
+        w->cb(mgr, text, success, w->data);
+        free(w);
+    }
+}
+
+static gboolean flush_cb(gpointer data)
+{
+    busmatch_t *mgr = (busmatch_t *)data;
+
+    mgr->idle = 0;
+    busmatch_flush(mgr);
+
+    return FALSE;
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,87 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#ifndef __OHM_COMMON_BUSMATCH_H__
+#define __OHM_COMMON_BUSMATCH_H__
+
+/*
+ * D-BUS match rule manager shared by the 'dbus' and 'apptrack' plugins.
+ * The implementation lives in common/busmatch.c and gets compiled into
+ * each plugin by its own busmatch.c.
+ *
+ * Identical rules are reference counted. Adding and removing a rule only
+ * queues the change; the queue is sent to the bus daemon from an idle
+ * callback as a batch of asynchronous AddMatch/RemoveMatch calls, so the
+ * main loop is never blocked waiting for the daemon. A rule that is
+ * added and removed before the queue is flushed never reaches the bus.
+ * An AddMatch that got no reply is retried a few times. A rule the
+ * daemon refuses is not installed but keeps its references, which are
+ * released with busmatch_del as usual; its callbacks report the failure.
+ * Destroying the manager removes every rule it has installed.
+ */
+
+
+#include <dbus/dbus.h>
+
+typedef struct busmatch_s busmatch_t;
+
+/*
+ * Completion callback of busmatch_add. It is called exactly once, with
+ * success set if the daemon has accepted the rule and cleared if it has
+ * refused it (the rule is then forgotten, a later busmatch_add tries
+ * again), if the rule got deleted before it was installed or if the
+ * manager got destroyed before the reply arrived.
+ */
+typedef void (*busmatch_cb_t)(busmatch_t *mgr, const char *rule,
+                              int success, void *data);
+
+typedef struct {
+    unsigned long  added;               /* AddMatch calls sent */
+    unsigned long  removed;             /* RemoveMatch calls sent */
+    unsigned long  failed;              /* AddMatch calls refused */
+    unsigned long  elided;              /* add/remove pairs never sent */
+    unsigned long  batches;             /* queue flushes */
+    int            rules;               /* rules currently referenced */
+    int            inflight;            /* AddMatch replies outstanding */
+} busmatch_stats_t;
+
+
+busmatch_t *busmatch_create(DBusConnection *conn);
+void        busmatch_destroy(busmatch_t *mgr);
+void        busmatch_set_connection(busmatch_t *mgr, DBusConnection *conn);
+
+int  busmatch_add(busmatch_t *mgr, const char *rule,
+                  busmatch_cb_t cb, void *data);
+int  busmatch_del(busmatch_t *mgr, const char *rule);
+void busmatch_flush(busmatch_t *mgr);
+
+void busmatch_get_stats(busmatch_t *mgr, busmatch_stats_t *stats);
+
+
+#endif /* __OHM_COMMON_BUSMATCH_H__ */
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,324 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+
+/*
+ * Shared outgoing D-BUS message queue. This file is not compiled on its
+ * own; each plugin includes it from its own busqueue.c after its plugin
+ * header, which has to provide the OHM logging macros.
+ *
+ * Messages are kept on a GQueue in the order they were queued. A flush
+ * hands the whole queue to libdbus back to back from a single place,
+ * either when the outermost bracket is closed or from an idle callback.
+ * libdbus still writes each message with its own writev, so the saving
+ * comes from the deferral itself (nothing is written while a decision
+ * is being evaluated, the burst leaves in one go afterwards) and from
+ * coalescing, which drops superseded state signals without ever writing
+ * them. Coalescing never changes the order in which a peer sees the
+ * messages.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "busqueue.h"
+
+typedef struct {
+    DBusMessage       *msg;
+    int                flags;
+} entry_t;
+
+struct busqueue_s {
+    DBusConnection    *conn;            /* bus connection, if any */
+    GQueue            *queue;           /* entry_t's in sending order */
+    int                depth;           /* busqueue_begin nesting */
+    guint              idle;            /* flush source */
+    busqueue_stats_t   stats;
+};
+
+static int      same_destination(DBusMessage *, DBusMessage *);
+static int      entry_coalesce(busqueue_t *, DBusMessage *);
+static void     entry_free(entry_t *);
+static void     schedule(busqueue_t *);
+static gboolean flush_cb(gpointer);
+
+
+busqueue_t *busqueue_create(DBusConnection *conn)
+{
+    busqueue_t *q;
+
+    if ((q = calloc(1, sizeof(*q))) == NULL)
+        return NULL;
+
+    if ((q->queue = g_queue_new()) == NULL) {
+        free(q);
+        return NULL;
+    }
+
+    busqueue_set_connection(q, conn);
+
+    return q;
+}
+
+/*
+ * Destroy the queue. Whatever is still queued is sent first, so a plugin
+ * shutting down does not lose its final signals.
+ */
+void busqueue_destroy(busqueue_t *q)
+{
+    if (q == NULL)
+        return;
+
+    busqueue_flush(q);
+    busqueue_purge(q);
+
+    if (q->idle != 0)
+        g_source_remove(q->idle);
+
+    g_queue_free(q->queue);
+
+    if (q->conn != NULL)
+        dbus_connection_unref(q->conn);
+
+    free(q);
+}
+
+/*
+ * Switch to a new connection (or to none). Messages queued for the old
+ * connection are dropped: replies and signals meant for peers of a bus
+ * we are no longer connected to make no sense on a new one.
+ */
+void busqueue_set_connection(busqueue_t *q, DBusConnection *conn)
+{
+    if (conn == q->conn)
+        return;
+
+    busqueue_purge(q);
+
+    if (q->conn != NULL)
+        dbus_connection_unref(q->conn);
+
+    if ((q->conn = conn) != NULL)
+        dbus_connection_ref(conn);
+}
+
+/*
+ * Queue a message for sending. Like dbus_connection_send this takes its
+ * own reference to msg, the caller still has to unref its own.
+ */
+int busqueue_send(busqueue_t *q, DBusMessage *msg, int flags)
+{
+    entry_t *e;
+
+    if (q->conn == NULL) {
+        OHM_ERROR("busqueue: no connection to send message on");
+        return FALSE;
+    }
+
+    if ((flags & BUSQUEUE_COALESCE) &&
+        dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_SIGNAL &&
+        entry_coalesce(q, msg))
+        return TRUE;
+
+    if ((e = calloc(1, sizeof(*e))) == NULL) {
+        OHM_ERROR("busqueue: failed to allocate queue entry");
+        return FALSE;
+    }
+
+    e->msg   = dbus_message_ref(msg);
+    e->flags = flags;
+
+    g_queue_push_tail(q->queue, e);
+
+    q->stats.queued++;
+    q->stats.pending++;
+
+    schedule(q);
+
+    return TRUE;
+}
+
+/*
+ * Open a bracket. Nothing is sent until the matching busqueue_end, so a
+ * burst of messages produced by a single operation leaves as one batch.
+ * Brackets nest; only the outermost one flushes.
+ */
+void busqueue_begin(busqueue_t *q)
+{
+    q->depth++;
+}
+
+void busqueue_end(busqueue_t *q)
+{
+    if (q->depth <= 0) {
+        OHM_ERROR("busqueue: unbalanced busqueue_end");
+        return;
+    }
+
+    if (--q->depth == 0)
+        busqueue_flush(q);
+}
+
+/*
+ * Send everything queued right now, regardless of open brackets.
+ */
+void busqueue_flush(busqueue_t *q)
+{
+    entry_t *e;
+    int      n;
+
+    if (q->idle != 0) {
+        g_source_remove(q->idle);
+        q->idle = 0;
+    }
+
+    if (q->conn == NULL || g_queue_is_empty(q->queue))
+        return;
+
+    n = 0;
+    while ((e = g_queue_pop_head(q->queue)) != NULL) {
+        if (dbus_connection_send(q->conn, e->msg, NULL))
+            q->stats.sent++;
+        else {
+            OHM_ERROR("busqueue: failed to send D-BUS message");
+            q->stats.failed++;
+        }
+
+        q->stats.pending--;
+        entry_free(e);
+        n++;
+    }
+
+    q->stats.batches++;
+
+    if (n > q->stats.largest)
+        q->stats.largest = n;
+}
+
+/*
+ * Drop everything queued without sending it.
+ */
+void busqueue_purge(busqueue_t *q)
+{
+    entry_t *e;
+
+    while ((e = g_queue_pop_head(q->queue)) != NULL) {
+        q->stats.dropped++;
+        q->stats.pending--;
+        entry_free(e);
+    }
+}
+
+void busqueue_get_stats(busqueue_t *q, busqueue_stats_t *stats)
+{
+    *stats = q->stats;
+}
+
+
+static int same_destination(DBusMessage *a, DBusMessage *b)
+{
+    const char *da = dbus_message_get_destination(a);
+    const char *db = dbus_message_get_destination(b);
+
+    if (da == NULL || db == NULL)
+        return da == db;
+
+    return !strcmp(da, db);
+}
+
+/*
+ * Replace the newest queued signal of the same kind (path, interface,
+ * member and destination) if it was queued with BUSQUEUE_COALESCE and
+ * nothing that could reach the same peer was queued after it. Otherwise
+ * the new content would overtake messages queued before it.
+ */
+static int entry_coalesce(busqueue_t *q, DBusMessage *msg)
+{
+    const char *dest = dbus_message_get_destination(msg);
+    GList      *l;
+    entry_t    *e;
+    const char *d;
+
+    for (l = q->queue->tail;  l != NULL;  l = l->prev) {
+        e = (entry_t *)l->data;
+
+        if (dbus_message_get_type(e->msg) == DBUS_MESSAGE_TYPE_SIGNAL &&
+            dbus_message_has_path(e->msg, dbus_message_get_path(msg)) &&
+            dbus_message_has_interface(e->msg,
+                                       dbus_message_get_interface(msg)) &&
+            dbus_message_has_member(e->msg, dbus_message_get_member(msg)) &&
+            same_destination(e->msg, msg)) {
+            if (!(e->flags & BUSQUEUE_COALESCE))
+                return FALSE;
+
+            dbus_message_unref(e->msg);
+            e->msg = dbus_message_ref(msg);
+
+            q->stats.queued++;
+            q->stats.coalesced++;
+
+            return TRUE;
+        }
+
+        /* messages to other peers don't care about the ordering */
+        d = dbus_message_get_destination(e->msg);
+        if (dest == NULL || d == NULL || !strcmp(dest, d))
+            return FALSE;
+    }
+
+    return FALSE;
+}
+
+static void entry_free(entry_t *e)
+{
+    dbus_message_unref(e->msg);
+    free(e);
+}
+
+static void schedule(busqueue_t *q)
+{
+    if (q->depth == 0 && q->idle == 0)
+        q->idle = g_idle_add(flush_cb, q);
+}
+
+static gboolean flush_cb(gpointer data)
+{
+    busqueue_t *q = (busqueue_t *)data;
+
+    q->idle = 0;
+
+    /* a bracket left open across iterations flushes when it is closed */
+    if (q->depth == 0)
+        busqueue_flush(q);
+
+    return FALSE;
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,87 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#ifndef __OHM_COMMON_BUSQUEUE_H__
+#define __OHM_COMMON_BUSQUEUE_H__
+
+/*
+ * Outgoing D-BUS message queue of a single connection, shared by the
+ * 'dbus', 'media' and 'signaling' plugins. The implementation lives in
+ * common/busqueue.c and gets compiled into each plugin by its own
+ * busqueue.c.
+ *
+ * Messages handed to busqueue_send are not written to the connection
+ * right away. They are kept in order and sent as one batch either when
+ * the outermost busqueue_begin/busqueue_end bracket is closed or, with
+ * no bracket open, from an idle callback once the current main loop
+ * iteration is done. This keeps a policy decision that fans out into
+ * many signals from interleaving its writes with its own evaluation.
+ */
+
+
+#include <dbus/dbus.h>
+
+typedef struct busqueue_s busqueue_t;
+
+/*
+ * Flags of busqueue_send, given per message. A signal queued with
+ * BUSQUEUE_COALESCE replaces, in place, the newest queued signal with the
+ * same path, interface, member and destination if that one was queued
+ * with the flag as well and nothing for the same peer was queued after
+ * it; the replaced one is never sent. Only signals carrying a full state
+ * should be queued with it.
+ */
+#define BUSQUEUE_COALESCE 0x01
+
+typedef struct {
+    unsigned long  queued;              /* messages queued */
+    unsigned long  sent;                /* messages written */
+    unsigned long  failed;              /* messages libdbus refused */
+    unsigned long  coalesced;           /* signals replaced before sending */
+    unsigned long  dropped;             /* purged or lost with a connection */
+    unsigned long  batches;             /* non-empty flushes */
+    int            largest;             /* largest batch so far */
+    int            pending;             /* messages currently queued */
+} busqueue_stats_t;
+
+
+busqueue_t *busqueue_create(DBusConnection *conn);
+void        busqueue_destroy(busqueue_t *q);
+void        busqueue_set_connection(busqueue_t *q, DBusConnection *conn);
+
+int  busqueue_send(busqueue_t *q, DBusMessage *msg, int flags);
+void busqueue_begin(busqueue_t *q);
+void busqueue_end(busqueue_t *q);
+void busqueue_flush(busqueue_t *q);
+void busqueue_purge(busqueue_t *q);
+
+void busqueue_get_stats(busqueue_t *q, busqueue_stats_t *stats);
+
+
+#endif /* __OHM_COMMON_BUSQUEUE_H__ */
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
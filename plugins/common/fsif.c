@@ -0,0 +1,1733 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Shared factstore interface implementation. This file is not compiled
+ * on its own; each plugin includes it from its own fsif.c after its
+ * plugin header, which has to provide the DBG_FS debug flag.
+ *
+ * Facts are looked up through per-fact-name indices that are keyed by
+ * the values of the selector fields. An index is created the first time
+ * a given set of selector fields is used for a fact name and it is kept
+ * up to date from the factstore inserted/removed/updated signals. A
+ * fact enters an index once all of its selector fields are keyable and
+ * a lookup that misses the index still falls back to a search.
+ * Watches are dispatched through a table keyed by the interned fact name
+ * and field name, so an update only ever visits the matching watches.
+ *
+ * Coalescing watches (fsif_add_fields_watch) are not called for every
+ * field update. Their updates are collected per fact and delivered as a
+ * single callback with the set of changed fields either at the end of
+ * the current main loop iteration or, if a fsif_transaction_begin/end
+ * bracket is open, when the outermost bracket is closed.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#include <ohm/ohm-fact.h>
+
+#include "fsif.h"
+
+#define FSIF_KEY_MAX  512
+
+typedef struct watch_entry_s {
+    struct watch_entry_s  *next;
+    int                    id;
+    fsif_field_t          *selist;
+    GQuark                 fldquark;    /* 0 means any field */
+    GQuark                *fldquarks;   /* coalesced fields, 0 terminated */
+    union {
+        fsif_field_watch_cb_t  field_watch;
+        fsif_fact_watch_cb_t   fact_watch;
+        fsif_fields_watch_cb_t fields_watch;
+    }                      callback;
+    void                  *usrdata;
+} watch_entry_t;
+
+typedef struct fsif_index_s {
+    struct fsif_index_s   *next;
+    int                    nfield;
+    GQuark                *fields;      /* selector fields, in order */
+    GHashTable            *entries;     /* key -> GSList of facts */
+    GHashTable            *keys;        /* fact -> key */
+    int                    broken;      /* key overflow, scan instead */
+} fsif_index_t;
+
+typedef struct {
+    GQuark                 name;        /* interned fact name */
+    watch_entry_t         *inserts;
+    watch_entry_t         *removes;
+    watch_entry_t         *anyfield;    /* field watches w/o field name */
+    watch_entry_t         *coalesced;   /* coalescing field watches */
+    GHashTable            *fields;      /* field quark -> watch entries */
+    fsif_index_t          *indices;
+} watch_fact_t;
+
+typedef struct {
+    watch_entry_t         *wentry;
+    GQuark                 fldquark;
+    GValue                 value;
+} pending_watch_t;
+
+typedef struct {
+    GQuark                 fldquark;
+    GValue                 value;
+} pending_field_t;
+
+typedef struct pending_fact_s {
+    struct pending_fact_s *next;        /* in delivery order */
+    struct pending_fact_s *fnext;       /* for the same fact */
+    watch_entry_t         *wentry;
+    OhmFact               *fact;
+    int                    dead;        /* fact removed meanwhile */
+    int                    nfield;
+    pending_field_t       *fields;
+} pending_fact_t;
+
+typedef struct flush_s {
+    struct flush_s        *up;          /* flush this one interrupted */
+    pending_fact_t        *next;        /* still to be delivered */
+} flush_t;
+
+static OhmFactStore  *fs;
+static int            watch_id = 1;
+static GHashTable    *watch_facts;      /* fact name quark -> watch_fact_t */
+
+static OhmFact       *batch_fact;
+static int            batch_depth;
+static GSList        *batch_pending;
+
+static int            coalesce_depth;
+static guint          coalesce_srcid;
+static GHashTable    *coalesce_facts;   /* fact -> pending_fact_t */
+static pending_fact_t *coalesce_head;
+static pending_fact_t *coalesce_tail;
+static flush_t       *coalesce_flushing; /* flushes in progress */
+
+static OhmFact       *find_entry(char *, fsif_field_t *);
+static OhmFact       *scan_entry(char *, fsif_field_t *);
+static int            matching_entry(OhmFact *, fsif_field_t *);
+static int            get_field(OhmFact *, fsif_fldtype_t, char *, void *);
+static void           set_field(OhmFact *, fsif_fldtype_t, char *, void *);
+static watch_fact_t  *find_watch(const char *, int);
+static void           free_watch(gpointer);
+static watch_entry_t *find_field_watch(watch_fact_t *, OhmFact *, GQuark);
+static void           fire_field_watch(OhmFact *, char *, watch_entry_t *,
+                                       GQuark, GValue *);
+static int            batch_begin(OhmFact *);
+static void           batch_end(void);
+static void           batch_queue(watch_entry_t *, GQuark, GValue *);
+static void           coalesce_queue(watch_entry_t *, OhmFact *, GQuark,
+                                     GValue *);
+static void           coalesce_forget(OhmFact *);
+static void           mark_pending_dead(gpointer, gpointer, gpointer);
+static void           coalesce_flush(void);
+static gboolean       coalesce_idle_cb(gpointer);
+static fsif_index_t  *find_index(watch_fact_t *, fsif_field_t *);
+static void           index_destroy(fsif_index_t *);
+static void           index_add(fsif_index_t *, OhmFact *, GQuark, GValue *);
+static void           index_remove(fsif_index_t *, OhmFact *);
+static char          *fact_key(fsif_index_t *, OhmFact *, GQuark, GValue *,
+                               char *, int);
+static char          *selector_key(fsif_field_t *, char *, int);
+static int            append_key(char **, char *, int, const char *, ...);
+static fsif_field_t  *copy_selector(fsif_field_t *);
+static void           free_selector(fsif_field_t *);
+static char          *print_selector(fsif_field_t *, char *, int);
+static char          *print_value(fsif_fldtype_t, void *, char *, int);
+static int            value_to_field(GValue *, fsif_field_t *);
+static void           inserted_cb(void *, OhmFact *);
+static void           removed_cb(void *, OhmFact *);
+static void           updated_cb(void *, OhmFact *, GQuark, gpointer);
+static char          *time_str(unsigned long long, char *, int);
+
+static guint          updated_id;
+static guint          inserted_id;
+static guint          removed_id;
+
+
+/*! \addtogroup pubif
+ *  Functions
+ *  @{
+ */
+
+FSIF_API void fsif_init(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    fs = ohm_fact_store_get_fact_store();
+
+    watch_facts = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                        NULL, free_watch);
+    coalesce_facts = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    updated_id  = g_signal_connect(G_OBJECT(fs), "updated" ,
+                                   G_CALLBACK(updated_cb) , NULL);
+
+    inserted_id = g_signal_connect(G_OBJECT(fs), "inserted",
+                                   G_CALLBACK(inserted_cb), NULL);
+
+    removed_id  = g_signal_connect(G_OBJECT(fs), "removed" ,
+                                   G_CALLBACK(removed_cb) , NULL);
+}
+
+FSIF_API void fsif_exit(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    fs = ohm_fact_store_get_fact_store();
+
+    if (g_signal_handler_is_connected(G_OBJECT(fs), updated_id)) {
+        g_signal_handler_disconnect(G_OBJECT(fs), updated_id);
+        updated_id = 0;
+    }
+    if (g_signal_handler_is_connected(G_OBJECT(fs), inserted_id)) {
+        g_signal_handler_disconnect(G_OBJECT(fs), inserted_id);
+        inserted_id = 0;
+    }
+    if (g_signal_handler_is_connected(G_OBJECT(fs), removed_id)) {
+        g_signal_handler_disconnect(G_OBJECT(fs), removed_id);
+        removed_id = 0;
+    }
+
+    if (coalesce_srcid != 0) {
+        g_source_remove(coalesce_srcid);
+        coalesce_srcid = 0;
+    }
+
+    /* drop whatever is still pending, nobody is listening anymore */
+    if (coalesce_facts != NULL) {
+        g_hash_table_foreach(coalesce_facts, mark_pending_dead, NULL);
+        coalesce_depth = 0;
+        coalesce_flush();
+
+        g_hash_table_destroy(coalesce_facts);
+        coalesce_facts = NULL;
+    }
+
+    if (watch_facts != NULL) {
+        g_hash_table_destroy(watch_facts);
+        watch_facts = NULL;
+    }
+}
+
+FSIF_API int fsif_add_factstore_entry(char *name, fsif_field_t *fldlist)
+{
+    OhmFact      *fact;
+    fsif_field_t *fld;
+
+    if (!name || !fldlist) {
+        OHM_ERROR("[%s] invalid arument", __FUNCTION__);
+        return FALSE;
+    }
+
+    if ((fact = ohm_fact_new(name)) == NULL) {
+        OHM_ERROR("[%s] Can't create new fact", __FUNCTION__);
+        return FALSE;
+    }
+
+    for (fld = fldlist;   fld->type != fldtype_invalid;   fld++) {
+        set_field(fact, fld->type, fld->name, (void *)&fld->value);
+    }
+
+    if (ohm_fact_store_insert(fs, fact))
+        OHM_DEBUG(DBG_FS, "factstore entry %s created", name);
+    else {
+        OHM_ERROR("[%s] Can't add %s to factsore", __FUNCTION__, name);
+        g_object_unref(fact);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+FSIF_API int fsif_delete_factstore_entry(char *name, fsif_field_t *selist)
+{
+    OhmFact *fact;
+    char     selb[256];
+    char    *selstr;
+    int      success;
+
+    selstr = print_selector(selist, selb, sizeof(selb));
+
+    if ((fact = find_entry(name, selist)) == NULL) {
+        OHM_ERROR("[%s] Failed to delete '%s%s' entry: no entry found",
+                  __FUNCTION__, name, selstr);
+        success = FALSE;
+    }
+    else {
+        ohm_fact_store_remove(fs, fact);
+
+        g_object_unref(fact);
+
+        OHM_DEBUG(DBG_FS, "factstore entry %s%s deleted", name, selstr);
+
+        success = TRUE;
+    }
+
+    return success;
+}
+
+FSIF_API int fsif_destroy_factstore_entry(fsif_entry_t *fact)
+{
+    char  *dump;
+    int    success;
+
+    if (fact == NULL)
+        success = FALSE;
+    else {
+        dump = ohm_structure_to_string(OHM_STRUCTURE(fact));
+
+        ohm_fact_store_remove(fs, fact);
+
+        g_object_unref(fact);
+
+        OHM_DEBUG(DBG_FS, "factstore entry deleted: %s", dump);
+
+        g_free(dump);
+        
+        success = TRUE;
+    }
+ 
+    return success;
+}
+
+FSIF_API int fsif_update_factstore_entry(char         *name,
+                                         fsif_field_t *selist,
+                                         fsif_field_t *fldlist)
+{
+    OhmFact      *fact;
+    fsif_field_t *fld;
+    char          selb[256];
+    char          valb[256];
+    char         *selstr;
+    char         *valstr;
+    int           batched;
+
+    selstr = print_selector(selist, selb, sizeof(selb));
+
+    if ((fact = find_entry(name, selist)) == NULL) {
+        OHM_ERROR("[%s] Failed to update '%s%s' entry: no entry found",
+                  __FUNCTION__, name, selstr);
+        return FALSE;
+    }
+
+    batched = batch_begin(fact);
+
+    for (fld = fldlist;   fld->type != fldtype_invalid;   fld++) {
+        set_field(fact, fld->type, fld->name, (void *)&fld->value);
+
+        valstr = print_value(fld->type,(void *)&fld->value, valb,sizeof(valb));
+
+        OHM_DEBUG(DBG_FS, "factstore entry update %s%s.%s = %s",
+                  name, selstr, fld->name, valstr);
+    }
+
+    if (batched)
+        batch_end();
+
+    return TRUE;
+}
+
+FSIF_API fsif_entry_t *fsif_get_entry(char *name, fsif_field_t *selist)
+{
+    OhmFact  *fact;
+    char     *selstr;
+    char      selb[256];
+    char     *result;
+
+    selstr = print_selector(selist, selb, sizeof(selb));
+    fact   = find_entry(name, selist);
+    result = (fact != NULL) ? "" : "not ";
+
+    OHM_DEBUG(DBG_FS, "factstore lookup %s%s %ssucceeded", name,selstr, result);
+
+    return fact;
+}
+
+FSIF_API void fsif_get_field_by_entry(fsif_entry_t   *entry,
+                                      fsif_fldtype_t  type,
+                                      char           *name,
+                                      void           *vptr)
+{
+    if (entry != NULL && name != NULL && vptr != NULL) {
+        get_field(entry, type, name, vptr);
+    }
+}
+
+FSIF_API void fsif_set_field_by_entry(fsif_entry_t   *entry,
+                                      fsif_fldtype_t  type,
+                                      char           *name,
+                                      void           *vptr)
+{
+    if (entry != NULL && name != NULL && vptr != NULL) {
+        set_field(entry, type, name, vptr);
+    }
+}
+
+/*
+ * Set several fields of an entry. The field watches are notified once
+ * the last field is set and each watch is notified at most once.
+ */
+FSIF_API int fsif_set_fields_by_entry(fsif_entry_t *entry,
+                                      fsif_field_t *fldlist)
+{
+    fsif_field_t *fld;
+    int           batched;
+
+    if (entry == NULL || fldlist == NULL)
+        return FALSE;
+
+    batched = batch_begin(entry);
+
+    for (fld = fldlist;   fld->type != fldtype_invalid;   fld++)
+        set_field(entry, fld->type, fld->name, (void *)&fld->value);
+
+    if (batched)
+        batch_end();
+
+    return TRUE;
+}
+
+FSIF_API int fsif_get_field_by_name(const char     *name,
+                                    fsif_fldtype_t  type,
+                                    char           *field,
+                                    void           *vptr)
+{
+    OhmFact *fact;
+    GSList  *list;
+
+    if (name == NULL || field == NULL || vptr == NULL)
+        return FALSE;
+    
+    list = ohm_fact_store_get_facts_by_name(fs, name);
+
+    if (g_slist_length(list) != 1)
+        return FALSE;
+
+    fact = (OhmFact *)list->data;
+    
+    return get_field(fact, type, field, vptr);
+}
+    
+
+FSIF_API int fsif_add_fact_watch(char                 *factname,
+                                 fsif_fact_watch_e     type,
+                                 fsif_fact_watch_cb_t  callback,
+                                 void                 *usrdata)
+{
+    watch_fact_t   *wfact;
+    watch_entry_t **wentry_head;
+    watch_entry_t  *wentry;
+
+    if (!factname || !callback)
+        return -1;
+
+    if ((wfact = find_watch(factname, TRUE)) == NULL)
+        return -1;
+    
+    switch(type) {
+    case fact_watch_insert:    wentry_head = &wfact->inserts;    break;
+    case fact_watch_remove:    wentry_head = &wfact->removes;    break;
+    default:                   return -1;
+    }
+
+    if ((wentry = malloc(sizeof(*wentry))) == NULL)
+        return -1;
+    else {
+        memset(wentry, 0, sizeof(*wentry));
+        wentry->next                = *wentry_head;
+        wentry->id                  = watch_id++;
+        wentry->callback.fact_watch = callback;
+        wentry->usrdata             = usrdata;
+        
+        *wentry_head = wentry;
+    }
+
+    OHM_DEBUG(DBG_FS, "fact watch point %d added for '%s'",
+              wentry->id, factname);
+
+    return wentry->id;
+}
+
+FSIF_API int fsif_add_field_watch(char                  *factname,
+                                  fsif_field_t          *selist,
+                                  char                  *fldname,
+                                  fsif_field_watch_cb_t  callback,
+                                  void                  *usrdata)
+{
+    watch_fact_t  *wfact;
+    watch_entry_t *wentry;
+    gpointer       key;
+
+    if (!factname || !callback)
+        return -1;
+
+    if ((wfact = find_watch(factname, TRUE)) == NULL)
+        return -1;
+
+    if ((wentry = malloc(sizeof(*wentry))) == NULL)
+        return -1;
+
+    memset(wentry, 0, sizeof(*wentry));
+    wentry->id                   = watch_id++;
+    wentry->selist               = copy_selector(selist);
+    wentry->fldquark             = fldname ? g_quark_from_string(fldname) : 0;
+    wentry->callback.field_watch = callback;
+    wentry->usrdata              = usrdata;
+
+    if (!wentry->fldquark) {
+        wentry->next    = wfact->anyfield;
+        wfact->anyfield = wentry;
+    }
+    else {
+        key          = GUINT_TO_POINTER(wentry->fldquark);
+        wentry->next = g_hash_table_lookup(wfact->fields, key);
+
+        g_hash_table_replace(wfact->fields, key, wentry);
+    }
+
+    OHM_DEBUG(DBG_FS, "field watch point %d added for '%s%s%s'", wentry->id,
+              factname, fldname?":":"", fldname?fldname:"");
+
+    return wentry->id;
+}
+
+/*
+ * Add a coalescing watch for a set of fields (fldnames is NULL terminated,
+ * NULL means any field) of the facts matching selist. The callback gets
+ * the changed fields as a fldtype_invalid terminated array, each field
+ * present once with its latest value.
+ */
+FSIF_API int fsif_add_fields_watch(char                   *factname,
+                                   fsif_field_t           *selist,
+                                   char                  **fldnames,
+                                   fsif_fields_watch_cb_t  callback,
+                                   void                   *usrdata)
+{
+    watch_fact_t  *wfact;
+    watch_entry_t *wentry;
+    int            n, i;
+
+    if (!factname || !callback)
+        return -1;
+
+    if ((wfact = find_watch(factname, TRUE)) == NULL)
+        return -1;
+
+    if ((wentry = malloc(sizeof(*wentry))) == NULL)
+        return -1;
+
+    memset(wentry, 0, sizeof(*wentry));
+
+    if (fldnames != NULL) {
+        for (n = 0;  fldnames[n];  n++)
+            ;
+
+        if ((wentry->fldquarks = calloc(n + 1, sizeof(GQuark))) == NULL) {
+            free(wentry);
+            return -1;
+        }
+
+        for (i = 0;  i < n;  i++)
+            wentry->fldquarks[i] = g_quark_from_string(fldnames[i]);
+    }
+
+    wentry->next                  = wfact->coalesced;
+    wentry->id                    = watch_id++;
+    wentry->selist                = copy_selector(selist);
+    wentry->callback.fields_watch = callback;
+    wentry->usrdata               = usrdata;
+
+    wfact->coalesced = wentry;
+
+    OHM_DEBUG(DBG_FS, "coalescing field watch point %d added for '%s'",
+              wentry->id, factname);
+
+    return wentry->id;
+}
+
+/*
+ * Open a bracket for coalescing watches. Changes made until the matching
+ * fsif_transaction_end() are delivered when the outermost bracket closes.
+ */
+FSIF_API void fsif_transaction_begin(void)
+{
+    coalesce_depth++;
+}
+
+FSIF_API void fsif_transaction_end(void)
+{
+    if (coalesce_depth <= 0) {
+        OHM_ERROR("[%s] unbalanced factstore transaction", __FUNCTION__);
+        return;
+    }
+
+    if (--coalesce_depth == 0)
+        coalesce_flush();
+}
+
+/*!
+ * @}
+ */
+
+
+static OhmFact *find_entry(char *name, fsif_field_t *selist)
+{
+    watch_fact_t *wfact;
+    fsif_index_t *index;
+    GSList       *list;
+    OhmFact      *fact;
+    char          keyb[FSIF_KEY_MAX];
+    char         *key;
+
+    if (selist == NULL || selist->type == fldtype_invalid)
+        return scan_entry(name, selist);
+
+    if ((wfact = find_watch(name, TRUE))          == NULL ||
+        (index = find_index(wfact, selist))       == NULL ||
+        index->broken                                     ||
+        (key = selector_key(selist, keyb, sizeof(keyb))) == NULL)
+    {
+        return scan_entry(name, selist);
+    }
+
+    for (list = g_hash_table_lookup(index->entries, key);
+         list != NULL;
+         list = g_slist_next(list))
+    {
+        fact = (OhmFact *)list->data;
+
+        if (matching_entry(fact, selist))
+            return fact;
+    }
+
+    /*
+     * A miss is not conclusive: the index only sees changes through the
+     * factstore signals, so fall back to a search rather than fail.
+     */
+    return scan_entry(name, selist);
+}
+
+static OhmFact *scan_entry(char *name, fsif_field_t *selist)
+{
+    OhmFact            *fact;
+    GSList             *list;
+
+    for (list  = ohm_fact_store_get_facts_by_name(fs, name);
+         list != NULL;
+         list  = g_slist_next(list))
+    {
+        fact = (OhmFact *)list->data;
+
+        if (matching_entry(fact, selist))
+            return fact;
+    }
+
+
+    return NULL;
+}
+
+static int matching_entry(OhmFact *fact, fsif_field_t *selist)
+{
+    fsif_field_t       *se;
+    char               *strval;
+    long                intval;
+    unsigned long       unsval;
+    double              fltval;
+    unsigned long long  timeval;
+
+    if (selist == NULL)
+        return TRUE;
+
+    for (se = selist;   se->type != fldtype_invalid;   se++) {
+        switch (se->type) {
+                        
+        case fldtype_string:
+            get_field(fact, fldtype_string, se->name, &strval);
+            if (strval == NULL || strcmp(strval, se->value.string))
+                return FALSE;
+            break;
+                
+        case fldtype_integer:
+            get_field(fact, fldtype_integer, se->name, &intval);
+            if (intval != se->value.integer)
+                return FALSE;
+            break;
+            
+        case fldtype_unsignd:
+            get_field(fact, fldtype_unsignd, se->name, &unsval);
+            if (unsval != se->value.unsignd)
+                return FALSE;
+            break;
+            
+        case fldtype_floating:
+            get_field(fact, fldtype_floating, se->name, &fltval);
+            if (fltval != se->value.floating)
+                return FALSE;
+            break;
+            
+        case fldtype_time:
+            get_field(fact, fldtype_time, se->name, &timeval);
+            if (timeval != se->value.time)
+                return FALSE;
+            break;
+            
+        default:
+            return FALSE;
+        } /* switch type */
+    } /* for se */
+
+    return TRUE;
+}
+
+static int get_field(OhmFact *fact, fsif_fldtype_t type,char *name,void *vptr)
+{
+    GValue  *gv;
+
+    if (!fact || !name || !(gv = ohm_fact_get(fact, name))) {
+        OHM_ERROR("[%s] Cant find field %s", __FUNCTION__, name?name:"<null>");
+        goto return_empty_value;
+    }
+
+    switch (type) {
+
+    case fldtype_string:
+        if (G_VALUE_TYPE(gv) != G_TYPE_STRING)
+            goto type_mismatch;
+        else
+            *(const char **)vptr = g_value_get_string(gv);
+        break;
+
+    case fldtype_integer:
+        switch (G_VALUE_TYPE(gv)) {
+        case G_TYPE_LONG: *(long *)vptr = g_value_get_long(gv); break;
+        case G_TYPE_INT:  *(long *)vptr = g_value_get_int(gv);  break;
+        default:          goto type_mismatch;
+        }
+        break;
+
+    case fldtype_unsignd:
+        if (G_VALUE_TYPE(gv) != G_TYPE_ULONG)
+            goto type_mismatch;
+        else
+            *(unsigned long *)vptr = g_value_get_ulong(gv);
+        break;
+
+    case fldtype_floating:
+        if (G_VALUE_TYPE(gv) != G_TYPE_DOUBLE)
+            goto type_mismatch;
+        else
+            *(double *)vptr = g_value_get_double(gv);
+        break;
+
+    case fldtype_time:
+        if (G_VALUE_TYPE(gv) != G_TYPE_UINT64)
+            goto type_mismatch;
+        else
+            *(unsigned long long *)vptr = g_value_get_uint64(gv);
+        break;
+
+    default:
+        break;
+    }
+
+    return TRUE;
+
+ type_mismatch:
+    OHM_ERROR("[%s] Type mismatch when fetching field '%s'",__FUNCTION__,name);
+
+ return_empty_value:
+    switch (type) {
+    case fldtype_string:      *(char              **)vptr = NULL;       break;
+    case fldtype_integer:     *(long               *)vptr = 0;          break;
+    case fldtype_unsignd:     *(unsigned long      *)vptr = 0;          break;
+    case fldtype_floating:    *(double             *)vptr = 0.0;        break;
+    case fldtype_time:        *(unsigned long long *)vptr = 0ULL;       break;
+    default:                                                            break;
+    }
+
+    return FALSE;
+} 
+
+static void set_field(OhmFact *fact, fsif_fldtype_t type,char *name,void *vptr)
+{
+    fsif_value_t *v = (fsif_value_t *)vptr;
+    GValue       *gv;
+
+    switch (type) {
+    case fldtype_string:    gv = ohm_value_from_string(v->string);      break;
+    case fldtype_integer:   gv = ohm_value_from_int(v->integer);        break;
+    case fldtype_unsignd:   gv = ohm_value_from_unsigned(v->unsignd);   break;
+    case fldtype_floating:  gv = ohm_value_from_double(v->floating);    break;
+    case fldtype_time:      gv = ohm_value_from_time(v->time);          break;
+    default:                OHM_ERROR("invalid type for %s", name);     return;
+    }
+
+    ohm_fact_set(fact, name, gv);
+}
+
+static watch_fact_t *find_watch(const char *name, int create)
+{
+    watch_fact_t *wfact;
+    GQuark        quark;
+
+    if (name == NULL || watch_facts == NULL)
+        return NULL;
+
+    if (!create) {
+        if (!(quark = g_quark_try_string(name)))
+            return NULL;
+    }
+    else
+        quark = g_quark_from_string(name);
+
+    wfact = g_hash_table_lookup(watch_facts, GUINT_TO_POINTER(quark));
+
+    if (wfact == NULL && create) {
+        if ((wfact = malloc(sizeof(*wfact))) == NULL)
+            return NULL;
+
+        memset(wfact, 0, sizeof(*wfact));
+        wfact->name   = quark;
+        wfact->fields = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+        g_hash_table_insert(watch_facts, GUINT_TO_POINTER(quark), wfact);
+    }
+
+    return wfact;
+}
+
+static void free_watch_list(watch_entry_t *wentry)
+{
+    watch_entry_t *next;
+
+    for ( ;  wentry != NULL;  wentry = next) {
+        next = wentry->next;
+        free_selector(wentry->selist);
+        free(wentry->fldquarks);
+        free(wentry);
+    }
+}
+
+static void free_field_watches(gpointer key, gpointer value, gpointer data)
+{
+    (void)key;
+    (void)data;
+
+    free_watch_list((watch_entry_t *)value);
+}
+
+static void free_watch(gpointer data)
+{
+    watch_fact_t *wfact = (watch_fact_t *)data;
+    fsif_index_t *index, *next;
+
+    if (wfact != NULL) {
+        free_watch_list(wfact->inserts);
+        free_watch_list(wfact->removes);
+        free_watch_list(wfact->anyfield);
+        free_watch_list(wfact->coalesced);
+
+        g_hash_table_foreach(wfact->fields, free_field_watches, NULL);
+        g_hash_table_destroy(wfact->fields);
+
+        for (index = wfact->indices;  index != NULL;  index = next) {
+            next = index->next;
+            index_destroy(index);
+        }
+
+        free(wfact);
+    }
+}
+
+/*
+ * Find the first watch matching an updated field. Field specific and
+ * field agnostic watches are kept on separate lists, but both are in
+ * most-recent-first order so merging them by id gives the same order
+ * the watches were tried in before they were split.
+ */
+static watch_entry_t *find_field_watch(watch_fact_t *wfact, OhmFact *fact,
+                                       GQuark fldquark)
+{
+    watch_entry_t *fw, *aw, *w;
+
+    fw = g_hash_table_lookup(wfact->fields, GUINT_TO_POINTER(fldquark));
+    aw = wfact->anyfield;
+
+    while (fw != NULL || aw != NULL) {
+        if (fw != NULL && (aw == NULL || fw->id > aw->id)) {
+            w  = fw;
+            fw = fw->next;
+        }
+        else {
+            w  = aw;
+            aw = aw->next;
+        }
+
+        if (matching_entry(fact, w->selist))
+            return w;
+    }
+
+    return NULL;
+}
+
+static void fire_field_watch(OhmFact *fact, char *name, watch_entry_t *wentry,
+                             GQuark fldquark, GValue *gval)
+{
+    fsif_field_t  fld;
+    char          valb[256];
+    char         *valstr;
+
+    fld.name = (char *)g_quark_to_string(fldquark);
+
+    if (!value_to_field(gval, &fld))
+        return;
+
+    valstr = print_value(fld.type, (void *)&fld.value, valb, sizeof(valb)); 
+    OHM_DEBUG(DBG_FS, "field watch point: field '%s:%s' changed to '%s'",
+              name, fld.name, valstr);
+
+    wentry->callback.field_watch(fact, name, &fld, wentry->usrdata);
+}
+
+static int batch_begin(OhmFact *fact)
+{
+    if (batch_depth > 0 && batch_fact != fact)
+        return FALSE;
+
+    batch_fact = fact;
+    batch_depth++;
+
+    return TRUE;
+}
+
+static void batch_end(void)
+{
+    GSList          *pending, *l;
+    pending_watch_t *pw;
+    OhmFact         *fact;
+    char            *name;
+
+    if (batch_depth <= 0 || --batch_depth > 0)
+        return;
+
+    fact    = batch_fact;
+    pending = batch_pending;
+
+    batch_fact    = NULL;
+    batch_pending = NULL;
+
+    name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
+
+    for (l = pending;  l != NULL;  l = g_slist_next(l)) {
+        pw = (pending_watch_t *)l->data;
+
+        fire_field_watch(fact, name, pw->wentry, pw->fldquark, &pw->value);
+
+        g_value_unset(&pw->value);
+        free(pw);
+    }
+
+    g_slist_free(pending);
+}
+
+static void batch_queue(watch_entry_t *wentry, GQuark fldquark, GValue *gval)
+{
+    pending_watch_t *pw;
+    GSList          *l;
+
+    for (l = batch_pending;  l != NULL;  l = g_slist_next(l)) {
+        pw = (pending_watch_t *)l->data;
+
+        if (pw->wentry == wentry && pw->fldquark == fldquark) {
+            g_value_unset(&pw->value);
+            break;
+        }
+    }
+
+    /*
+     * A watch covering several fields gets one delivery per changed
+     * field; only repeated changes of the same field collapse.
+     */
+    if (l == NULL) {
+        if ((pw = malloc(sizeof(*pw))) == NULL) {
+            OHM_ERROR("[%s] failed to allocate memory", __FUNCTION__);
+            return;
+        }
+        memset(pw, 0, sizeof(*pw));
+        pw->wentry   = wentry;
+        pw->fldquark = fldquark;
+
+        batch_pending = g_slist_append(batch_pending, pw);
+    }
+
+    g_value_init(&pw->value, G_VALUE_TYPE(gval));
+    g_value_copy(gval, &pw->value);
+}
+
+static int coalesced_field(watch_entry_t *wentry, GQuark fldquark)
+{
+    GQuark *q;
+
+    if (wentry->fldquarks == NULL)
+        return TRUE;
+
+    for (q = wentry->fldquarks;  *q;  q++) {
+        if (*q == fldquark)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static void coalesce_queue(watch_entry_t *wentry, OhmFact *fact,
+                           GQuark fldquark, GValue *gval)
+{
+    pending_fact_t  *pf, *first;
+    pending_field_t *fields;
+    int              i;
+
+    first = g_hash_table_lookup(coalesce_facts, fact);
+
+    for (pf = first;  pf != NULL;  pf = pf->fnext) {
+        if (pf->wentry == wentry)
+            break;
+    }
+
+    if (pf == NULL) {
+        if ((pf = malloc(sizeof(*pf))) == NULL) {
+            OHM_ERROR("[%s] failed to allocate memory", __FUNCTION__);
+            return;
+        }
+
+        memset(pf, 0, sizeof(*pf));
+        pf->wentry = wentry;
+        pf->fact   = g_object_ref(fact);
+        pf->fnext  = first;
+
+        g_hash_table_insert(coalesce_facts, fact, pf);
+
+        if (coalesce_tail != NULL)
+            coalesce_tail->next = pf;
+        else
+            coalesce_head = pf;
+        coalesce_tail = pf;
+    }
+
+    /* a field that changes again within the window keeps its latest value */
+    for (i = 0;  i < pf->nfield;  i++) {
+        if (pf->fields[i].fldquark == fldquark) {
+            g_value_unset(&pf->fields[i].value);
+            break;
+        }
+    }
+
+    if (i == pf->nfield) {
+        fields = realloc(pf->fields, (i + 1) * sizeof(pf->fields[0]));
+
+        if (fields == NULL) {
+            OHM_ERROR("[%s] failed to allocate memory", __FUNCTION__);
+            return;
+        }
+
+        memset(fields + i, 0, sizeof(fields[0]));
+
+        pf->fields = fields;
+        pf->nfield++;
+    }
+
+    pf->fields[i].fldquark = fldquark;
+
+    g_value_init(&pf->fields[i].value, G_VALUE_TYPE(gval));
+    g_value_copy(gval, &pf->fields[i].value);
+
+    if (coalesce_depth == 0 && coalesce_srcid == 0)
+        coalesce_srcid = g_idle_add(coalesce_idle_cb, NULL);
+}
+
+static void coalesce_forget(OhmFact *fact)
+{
+    pending_fact_t *pf;
+    flush_t        *flush;
+
+    for (pf = g_hash_table_lookup(coalesce_facts, fact);  pf;  pf = pf->fnext)
+        pf->dead = TRUE;
+
+    g_hash_table_remove(coalesce_facts, fact);
+
+    /* a flush in progress has already taken its entries off the table */
+    for (flush = coalesce_flushing;  flush != NULL;  flush = flush->up) {
+        for (pf = flush->next;  pf != NULL;  pf = pf->next) {
+            if (pf->fact == fact)
+                pf->dead = TRUE;
+        }
+    }
+}
+
+static void mark_pending_dead(gpointer key, gpointer value, gpointer data)
+{
+    pending_fact_t *pf;
+
+    (void)key;
+    (void)data;
+
+    for (pf = (pending_fact_t *)value;  pf != NULL;  pf = pf->fnext)
+        pf->dead = TRUE;
+}
+
+static void coalesce_flush(void)
+{
+    pending_fact_t *pf;
+    flush_t         flush;
+    fsif_field_t   *flds;
+    char           *name;
+    int             i, n;
+
+    if (coalesce_srcid != 0) {
+        g_source_remove(coalesce_srcid);
+        coalesce_srcid = 0;
+    }
+
+    flush.up   = coalesce_flushing;
+    flush.next = coalesce_head;
+
+    coalesce_flushing = &flush;
+    coalesce_head     = coalesce_tail = NULL;
+    g_hash_table_remove_all(coalesce_facts);
+
+    while ((pf = flush.next) != NULL) {
+        flush.next = pf->next;
+
+        if (!pf->dead && (flds = calloc(pf->nfield + 1, sizeof(*flds)))) {
+            for (i = n = 0;  i < pf->nfield;  i++) {
+                flds[n].name = (char *)g_quark_to_string(pf->fields[i].fldquark);
+
+                if (value_to_field(&pf->fields[i].value, flds + n))
+                    n++;
+            }
+
+            flds[n].type = fldtype_invalid;
+            flds[n].name = NULL;
+
+            name = (char *)ohm_structure_get_name(OHM_STRUCTURE(pf->fact));
+
+            OHM_DEBUG(DBG_FS, "coalesced watch point: %d field(s) of '%s' "
+                      "changed", n, name);
+
+            if (n > 0)
+                pf->wentry->callback.fields_watch(pf->fact, name, flds,
+                                                  pf->wentry->usrdata);
+            free(flds);
+        }
+
+        for (i = 0;  i < pf->nfield;  i++)
+            g_value_unset(&pf->fields[i].value);
+
+        g_object_unref(pf->fact);
+        free(pf->fields);
+        free(pf);
+    }
+
+    coalesce_flushing = flush.up;
+}
+
+static gboolean coalesce_idle_cb(gpointer data)
+{
+    (void)data;
+
+    coalesce_srcid = 0;
+
+    if (coalesce_depth == 0)
+        coalesce_flush();
+
+    return FALSE;
+}
+
+static fsif_index_t *find_index(watch_fact_t *wfact, fsif_field_t *selist)
+{
+    fsif_index_t *index;
+    fsif_field_t *se;
+    GSList       *list;
+    int           n, i;
+
+    for (n = 0;  selist[n].type != fldtype_invalid;  n++)
+        ;
+
+    for (index = wfact->indices;  index != NULL;  index = index->next) {
+        if (index->nfield != n)
+            continue;
+
+        for (i = 0, se = selist;  i < n;  i++, se++) {
+            if (index->fields[i] != g_quark_try_string(se->name))
+                break;
+        }
+
+        if (i == n)
+            return index;
+    }
+
+    if ((index = malloc(sizeof(*index))) == NULL)
+        return NULL;
+
+    memset(index, 0, sizeof(*index));
+
+    if ((index->fields = malloc(n * sizeof(GQuark))) == NULL) {
+        free(index);
+        return NULL;
+    }
+
+    index->nfield  = n;
+    index->entries = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                           g_free, NULL);
+    index->keys    = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                           NULL, g_free);
+
+    for (i = 0;  i < n;  i++)
+        index->fields[i] = g_quark_from_string(selist[i].name);
+
+    for (list  = ohm_fact_store_get_facts_by_name(fs,
+                                        g_quark_to_string(wfact->name));
+         list != NULL;
+         list  = g_slist_next(list))
+    {
+        index_add(index, (OhmFact *)list->data, 0, NULL);
+    }
+
+    index->next    = wfact->indices;
+    wfact->indices = index;
+
+    OHM_DEBUG(DBG_FS, "created %d field index for '%s'", n,
+              g_quark_to_string(wfact->name));
+
+    return index;
+}
+
+static void free_index_entry(gpointer key, gpointer value, gpointer data)
+{
+    (void)key;
+    (void)data;
+
+    g_slist_free((GSList *)value);
+}
+
+static void index_destroy(fsif_index_t *index)
+{
+    if (index != NULL) {
+        g_hash_table_foreach(index->entries, free_index_entry, NULL);
+        g_hash_table_destroy(index->entries);
+        g_hash_table_destroy(index->keys);
+        free(index->fields);
+        free(index);
+    }
+}
+
+static void index_add(fsif_index_t *index, OhmFact *fact,
+                      GQuark fldquark, GValue *gval)
+{
+    GSList *list;
+    char    keyb[FSIF_KEY_MAX];
+    char   *key;
+
+    index_remove(index, fact);
+
+    if ((key = fact_key(index, fact, fldquark, gval, keyb,sizeof(keyb))) == NULL)
+        return;
+
+    if ((list = g_hash_table_lookup(index->entries, key)) == NULL)
+        g_hash_table_insert(index->entries, g_strdup(key),
+                            g_slist_append(NULL, fact));
+    else
+        g_slist_append(list, fact);
+
+    g_hash_table_insert(index->keys, fact, g_strdup(key));
+}
+
+static void index_remove(fsif_index_t *index, OhmFact *fact)
+{
+    GSList *list, *rest;
+    char   *key;
+
+    if ((key = g_hash_table_lookup(index->keys, fact)) == NULL)
+        return;
+
+    list = g_hash_table_lookup(index->entries, key);
+    rest = g_slist_remove(list, fact);
+
+    if (rest == NULL)
+        g_hash_table_remove(index->entries, key);
+    else if (rest != list)
+        g_hash_table_insert(index->entries, g_strdup(key), rest);
+
+    g_hash_table_remove(index->keys, fact);
+}
+
+/*
+ * Index keys are the selector field values, each prefixed with a type
+ * tag. fact_key and selector_key must produce identical keys for facts
+ * that matching_entry() would accept.
+ */
+static char *fact_key(fsif_index_t *index, OhmFact *fact, GQuark fldquark,
+                      GValue *gval, char *buf, int len)
+{
+    GValue *gv;
+    char   *p;
+    int     i, ok;
+
+    p = buf;
+    *p = '\0';
+
+    for (i = 0;  i < index->nfield;  i++) {
+        if (fldquark && gval && index->fields[i] == fldquark)
+            gv = gval;
+        else
+            gv = ohm_fact_get(fact, (char *)g_quark_to_string(index->fields[i]));
+
+        if (gv == NULL)
+            return NULL;
+
+        switch (G_VALUE_TYPE(gv)) {
+        case G_TYPE_STRING:
+            ok = append_key(&p, buf, len, "s%s", g_value_get_string(gv) ?
+                            g_value_get_string(gv) : "");
+            break;
+        case G_TYPE_LONG:
+            ok = append_key(&p, buf, len, "i%ld", g_value_get_long(gv));
+            break;
+        case G_TYPE_INT:
+            ok = append_key(&p, buf, len, "i%ld", (long)g_value_get_int(gv));
+            break;
+        case G_TYPE_ULONG:
+            ok = append_key(&p, buf, len, "u%lu", g_value_get_ulong(gv));
+            break;
+        case G_TYPE_DOUBLE:
+            ok = append_key(&p, buf, len, "f%.17g", g_value_get_double(gv));
+            break;
+        case G_TYPE_UINT64:
+            ok = append_key(&p, buf, len, "t%llu",
+                            (unsigned long long)g_value_get_uint64(gv));
+            break;
+        default:
+            return NULL;
+        }
+
+        if (!ok) {
+            index->broken = TRUE;
+            return NULL;
+        }
+    }
+
+    return buf;
+}
+
+static char *selector_key(fsif_field_t *selist, char *buf, int len)
+{
+    fsif_field_t *se;
+    fsif_value_t *v;
+    char         *p;
+    int           ok;
+
+    p = buf;
+    *p = '\0';
+
+    for (se = selist;  se->type != fldtype_invalid;  se++) {
+        v = &se->value;
+
+        switch (se->type) {
+        case fldtype_string:
+            ok = append_key(&p, buf, len, "s%s", v->string ? v->string : "");
+            break;
+        case fldtype_integer:
+            ok = append_key(&p, buf, len, "i%ld", v->integer);
+            break;
+        case fldtype_unsignd:
+            ok = append_key(&p, buf, len, "u%lu", v->unsignd);
+            break;
+        case fldtype_floating:
+            ok = append_key(&p, buf, len, "f%.17g", v->floating);
+            break;
+        case fldtype_time:
+            ok = append_key(&p, buf, len, "t%llu", v->time);
+            break;
+        default:
+            return NULL;
+        }
+
+        if (!ok)
+            return NULL;
+    }
+
+    return buf;
+}
+
+static int append_key(char **p, char *buf, int len, const char *fmt, ...)
+{
+    va_list ap;
+    int     room, n;
+
+    room = len - (*p - buf);
+
+    va_start(ap, fmt);
+    n = vsnprintf(*p, room, fmt, ap);
+    va_end(ap);
+
+    if (n < 0 || n + 1 >= room)
+        return FALSE;
+
+    /* fields are separated by a unit separator */
+    (*p)[n]     = '\x1f';
+    (*p)[n + 1] = '\0';
+    *p += n + 1;
+
+    return TRUE;
+}
+
+static fsif_field_t *copy_selector(fsif_field_t *selist)
+{
+    fsif_field_t  *cplist;
+    fsif_field_t  *last;
+    fsif_field_t  *se;
+    fsif_field_t  *cp;
+    int            dim;
+    int            len;
+
+    if (selist == NULL)
+        cplist = NULL;
+    else {
+        for (last = selist;  last->type != fldtype_invalid;  last++)
+            ;
+        
+        dim = (last - selist) + 1;
+        len = dim * sizeof(fsif_field_t);
+        
+        if ((cplist = malloc(len)) != NULL) {
+            memset(cplist, 0, len);
+            
+            for (se = selist, cp = cplist;    se < last;    se++, cp++) {
+                cp->type = se->type;
+                cp->name = strdup(se->name);
+                
+                switch (se->type) {
+                    
+                case fldtype_string:
+                    cp->value.string = strdup(se->value.string);
+                    break;
+                    
+                case fldtype_integer:
+                    cp->value.integer = se->value.integer;
+                    break;
+                    
+                case fldtype_unsignd:
+                    cp->value.unsignd = se->value.unsignd;
+                    break;
+                    
+                case fldtype_floating:
+                    cp->value.floating = se->value.floating;
+                    break;
+                    
+                case fldtype_time:
+                    cp->value.time = se->value.time;
+                    break;
+                    
+                default:
+                    OHM_ERROR("[%s] unsupported type", __FUNCTION__);
+                    memset(&cp->value, 0, sizeof(cp->value));
+                    break;
+                } /* switch */
+            } /* for */
+        }
+    }
+
+    return cplist;
+}
+
+static void free_selector(fsif_field_t *selist)
+{
+    fsif_field_t  *se;
+
+    if (selist != NULL) {
+        for (se = selist;  se->type != fldtype_invalid;  se++) {
+            free(se->name);
+
+            switch(se->type) {
+
+            case fldtype_string:
+                free(se->value.string);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        free(selist);
+    }
+}
+
+static char *print_selector(fsif_field_t *selist, char *buf, int len)
+{
+    fsif_field_t *se;
+    fsif_value_t *v;
+    char         *p, *e, *c;
+    char         *val;
+    char          vb[64];
+
+    if (!selist || !buf || len < 3)
+        return "";
+
+    e = (p = buf) + len - 2;
+
+    p += snprintf(p, e-p, "[");
+
+    for (se = selist, c = "";
+         se->type != fldtype_invalid && p < e;
+         se++, c = ", ")
+    {
+        v = &se->value;
+
+        switch (se->type) {
+        case fldtype_string:   val = v->string;                         break;
+        case fldtype_integer:  val = vb; sprintf(vb,"%ld",v->integer);  break;
+        case fldtype_unsignd:  val = vb; sprintf(vb,"%lu",v->unsignd);  break;
+        case fldtype_floating: val = vb; sprintf(vb,"%lf",v->floating); break;
+        case fldtype_time:     val = time_str(v->time,vb,sizeof(vb));   break;
+        default:               val = "???";                             break;
+        }
+
+        p += snprintf(p, e-p, "%s%s:%s", c, se->name, val);
+    }
+
+    p += snprintf(p, (buf + len) - p, "]");
+
+    return buf;
+}
+
+static char *print_value(fsif_fldtype_t type, void *vptr, char *buf, int len)
+{
+    fsif_value_t *v = (fsif_value_t *)vptr;
+    char         *s;
+
+    if (!buf || !v || len <= 0)
+        return "";
+
+    switch (type) {
+    case fldtype_string:   s = v->string;                                break;
+    case fldtype_integer:  s = buf; snprintf(buf,len,"%ld",v->integer);  break;
+    case fldtype_unsignd:  s = buf; snprintf(buf,len,"%lu",v->unsignd);  break;
+    case fldtype_floating: s = buf; snprintf(buf,len,"%lf",v->floating); break;
+    case fldtype_time:     s = time_str(v->time,buf,len);                break;
+    default:               s = "???";                                    break;
+    }
+
+    return s;
+}
+
+static int value_to_field(GValue *gval, fsif_field_t *fld)
+{
+    switch (G_VALUE_TYPE(gval)) {
+                    
+    case G_TYPE_STRING:
+        fld->type = fldtype_string;
+        fld->value.string = (char *)g_value_get_string(gval);
+        break;
+                    
+    case G_TYPE_LONG:
+        fld->type = fldtype_integer;
+        fld->value.integer = g_value_get_long(gval);
+        break;
+
+    case G_TYPE_INT:
+        fld->type = fldtype_integer;
+        fld->value.integer = g_value_get_int(gval);
+        break;
+                    
+    case G_TYPE_ULONG:
+        fld->type = fldtype_unsignd;
+        fld->value.unsignd = g_value_get_ulong(gval);
+        break;
+                    
+    case G_TYPE_DOUBLE:
+        fld->type = fldtype_floating;
+        fld->value.floating = g_value_get_double(gval);
+        break;
+                    
+    case G_TYPE_UINT64:
+        fld->type = fldtype_time;
+        fld->value.time = g_value_get_uint64(gval);
+        break;
+                    
+    default:
+        OHM_ERROR("[%s] Unsupported data type (%d) for field '%s'",
+                  __FUNCTION__, (int)G_VALUE_TYPE(gval), fld->name);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void inserted_cb(void *data, OhmFact *fact)
+{
+    (void)data;
+
+    char          *name;
+    watch_fact_t  *wfact;
+    watch_entry_t *wentry;
+    fsif_index_t  *index;
+    
+    if (fact == NULL) {
+        OHM_ERROR("%s() called with null fact pointer", __FUNCTION__);
+        return;
+    }
+        
+    name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
+
+    if ((wfact = find_watch(name, FALSE)) == NULL)
+        return;
+
+    for (index = wfact->indices;  index != NULL;  index = index->next)
+        index_add(index, fact, 0, NULL);
+
+    if (wfact->inserts != NULL) {
+
+        OHM_DEBUG(DBG_FS, "fact watch point: fact '%s' inserted", name);
+
+        for (wentry = wfact->inserts;  wentry != NULL;  wentry = wentry->next){
+
+            wentry->callback.fact_watch(fact, name, fact_watch_insert,
+                                        wentry->usrdata); 
+        } /* for */
+    } /* if inserts */
+}
+
+static void removed_cb(void *data, OhmFact *fact)
+{
+    (void)data;
+
+    char          *name;
+    watch_fact_t  *wfact;
+    watch_entry_t *wentry;
+    fsif_index_t  *index;
+    
+    if (fact == NULL) {
+        OHM_ERROR("%s() called with null fact pointer", __FUNCTION__);
+        return;
+    }
+        
+    name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
+
+    if ((wfact = find_watch(name, FALSE)) == NULL)
+        return;
+
+    for (index = wfact->indices;  index != NULL;  index = index->next)
+        index_remove(index, fact);
+
+    if (wfact->coalesced != NULL)
+        coalesce_forget(fact);
+
+    if (wfact->removes != NULL) {
+
+        OHM_DEBUG(DBG_FS, "fact watch point: fact '%s' removed", name);
+
+        for (wentry = wfact->removes;  wentry != NULL;  wentry = wentry->next){
+
+            wentry->callback.fact_watch(fact, name, fact_watch_remove,
+                                        wentry->usrdata); 
+        } /* for */
+    } /* if removes */
+}
+
+static void updated_cb(void *data,OhmFact *fact,GQuark fldquark,gpointer value)
+{
+    (void)data;
+
+    GValue        *gval = (GValue *)value;
+    char          *name;
+    watch_fact_t  *wfact;
+    watch_entry_t *wentry;
+    fsif_index_t  *index;
+    int            i;
+    
+    if (fact == NULL) {
+        OHM_ERROR("%s() called with null fact pointer", __FUNCTION__);
+        return;
+    }
+        
+    name = (char *)ohm_structure_get_name(OHM_STRUCTURE(fact));
+
+    if ((wfact = find_watch(name, FALSE)) == NULL)
+        return;
+
+    /* rekey the fact in every index that has the changed field */
+    for (index = wfact->indices;  index != NULL;  index = index->next) {
+        for (i = 0;  i < index->nfield;  i++) {
+            if (index->fields[i] == fldquark) {
+                /* facts that were not keyable on insertion enter here */
+                index_add(index, fact, fldquark, gval);
+                break;
+            }
+        }
+    }
+
+    if (gval == NULL)
+        return;
+
+    for (wentry = wfact->coalesced;  wentry != NULL;  wentry = wentry->next) {
+        if (coalesced_field(wentry, fldquark) &&
+            matching_entry(fact, wentry->selist))
+            coalesce_queue(wentry, fact, fldquark, gval);
+    }
+
+    if ((wentry = find_field_watch(wfact, fact, fldquark)) == NULL)
+        return;
+
+    if (batch_depth > 0 && fact == batch_fact)
+        batch_queue(wentry, fldquark, gval);
+    else
+        fire_field_watch(fact, name, wentry, fldquark, gval);
+}
+
+static char *time_str(unsigned long long t, char *buf , int len)
+{
+    time_t       sec;
+    unsigned int ms;
+    struct tm    tm;
+
+    sec = t / 1000ULL;
+    ms  = t % 1000ULL;
+
+    localtime_r(&sec, &tm);
+
+    snprintf(buf, len, "%02d/%02d %02d:%02d:%02d.%03d",
+             tm.tm_mday,tm.tm_mon+1,  tm.tm_hour,tm.tm_min,tm.tm_sec, ms);
+
+    return buf;
+}
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,422 @@
+/*************************************************************************
+Copyright (C) 2011 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Benchmark for the signal handler.
+ *
+ * Recorded high-rate signal streams (battery, orientation sensor,
+ * property changes and a headset condition, with their bursts and
+ * jitter) are replayed through handler() on a virtual clock (-d seconds
+ * of it), once resolving every signal and once with a coalescing window
+ * of -w milliseconds. The dres resolver is replaced by a stand-in that
+ * only records its arguments. For every stream the number of signals
+ * and resolves and the time spent in the handler are reported, and the
+ * last arguments resolved for every key are checked against the last
+ * ones sent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "dbus-signal-plugin.c"
+
+#define DEFAULT_DURATION  600                  /* s of recorded time */
+#define DEFAULT_WINDOW    100                  /* ms */
+#define MAX_KEYS          8
+#define DIM(a)            (int)(sizeof(a) / sizeof(a[0]))
+
+typedef struct {
+    const char *target;                        /* also the stream name */
+    const char *interface;
+    const char *member;
+    const char *signature;
+    const char *arguments;                     /* ';' separated */
+    const char *key;                           /* coalescing key or NULL */
+    int         period;                        /* ms between bursts */
+    int         jitter;                        /* ms, random */
+    int         burst;                         /* signals per burst */
+    int         spacing;                       /* ms between them */
+    const char *keys[MAX_KEYS];                /* values of the key arg */
+} stream_t;
+
+typedef struct {
+    double      time;                          /* virtual, in ms */
+    int         stream;
+    int         seq;
+} event_t;
+
+typedef struct {
+    struct dbus_signal_parameters_s *params;
+    double      deadline;                      /* end of current window */
+    double      cpu;                           /* s spent in the handler */
+    char        sent[MAX_KEYS][128];           /* last sent per key */
+    char        got[MAX_KEYS][128];            /* last resolved per key */
+} state_t;
+
+/*
+ * the recorded streams
+ */
+
+static stream_t streams[] = {
+    { "battery_level", "com.nokia.bme.signal", "battery_state_changed",
+      "ii", "level;max", NULL, 1000, 200, 20, 50, { NULL } },
+    { "device_orientation", "com.nokia.mce.signal",
+      "sig_device_orientation_ind", "sssiii", "rotation;stand;facing;x;y;z",
+      NULL, 20, 5, 1, 0, { NULL } },
+    { "hal_property", "org.freedesktop.Hal.Device", "PropertyModified",
+      "sd", "property;value", "property", 250, 100, 12, 2,
+      { "battery.charge_level.current", "battery.voltage.current",
+        "battery.reporting.current", "battery.remaining_time", NULL } },
+    { "headset_condition", "org.freedesktop.Hal.Device", "Condition",
+      "ss", "condition;detail", "condition", 5000, 2000, 30, 10,
+      { "ButtonPressed", "connection", NULL } },
+};
+
+static state_t  states[DIM(streams)];
+static event_t *events;
+static int      nevent;
+
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level == OHM_LOG_ERROR) {
+        va_start(ap, format);
+        vfprintf(stderr, format, ap);
+        fputs("\n", stderr);
+        va_end(ap);
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+static int stream_of(const char *target)
+{
+    int i;
+
+    for (i = 0; i < DIM(streams); i++)
+        if (!strcmp(streams[i].target, target))
+            return i;
+
+    return -1;
+}
+
+static int key_index(stream_t *s, const char *value)
+{
+    int i;
+
+    for (i = 0; s->key != NULL && s->keys[i] != NULL; i++)
+        if (!strcmp(s->keys[i], value))
+            return i;
+
+    return 0;
+}
+
+/*
+ * Format the values of a dres argument array, one "name=value" per
+ * argument, into buf and return the value of the key argument.
+ */
+static const char *format_args(stream_t *s, char **args, char *buf,
+        size_t size)
+{
+    const char *key = "";
+    int n = 0;
+
+    buf[0] = '\0';
+
+    for ( ; args != NULL && args[0] != NULL; args += 3) {
+        switch ((int)(long)args[1]) {
+            case 's':
+                n += snprintf(buf + n, size - n, "%s=%s ", args[0], args[2]);
+                break;
+            case 'i':
+                n += snprintf(buf + n, size - n, "%s=%ld ", args[0],
+                        (long)args[2]);
+                break;
+            case 'd':
+                n += snprintf(buf + n, size - n, "%s=%g ", args[0],
+                        *(double *)args[2]);
+                break;
+        }
+
+        if (s->key != NULL && !strcmp(args[0], s->key))
+            key = args[2];
+    }
+
+    return key;
+}
+
+static int bench_resolve(char *goal, char **locals)
+{
+    state_t *st;
+    const char *key;
+    char buf[128];
+    int i;
+
+    if ((i = stream_of(goal)) < 0)
+        return -1;
+
+    st  = states + i;
+    key = format_args(streams + i, locals, buf, sizeof(buf));
+    strcpy(st->got[key_index(streams + i, key)], buf);
+
+    return 0;
+}
+
+static int event_cmp(const void *a, const void *b)
+{
+    const event_t *ea = a, *eb = b;
+
+    return ea->time < eb->time ? -1 : (ea->time > eb->time ? 1 : 0);
+}
+
+/*
+ * Generate the timeline of all streams for the given duration.
+ */
+static void record(int duration)
+{
+    stream_t *s;
+    double t;
+    int i, j, size, seq;
+
+    size = 0;
+    for (i = 0; i < DIM(streams); i++) {
+        s = streams + i;
+        size += (duration * 1000 / s->period + 1) * s->burst;
+    }
+
+    if ((events = calloc(size, sizeof(*events))) == NULL) {
+        fprintf(stderr, "failed to allocate %d events\n", size);
+        exit(1);
+    }
+
+    nevent = 0;
+    for (i = 0; i < DIM(streams); i++) {
+        s = streams + i;
+        seq = 0;
+
+        for (t = 0; t < duration * 1000.0; t += s->period) {
+            double start = t + (s->jitter ? random() % s->jitter : 0);
+
+            for (j = 0; j < s->burst && nevent < size; j++) {
+                events[nevent].time   = start + j * s->spacing;
+                events[nevent].stream = i;
+                events[nevent].seq    = seq++;
+                nevent++;
+            }
+        }
+    }
+
+    qsort(events, nevent, sizeof(*events), event_cmp);
+}
+
+static DBusMessage *build(stream_t *s, int seq)
+{
+    DBusMessage *msg;
+    DBusMessageIter it;
+    const char *str;
+    char buf[32];
+    dbus_int32_t i32;
+    double d;
+    int i, nkey;
+
+    msg = dbus_message_new_signal("/com/nokia/bench", s->interface,
+            s->member);
+    dbus_message_iter_init_append(msg, &it);
+
+    for (nkey = 0; s->keys[nkey] != NULL; nkey++)
+        ;
+
+    for (i = 0; s->signature[i]; i++) {
+        switch (s->signature[i]) {
+            case 's':
+                if (i == 0 && nkey > 0)
+                    str = s->keys[random() % nkey];
+                else {
+                    snprintf(buf, sizeof(buf), "value-%d", seq % 7);
+                    str = buf;
+                }
+                dbus_message_iter_append_basic(&it, DBUS_TYPE_STRING, &str);
+                break;
+            case 'i':
+                i32 = (seq * 7 + i) % 101;
+                dbus_message_iter_append_basic(&it, DBUS_TYPE_INT32, &i32);
+                break;
+            case 'd':
+                d = seq * 0.25;
+                dbus_message_iter_append_basic(&it, DBUS_TYPE_DOUBLE, &d);
+                break;
+        }
+    }
+
+    return msg;
+}
+
+static struct dbus_signal_parameters_s *setup(stream_t *s, guint window)
+{
+    struct dbus_signal_parameters_s *params;
+
+    params = calloc(1, sizeof(*params));
+    params->name      = g_strdup(s->member);
+    params->path      = g_strdup("/com/nokia/bench");
+    params->interface = g_strdup(s->interface);
+    params->signature = g_strdup(s->signature);
+    params->target    = g_strdup(s->target);
+    params->arguments = g_strsplit(s->arguments, INI_FILE_STRING_DELIMITER, 0);
+
+    if (!compile_dbus_signal_parameters(params) ||
+            !setup_coalescing(params, window, s->key)) {
+        fprintf(stderr, "invalid parameters for %s\n", s->target);
+        exit(1);
+    }
+
+    return params;
+}
+
+static int run(guint window)
+{
+    struct dbus_signal_parameters_s *params;
+    DBusMessage *msg;
+    state_t *st;
+    event_t *e;
+    double start, total;
+    char buf[128];
+    const char *key;
+    int i, k, failed;
+
+    memset(states, 0, sizeof(states));
+    for (i = 0; i < DIM(streams); i++)
+        states[i].params = setup(streams + i, window);
+
+    total = 0;
+    for (e = events; e < events + nevent; e++) {
+        st     = states + e->stream;
+        params = st->params;
+
+        /* the virtual clock has passed the end of the window */
+        if (params->timer != 0 && e->time >= st->deadline) {
+            start = now();
+            coalesce_flush(params);
+            st->cpu += now() - start;
+        }
+
+        msg = build(streams + e->stream, e->seq);
+
+        /* what the resolve for this signal should see */
+        extract_arguments(params, msg);
+        key = format_args(streams + e->stream, params->dres_args, buf,
+                sizeof(buf));
+        strcpy(st->sent[key_index(streams + e->stream, key)], buf);
+
+        start = now();
+        handler(NULL, msg, params);
+        st->cpu += now() - start;
+
+        if (params->timer != 0 && st->deadline <= e->time)
+            st->deadline = e->time + window;
+
+        dbus_message_unref(msg);
+    }
+
+    failed = 0;
+    printf("window %u ms:\n", window);
+
+    for (i = 0; i < DIM(streams); i++) {
+        st = states + i;
+        params = st->params;
+
+        if (params->timer != 0)
+            coalesce_flush(params);
+
+        printf("  %-20s %8lu signals %8lu resolves %8lu coalesced "
+                "%7.3f us/signal\n", streams[i].target, params->received,
+                params->resolved, params->coalesced,
+                params->received ? 1e6 * st->cpu / params->received : 0.0);
+
+        for (k = 0; k < MAX_KEYS; k++) {
+            if (strcmp(st->sent[k], st->got[k])) {
+                printf("  %-20s last resolved '%s', last sent '%s'\n",
+                        streams[i].target, st->got[k], st->sent[k]);
+                failed++;
+            }
+        }
+
+        total += st->cpu;
+        free_dbus_signal_parameters(params);
+    }
+
+    printf("  total %.3f s in the handler\n", total);
+
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    int duration = DEFAULT_DURATION, window = DEFAULT_WINDOW, opt, failed;
+
+    while ((opt = getopt(argc, argv, "d:w:")) != -1) {
+        switch (opt) {
+            case 'd': duration = atoi(optarg); break;
+            case 'w': window = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-d seconds] [-w window-ms]\n",
+                        argv[0]);
+                exit(1);
+        }
+    }
+
+    srandom(1);
+
+    /* the plugin is not initialized, make the handler believe it is */
+    dbus_plugin = calloc(1, sizeof(*dbus_plugin));
+    resolve = bench_resolve;
+
+    record(duration);
+    printf("%d signals over %d s\n", nevent, duration);
+
+    failed  = run(0);
+    failed += run(window);
+
+    free(events);
+    free(dbus_plugin);
+
+    return failed ? 1 : 0;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
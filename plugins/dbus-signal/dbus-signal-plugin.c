@@ -34,6 +34,15 @@ USA.
  * signature = si
  * target = dres_signal_handler
  * arguments = foo,bar
+ * coalesce = 200
+ * coalesce-key = foo
+ *
+ * The optional coalesce entry gives a window in milliseconds. Signals
+ * arriving within the window are not resolved one by one: once the
+ * window is over the target is resolved only with the arguments of the
+ * latest one. With coalesce-key the latest signal is kept separately
+ * for each value of the named argument, so that eg. changes of
+ * different properties reported by the same signal are not lost.
  *
  */
 
@@ -67,8 +76,25 @@ OHM_DEBUG_PLUGIN(dbussignal,
         OHM_DEBUG_FLAG("signal", "DBUS signal routing", &DBG_DBUS_SIGNAL));
 
 
+typedef struct {
+    char *key;                  /* value of the coalescing key */
+    DBusMessage *msg;           /* latest signal with this key */
+} pending_signal_t;
+
+#define DRES_VARTYPE(t)  (char *)(t)
+#define DRES_VARVALUE(s) (char *)(s)
+
 static void free_dbus_signal_parameters(struct dbus_signal_parameters_s *params)
 {
+    if (params->timer != 0)
+        g_source_remove(params->timer);
+
+    if (params->pending != NULL)
+        g_hash_table_destroy(params->pending);
+
+    if (params->order != NULL)
+        g_queue_free(params->order);
+
     g_free(params->name);
     g_free(params->path);
     g_free(params->interface);
@@ -77,111 +103,292 @@ static void free_dbus_signal_parameters(struct dbus_signal_parameters_s *params)
     g_free(params->target);
     g_strfreev(params->arguments);
 
+    g_free(params->extractors);
+    g_free(params->dres_args);
+    g_free(params->doubles);
+
     g_free(params);
 
     return;
 }
 
-#define DRES_VARTYPE(t)  (char *)(t)
-#define DRES_VARVALUE(s) (char *)(s)
+static void free_pending_signal(gpointer data)
+{
+    pending_signal_t *pending = data;
+
+    dbus_message_unref(pending->msg);
+    g_free(pending->key);
+    g_free(pending);
+}
+
+/*
+ * Turn the (already validated) signature into a list of extractors and
+ * set up the dres argument array with the names and types filled in, so
+ * that handling a signal only needs to store the values.
+ */
+static int compile_dbus_signal_parameters(struct dbus_signal_parameters_s *params)
+{
+    struct dbus_signal_extractor_s *e;
+    int len, i, k = 0;
+
+    len = strlen(params->signature);
+
+    params->n_extractors = len;
+    params->extractors = g_new0(struct dbus_signal_extractor_s, len + 1);
+    params->dres_args = g_new0(char *, len * 3 + 1);
+    params->doubles = g_new0(double, len + 1);
+
+    for (i = 0; i < len; i++) {
+        e = params->extractors + i;
+        e->value = params->dres_args + 3 * i + 2;
+
+        params->dres_args[3 * i] = params->arguments[i];
+
+        switch (params->signature[i]) {
+            case 's':
+                e->dbus_type = DBUS_TYPE_STRING;
+                params->dres_args[3 * i + 1] = DRES_VARTYPE('s');
+                break;
+            case 'i':
+                e->dbus_type = DBUS_TYPE_INT32;
+                params->dres_args[3 * i + 1] = DRES_VARTYPE('i');
+                break;
+            case 'd':
+                /* dres takes doubles by reference */
+                e->dbus_type = DBUS_TYPE_DOUBLE;
+                e->storage = params->doubles + k++;
+                params->dres_args[3 * i + 1] = DRES_VARTYPE('d');
+                *e->value = DRES_VARVALUE(e->storage);
+                break;
+            default:
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static int extract_arguments(struct dbus_signal_parameters_s *params,
+        DBusMessage *msg)
+{
+    struct dbus_signal_extractor_s *e;
+    DBusMessageIter msg_it;
+    dbus_int32_t intvalue;
+    char *strvalue;
+    int i;
+
+    if (!dbus_message_iter_init(msg, &msg_it))
+        return params->n_extractors == 0;
+
+    for (i = 0, e = params->extractors; i < params->n_extractors; i++, e++) {
+        if (dbus_message_iter_get_arg_type(&msg_it) != e->dbus_type)
+            return FALSE;
+
+        switch (e->dbus_type) {
+            case DBUS_TYPE_STRING:
+                dbus_message_iter_get_basic(&msg_it, &strvalue);
+                *e->value = DRES_VARVALUE(strvalue);
+                break;
+            case DBUS_TYPE_INT32:
+                dbus_message_iter_get_basic(&msg_it, &intvalue);
+                *e->value = DRES_VARVALUE((long)intvalue);
+                break;
+            case DBUS_TYPE_DOUBLE:
+                dbus_message_iter_get_basic(&msg_it, e->storage);
+                break;
+        }
+
+        dbus_message_iter_next(&msg_it);
+    }
+
+    /* no extra arguments either */
+    return dbus_message_iter_get_arg_type(&msg_it) == DBUS_TYPE_INVALID;
+}
+
+static const char *coalescing_key(struct dbus_signal_parameters_s *params,
+        char *buf, size_t size)
+{
+    struct dbus_signal_extractor_s *e;
+
+    if (params->key < 0)
+        return "";
+
+    e = params->extractors + params->key;
+
+    switch (e->dbus_type) {
+        case DBUS_TYPE_STRING:
+            return *e->value;
+        case DBUS_TYPE_INT32:
+            snprintf(buf, size, "%ld", (long)*e->value);
+            return buf;
+        case DBUS_TYPE_DOUBLE:
+            snprintf(buf, size, "%g", *e->storage);
+            return buf;
+        default:
+            return "";
+    }
+}
+
+static void run_policy_hook(struct dbus_signal_parameters_s *params)
+{
+    int status;
+
+    status = resolve(params->target,
+            params->n_extractors > 0 ? params->dres_args : NULL);
+
+    params->resolved++;
 
+    if (status < 0) {
+        OHM_DEBUG(DBG_DBUS_SIGNAL, "ran policy hook '%s' with status %d",
+                params->target ? params->target : "NULL", status);
+    }
+}
+
+static void coalesce_flush(struct dbus_signal_parameters_s *params)
+{
+    pending_signal_t *pending;
+
+    if (params->timer != 0) {
+        g_source_remove(params->timer);
+        params->timer = 0;
+    }
+
+    while ((pending = g_queue_pop_head(params->order)) != NULL) {
+        /* the arguments were checked when the signal arrived */
+        if (extract_arguments(params, pending->msg))
+            run_policy_hook(params);
+
+        g_hash_table_remove(params->pending, pending->key);
+    }
+}
+
+static gboolean coalesce_cb(gpointer data)
+{
+    struct dbus_signal_parameters_s *params = data;
+
+    params->timer = 0;
+    coalesce_flush(params);
+
+    return FALSE;
+}
+
+/*
+ * Without a coalescing window every signal resolves the target right
+ * away. With a window the first signal starts it and only the latest
+ * signal (per key value) is kept; the target is resolved for those when
+ * the window is over.
+ */
 static DBusHandlerResult handler(DBusConnection *c, DBusMessage *msg, void *data)
 {
     struct dbus_signal_parameters_s *params = data;
-    /* i is the dres array iterator, j is the parameter iterator and k
-     * is the double storage iterator */
-    int status, len, i = 0, j = 0, k = 0;
-    const char *sig;
-    DBusMessageIter msg_it;
-    char **dres_args = NULL;
-    double double_storage[32];
+    pending_signal_t *pending;
+    const char *key;
+    char buf[64];
 
     (void) c;
-    (void) msg;
 
     if (params == NULL || msg == NULL || dbus_plugin == NULL) {
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
 
+    params->received++;
+
     OHM_DEBUG(DBG_DBUS_SIGNAL, "handling signal '%s.%s' on path '%s', calling target '%s'",
             params->interface, params->name, params->path, params->target);
 
-    /* get the signal parameters */
-
-    sig = dbus_message_get_signature(msg);
+    if (!extract_arguments(params, msg)) {
+        params->rejected++;
+        OHM_DEBUG(DBG_DBUS_SIGNAL, "wrong signal signature ('%s': expected '%s'",
+                dbus_message_get_signature(msg), params->signature);
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    }
 
-    if (strcmp(sig, params->signature) != 0) {
-        OHM_DEBUG(DBG_DBUS_SIGNAL, "wrong signal signature ('%s': expected '%s'", sig, params->signature);
+    if (params->window == 0) {
+        run_policy_hook(params);
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
 
-    len = strlen(sig) * 3 + 1;
+    key = coalescing_key(params, buf, sizeof(buf));
 
-    if (len > 1) {
+    if ((pending = g_hash_table_lookup(params->pending, key)) != NULL) {
+        dbus_message_unref(pending->msg);
+        pending->msg = dbus_message_ref(msg);
+        params->coalesced++;
+    }
+    else {
+        pending = g_new0(pending_signal_t, 1);
+        pending->key = g_strdup(key);
+        pending->msg = dbus_message_ref(msg);
 
-        dres_args = calloc(len, sizeof(char *));
+        g_hash_table_insert(params->pending, pending->key, pending);
+        g_queue_push_tail(params->order, pending);
+    }
 
-        if (dres_args == NULL) {
-            OHM_DEBUG(DBG_DBUS_SIGNAL, "error allocating memory");
-            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-        }
+    if (params->timer == 0)
+        params->timer = g_timeout_add(params->window, coalesce_cb, params);
 
-        dbus_message_iter_init(msg, &msg_it);
-        do {
-            switch (dbus_message_iter_get_arg_type(&msg_it)) {
-                case DBUS_TYPE_STRING:
-                    {
-                        char *strvalue;
-                        dbus_message_iter_get_basic(&msg_it, &strvalue);
-                        dres_args[i++] = params->arguments[j++];
-                        dres_args[i++] = DRES_VARTYPE('s');
-                        dres_args[i++] = DRES_VARVALUE(strvalue);
-                        break;
-                    }
-                case DBUS_TYPE_INT32:
-                    {
-                        int intvalue;
-                        dbus_message_iter_get_basic(&msg_it, &intvalue);
-                        dres_args[i++] = params->arguments[j++];
-                        dres_args[i++] = DRES_VARTYPE('i');
-                        dres_args[i++] = DRES_VARVALUE(intvalue);
-                        break;
-                    }
-                case DBUS_TYPE_DOUBLE:
-                    {
-                        if (k == 32) {
-                            OHM_DEBUG(DBG_DBUS_SIGNAL, "too many double arguments");
-                            free(dres_args);
-                            return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-                        }
-                        dbus_message_iter_get_basic(&msg_it, &double_storage[k]);
-                        dres_args[i++] = params->arguments[j++];
-                        dres_args[i++] = DRES_VARTYPE('d');
-                        dres_args[i++] = (char *) DRES_VARVALUE(&double_storage[k]);
-                        k++;
-                        break;
-                    }
-                default:
-                    OHM_DEBUG(DBG_DBUS_SIGNAL, "impossible signal parameter error");
-                    free(dres_args);
-                    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-            }
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
 
-        } while (dbus_message_iter_next(&msg_it) && i < len-1);
+/*
+ * Set up coalescing with the given window (in ms, 0 for none) and key
+ * argument (NULL for none). Returns FALSE if there is no such argument.
+ */
+static int setup_coalescing(struct dbus_signal_parameters_s *params,
+        guint window, const char *key)
+{
+    int j;
+
+    params->window = window;
+    params->key = -1;
 
-        dres_args[len-1] = NULL;
+    if (key != NULL) {
+        for (j = 0; j < params->n_extractors; j++) {
+            if (!strcmp(params->arguments[j], key))
+                params->key = j;
+        }
+
+        if (params->key < 0) {
+            OHM_ERROR("dbus-signal: coalescing key '%s' is not an argument", key);
+            return FALSE;
+        }
     }
 
-    status = resolve(params->target, dres_args);
+    if (params->window > 0) {
+        params->pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+                NULL, free_pending_signal);
+        params->order = g_queue_new();
+    }
 
-    free(dres_args);
+    return TRUE;
+}
 
-    if (status < 0) {
-        OHM_DEBUG(DBG_DBUS_SIGNAL, "ran policy hook '%s' with status %d",
-                params->target ? params->target : "NULL", status);
+static int parse_coalescing(struct dbus_signal_parameters_s *params,
+        GKeyFile *keyfile, const gchar *group)
+{
+    gchar *window, *key, *end;
+    guint msecs = 0;
+    int success = TRUE;
+
+    window = g_key_file_get_value(keyfile, group, "coalesce", NULL);
+    key = g_key_file_get_value(keyfile, group, "coalesce-key", NULL);
+
+    if (window != NULL) {
+        msecs = strtoul(window, &end, 10);
+
+        if (*end != '\0' || end == window) {
+            OHM_ERROR("dbus-signal: invalid coalescing window '%s'", window);
+            success = FALSE;
+        }
     }
 
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    if (success)
+        success = setup_coalescing(params, msecs, key);
+
+    g_free(window);
+    g_free(key);
+
+    return success;
 }
 
 #undef DRES_VARVALUE
@@ -297,6 +504,14 @@ static void plugin_init(OhmPlugin *plugin)
                 continue;
             }
 
+            if (!compile_dbus_signal_parameters(params) ||
+                    !parse_coalescing(params, keyfile, signals[i])) {
+                OHM_ERROR("dbus-signal: invalid configuration for signal '%s'",
+                        params->name);
+                free_dbus_signal_parameters(params);
+                continue;
+            }
+
             success = add_signal(DBUS_BUS_SYSTEM, params->path, params->interface,
                     params->name, params->signature, params->sender, handler, params);
 
@@ -341,6 +556,11 @@ plugin_exit(OhmPlugin *plugin)
             del_signal(DBUS_BUS_SYSTEM, params->path, params->interface,
                     params->name, params->signature, params->sender, handler, params);
 
+            OHM_INFO("dbus-signal: signal '%s': %lu received, %lu resolves, "
+                    "%lu coalesced, %lu rejected", params->name,
+                    params->received, params->resolved, params->coalesced,
+                    params->rejected);
+
             free_dbus_signal_parameters(params);
         }
         g_slist_free(dbus_plugin->signals);
@@ -27,6 +27,8 @@ USA.
 #include <ohm/ohm-fact.h>
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <glib.h>
 #include <dbus/dbus.h>
 
@@ -37,6 +39,13 @@ struct dbus_plugin_s {
     GSList *signals;
 };
 
+/* how to fetch one signal argument into the dres argument array */
+struct dbus_signal_extractor_s {
+    int dbus_type;              /* DBUS_TYPE_{STRING,INT32,DOUBLE} */
+    char **value;               /* where the value goes in the array */
+    double *storage;            /* where a double is kept, or NULL */
+};
+
 struct dbus_signal_parameters_s {
     gchar *name;
     gchar *path;
@@ -45,6 +54,25 @@ struct dbus_signal_parameters_s {
     gchar *sender;
     gchar *target;
     gchar **arguments;
+
+    /* compiled from the signature at plugin_init */
+    struct dbus_signal_extractor_s *extractors;
+    int n_extractors;
+    char **dres_args;           /* name, type, value triplets + NULL */
+    double *doubles;            /* storage of double arguments */
+
+    /* coalescing, see the comment at handler() */
+    guint window;               /* in ms, 0 resolves every signal */
+    int key;                    /* argument grouping the signals, or -1 */
+    GHashTable *pending;        /* key value -> latest message */
+    GQueue *order;              /* key values in order of arrival */
+    guint timer;
+
+    /* statistics */
+    unsigned long received;     /* signals handled */
+    unsigned long resolved;     /* policy hook runs */
+    unsigned long coalesced;    /* signals superseded within a window */
+    unsigned long rejected;     /* signals with unexpected arguments */
 };
 
 #endif
@@ -0,0 +1,535 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Test of the match rule manager against a private bus daemon.
+ *
+ * A session bus daemon is started for the test (DBUS_DAEMON overrides
+ * the binary to use); if it cannot be started the test is skipped. One
+ * connection manages its rules through busmatch, another one emits the
+ * signals the rules are supposed to let through. Whether a signal got
+ * delivered is decided by a marker signal sent right after it, which is
+ * matched by a rule that stays installed for the whole test.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "dbus-plugin.h"
+
+#define TEST_PATH       "/org/freedesktop/ohm/BusmatchTest"
+#define TEST_INTERFACE  "org.freedesktop.ohm.BusmatchTest"
+#define TEST_SIGNAL     "Ping"
+#define STORM           500
+#define TIMEOUT         5000            /* ms */
+#define SKIP            77              /* automake: test skipped */
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("%s:%d: check '%s' failed\n", __FILE__, __LINE__,    \
+                   #cond);                                              \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static int             failures;
+static pid_t           daemon_pid;
+static char            address[256];
+static DBusConnection *emitter;         /* sends the test signals */
+static busmatch_t     *mgr;
+
+static int             received;        /* test signals, but the markers */
+static int             markers;
+static int             completed;       /* busmatch_add callbacks */
+static int             succeeded;
+
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    (void)level;
+
+    va_start(ap, format);
+    vprintf(format, ap);
+    printf("\n");
+    va_end(ap);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static int daemon_start(void)
+{
+    const char *binary;
+    char        fd[32];
+    int         pipefd[2], n, len;
+
+    if ((binary = getenv("DBUS_DAEMON")) == NULL)
+        binary = "dbus-daemon";
+
+    if (pipe(pipefd) < 0)
+        return FALSE;
+
+    switch ((daemon_pid = fork())) {
+    case -1:
+        return FALSE;
+
+    case 0:
+        close(pipefd[0]);
+        snprintf(fd, sizeof(fd), "--print-address=%d", pipefd[1]);
+        execlp(binary, binary, "--session", "--nofork", fd, (char *)NULL);
+        _exit(127);
+
+    default:
+        close(pipefd[1]);
+        break;
+    }
+
+    len = 0;
+    while (len < (int)sizeof(address) - 1 &&
+           (n = read(pipefd[0], address + len, sizeof(address) - 1 - len)) > 0)
+        if (strchr(address, '\n') != NULL)
+            break;
+        else
+            len += n;
+
+    close(pipefd[0]);
+    address[strcspn(address, "\n")] = '\0';
+
+    return address[0] != '\0';
+}
+
+static void daemon_stop(void)
+{
+    if (daemon_pid > 0) {
+        kill(daemon_pid, SIGTERM);
+        waitpid(daemon_pid, NULL, 0);
+    }
+}
+
+static DBusHandlerResult count_cb(DBusConnection *c, DBusMessage *msg,
+                                  void *data)
+{
+    const char *tag;
+
+    (void)c;
+    (void)data;
+
+    if (dbus_message_is_signal(msg, TEST_INTERFACE, TEST_SIGNAL) &&
+        dbus_message_get_args(msg, NULL, DBUS_TYPE_STRING, &tag,
+                              DBUS_TYPE_INVALID)) {
+        if (!strcmp(tag, "marker"))
+            markers++;
+        else
+            received++;
+    }
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static DBusConnection *connect_bus(void)
+{
+    DBusConnection *conn;
+    DBusError       err;
+
+    dbus_error_init(&err);
+
+    if ((conn = dbus_connection_open_private(address, &err)) == NULL ||
+        !dbus_bus_register(conn, &err)) {
+        printf("failed to connect to %s (%s)\n", address,
+               dbus_error_is_set(&err) ? err.message : "unknown error");
+        exit(1);
+    }
+
+    dbus_connection_set_exit_on_disconnect(conn, FALSE);
+    dbus_connection_add_filter(conn, count_cb, NULL, NULL);
+
+    return conn;
+}
+
+static void disconnect_bus(DBusConnection *conn)
+{
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+}
+
+static char *rule_for(char *buf, size_t size, const char *tag)
+{
+    snprintf(buf, size, "type='signal',interface='%s',member='%s',arg0='%s'",
+             TEST_INTERFACE, TEST_SIGNAL, tag);
+
+    return buf;
+}
+
+static void add_cb(busmatch_t *m, const char *rule, int success, void *data)
+{
+    (void)m;
+    (void)rule;
+    (void)data;
+
+    completed++;
+    if (success)
+        succeeded++;
+}
+
+/*
+ * Send the queued changes and wait until the daemon has processed them:
+ * all AddMatch replies are in and a round trip made sure that the
+ * RemoveMatch calls sent before it are done as well.
+ */
+static void settle(DBusConnection *conn)
+{
+    busmatch_stats_t  stats;
+    DBusMessage      *msg, *reply;
+    double            deadline = now() + TIMEOUT;
+
+    busmatch_flush(mgr);
+
+    do {
+        busmatch_get_stats(mgr, &stats);
+        if (stats.inflight == 0)
+            break;
+        dbus_connection_read_write_dispatch(conn, 10);
+    } while (now() < deadline);
+
+    CHECK(stats.inflight == 0);
+
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                       DBUS_INTERFACE_DBUS, "GetId");
+    reply = dbus_connection_send_with_reply_and_block(conn, msg, TIMEOUT,
+                                                      NULL);
+    CHECK(reply != NULL);
+
+    dbus_message_unref(msg);
+    if (reply != NULL)
+        dbus_message_unref(reply);
+}
+
+/*
+ * Emit a test signal followed by a marker and return the number of test
+ * signals delivered to conn by the time the marker arrives.
+ */
+static int ping(DBusConnection *conn, const char *tag)
+{
+    const char  *tags[2] = { tag, "marker" };
+    DBusMessage *msg;
+    double       deadline = now() + TIMEOUT;
+    int          i, before, marker;
+
+    before = received;
+    marker = markers;
+
+    for (i = 0; i < 2; i++) {
+        msg = dbus_message_new_signal(TEST_PATH, TEST_INTERFACE, TEST_SIGNAL);
+        dbus_message_append_args(msg, DBUS_TYPE_STRING, &tags[i],
+                                 DBUS_TYPE_INVALID);
+        dbus_connection_send(emitter, msg, NULL);
+        dbus_message_unref(msg);
+    }
+    dbus_connection_flush(emitter);
+
+    while (markers == marker && now() < deadline)
+        dbus_connection_read_write_dispatch(conn, 10);
+
+    CHECK(markers == marker + 1);
+
+    return received - before;
+}
+
+static void test_refcount(DBusConnection *conn)
+{
+    busmatch_stats_t before, after;
+    char             rule[256];
+
+    rule_for(rule, sizeof(rule), "one");
+    busmatch_get_stats(mgr, &before);
+    completed = succeeded = 0;
+
+    /* two references, a single AddMatch */
+    CHECK(busmatch_add(mgr, rule, add_cb, NULL));
+    CHECK(busmatch_add(mgr, rule, add_cb, NULL));
+    settle(conn);
+
+    busmatch_get_stats(mgr, &after);
+    CHECK(after.added == before.added + 1);
+    CHECK(completed == 2 && succeeded == 2);
+    CHECK(ping(conn, "one") == 1);
+
+    /* already installed, confirmed right away */
+    CHECK(busmatch_add(mgr, rule, add_cb, NULL));
+    CHECK(completed == 3 && succeeded == 3);
+    CHECK(busmatch_del(mgr, rule));
+
+    /* dropping one reference keeps the rule */
+    CHECK(busmatch_del(mgr, rule));
+    settle(conn);
+    CHECK(ping(conn, "one") == 1);
+
+    /* dropping the last one removes it */
+    CHECK(busmatch_del(mgr, rule));
+    settle(conn);
+    CHECK(ping(conn, "one") == 0);
+
+    busmatch_get_stats(mgr, &after);
+    CHECK(after.removed == before.removed + 1);
+    CHECK(!busmatch_del(mgr, rule));
+}
+
+static void test_elide(DBusConnection *conn)
+{
+    busmatch_stats_t before, after;
+    char             one[256], two[256];
+
+    rule_for(one, sizeof(one), "one");
+    rule_for(two, sizeof(two), "two");
+
+    CHECK(busmatch_add(mgr, two, NULL, NULL));
+    settle(conn);
+
+    busmatch_get_stats(mgr, &before);
+    completed = succeeded = 0;
+
+    /* added and removed before the flush: never sent */
+    CHECK(busmatch_add(mgr, one, add_cb, NULL));
+    CHECK(busmatch_del(mgr, one));
+
+    /* removed and re-added before the flush: left alone */
+    CHECK(busmatch_del(mgr, two));
+    CHECK(busmatch_add(mgr, two, NULL, NULL));
+
+    settle(conn);
+
+    busmatch_get_stats(mgr, &after);
+    CHECK(after.added == before.added);
+    CHECK(after.removed == before.removed);
+    CHECK(after.elided == before.elided + 2);
+    CHECK(completed == 1 && succeeded == 0);
+
+    CHECK(ping(conn, "one") == 0);
+    CHECK(ping(conn, "two") == 1);
+
+    CHECK(busmatch_del(mgr, two));
+    settle(conn);
+}
+
+static void test_storm(DBusConnection *conn)
+{
+    busmatch_stats_t  before, after;
+    char              rule[256], tag[32];
+    double            start, elapsed;
+    int               i;
+
+    busmatch_get_stats(mgr, &before);
+    completed = succeeded = 0;
+
+    start = now();
+    for (i = 0; i < STORM; i++) {
+        snprintf(tag, sizeof(tag), "client-%d", i);
+        CHECK(busmatch_add(mgr, rule_for(rule, sizeof(rule), tag),
+                           add_cb, NULL));
+    }
+    busmatch_flush(mgr);
+    elapsed = now() - start;
+
+    settle(conn);
+
+    busmatch_get_stats(mgr, &after);
+    CHECK(after.added == before.added + STORM);
+    CHECK(after.batches > before.batches);
+    CHECK(completed == STORM && succeeded == STORM);
+    CHECK(ping(conn, "client-0") == 1);
+    CHECK(ping(conn, "client-499") == 1);
+
+    printf("%d rules queued and sent in %.2f ms\n", STORM, elapsed);
+
+    for (i = 0; i < STORM; i++) {
+        snprintf(tag, sizeof(tag), "client-%d", i);
+        CHECK(busmatch_del(mgr, rule_for(rule, sizeof(rule), tag)));
+    }
+    settle(conn);
+
+    busmatch_get_stats(mgr, &after);
+    CHECK(after.removed == before.removed + STORM);
+    CHECK(ping(conn, "client-0") == 0);
+}
+
+static void test_failure(DBusConnection *conn)
+{
+    busmatch_stats_t before, after;
+
+    busmatch_get_stats(mgr, &before);
+    completed = succeeded = 0;
+
+    CHECK(busmatch_add(mgr, "type='bogus'", add_cb, NULL));
+    settle(conn);
+
+    /* a refused rule is not retried, its reference stays with us */
+    busmatch_get_stats(mgr, &after);
+    CHECK(after.failed == before.failed + 1);
+    CHECK(after.rules == before.rules + 1);
+    CHECK(completed == 1 && succeeded == 0);
+
+    CHECK(busmatch_del(mgr, "type='bogus'"));
+    CHECK(!busmatch_del(mgr, "type='bogus'"));
+    settle(conn);
+
+    busmatch_get_stats(mgr, &after);
+    CHECK(after.rules == before.rules);
+}
+
+static void test_takeback(DBusConnection *conn)
+{
+    char rule[256];
+
+    completed = succeeded = 0;
+
+    /* a rule removed with its AddMatch in flight is reported as failed */
+    CHECK(busmatch_add(mgr, rule_for(rule, sizeof(rule), "five"),
+                       add_cb, NULL));
+    busmatch_flush(mgr);
+    CHECK(busmatch_del(mgr, rule));
+    busmatch_flush(mgr);
+    settle(conn);
+
+    CHECK(completed == 1 && succeeded == 0);
+    CHECK(ping(conn, "five") == 0);
+}
+
+static DBusConnection *test_reconnect(DBusConnection *conn)
+{
+    DBusConnection *fresh;
+    char            rule[256];
+
+    CHECK(busmatch_add(mgr, rule_for(rule, sizeof(rule), "two"), NULL, NULL));
+    settle(conn);
+
+    /* the rules follow the manager to the new connection */
+    fresh = connect_bus();
+    busmatch_set_connection(mgr, fresh);
+    disconnect_bus(conn);
+    settle(fresh);
+
+    CHECK(ping(fresh, "two") == 1);
+
+    /* changes made while disconnected only affect the next connection */
+    busmatch_set_connection(mgr, NULL);
+    CHECK(busmatch_del(mgr, rule));
+    busmatch_flush(mgr);
+
+    conn = connect_bus();
+    busmatch_set_connection(mgr, conn);
+    disconnect_bus(fresh);
+    settle(conn);
+
+    CHECK(ping(conn, "two") == 0);
+
+    return conn;
+}
+
+static void test_destroy(DBusConnection *conn)
+{
+    char rule[256];
+
+    CHECK(busmatch_add(mgr, rule_for(rule, sizeof(rule), "four"), NULL, NULL));
+    settle(conn);
+    CHECK(ping(conn, "four") == 1);
+
+    completed = succeeded = 0;
+
+    /* callbacks of a manager destroyed with a reply outstanding */
+    CHECK(busmatch_add(mgr, rule_for(rule, sizeof(rule), "three"),
+                       add_cb, NULL));
+    busmatch_flush(mgr);
+    busmatch_destroy(mgr);
+    mgr = NULL;
+
+    CHECK(completed == 1 && succeeded == 0);
+
+    /* and the rules it has installed are taken back */
+    dbus_bus_add_match(conn, rule_for(rule, sizeof(rule), "marker"), NULL);
+    CHECK(ping(conn, "four") == 0);
+    CHECK(ping(conn, "three") == 0);
+}
+
+int main(int argc, char **argv)
+{
+    DBusConnection *conn;
+    char            rule[256];
+
+    (void)argc;
+
+    if (!daemon_start()) {
+        printf("%s: skipped, could not start a bus daemon\n", argv[0]);
+        daemon_stop();
+        return SKIP;
+    }
+
+    emitter = connect_bus();
+    conn    = connect_bus();
+
+    if ((mgr = busmatch_create(conn)) == NULL) {
+        printf("failed to create match rule manager\n");
+        daemon_stop();
+        return 1;
+    }
+
+    CHECK(busmatch_add(mgr, rule_for(rule, sizeof(rule), "marker"),
+                       NULL, NULL));
+    settle(conn);
+
+    test_refcount(conn);
+    test_elide(conn);
+    test_storm(conn);
+    test_failure(conn);
+    test_takeback(conn);
+    conn = test_reconnect(conn);
+    test_destroy(conn);
+
+    disconnect_bus(conn);
+    disconnect_bus(emitter);
+    daemon_stop();
+
+    printf("%s: %s\n", argv[0], failures ? "FAILED" : "passed");
+
+    return failures ? 1 : 0;
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -0,0 +1,431 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Test of the outgoing message queue against a private bus daemon.
+ *
+ * A session bus daemon is started for the test (DBUS_DAEMON overrides
+ * the binary to use); if it cannot be started the test is skipped. One
+ * connection sends numbered signals through busqueue, another one
+ * collects them in the order they arrive. Whether everything sent has
+ * arrived is decided by a marker signal sent directly after a flush.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "dbus-plugin.h"
+
+#define TEST_PATH       "/org/freedesktop/ohm/BusqueueTest"
+#define TEST_INTERFACE  "org.freedesktop.ohm.BusqueueTest"
+#define TEST_STATE      "State"
+#define TEST_EVENT      "Event"
+#define TEST_MARKER     "Marker"
+#define BURST           200
+#define TIMEOUT         5000            /* ms */
+#define SKIP            77              /* automake: test skipped */
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("%s:%d: check '%s' failed\n", __FILE__, __LINE__,    \
+                   #cond);                                              \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static int             failures;
+static pid_t           daemon_pid;
+static char            address[256];
+static DBusConnection *receiver;
+static busqueue_t     *q;
+
+static int             states[BURST];   /* values of State, in order */
+static int             nstate;
+static int             events[BURST];   /* values of Event, in order */
+static int             nevent;
+static int             markers;
+
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    (void)level;
+
+    va_start(ap, format);
+    vprintf(format, ap);
+    printf("\n");
+    va_end(ap);
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static int daemon_start(void)
+{
+    const char *binary;
+    char        fd[32];
+    int         pipefd[2], n, len;
+
+    if ((binary = getenv("DBUS_DAEMON")) == NULL)
+        binary = "dbus-daemon";
+
+    if (pipe(pipefd) < 0)
+        return FALSE;
+
+    switch ((daemon_pid = fork())) {
+    case -1:
+        return FALSE;
+
+    case 0:
+        close(pipefd[0]);
+        snprintf(fd, sizeof(fd), "--print-address=%d", pipefd[1]);
+        execlp(binary, binary, "--session", "--nofork", fd, (char *)NULL);
+        _exit(127);
+
+    default:
+        close(pipefd[1]);
+        break;
+    }
+
+    len = 0;
+    while (len < (int)sizeof(address) - 1 &&
+           (n = read(pipefd[0], address + len, sizeof(address) - 1 - len)) > 0)
+        if (strchr(address, '\n') != NULL)
+            break;
+        else
+            len += n;
+
+    close(pipefd[0]);
+    address[strcspn(address, "\n")] = '\0';
+
+    return address[0] != '\0';
+}
+
+static void daemon_stop(void)
+{
+    if (daemon_pid > 0) {
+        kill(daemon_pid, SIGTERM);
+        waitpid(daemon_pid, NULL, 0);
+    }
+}
+
+static DBusHandlerResult collect_cb(DBusConnection *c, DBusMessage *msg,
+                                    void *data)
+{
+    dbus_int32_t value;
+
+    (void)c;
+    (void)data;
+
+    if (!dbus_message_get_args(msg, NULL, DBUS_TYPE_INT32, &value,
+                               DBUS_TYPE_INVALID))
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+
+    if (dbus_message_is_signal(msg, TEST_INTERFACE, TEST_STATE)) {
+        if (nstate < BURST)
+            states[nstate] = value;
+        nstate++;
+    }
+    else if (dbus_message_is_signal(msg, TEST_INTERFACE, TEST_EVENT)) {
+        if (nevent < BURST)
+            events[nevent] = value;
+        nevent++;
+    }
+    else if (dbus_message_is_signal(msg, TEST_INTERFACE, TEST_MARKER))
+        markers++;
+
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+static DBusConnection *connect_bus(void)
+{
+    DBusConnection *conn;
+    DBusError       err;
+
+    dbus_error_init(&err);
+
+    if ((conn = dbus_connection_open_private(address, &err)) == NULL ||
+        !dbus_bus_register(conn, &err)) {
+        printf("failed to connect to %s (%s)\n", address,
+               dbus_error_is_set(&err) ? err.message : "unknown error");
+        exit(1);
+    }
+
+    dbus_connection_set_exit_on_disconnect(conn, FALSE);
+
+    return conn;
+}
+
+static void disconnect_bus(DBusConnection *conn)
+{
+    dbus_connection_close(conn);
+    dbus_connection_unref(conn);
+}
+
+static DBusMessage *signal_new(const char *member, int value)
+{
+    DBusMessage  *msg;
+    dbus_int32_t  v = value;
+
+    msg = dbus_message_new_signal(TEST_PATH, TEST_INTERFACE, member);
+    dbus_message_append_args(msg, DBUS_TYPE_INT32, &v, DBUS_TYPE_INVALID);
+
+    return msg;
+}
+
+static int queue(const char *member, int value, int flags)
+{
+    DBusMessage *msg = signal_new(member, value);
+    int          success;
+
+    success = busqueue_send(q, msg, flags);
+    dbus_message_unref(msg);
+
+    return success;
+}
+
+/*
+ * Send a marker directly on conn and wait until the receiver has got it.
+ * Messages are delivered in order, so by then everything busqueue has
+ * written before is in as well.
+ */
+static void settle(DBusConnection *conn)
+{
+    DBusMessage *msg    = signal_new(TEST_MARKER, 0);
+    int          wanted = markers + 1;
+    double       deadline = now() + TIMEOUT;
+
+    dbus_connection_send(conn, msg, NULL);
+    dbus_connection_flush(conn);
+    dbus_message_unref(msg);
+
+    while (markers < wanted && now() < deadline)
+        dbus_connection_read_write_dispatch(receiver, 10);
+
+    CHECK(markers == wanted);
+}
+
+static void reset(void)
+{
+    nstate = nevent = 0;
+}
+
+static void test_bracket(DBusConnection *conn)
+{
+    busqueue_stats_t stats;
+    int              i, in_order;
+
+    reset();
+
+    busqueue_begin(q);
+    busqueue_begin(q);
+
+    for (i = 0;  i < BURST;  i++)
+        CHECK(queue(TEST_EVENT, i, 0));
+
+    /* an inner bracket does not flush */
+    busqueue_end(q);
+    settle(conn);
+    CHECK(nevent == 0);
+
+    busqueue_get_stats(q, &stats);
+    CHECK(stats.pending == BURST);
+
+    busqueue_end(q);
+    settle(conn);
+
+    CHECK(nevent == BURST);
+
+    in_order = TRUE;
+    for (i = 0;  i < BURST && i < nevent;  i++)
+        if (events[i] != i)
+            in_order = FALSE;
+    CHECK(in_order);
+
+    busqueue_get_stats(q, &stats);
+    CHECK(stats.pending == 0);
+    CHECK(stats.sent == BURST);
+    CHECK(stats.batches == 1);
+    CHECK(stats.largest == BURST);
+}
+
+static void test_coalesce(DBusConnection *conn)
+{
+    busqueue_stats_t before, after;
+    int              i;
+
+    reset();
+    busqueue_get_stats(q, &before);
+
+    busqueue_begin(q);
+
+    for (i = 0;  i < BURST;  i++)
+        CHECK(queue(TEST_STATE, i, BUSQUEUE_COALESCE));
+
+    CHECK(queue(TEST_EVENT, 0, 0));
+
+    busqueue_end(q);
+    settle(conn);
+
+    /* only the last state goes out */
+    CHECK(nstate == 1);
+    CHECK(nstate == 1 && states[0] == BURST - 1);
+    CHECK(nevent == 1);
+
+    busqueue_get_stats(q, &after);
+    CHECK(after.coalesced - before.coalesced == BURST - 1);
+    CHECK(after.sent - before.sent == 2);
+
+    /* a state never overtakes a message queued before it */
+    reset();
+
+    busqueue_begin(q);
+    CHECK(queue(TEST_STATE, 1, BUSQUEUE_COALESCE));
+    CHECK(queue(TEST_EVENT, 1, 0));
+    CHECK(queue(TEST_STATE, 2, BUSQUEUE_COALESCE));
+    busqueue_end(q);
+    settle(conn);
+
+    CHECK(nstate == 2 && states[0] == 1 && states[1] == 2);
+    CHECK(nevent == 1);
+
+    /* without the flag nothing gets replaced */
+    reset();
+
+    CHECK(queue(TEST_STATE, 1, 0));
+    CHECK(queue(TEST_STATE, 2, BUSQUEUE_COALESCE));
+    busqueue_flush(q);
+    settle(conn);
+
+    CHECK(nstate == 2);
+}
+
+static DBusConnection *test_reconnect(DBusConnection *conn)
+{
+    busqueue_stats_t  stats;
+    DBusConnection   *fresh;
+
+    reset();
+
+    busqueue_begin(q);
+    CHECK(queue(TEST_EVENT, 1, 0));
+    CHECK(queue(TEST_EVENT, 2, 0));
+
+    /* messages queued for the old connection are dropped */
+    fresh = connect_bus();
+    busqueue_set_connection(q, fresh);
+    disconnect_bus(conn);
+
+    CHECK(queue(TEST_EVENT, 3, 0));
+    busqueue_end(q);
+    settle(fresh);
+
+    CHECK(nevent == 1 && events[0] == 3);
+
+    busqueue_get_stats(q, &stats);
+    CHECK(stats.dropped == 2);
+
+    /* and with no connection nothing can be queued */
+    busqueue_set_connection(q, NULL);
+    CHECK(!queue(TEST_EVENT, 4, 0));
+    busqueue_set_connection(q, fresh);
+
+    return fresh;
+}
+
+static void test_destroy(DBusConnection *conn)
+{
+    reset();
+
+    /* whatever is queued is sent on destruction */
+    busqueue_begin(q);
+    CHECK(queue(TEST_EVENT, 1, 0));
+    busqueue_destroy(q);
+    q = NULL;
+
+    settle(conn);
+    CHECK(nevent == 1);
+}
+
+int main(int argc, char **argv)
+{
+    DBusConnection *conn;
+    DBusError       err;
+    char            rule[256];
+
+    (void)argc;
+
+    if (!daemon_start()) {
+        printf("%s: skipped, could not start a bus daemon\n", argv[0]);
+        daemon_stop();
+        return SKIP;
+    }
+
+    receiver = connect_bus();
+    conn     = connect_bus();
+
+    dbus_error_init(&err);
+    snprintf(rule, sizeof(rule), "type='signal',interface='%s'",
+             TEST_INTERFACE);
+    dbus_bus_add_match(receiver, rule, &err);
+    dbus_connection_add_filter(receiver, collect_cb, NULL, NULL);
+
+    if (dbus_error_is_set(&err) || (q = busqueue_create(conn)) == NULL) {
+        printf("failed to set up the test\n");
+        daemon_stop();
+        return 1;
+    }
+
+    test_bracket(conn);
+    test_coalesce(conn);
+    conn = test_reconnect(conn);
+    test_destroy(conn);
+
+    disconnect_bus(conn);
+    disconnect_bus(receiver);
+    daemon_stop();
+
+    printf("%s: %s\n", argv[0], failures ? "FAILED" : "passed");
+
+    return failures ? 1 : 0;
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
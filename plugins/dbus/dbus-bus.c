@@ -92,6 +92,17 @@ bus_create(DBusBusType type)
     if (ALLOC_OBJ(bus) != NULL) {
         bus->type = type;
         list_init(&bus->notify);
+
+        if ((bus->matches = busmatch_create(NULL)) == NULL) {
+            FREE(bus);
+            return NULL;
+        }
+
+        if ((bus->outq = busqueue_create(NULL)) == NULL) {
+            busmatch_destroy(bus->matches);
+            FREE(bus);
+            return NULL;
+        }
     }
     
     return bus;
@@ -120,6 +131,16 @@ bus_destroy(bus_t *bus)
             bus->watches = NULL;
         }
 
+        if (bus->matches) {
+            busmatch_destroy(bus->matches);
+            bus->matches = NULL;
+        }
+
+        if (bus->outq) {
+            busqueue_destroy(bus->outq);
+            bus->outq = NULL;
+        }
+
         bus_disconnect(bus);
 
         FREE(bus);
@@ -219,6 +240,10 @@ bus_connect(bus_t *bus, const char *address)
         }
     }
 
+    /* (re)install our match rules, without waiting for the daemon */
+    busmatch_set_connection(bus->matches, bus->conn);
+    busqueue_set_connection(bus->outq, bus->conn);
+
     bus_event(bus, BUS_EVENT_CONNECTED);
     
     return TRUE;
@@ -244,6 +269,46 @@ bus_disconnect(bus_t *bus)
 }
 
 
+/********************
+ * bus_send
+ ********************/
+int
+bus_send(DBusBusType type, DBusMessage *msg, int flags)
+{
+    bus_t *bus = bus_by_type(type);
+
+    if (bus == NULL || bus->conn == NULL) {
+        OHM_ERROR("dbus: cannot send message, %s bus is not connected",
+                  type == DBUS_BUS_SYSTEM ? "system" : "session");
+        return FALSE;
+    }
+
+    return busqueue_send(bus->outq, msg, flags);
+}
+
+
+/********************
+ * bus_batch_begin
+ ********************/
+void
+bus_batch_begin(bus_t *bus)
+{
+    if (bus != NULL && bus->outq != NULL)
+        busqueue_begin(bus->outq);
+}
+
+
+/********************
+ * bus_batch_end
+ ********************/
+void
+bus_batch_end(bus_t *bus)
+{
+    if (bus != NULL && bus->outq != NULL)
+        busqueue_end(bus->outq);
+}
+
+
 /********************
  * bus_by_type
  ********************/
@@ -103,6 +103,78 @@ hash_table_foreach(hash_table_t *ht, GHFunc callback, void *data)
     g_hash_table_foreach(ht, callback, data);
 }
 
+
+
+/*
+ * interned strings
+ *
+ * The table is created with the first atom and goes away with the last
+ * one, so it needs no explicit setup or teardown.
+ */
+
+static GHashTable *atoms;
+
+
+/********************
+ * atom_get
+ ********************/
+atom_t *
+atom_get(const char *name)
+{
+    atom_t *atom;
+
+    if (atoms == NULL &&
+        (atoms = g_hash_table_new(g_str_hash, g_str_equal)) == NULL)
+        return NULL;
+
+    if ((atom = g_hash_table_lookup(atoms, name)) == NULL) {
+        if (ALLOC_OBJ(atom) == NULL)
+            return NULL;
+
+        if ((atom->name = STRDUP(name)) == NULL) {
+            FREE(atom);
+            return NULL;
+        }
+
+        g_hash_table_insert(atoms, atom->name, atom);
+    }
+
+    atom->refcnt++;
+
+    return atom;
+}
+
+
+/********************
+ * atom_lookup
+ ********************/
+atom_t *
+atom_lookup(const char *name)
+{
+    return atoms != NULL ? g_hash_table_lookup(atoms, name) : NULL;
+}
+
+
+/********************
+ * atom_put
+ ********************/
+void
+atom_put(atom_t *atom)
+{
+    if (atom != NULL && --atom->refcnt <= 0) {
+        g_hash_table_remove(atoms, atom->name);
+
+        FREE(atom->name);
+        FREE(atom);
+
+        if (g_hash_table_size(atoms) == 0) {
+            g_hash_table_destroy(atoms);
+            atoms = NULL;
+        }
+    }
+}
+
+
 /* 
  * Local Variables:
  * c-basic-offset: 4
@@ -0,0 +1,421 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+
+/*
+ * Microbenchmark for the method call router.
+ *
+ * A number of objects (-o) are registered with methods on a few
+ * interfaces, some of them with and some without a signature, and with
+ * a couple of methods on the wildcard interface. Then method calls (-n)
+ * are routed to them in four flavours:
+ *
+ *   exact:     interface, member and signature all match a method,
+ *   signature: a method registered without a signature takes the call,
+ *   interface: only a method on the wildcard interface takes the call,
+ *   miss:      nobody takes the call.
+ *
+ * For reference the calls are also routed the way it used to be done,
+ * by formatting lookup keys and doing up to three string hash lookups.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "dbus-method.c"
+
+#define DEFAULT_OBJECTS   20
+#define DEFAULT_CALLS     1000000
+#define NINTERFACE        5
+#define NMEMBER           10
+#define NWILDCARD         3
+
+enum {
+    CALL_EXACT = 0,
+    CALL_SIGNATURE,
+    CALL_INTERFACE,
+    CALL_MISS,
+    CALL_MAX
+};
+
+static const char *call_names[CALL_MAX] = {
+    "exact", "signature", "interface", "miss"
+};
+
+int DBG_METHOD;
+
+static bus_t          system_bus;
+static GHashTable    *reference;            /* old-style key -> data */
+static void          *called;               /* data of the last handler */
+
+
+static double now(void);
+static DBusHandlerResult handler(DBusConnection *, DBusMessage *, void *);
+static int    unregister_methods(int);
+
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s [-o objects] [-n calls]\n", argv0);
+    exit(1);
+}
+
+static void register_methods(int nobject)
+{
+    char  path[64], interface[64], member[64], key[1024];
+    int   o, i, m;
+    long  id;
+
+    reference = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+
+    for (o = 0; o < nobject; o++) {
+        snprintf(path, sizeof(path), "/com/nokia/policy/object%d", o);
+
+        for (i = 0; i < NINTERFACE; i++) {
+            snprintf(interface, sizeof(interface),
+                     "com.nokia.policy.Interface%d", i);
+
+            for (m = 0; m < NMEMBER; m++) {
+                snprintf(member, sizeof(member), "Method%d", m);
+                id = ((o + 1) << 16) | (i << 8) | m;
+
+                /* odd members take any signature */
+                method_add(DBUS_BUS_SYSTEM, path, interface, member,
+                           (m & 1) ? NULL : "s", handler, (void *)id);
+
+                snprintf(key, sizeof(key), "%s/%s.%s/%s", path, interface,
+                         member, (m & 1) ? "" : "s");
+                g_hash_table_insert(reference, strdup(key), (void *)id);
+            }
+        }
+
+        for (m = 0; m < NWILDCARD; m++) {
+            snprintf(member, sizeof(member), "Wildcard%d", m);
+            id = ((o + 1) << 16) | 0xff00 | m;
+
+            method_add(DBUS_BUS_SYSTEM, path, NULL, member, NULL,
+                       handler, (void *)id);
+
+            snprintf(key, sizeof(key), "%s/.%s/", path, member);
+            g_hash_table_insert(reference, strdup(key), (void *)id);
+        }
+    }
+}
+
+static int unregister_methods(int nobject)
+{
+    char  path[64], interface[64], member[64];
+    int   o, i, m, failures;
+    long  id;
+
+    failures = 0;
+
+    for (o = 0; o < nobject; o++) {
+        snprintf(path, sizeof(path), "/com/nokia/policy/object%d", o);
+
+        /* the wildcards first, so the fallbacks need to be unlinked */
+        for (m = 0; m < NWILDCARD; m++) {
+            snprintf(member, sizeof(member), "Wildcard%d", m);
+            id = ((o + 1) << 16) | 0xff00 | m;
+
+            if (!method_del(DBUS_BUS_SYSTEM, path, NULL, member, NULL,
+                            handler, (void *)id))
+                failures++;
+        }
+
+        for (i = 0; i < NINTERFACE; i++) {
+            snprintf(interface, sizeof(interface),
+                     "com.nokia.policy.Interface%d", i);
+
+            for (m = 0; m < NMEMBER; m++) {
+                snprintf(member, sizeof(member), "Method%d", m);
+                id = ((o + 1) << 16) | (i << 8) | m;
+
+                if (!method_del(DBUS_BUS_SYSTEM, path, interface, member,
+                                (m & 1) ? NULL : "s", handler, (void *)id))
+                    failures++;
+            }
+        }
+    }
+
+    if (!hash_table_empty(system_bus.objects))
+        failures++;
+
+    return failures;
+}
+
+static DBusMessage *make_call(int type, int o, long *expected)
+{
+    char         path[64], interface[64], member[64];
+    const char  *s = "x";
+    DBusMessage *msg;
+    int          i, m;
+
+    i = random() % NINTERFACE;
+    m = random() % NMEMBER;
+
+    snprintf(path, sizeof(path), "/com/nokia/policy/object%d", o);
+    snprintf(interface, sizeof(interface), "com.nokia.policy.Interface%d", i);
+
+    switch (type) {
+    case CALL_EXACT:
+        m &= ~1;
+        *expected = ((o + 1) << 16) | (i << 8) | m;
+        break;
+    case CALL_SIGNATURE:
+        m |= 1;
+        *expected = ((o + 1) << 16) | (i << 8) | m;
+        break;
+    case CALL_INTERFACE:
+        m = random() % NWILDCARD;
+        *expected = ((o + 1) << 16) | 0xff00 | m;
+        break;
+    default:
+        *expected = -1;
+        break;
+    }
+
+    if (type == CALL_INTERFACE)
+        snprintf(member, sizeof(member), "Wildcard%d", m);
+    else if (type == CALL_MISS)
+        snprintf(member, sizeof(member), "Unknown%d", m);
+    else
+        snprintf(member, sizeof(member), "Method%d", m);
+
+    msg = dbus_message_new_method_call(":1.1", path, interface, member);
+    dbus_message_append_args(msg, DBUS_TYPE_STRING, &s, DBUS_TYPE_INVALID);
+
+    return msg;
+}
+
+/*
+ * the way calls used to be routed: format keys, then up to three lookups
+ */
+static void *reference_route(DBusMessage *msg)
+{
+    const char *path      = dbus_message_get_path(msg);
+    const char *interface = dbus_message_get_interface(msg);
+    const char *member    = dbus_message_get_member(msg);
+    const char *signature = dbus_message_get_signature(msg);
+    char        key[1024];
+    void       *data;
+
+    snprintf(key, sizeof(key), "%s/%s.%s/%s", path, interface, member,
+             signature);
+    if ((data = g_hash_table_lookup(reference, key)) != NULL)
+        return data;
+
+    snprintf(key, sizeof(key), "%s/%s.%s/", path, interface, member);
+    if ((data = g_hash_table_lookup(reference, key)) != NULL)
+        return data;
+
+    snprintf(key, sizeof(key), "%s/.%s/", path, member);
+    return g_hash_table_lookup(reference, key);
+}
+
+int main(int argc, char **argv)
+{
+    int           nobject = DEFAULT_OBJECTS;
+    int           ncall   = DEFAULT_CALLS;
+    DBusMessage **msgs;
+    object_t    **objects;
+    long         *expected;
+    double        start, routed, formatted;
+    int           opt, type, i, failures;
+
+    while ((opt = getopt(argc, argv, "o:n:")) != -1) {
+        switch (opt) {
+        case 'o':   nobject = atoi(optarg); break;
+        case 'n':   ncall   = atoi(optarg); break;
+        default:    usage(argv[0]);
+        }
+    }
+
+    if (nobject <= 0 || ncall <= 0)
+        usage(argv[0]);
+
+    srandom(1);
+
+    system_bus.type    = DBUS_BUS_SYSTEM;
+    system_bus.objects = hash_table_create(NULL, object_purge);
+    list_init(&system_bus.notify);
+
+    register_methods(nobject);
+
+    msgs     = calloc(ncall, sizeof(*msgs));
+    objects  = calloc(ncall, sizeof(*objects));
+    expected = calloc(ncall, sizeof(*expected));
+
+    if (msgs == NULL || objects == NULL || expected == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    printf("objects:           %d (%d methods each)\n", nobject,
+           NINTERFACE * NMEMBER + NWILDCARD);
+
+    failures = 0;
+
+    for (type = 0; type < CALL_MAX; type++) {
+        for (i = 0; i < ncall; i++) {
+            int o = random() % nobject;
+
+            msgs[i] = make_call(type, o, expected + i);
+            objects[i] = object_lookup(&system_bus,
+                                       dbus_message_get_path(msgs[i]));
+        }
+
+        start = now();
+
+        for (i = 0; i < ncall; i++) {
+            called = (void *)-1;
+            method_dispatch(system_bus.conn, msgs[i], objects[i]);
+
+            if ((long)called != expected[i])
+                failures++;
+        }
+
+        routed = now() - start;
+        start  = now();
+
+        for (i = 0; i < ncall; i++) {
+            if ((long)(reference_route(msgs[i]) ?: (void *)-1) != expected[i])
+                failures++;
+        }
+
+        formatted = now() - start;
+
+        printf("%-10s %8.1f ns/call (formatted keys: %.1f ns/call)\n",
+               call_names[type], routed * 1.0e9 / ncall,
+               formatted * 1.0e9 / ncall);
+
+        for (i = 0; i < ncall; i++)
+            dbus_message_unref(msgs[i]);
+    }
+
+    if (failures)
+        printf("%d calls were misrouted\n", failures);
+
+    if (unregister_methods(nobject)) {
+        printf("failed to unregister all methods\n");
+        failures++;
+    }
+
+    hash_table_destroy(system_bus.objects);
+    g_hash_table_destroy(reference);
+
+    free(msgs);
+    free(objects);
+    free(expected);
+
+    return failures ? 1 : 0;
+}
+
+static DBusHandlerResult handler(DBusConnection *c, DBusMessage *msg,
+                                 void *data)
+{
+    (void)c;
+    (void)msg;
+
+    called = data;
+
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+/*
+ * dbus-bus.c stand-ins
+ */
+
+bus_t *bus_by_type(DBusBusType type)
+{
+    return type == DBUS_BUS_SYSTEM ? &system_bus : NULL;
+}
+
+bus_t *bus_by_connection(DBusConnection *conn)
+{
+    (void)conn;
+
+    return &system_bus;
+}
+
+int bus_watch_add(bus_t *bus, void (*callback)(bus_t *, int, void *),
+                  void *data)
+{
+    (void)bus;
+    (void)callback;
+    (void)data;
+
+    return TRUE;
+}
+
+int bus_watch_del(bus_t *bus, void (*callback)(bus_t *, int, void *),
+                  void *data)
+{
+    (void)bus;
+    (void)callback;
+    (void)data;
+
+    return TRUE;
+}
+
+void bus_batch_begin(bus_t *bus)
+{
+    (void)bus;
+}
+
+void bus_batch_end(bus_t *bus)
+{
+    (void)bus;
+}
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level == OHM_LOG_ERROR) {
+        va_start(ap, format);
+        vfprintf(stderr, format, ap);
+        fputs("\n", stderr);
+        va_end(ap);
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -24,20 +24,45 @@ USA.
 
 extern int DBG_METHOD;                         /* debug flag for methods */
 
+
+/*
+ * Methods of an object are kept in a two-level table indexed by the
+ * interned interface and member names. Methods registered without an
+ * interface live in a wildcard interface and every member of a real
+ * interface points to its wildcard counterpart, if any, so falling back
+ * costs no extra lookup. Methods of a member are kept in a short list,
+ * one for each signature (or no signature) they were registered with.
+ */
+
+typedef struct method_s method_t;
+typedef struct member_s member_t;
+
+struct method_s {
+    atom_t                        *signature;  /* NULL if any will do */
+    DBusObjectPathMessageFunction  handler;
+    void                          *data;
+    method_t                      *next;       /* other signatures */
+};
+
+struct member_s {
+    atom_t                        *member;     /* member name */
+    method_t                      *methods;    /* methods of this member */
+    member_t                      *fallback;   /* same on any interface */
+};
+
+typedef struct {
+    atom_t       *interface;                   /* NULL for the wildcard */
+    GHashTable   *members;                     /* member atom -> member_t */
+} iface_t;
+
 typedef struct {
     char         *path;                        /* object path */
     bus_t        *bus;                         /* bus this object is on */
-    hash_table_t *methods;                     /* object method table */
+    GHashTable   *interfaces;                  /* interface atom -> iface_t */
+    iface_t      *any;                         /* wildcard interface */
+    int           nmethod;                     /* number of methods */
 } object_t;
 
-typedef struct {
-    char                          *interface;
-    char                          *member;
-    char                          *signature;
-    DBusObjectPathMessageFunction  handler;
-    void                          *data;
-} method_t;
-
 
 static object_t *object_add(bus_t *, const char *);
 static int       object_del(object_t *);
@@ -46,6 +71,13 @@ static int       object_register(object_t *object);
 static void      object_unregister(object_t *object);
 static void      object_purge(void *);
 
+static iface_t  *iface_get(object_t *, atom_t *, int);
+static void      iface_purge(void *);
+static member_t *member_get(object_t *, iface_t *, atom_t *, int);
+static void      member_del(object_t *, iface_t *, member_t *);
+static void      member_purge(void *);
+static void      iface_check(object_t *, iface_t *);
+
 static void session_bus_event(bus_t *, int, void *);
 
 
@@ -117,35 +149,34 @@ method_exit(void)
 
 
 /********************
- * method_key
+ * method_purge
  ********************/
-static inline char *
-method_key(char *buf, size_t size,
-           const char *interface, const char *member, const char *signature)
+static void
+method_purge(method_t *method)
 {
-    snprintf(buf, size, "%s.%s/%s",
-             interface ? interface : "",
-             member    ? member    : "",
-             signature ? signature : "");
-    return buf;
+    if (method) {
+        atom_put(method->signature);
+        FREE(method);
+    }
 }
 
 
 /********************
- * method_purge
+ * method_find
  ********************/
-static void
-method_purge(method_t *method)
+static inline method_t *
+method_find(member_t *m, atom_t *signature)
 {
-#define MEMBER_FREE(member) if ((method)->member) FREE((method)->member)
+    method_t *method, *any;
 
-    MEMBER_FREE(interface);
-    MEMBER_FREE(member);
-    MEMBER_FREE(signature);
-    
-    FREE(method);
+    for (any = NULL, method = m->methods; method; method = method->next) {
+        if (method->signature == signature)
+            return method;
+        if (method->signature == NULL)
+            any = method;
+    }
 
-#undef METHOD_FREE
+    return any;
 }
 
 
@@ -159,45 +190,72 @@ method_add(DBusBusType type, const char *path, const char *interface,
 {
     bus_t    *bus;
     object_t *object;
-    method_t *method;
-    char      key_buf[1024];
-    char     *key = NULL;
+    iface_t  *iface = NULL;
+    member_t *m;
+    method_t *method, **tail;
+    atom_t   *ifatom, *mbatom;
 
-    if ((bus = bus_by_type(type)) == NULL)
+    if ((bus = bus_by_type(type)) == NULL || member == NULL)
         return FALSE;
     
     if (ALLOC_OBJ(method) == NULL)
-        goto failed;
+        return FALSE;
 
-    method->interface = interface ? STRDUP(interface) : NULL;
-    method->member    = STRDUP(member);
-    method->signature = signature ? STRDUP(signature) : NULL;
-    method->handler   = handler;
-    method->data      = data;
-    
-    method_key(key_buf, sizeof(key_buf), interface, member, signature);
-    key = key_buf;
+    method->handler = handler;
+    method->data    = data;
 
-    if ((object = object_lookup(bus, path)) == NULL) {
-        if ((object = object_add(bus, path)) == NULL)
-            goto failed;
-    }
-    else
-        if (hash_table_lookup(object->methods, key) != NULL)
-            goto failed;
-            
-    if ((key = STRDUP(key)) == NULL)
+    ifatom = interface ? atom_get(interface) : NULL;
+    mbatom = atom_get(member);
+
+    if (signature && (method->signature = atom_get(signature)) == NULL)
         goto failed;
 
-    if (!hash_table_insert(object->methods, key, method))
+    if ((interface && ifatom == NULL) || mbatom == NULL)
         goto failed;
+
+    if ((object = object_lookup(bus, path)) == NULL &&
+        (object = object_add(bus, path))    == NULL)
+        goto failed;
+
+    if ((iface = iface_get(object, ifatom, TRUE))       == NULL ||
+        (m     = member_get(object, iface, mbatom, TRUE)) == NULL)
+        goto cleanup;
+
+    for (tail = &m->methods; *tail != NULL; tail = &(*tail)->next) {
+        if ((*tail)->signature == method->signature)
+            goto cleanup;                           /* already registered */
+    }
+
+    *tail = method;
+    object->nmethod++;
+
+    atom_put(ifatom);
+    atom_put(mbatom);
     
-    OHM_DEBUG(DBG_METHOD,
-              "registered handler %p for %s:%s", handler, path, key);
+    OHM_DEBUG(DBG_METHOD, "registered handler %p for %s:%s.%s/%s", handler,
+              path, interface ? interface : "", member,
+              signature ? signature : "");
 
     return TRUE;
     
+ cleanup:
+    /* don't leave behind the empty tables we might have created */
+    if (iface != NULL) {
+        if ((m = member_get(object, iface, mbatom, FALSE)) != NULL &&
+            m->methods == NULL)
+            member_del(object, iface, m);
+        else
+            iface_check(object, iface);
+    }
+
+    if (object->nmethod == 0) {
+        object_unregister(object);
+        object_del(object);
+    }
+    
  failed:
+    atom_put(ifatom);
+    atom_put(mbatom);
     method_purge(method);
 
     return FALSE;
@@ -212,32 +270,55 @@ method_del(DBusBusType type, const char *path, const char *interface,
            const char *member, const char *signature,
            DBusObjectPathMessageFunction handler, void *data)
 {
-    bus_t    *bus;
-    object_t *object;
-    method_t *method;
-    char      key[1024];
+    bus_t     *bus;
+    object_t  *object;
+    iface_t   *iface;
+    member_t  *m;
+    method_t  *method, **prev;
+    atom_t    *ifatom, *mbatom, *sigatom;
+
+    if ((bus = bus_by_type(type)) == NULL || member == NULL)
+        return FALSE;
+
+    ifatom  = interface ? atom_lookup(interface) : NULL;
+    mbatom  = atom_lookup(member);
+    sigatom = signature ? atom_lookup(signature) : NULL;
 
-    if ((bus = bus_by_type(type)) == NULL)
+    if ((interface && ifatom == NULL) || mbatom == NULL ||
+        (signature && sigatom == NULL))
         return FALSE;
 
-    method_key(key, sizeof(key), interface, member, signature);
-    
     if ((object = object_lookup(bus, path))                == NULL ||
-        (method = hash_table_lookup(object->methods, key)) == NULL)
+        (iface  = iface_get(object, ifatom, FALSE))        == NULL ||
+        (m      = member_get(object, iface, mbatom, FALSE)) == NULL)
+        return FALSE;
+
+    for (prev = &m->methods; (method = *prev) != NULL; prev = &method->next)
+        if (method->signature == sigatom)
+            break;
+
+    if (method == NULL)
         return FALSE;
     
     if (method->handler != handler || method->data != data) {
-        OHM_WARNING("dbus: %s:%s has handler %p instead of %p",
-                    path, key, method->handler, handler);
+        OHM_WARNING("dbus: %s:%s.%s has handler %p instead of %p", path,
+                    interface ? interface : "", member, method->handler,
+                    handler);
         return FALSE;
     }
 
-    hash_table_remove(object->methods, key);
-    
-    OHM_DEBUG(DBG_METHOD,
-              "unregistered handler %p for %s:%s", method->handler, path, key);
+    *prev = method->next;
+    method_purge(method);
+    object->nmethod--;
+
+    OHM_DEBUG(DBG_METHOD, "unregistered handler %p for %s:%s.%s/%s",
+              handler, path, interface ? interface : "", member,
+              signature ? signature : "");
 
-    if (hash_table_empty(object->methods)) {
+    if (m->methods == NULL)
+        member_del(object, iface, m);
+
+    if (object->nmethod == 0) {
         OHM_DEBUG(DBG_METHOD, "object %s became empty, destroying it", path);
         object_unregister(object);
         object_del(object);
@@ -253,43 +334,236 @@ method_del(DBusBusType type, const char *path, const char *interface,
 DBusHandlerResult
 method_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
 {
-    const char *path      = dbus_message_get_path(msg);
     const char *interface = dbus_message_get_interface(msg);
     const char *member    = dbus_message_get_member(msg);
     const char *signature = dbus_message_get_signature(msg);
-    const char *sender    = dbus_message_get_sender(msg);
-    bus_t      *bus       = bus_by_connection(c);
     object_t   *object    = (object_t *)data;
+    atom_t     *ifatom, *mbatom, *sigatom;
+    iface_t    *iface;
+    member_t   *m;
     method_t   *method;
-    char        key[1024];
+    bus_t      *bus;
+
+    DBusHandlerResult result;
 
-    if (bus == NULL)
+    if ((bus = bus_by_connection(c)) == NULL)
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     
     OHM_DEBUG(DBG_METHOD, "got method call %s.%s(%s) for %s from %s",
-              interface, member, signature, path ? path : NULL, sender);
+              interface, member, signature, object->path,
+              dbus_message_get_sender(msg));
+
+    /* a member nobody has registered can't have a method */
+    if (member == NULL || (mbatom = atom_lookup(member)) == NULL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    method_key(key, sizeof(key), interface, member, signature);
-    if ((method = hash_table_lookup(object->methods, key)) != NULL) {
-        OHM_DEBUG(DBG_METHOD,
-                  "routing to handler %p (%s)", method->handler, key);
-        return method->handler(c, msg, method->data);
+    ifatom  = interface ? atom_lookup(interface) : NULL;
+    sigatom = signature ? atom_lookup(signature) : NULL;
+
+    m = NULL;
+    if (ifatom != NULL && object->interfaces != NULL &&
+        (iface = g_hash_table_lookup(object->interfaces, ifatom)) != NULL)
+        m = g_hash_table_lookup(iface->members, mbatom);
+
+    if (m == NULL && object->any != NULL)
+        m = g_hash_table_lookup(object->any->members, mbatom);
+
+    for ( ; m != NULL; m = m->fallback) {
+        if ((method = method_find(m, sigatom)) != NULL) {
+            OHM_DEBUG(DBG_METHOD, "routing to handler %p", method->handler);
+
+            /* whatever the handler queues goes out once it returns */
+            bus_batch_begin(bus);
+            result = method->handler(c, msg, method->data);
+            bus_batch_end(bus);
+
+            return result;
+        }
     }
 
-    method_key(key, sizeof(key), interface, member, NULL);
-    if ((method = hash_table_lookup(object->methods, key)) != NULL) {
-        OHM_DEBUG(DBG_METHOD,
-                  "routing to handler %p (%s)", method->handler, key);
-        return method->handler(c, msg, method->data);
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+
+/********************
+ * iface_get
+ ********************/
+static iface_t *
+iface_get(object_t *object, atom_t *interface, int create)
+{
+    iface_t *iface;
+
+    if (interface == NULL)
+        iface = object->any;
+    else if (object->interfaces != NULL)
+        iface = g_hash_table_lookup(object->interfaces, interface);
+    else
+        iface = NULL;
+
+    if (iface != NULL || !create)
+        return iface;
+
+    if (interface != NULL && object->interfaces == NULL) {
+        object->interfaces = g_hash_table_new_full(g_direct_hash,
+                                                   g_direct_equal,
+                                                   NULL, iface_purge);
+        if (object->interfaces == NULL)
+            return NULL;
     }
 
-    if ((method = hash_table_lookup(object->methods, member)) != NULL) {
-        OHM_DEBUG(DBG_METHOD,
-                  "routing to handler %p (%s)", method->handler, member);
-        return method->handler(c, msg, method->data);
+    if (ALLOC_OBJ(iface) == NULL)
+        return NULL;
+
+    iface->members = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                           NULL, member_purge);
+    if (iface->members == NULL) {
+        FREE(iface);
+        return NULL;
     }
 
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    if (interface != NULL) {
+        iface->interface = interface;
+        interface->refcnt++;
+        g_hash_table_insert(object->interfaces, interface, iface);
+    }
+    else
+        object->any = iface;
+
+    return iface;
+}
+
+
+/********************
+ * iface_purge
+ ********************/
+static void
+iface_purge(void *ptr)
+{
+    iface_t *iface = (iface_t *)ptr;
+
+    if (iface) {
+        g_hash_table_destroy(iface->members);
+        atom_put(iface->interface);
+        FREE(iface);
+    }
+}
+
+
+/********************
+ * iface_check
+ ********************/
+static void
+iface_check(object_t *object, iface_t *iface)
+{
+    if (g_hash_table_size(iface->members) == 0) {
+        if (iface == object->any) {
+            object->any = NULL;
+            iface_purge(iface);
+        }
+        else
+            g_hash_table_remove(object->interfaces, iface->interface);
+    }
+}
+
+
+/********************
+ * link_fallback
+ ********************/
+static void
+link_fallback(gpointer key, gpointer value, gpointer data)
+{
+    iface_t  *iface    = (iface_t *)value;
+    member_t *fallback = (member_t *)data;
+    member_t *m;
+
+    (void)key;
+
+    if ((m = g_hash_table_lookup(iface->members, fallback->member)) != NULL)
+        m->fallback = fallback;
+}
+
+
+/********************
+ * unlink_fallback
+ ********************/
+static void
+unlink_fallback(gpointer key, gpointer value, gpointer data)
+{
+    iface_t  *iface    = (iface_t *)value;
+    member_t *fallback = (member_t *)data;
+    member_t *m;
+
+    (void)key;
+
+    if ((m = g_hash_table_lookup(iface->members, fallback->member)) != NULL &&
+        m->fallback == fallback)
+        m->fallback = NULL;
+}
+
+
+/********************
+ * member_get
+ ********************/
+static member_t *
+member_get(object_t *object, iface_t *iface, atom_t *member, int create)
+{
+    member_t *m;
+
+    if ((m = g_hash_table_lookup(iface->members, member)) != NULL || !create)
+        return m;
+
+    if (ALLOC_OBJ(m) == NULL)
+        return NULL;
+
+    m->member = member;
+    member->refcnt++;
+
+    g_hash_table_insert(iface->members, member, m);
+
+    if (iface == object->any) {
+        /* point the same member of all real interfaces here */
+        if (object->interfaces != NULL)
+            g_hash_table_foreach(object->interfaces, link_fallback, m);
+    }
+    else if (object->any != NULL)
+        m->fallback = g_hash_table_lookup(object->any->members, member);
+
+    return m;
+}
+
+
+/********************
+ * member_del
+ ********************/
+static void
+member_del(object_t *object, iface_t *iface, member_t *m)
+{
+    if (iface == object->any && object->interfaces != NULL)
+        g_hash_table_foreach(object->interfaces, unlink_fallback, m);
+
+    g_hash_table_remove(iface->members, m->member);
+    iface_check(object, iface);
+}
+
+
+/********************
+ * member_purge
+ ********************/
+static void
+member_purge(void *ptr)
+{
+    member_t *m = (member_t *)ptr;
+    method_t *method, *next;
+
+    if (m) {
+        for (method = m->methods; method != NULL; method = next) {
+            next = method->next;
+            method_purge(method);
+        }
+
+        atom_put(m->member);
+        FREE(m);
+    }
 }
 
 
@@ -309,23 +583,19 @@ object_add(bus_t *bus, const char *path)
     if ((object->path = STRDUP(path)) == NULL)
         goto failed;
     
-    if ((object->methods = hash_table_create(NULL, object_purge)) == NULL)
-        goto failed;
-    
     if (!hash_table_insert(bus->objects, object->path, object))
         goto failed;
 
-    if (!object_register(object))
+    if (!object_register(object)) {
+        hash_table_unhash(bus->objects, object->path);
         goto failed;
+    }
 
     return object;
 
  failed:
-    if (object) {
-        if (object->methods)
-            hash_table_unhash(bus->objects, object->path);
+    if (object)
         object_purge(object);
-    }
     
     return NULL;
 }
@@ -393,8 +663,10 @@ object_purge(void *ptr)
     object_t *object = (object_t *)ptr;
 
     object_unregister(object);
-    if (object->methods)
-        hash_table_destroy(object->methods);
+    if (object->interfaces)
+        g_hash_table_destroy(object->interfaces);
+    if (object->any)
+        iface_purge(object->any);
     FREE(object->path);
     FREE(object);
 }
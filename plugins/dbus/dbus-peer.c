@@ -0,0 +1,774 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Peer cache: unique name -> (pid, uid, owned well-known names), kept
+ * per bus. The cache is primed with a single ListNames call and kept
+ * current from NameOwnerChanged signals, which reach us through the name
+ * watch dispatcher. The pid and uid of a peer are asked from the bus
+ * daemon once, asynchronously, when it first shows up on the bus, so
+ * other plugins no longer need a round trip per request to find out who
+ * is calling them. Queries are always answered from the main loop, even
+ * when the answer is in the cache, so callers never get called back
+ * before peer_query has returned.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "dbus-plugin.h"
+
+#define OWNER_RULE "type='signal',"                     \
+                   "sender='org.freedesktop.DBus',"     \
+                   "path='/org/freedesktop/DBus',"      \
+                   "interface='org.freedesktop.DBus',"  \
+                   "member='NameOwnerChanged'"
+
+#define NO_UID ((uid_t)-1)
+
+extern int DBG_PEER;                           /* debug flag for peers */
+
+typedef struct {
+    bus_t        *bus;                         /* bus of this peer */
+    char         *name;                        /* unique name */
+    int           refcnt;                      /* table + queries in flight */
+    int           pending;                     /* identity queries in flight */
+    pid_t         pid;                         /* 0 if unknown */
+    uid_t         uid;                         /* NO_UID if unknown */
+    char        **names;                       /* owned names, NULL-terminated */
+    int           nname;
+    list_hook_t   queries;                     /* waiting for the identity */
+    guint         idle;                        /* delivery of cached answers */
+} peer_t;
+
+typedef struct {
+    list_hook_t   hook;
+    peer_cb_t     callback;
+    void         *data;
+} query_t;
+
+typedef struct {
+    DBusBusType   type;                        /* bus of the query */
+    char         *name;                        /* well-known name */
+} owner_query_t;
+
+
+static int     peer_tables(bus_t *bus);
+static void    peer_prime(bus_t *bus);
+static peer_t *peer_create(bus_t *bus, const char *name);
+static void    peer_remove(bus_t *bus, peer_t *peer);
+static void    peer_drop(void *ptr);
+static void    peer_unref(void *ptr);
+static void    peer_identify(peer_t *peer);
+static void    peer_identified(peer_t *peer);
+static void    peer_notify(peer_t *peer);
+static gboolean peer_notify_cb(gpointer data);
+static void    list_reply(DBusPendingCall *pending, void *data);
+static void    owner_reply(DBusPendingCall *pending, void *data);
+static void    owner_query_free(void *ptr);
+static void    pid_reply(DBusPendingCall *pending, void *data);
+static void    uid_reply(DBusPendingCall *pending, void *data);
+static void    peer_add_name(peer_t *peer, const char *name);
+static void    peer_del_name(peer_t *peer, const char *name);
+static void    owner_set(bus_t *bus, const char *name, const char *owner);
+static int     bus_call(bus_t *bus, const char *method, const char *arg,
+                        DBusPendingCallNotifyFunction notify, void *data,
+                        DBusFreeFunction free_data);
+
+static void session_bus_event(bus_t *bus, int event, void *data);
+
+
+/********************
+ * peer_init
+ ********************/
+int
+peer_init(void)
+{
+    bus_t *system, *session;
+
+    if ((system = bus_by_type(DBUS_BUS_SYSTEM)) == NULL)
+        return FALSE;
+
+    if (!peer_tables(system) ||
+        !busmatch_add(system->matches, OWNER_RULE, NULL, NULL)) {
+        OHM_ERROR("dbus: failed to create peer cache");
+        peer_exit();
+        return FALSE;
+    }
+
+    peer_prime(system);
+
+    if ((session = bus_by_type(DBUS_BUS_SESSION)) == NULL)
+        return FALSE;
+
+    if (!peer_tables(session) ||
+        !busmatch_add(session->matches, OWNER_RULE, NULL, NULL)) {
+        OHM_ERROR("dbus: failed to create peer cache");
+        peer_exit();
+        return FALSE;
+    }
+
+    if (!bus_watch_add(session, session_bus_event, NULL)) {
+        OHM_ERROR("dbus: failed to install session bus watch");
+        peer_exit();
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * peer_exit
+ ********************/
+void
+peer_exit(void)
+{
+    bus_t *bus;
+    int    i;
+
+    for (i = 0; i < 2; i++) {
+        bus = bus_by_type(i ? DBUS_BUS_SESSION : DBUS_BUS_SYSTEM);
+
+        if (bus == NULL)
+            continue;
+
+        if (i)
+            bus_watch_del(bus, session_bus_event, NULL);
+
+        if (bus->owners) {
+            hash_table_destroy(bus->owners);
+            bus->owners = NULL;
+        }
+
+        if (bus->peers) {
+            hash_table_destroy(bus->peers);
+            bus->peers = NULL;
+            busmatch_del(bus->matches, OWNER_RULE);
+        }
+    }
+}
+
+
+/********************
+ * peer_query
+ ********************/
+int
+peer_query(DBusBusType type, const char *name, peer_cb_t callback,
+           void *data)
+{
+    bus_t   *bus;
+    peer_t  *peer = NULL;
+    query_t *query;
+
+    if ((bus = bus_by_type(type)) == NULL || bus->peers == NULL ||
+        name == NULL || callback == NULL)
+        return FALSE;
+
+    if (name[0] != ':')
+        peer = hash_table_lookup(bus->owners, name);
+    else if ((peer = hash_table_lookup(bus->peers, name)) == NULL) {
+        /* not seen it come, ask for it now */
+        if (bus->conn != NULL)
+            peer = peer_create(bus, name);
+    }
+
+    if (peer == NULL)
+        return FALSE;
+
+    if (ALLOC_OBJ(query) == NULL)
+        return FALSE;
+
+    query->callback = callback;
+    query->data     = data;
+    list_append(&peer->queries, &query->hook);
+
+    /* never call back before our caller got our return value */
+    if (!peer->pending && !peer->idle) {
+        peer->idle = g_idle_add(peer_notify_cb, peer);
+        peer->refcnt++;
+    }
+
+    return TRUE;
+}
+
+
+/********************
+ * peer_lookup
+ ********************/
+int
+peer_lookup(DBusBusType type, const char *name, const char **unique,
+            pid_t *pid, uid_t *uid, char ***names)
+{
+    bus_t  *bus;
+    peer_t *peer;
+
+    if ((bus = bus_by_type(type)) == NULL || bus->peers == NULL ||
+        name == NULL)
+        return FALSE;
+
+    if (name[0] == ':')
+        peer = hash_table_lookup(bus->peers, name);
+    else
+        peer = hash_table_lookup(bus->owners, name);
+
+    if (peer == NULL || peer->pending)
+        return FALSE;
+
+    if (unique != NULL)
+        *unique = peer->name;
+    if (pid != NULL)
+        *pid = peer->pid;
+    if (uid != NULL)
+        *uid = peer->uid;
+    if (names != NULL)
+        *names = peer->names;
+
+    return TRUE;
+}
+
+
+/********************
+ * peer_owner_changed
+ ********************/
+void
+peer_owner_changed(bus_t *bus, const char *name, const char *previous,
+                   const char *current)
+{
+    peer_t *peer;
+
+    if (bus->peers == NULL)
+        return;
+
+    OHM_DEBUG(DBG_PEER, "owner of %s: '%s' -> '%s'", name, previous, current);
+
+    if (name[0] == ':') {
+        peer = hash_table_lookup(bus->peers, name);
+
+        if (current == NULL || !current[0]) {
+            if (peer != NULL)
+                peer_remove(bus, peer);
+        }
+        else if (peer == NULL)
+            peer_create(bus, name);
+    }
+    else
+        owner_set(bus, name, current);
+}
+
+
+/********************
+ * peer_tables
+ ********************/
+static int
+peer_tables(bus_t *bus)
+{
+    bus->peers  = hash_table_create(NULL, peer_drop);
+    bus->owners = hash_table_create(free, NULL);
+
+    return bus->peers != NULL && bus->owners != NULL;
+}
+
+
+/********************
+ * list_reply
+ ********************/
+static void
+list_reply(DBusPendingCall *pending, void *data)
+{
+    DBusBusType   type = (DBusBusType)(long)data;
+    bus_t        *bus  = bus_by_type(type);
+    DBusMessage  *reply;
+    char        **names;
+    int           nname, i;
+    owner_query_t *qry;
+
+    reply = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(pending);
+
+    if (reply == NULL || bus == NULL || bus->peers == NULL)
+        goto out;
+
+    if (!dbus_message_get_args(reply, NULL,
+                               DBUS_TYPE_ARRAY, DBUS_TYPE_STRING,
+                               &names, &nname, DBUS_TYPE_INVALID)) {
+        OHM_ERROR("dbus: failed to list the names on the bus");
+        goto out;
+    }
+
+    OHM_DEBUG(DBG_PEER, "priming peer cache with %d names", nname);
+
+    /*
+     * Changes that happened before the daemon got to our ListNames came
+     * in as signals and are reflected in the list, later ones will come
+     * after this reply. So we only add what we do not know yet.
+     */
+    for (i = 0; i < nname; i++) {
+        if (names[i][0] == ':') {
+            if (hash_table_lookup(bus->peers, names[i]) == NULL)
+                peer_create(bus, names[i]);
+        }
+        else if (strcmp(names[i], DBUS_SERVICE_DBUS) &&
+                 hash_table_lookup(bus->owners, names[i]) == NULL) {
+            if (ALLOC_OBJ(qry) == NULL ||
+                (qry->name = STRDUP(names[i])) == NULL) {
+                FREE(qry);
+                continue;
+            }
+            qry->type = type;
+
+            if (!bus_call(bus, "GetNameOwner", names[i], owner_reply, qry,
+                          owner_query_free))
+                owner_query_free(qry);
+        }
+    }
+
+    dbus_free_string_array(names);
+
+ out:
+    if (reply != NULL)
+        dbus_message_unref(reply);
+}
+
+
+/********************
+ * owner_reply
+ ********************/
+static void
+owner_reply(DBusPendingCall *pending, void *data)
+{
+    owner_query_t *qry = (owner_query_t *)data;
+    bus_t         *bus = bus_by_type(qry->type);
+    DBusMessage   *reply;
+    const char    *owner;
+
+    reply = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(pending);
+
+    if (reply == NULL)
+        return;
+
+    /* the reply is more recent than any signal we have seen about it */
+    if (bus != NULL && bus->peers != NULL &&
+        dbus_message_get_args(reply, NULL, DBUS_TYPE_STRING, &owner,
+                              DBUS_TYPE_INVALID))
+        owner_set(bus, qry->name, owner);
+
+    dbus_message_unref(reply);
+}
+
+
+/********************
+ * owner_query_free
+ ********************/
+static void
+owner_query_free(void *ptr)
+{
+    owner_query_t *qry = (owner_query_t *)ptr;
+
+    if (qry) {
+        FREE(qry->name);
+        FREE(qry);
+    }
+}
+
+
+/********************
+ * owner_set
+ ********************/
+static void
+owner_set(bus_t *bus, const char *name, const char *owner)
+{
+    peer_t *peer;
+    char   *key;
+
+    if ((peer = hash_table_lookup(bus->owners, name)) != NULL) {
+        if (owner != NULL && !strcmp(peer->name, owner))
+            return;
+
+        peer_del_name(peer, name);
+        hash_table_remove(bus->owners, name);
+    }
+
+    if (owner == NULL || owner[0] != ':')
+        return;
+
+    if ((peer = hash_table_lookup(bus->peers, owner)) == NULL &&
+        (peer = peer_create(bus, owner)) == NULL)
+        return;
+
+    if ((key = STRDUP(name)) != NULL) {
+        hash_table_insert(bus->owners, key, peer);
+        peer_add_name(peer, name);
+    }
+}
+
+
+/********************
+ * peer_prime
+ ********************/
+static void
+peer_prime(bus_t *bus)
+{
+    if (bus->conn == NULL)
+        return;
+
+    /*
+     * Get our NameOwnerChanged rule out before asking for the names. The
+     * daemon processes our calls in order, so no change can fall between
+     * the list and the signals.
+     */
+    busmatch_flush(bus->matches);
+
+    if (!bus_call(bus, "ListNames", NULL,
+                  list_reply, (void *)(long)bus->type, NULL))
+        OHM_ERROR("dbus: failed to query the names on the bus");
+}
+
+
+/********************
+ * peer_create
+ ********************/
+static peer_t *
+peer_create(bus_t *bus, const char *name)
+{
+    peer_t *peer;
+
+    if (ALLOC_OBJ(peer) == NULL)
+        return NULL;
+
+    if ((peer->name = STRDUP(name)) == NULL) {
+        FREE(peer);
+        return NULL;
+    }
+
+    peer->bus    = bus;
+    peer->refcnt = 1;
+    peer->uid    = NO_UID;
+    list_init(&peer->queries);
+
+    hash_table_insert(bus->peers, peer->name, peer);
+
+    OHM_DEBUG(DBG_PEER, "new peer %s", peer->name);
+
+    peer_identify(peer);
+
+    return peer;
+}
+
+
+/********************
+ * peer_remove
+ ********************/
+static void
+peer_remove(bus_t *bus, peer_t *peer)
+{
+    int i;
+
+    OHM_DEBUG(DBG_PEER, "peer %s (pid %u) is gone", peer->name,
+              (unsigned)peer->pid);
+
+    /* normally the names are released first, but do not rely on it */
+    for (i = 0; i < peer->nname; i++)
+        if (hash_table_lookup(bus->owners, peer->names[i]) == peer)
+            hash_table_remove(bus->owners, peer->names[i]);
+
+    while (peer->nname > 0)
+        peer_del_name(peer, peer->names[0]);
+
+    if (hash_table_lookup(bus->peers, peer->name) == peer)
+        hash_table_remove(bus->peers, peer->name);
+}
+
+
+/********************
+ * peer_drop
+ ********************/
+static void
+peer_drop(void *ptr)
+{
+    peer_t *peer = (peer_t *)ptr;
+
+    /* out of the table, queries still in flight may hold on to it */
+    peer->bus = NULL;
+
+    /* answer from the cache now, we might be going away for good */
+    if (peer->idle) {
+        g_source_remove(peer->idle);
+        peer->idle = 0;
+        peer_notify(peer);
+        peer_unref(peer);
+    }
+
+    peer_unref(peer);
+}
+
+
+/********************
+ * peer_unref
+ ********************/
+static void
+peer_unref(void *ptr)
+{
+    peer_t *peer = (peer_t *)ptr;
+    int     i;
+
+    if (--peer->refcnt > 0)
+        return;
+
+    for (i = 0; i < peer->nname; i++)
+        FREE(peer->names[i]);
+    FREE(peer->names);
+    FREE(peer->name);
+    FREE(peer);
+}
+
+
+/********************
+ * peer_identify
+ ********************/
+static void
+peer_identify(peer_t *peer)
+{
+    if (bus_call(peer->bus, "GetConnectionUnixProcessID", peer->name,
+                 pid_reply, peer, peer_unref)) {
+        peer->refcnt++;
+        peer->pending++;
+    }
+
+    if (bus_call(peer->bus, "GetConnectionUnixUser", peer->name,
+                 uid_reply, peer, peer_unref)) {
+        peer->refcnt++;
+        peer->pending++;
+    }
+}
+
+
+/********************
+ * pid_reply
+ ********************/
+static void
+pid_reply(DBusPendingCall *pending, void *data)
+{
+    peer_t        *peer = (peer_t *)data;
+    DBusMessage   *reply;
+    dbus_uint32_t  pid;
+
+    reply = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(pending);
+
+    if (reply != NULL) {
+        if (dbus_message_get_args(reply, NULL, DBUS_TYPE_UINT32, &pid,
+                                  DBUS_TYPE_INVALID))
+            peer->pid = (pid_t)pid;
+        dbus_message_unref(reply);
+    }
+
+    peer_identified(peer);
+}
+
+
+/********************
+ * uid_reply
+ ********************/
+static void
+uid_reply(DBusPendingCall *pending, void *data)
+{
+    peer_t        *peer = (peer_t *)data;
+    DBusMessage   *reply;
+    dbus_uint32_t  uid;
+
+    reply = dbus_pending_call_steal_reply(pending);
+    dbus_pending_call_unref(pending);
+
+    if (reply != NULL) {
+        if (dbus_message_get_args(reply, NULL, DBUS_TYPE_UINT32, &uid,
+                                  DBUS_TYPE_INVALID))
+            peer->uid = (uid_t)uid;
+        dbus_message_unref(reply);
+    }
+
+    peer_identified(peer);
+}
+
+
+/********************
+ * peer_identified
+ ********************/
+static void
+peer_identified(peer_t *peer)
+{
+    if (--peer->pending > 0)
+        return;
+
+    OHM_DEBUG(DBG_PEER, "peer %s: pid %u, uid %d", peer->name,
+              (unsigned)peer->pid, (int)peer->uid);
+
+    peer_notify(peer);
+
+    /* the peer is gone or unknown to the daemon, do not cache that */
+    if (peer->pid == 0 && peer->bus != NULL)
+        peer_remove(peer->bus, peer);
+}
+
+
+/********************
+ * peer_notify
+ ********************/
+static void
+peer_notify(peer_t *peer)
+{
+    query_t     *query;
+    list_hook_t *p, *n;
+
+    list_foreach(&peer->queries, p, n) {
+        query = list_entry(p, query_t, hook);
+        list_delete(&query->hook);
+        query->callback(peer->name, peer->pid, peer->uid, query->data);
+        FREE(query);
+    }
+}
+
+
+/********************
+ * peer_notify_cb
+ ********************/
+static gboolean
+peer_notify_cb(gpointer data)
+{
+    peer_t *peer = (peer_t *)data;
+
+    peer->idle = 0;
+    peer_notify(peer);
+    peer_unref(peer);
+
+    return FALSE;
+}
+
+
+/********************
+ * peer_add_name
+ ********************/
+static void
+peer_add_name(peer_t *peer, const char *name)
+{
+    char *copy;
+
+    if ((copy = STRDUP(name)) == NULL)
+        return;
+
+    if (REALLOC_ARR(peer->names, peer->nname + 1, peer->nname + 2) == NULL) {
+        FREE(copy);
+        return;
+    }
+
+    peer->names[peer->nname++] = copy;
+    peer->names[peer->nname]   = NULL;
+}
+
+
+/********************
+ * peer_del_name
+ ********************/
+static void
+peer_del_name(peer_t *peer, const char *name)
+{
+    int i;
+
+    for (i = 0; i < peer->nname; i++) {
+        if (!strcmp(peer->names[i], name)) {
+            FREE(peer->names[i]);
+            memmove(peer->names + i, peer->names + i + 1,
+                    (peer->nname - i) * sizeof(peer->names[0]));
+            peer->nname--;
+            return;
+        }
+    }
+}
+
+
+/********************
+ * bus_call
+ ********************/
+static int
+bus_call(bus_t *bus, const char *method, const char *arg,
+         DBusPendingCallNotifyFunction notify, void *data,
+         DBusFreeFunction free_data)
+{
+    DBusMessage     *msg;
+    DBusPendingCall *pending = NULL;
+    int              success;
+
+    if (bus == NULL || bus->conn == NULL)
+        return FALSE;
+
+    msg = dbus_message_new_method_call(DBUS_SERVICE_DBUS, DBUS_PATH_DBUS,
+                                       DBUS_INTERFACE_DBUS, method);
+    if (msg == NULL)
+        return FALSE;
+
+    success = (arg == NULL ||
+               dbus_message_append_args(msg, DBUS_TYPE_STRING, &arg,
+                                        DBUS_TYPE_INVALID)) &&
+        dbus_connection_send_with_reply(bus->conn, msg, &pending, -1) &&
+        pending != NULL &&
+        dbus_pending_call_set_notify(pending, notify, data, free_data);
+
+    if (!success && pending != NULL) {
+        dbus_pending_call_cancel(pending);
+        dbus_pending_call_unref(pending);
+    }
+
+    dbus_message_unref(msg);
+
+    return success;
+}
+
+
+/********************
+ * session_bus_event
+ ********************/
+static void
+session_bus_event(bus_t *bus, int event, void *data)
+{
+    (void)data;
+
+    if (event == BUS_EVENT_CONNECTED && bus->peers != NULL) {
+        /* a new bus, nothing we knew about the old one applies */
+        hash_table_destroy(bus->owners);
+        hash_table_destroy(bus->peers);
+
+        if (!peer_tables(bus)) {
+            OHM_ERROR("dbus: failed to create peer cache");
+            return;
+        }
+
+        peer_prime(bus);
+    }
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
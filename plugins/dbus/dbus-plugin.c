@@ -25,11 +25,12 @@ USA.
 static OhmPlugin *dbus_plugin;                /* this plugin */
 
 /* debug flags */
-int DBG_SIGNAL, DBG_METHOD;
+int DBG_SIGNAL, DBG_METHOD, DBG_PEER;
 
 OHM_DEBUG_PLUGIN(dbus,
     OHM_DEBUG_FLAG("signals", "DBUS signal routing", &DBG_SIGNAL),
-    OHM_DEBUG_FLAG("methods", "DBUS method routing", &DBG_METHOD));
+    OHM_DEBUG_FLAG("methods", "DBUS method routing", &DBG_METHOD),
+    OHM_DEBUG_FLAG("peers"  , "DBUS peer cache"    , &DBG_PEER));
 
 
 static void plugin_exit(OhmPlugin *plugin);
@@ -54,6 +55,7 @@ plugin_init(OhmPlugin *plugin)
     retval += watch_init()    * 2;
     retval += method_init()   * 4;
     retval += signal_init()   * 8;
+    retval += peer_init()     * 16;
 
     if (!retval) {
         OHM_ERROR("dbus ERROR: 0x%04x", retval);
@@ -85,6 +87,7 @@ plugin_exit(OhmPlugin *plugin)
                "com.nokia.policy", "NewSession", "s", NULL,
                session_bus_up, NULL);
     
+    peer_exit();
     signal_exit();
     method_exit();
     watch_exit();
@@ -245,6 +248,57 @@ OHM_EXPORTABLE(int, del_watch, (DBusBusType type,
 }
 
 
+/********************
+ * query_peer
+ ********************/
+OHM_EXPORTABLE(int, query_peer, (DBusBusType type, const char *name,
+                                 void (*callback)(const char *, pid_t, uid_t,
+                                                  void *),
+                                 void *data))
+{
+    return peer_query(type, name, callback, data);
+}
+
+
+/********************
+ * lookup_peer
+ ********************/
+OHM_EXPORTABLE(int, lookup_peer, (DBusBusType type, const char *name,
+                                  const char **unique, pid_t *pid, uid_t *uid,
+                                  char ***names))
+{
+    return peer_lookup(type, name, unique, pid, uid, names);
+}
+
+
+/********************
+ * send_message
+ ********************/
+OHM_EXPORTABLE(int, send_message, (DBusBusType type, DBusMessage *msg,
+                                   int flags))
+{
+    return bus_send(type, msg, flags);
+}
+
+
+/********************
+ * batch_begin
+ ********************/
+OHM_EXPORTABLE(void, batch_begin, (DBusBusType type))
+{
+    bus_batch_begin(bus_by_type(type));
+}
+
+
+/********************
+ * batch_end
+ ********************/
+OHM_EXPORTABLE(void, batch_end, (DBusBusType type))
+{
+    bus_batch_end(bus_by_type(type));
+}
+
+
 /*****************************************************************************
  *                            *** OHM plugin glue ***                        *
  *****************************************************************************/
@@ -255,13 +309,18 @@ OHM_PLUGIN_DESCRIPTION(PLUGIN_NAME,
                        OHM_LICENSE_LGPL, /* OHM_LICENSE_LGPL */
                        plugin_init, plugin_exit, NULL);
 
-OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 6,
+OHM_PLUGIN_PROVIDES_METHODS(PLUGIN_PREFIX, 11,
                             OHM_EXPORT(add_method, "add_method"),
                             OHM_EXPORT(del_method, "del_method"),
                             OHM_EXPORT(add_signal, "add_signal"),
                             OHM_EXPORT(del_signal, "del_signal"),
                             OHM_EXPORT(add_watch , "add_watch"),
-                            OHM_EXPORT(del_watch , "del_watch")
+                            OHM_EXPORT(del_watch , "del_watch"),
+                            OHM_EXPORT(query_peer , "query_peer"),
+                            OHM_EXPORT(lookup_peer, "lookup_peer"),
+                            OHM_EXPORT(send_message, "send_message"),
+                            OHM_EXPORT(batch_begin , "batch_begin"),
+                            OHM_EXPORT(batch_end   , "batch_end")
 #if 0
                             OHM_EXPORT(register_name, "register_name"),
                             OHM_EXPORT(release_name , "release_name")
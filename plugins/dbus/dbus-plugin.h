@@ -30,6 +30,8 @@ USA.
 
 #include "mm.h"
 #include "list.h"
+#include "busmatch.h"
+#include "busqueue.h"
 
 #define PLUGIN_PREFIX   dbus
 #define PLUGIN_NAME    "dbus"
@@ -37,12 +39,19 @@ USA.
 
 typedef GHashTable hash_table_t;
 
+typedef struct signode_s signode_t;
+
 typedef struct {
     DBusBusType     type;                  /* DBUS_BUS_{SYSTEM, SESSION} */
     DBusConnection *conn;                  /* connection if it is up */
     hash_table_t   *watches;               /* watched names */
     hash_table_t   *objects;               /* exported objects */
-    hash_table_t   *signals;               /* signals we listen for */
+    hash_table_t   *signals;               /* match rules of our signals */
+    signode_t      *dispatch;              /* signal dispatch trie */
+    busmatch_t     *matches;               /* match rules on the bus */
+    busqueue_t     *outq;                  /* outgoing messages */
+    hash_table_t   *peers;                 /* unique name -> peer */
+    hash_table_t   *owners;                /* well-known name -> peer */
     list_hook_t     notify;                /* bus event watchers */
 } bus_t;
 
@@ -62,6 +71,9 @@ int bus_watch_add(bus_t *bus,
                   void (*callback)(bus_t *, int, void *), void *data);
 int bus_watch_del(bus_t *bus,
                   void (*callback)(bus_t *, int, void *), void *data);
+int  bus_send(DBusBusType type, DBusMessage *msg, int flags);
+void bus_batch_begin(bus_t *bus);
+void bus_batch_end(bus_t *bus);
 
 
 
@@ -106,6 +118,19 @@ int watch_del(DBusBusType type, const char *name,
 
 void watch_bus_up(bus_t *bus);
 
+/* dbus-peer.c */
+typedef void (*peer_cb_t)(const char *name, pid_t pid, uid_t uid, void *data);
+
+int  peer_init(void);
+void peer_exit(void);
+
+int peer_query(DBusBusType type, const char *name, peer_cb_t callback,
+               void *data);
+int peer_lookup(DBusBusType type, const char *name, const char **unique,
+                pid_t *pid, uid_t *uid, char ***names);
+void peer_owner_changed(bus_t *bus, const char *name, const char *previous,
+                        const char *current);
+
 
 /*
  * hash tables (just a wrapper around GHashTable)
@@ -122,6 +147,20 @@ int hash_table_empty(hash_table_t *ht);
 void hash_table_foreach(hash_table_t *ht, GHFunc callback, void *data);
 
 
+/*
+ * interned strings, compared by pointer (dbus-hash.c)
+ */
+
+typedef struct {
+    char *name;                            /* the string itself */
+    int   refcnt;                          /* number of references */
+} atom_t;
+
+atom_t *atom_get(const char *name);
+atom_t *atom_lookup(const char *name);
+void atom_put(atom_t *atom);
+
+
 
 
 #endif /* __OHM_PLUGIN_DBUS_H__ */
@@ -0,0 +1,408 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+
+/*
+ * Benchmark for the signal dispatcher.
+ *
+ * A few hundred handlers (-h) are registered for signals typically seen
+ * on the system bus of a device, with and without path, sender and
+ * interface restrictions. Then a recorded mix of signals is replayed
+ * (-n) through the dispatcher. For reference the same mix is matched by
+ * the linear scan of all handlers the dispatcher used to do; the number
+ * of handler invocations of the two must agree.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "dbus-signal.c"
+
+#define DEFAULT_HANDLERS  500
+#define DEFAULT_SIGNALS   1000000
+#define DIM(a)            (int)(sizeof(a) / sizeof(a[0]))
+
+typedef struct {
+    int         weight;                        /* share in the mix */
+    const char *interface;
+    const char *member;
+    const char *path;
+    const char *sender;
+    const char *signature;
+} record_t;
+
+typedef struct {
+    const char *interface;                     /* NULL matches any */
+    const char *member;
+    const char *path;
+    const char *sender;
+    const char *signature;
+} rule_t;
+
+
+int DBG_SIGNAL;
+
+static bus_t          system_bus;
+static unsigned long  ncall;
+
+/*
+ * the recorded mix of signals
+ */
+
+static record_t mix[] = {
+    { 30, "org.freedesktop.DBus", "NameOwnerChanged",
+      "/org/freedesktop/DBus", "org.freedesktop.DBus", "sss" },
+    { 20, "org.freedesktop.Hal.Device", "PropertyModified",
+      "/org/freedesktop/Hal/devices/computer_power_supply_battery_bme",
+      ":1.4", "is" },
+    { 10, "org.freedesktop.Hal.Device", "Condition",
+      "/org/freedesktop/Hal/devices/platform_headphone", ":1.4", "ss" },
+    { 10, "com.nokia.mce.signal", "display_status_ind",
+      "/com/nokia/mce/signal", ":1.7", "s" },
+    {  8, "com.nokia.mce.signal", "sig_call_state_ind",
+      "/com/nokia/mce/signal", ":1.7", "ss" },
+    {  8, "org.bluez.Headset", "PropertyChanged",
+      "/org/bluez/1234/hci0/dev_00_11_22_33_44_55", ":1.12", "s" },
+    {  6, "org.bluez.AudioSink", "PropertyChanged",
+      "/org/bluez/1234/hci0/dev_00_11_22_33_44_55", ":1.12", "s" },
+    {  4, "org.freedesktop.Telepathy.Connection.Interface.Requests",
+      "NewChannels", "/org/freedesktop/Telepathy/Connection/ring/tel/ring",
+      ":1.31", "s" },
+    {  2, "org.freedesktop.Telepathy.Channel", "Closed",
+      "/org/freedesktop/Telepathy/Connection/ring/tel/ring/incoming1",
+      ":1.31", "" },
+    {  1, "com.nokia.policy", "NewSession", "/com/nokia/policy", ":1.2", "s" },
+    {  1, "com.nokia.policy", "audio_actions", "/com/nokia/policy/decision",
+      ":1.2", "u" },
+    {  5, "org.freedesktop.Tracker1.Resources", "GraphUpdated",
+      "/org/freedesktop/Tracker1/Resources", ":1.40", "s" },
+};
+
+static const char *paths[] = {
+    "/org/freedesktop/DBus",
+    "/org/freedesktop/Hal/devices/computer_power_supply_battery_bme",
+    "/org/freedesktop/Hal/devices/platform_headphone",
+    "/org/freedesktop/Hal/devices/platform_soc_audio_logicaldev_input",
+    "/com/nokia/mce/signal",
+    "/org/bluez/1234/hci0/dev_00_11_22_33_44_55",
+    "/org/bluez/1234/hci0/dev_66_77_88_99_AA_BB",
+    "/org/freedesktop/Telepathy/Connection/ring/tel/ring",
+};
+
+static const char *senders[] = {
+    "org.freedesktop.DBus", ":1.4", ":1.7", ":1.12", ":1.31", ":1.99",
+};
+
+static rule_t *rules;
+static int     nrule;
+
+
+static double now(void);
+static void   register_handlers(int);
+static int    linear_matches(rule_t *, record_t *);
+static DBusHandlerResult handler(DBusConnection *, DBusMessage *, void *);
+
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s [-h handlers] [-n signals] [-s seed]\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int            nhandler = DEFAULT_HANDLERS;
+    int            nsignal  = DEFAULT_SIGNALS;
+    unsigned       seed     = 1;
+    DBusMessage   *msgs[DIM(mix)];
+    DBusMessage   *m;
+    int           *seq;
+    unsigned long  expected;
+    double         start, trie, linear;
+    int            opt, total, i, j, w;
+
+    while ((opt = getopt(argc, argv, "h:n:s:")) != -1) {
+        switch (opt) {
+        case 'h':   nhandler = atoi(optarg);              break;
+        case 'n':   nsignal  = atoi(optarg);              break;
+        case 's':   seed     = strtoul(optarg, NULL, 10); break;
+        default:    usage(argv[0]);
+        }
+    }
+
+    if (nhandler <= 0 || nsignal <= 0)
+        usage(argv[0]);
+
+    srandom(seed);
+
+    system_bus.type = DBUS_BUS_SYSTEM;
+    list_init(&system_bus.notify);
+
+    /* no bus connection to install a filter on, set up the tables only */
+    system_bus.signals  = hash_table_create(NULL, match_purge);
+    system_bus.dispatch = node_create();
+    system_bus.matches  = busmatch_create(NULL);
+
+    /* build the messages of the recorded mix */
+    for (i = 0; i < DIM(mix); i++) {
+        m = dbus_message_new_signal(mix[i].path, mix[i].interface,
+                                    mix[i].member);
+        dbus_message_set_sender(m, mix[i].sender);
+
+        for (j = 0; mix[i].signature[j]; j++) {
+            const char   *s = "x";
+            dbus_uint32_t u = 1;
+
+            if (mix[i].signature[j] == 's')
+                dbus_message_append_args(m, DBUS_TYPE_STRING, &s,
+                                         DBUS_TYPE_INVALID);
+            else if (mix[i].signature[j] == 'i')
+                dbus_message_append_args(m, DBUS_TYPE_INT32, &u,
+                                         DBUS_TYPE_INVALID);
+            else
+                dbus_message_append_args(m, DBUS_TYPE_UINT32, &u,
+                                         DBUS_TYPE_INVALID);
+        }
+
+        msgs[i] = m;
+    }
+
+    /* the sequence to replay, following the weights of the mix */
+    for (i = 0, total = 0; i < DIM(mix); i++)
+        total += mix[i].weight;
+
+    if ((seq = malloc(nsignal * sizeof(*seq))) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (i = 0; i < nsignal; i++) {
+        w = random() % total;
+
+        for (j = 0; w >= mix[j].weight; j++)
+            w -= mix[j].weight;
+
+        seq[i] = j;
+    }
+
+    register_handlers(nhandler);
+
+    /* the dispatcher */
+    ncall = 0;
+    start = now();
+
+    for (i = 0; i < nsignal; i++)
+        signal_dispatch(system_bus.conn, msgs[seq[i]], NULL);
+
+    trie = now() - start;
+
+    /* the linear scan for reference */
+    expected = 0;
+    start    = now();
+
+    for (i = 0; i < nsignal; i++) {
+        for (j = 0; j < nrule; j++)
+            if (linear_matches(rules + j, mix + seq[i]))
+                expected++;
+    }
+
+    linear = now() - start;
+
+    printf("handlers:          %d\n", nhandler);
+    printf("signals:           %d (%d kinds)\n", nsignal, DIM(mix));
+    printf("handler calls:     %lu (linear scan: %lu)\n", ncall, expected);
+    printf("dispatch:          %.1f ns/signal\n", trie * 1.0e9 / nsignal);
+    printf("linear scan:       %.1f ns/signal\n", linear * 1.0e9 / nsignal);
+
+    for (i = 0; i < nrule; i++)
+        signal_del(DBUS_BUS_SYSTEM, rules[i].path, rules[i].interface,
+                   rules[i].member, rules[i].signature, rules[i].sender,
+                   handler, rules + i);
+
+    if (!node_empty(system_bus.dispatch) || atom_lookup(mix[0].member) != NULL)
+        printf("WARNING: dispatch trie not empty after deleting handlers\n");
+
+    signal_exit();
+    busmatch_destroy(system_bus.matches);
+
+    for (i = 0; i < DIM(mix); i++)
+        dbus_message_unref(msgs[i]);
+
+    free(seq);
+    free(rules);
+
+    return ncall == expected ? 0 : 1;
+}
+
+
+/*
+ * register handlers with various restrictions for the signals of the mix
+ * and for signals that never show up
+ */
+
+static void register_handlers(int n)
+{
+    record_t *r;
+    rule_t   *rule;
+    int       i;
+
+    if ((rules = calloc(n, sizeof(*rules))) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    for (i = 0; i < n; i++) {
+        r    = mix + random() % DIM(mix);
+        rule = rules + i;
+
+        rule->interface = r->interface;
+        rule->member    = r->member;
+
+        switch (random() % 8) {
+        case 0:                                 /* any interface */
+            rule->interface = NULL;
+            break;
+        case 1: case 2:                         /* some path */
+            rule->path = paths[random() % DIM(paths)];
+            break;
+        case 3:                                 /* some sender */
+            rule->sender = senders[random() % DIM(senders)];
+            break;
+        case 4:                                 /* never emitted */
+            rule->member = "NeverEmitted";
+            break;
+        default:
+            break;
+        }
+
+        if (random() % 4 == 0)
+            rule->signature = r->signature;
+
+        nrule++;
+
+        if (!signal_add(DBUS_BUS_SYSTEM, rule->path, rule->interface,
+                        rule->member, rule->signature, rule->sender,
+                        handler, rule)) {
+            fprintf(stderr, "failed to add signal handler #%d\n", i);
+            exit(1);
+        }
+    }
+}
+
+static int linear_matches(rule_t *rule, record_t *r)
+{
+#define MATCHES(field) (!rule->field || !strcmp(rule->field, r->field))
+    return MATCHES(interface) && MATCHES(member) && MATCHES(path) &&
+        MATCHES(sender) && MATCHES(signature);
+#undef MATCHES
+}
+
+static DBusHandlerResult handler(DBusConnection *c, DBusMessage *msg,
+                                 void *data)
+{
+    (void)c;
+    (void)msg;
+    (void)data;
+
+    ncall++;
+
+    return DBUS_HANDLER_RESULT_HANDLED;
+}
+
+
+/*
+ * dbus-bus.c stand-ins
+ */
+
+bus_t *bus_by_type(DBusBusType type)
+{
+    return type == DBUS_BUS_SYSTEM ? &system_bus : NULL;
+}
+
+bus_t *bus_by_connection(DBusConnection *conn)
+{
+    (void)conn;
+
+    return &system_bus;
+}
+
+int bus_watch_add(bus_t *bus, void (*callback)(bus_t *, int, void *),
+                  void *data)
+{
+    (void)bus;
+    (void)callback;
+    (void)data;
+
+    return TRUE;
+}
+
+int bus_watch_del(bus_t *bus, void (*callback)(bus_t *, int, void *),
+                  void *data)
+{
+    (void)bus;
+    (void)callback;
+    (void)data;
+
+    return TRUE;
+}
+
+void bus_batch_begin(bus_t *bus)
+{
+    (void)bus;
+}
+
+void bus_batch_end(bus_t *bus)
+{
+    (void)bus;
+}
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level == OHM_LOG_ERROR) {
+        va_start(ap, format);
+        vfprintf(stderr, format, ap);
+        fputs("\n", stderr);
+        va_end(ap);
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -27,14 +27,42 @@ extern int DBG_SIGNAL;                         /* debug flag for signals */
 
 
 /*
- * a list of signal handlers (with the same hash key)
+ * Signal handlers are kept in a per-bus dispatch trie with one level for
+ * each of interface, member, path and sender. Every level has a child for
+ * each value some handler asks for and a wildcard child for the handlers
+ * that do not care. The values are interned into atoms, so a node can be
+ * looked up by a pointer instead of comparing or formatting strings and
+ * an incoming signal costs a single walk down the trie.
+ */
+
+enum {
+    LEVEL_INTERFACE = 0,
+    LEVEL_MEMBER,
+    LEVEL_PATH,
+    LEVEL_SENDER,
+    LEVEL_MAX
+};
+
+
+/*
+ * a node of the dispatch trie
+ */
+
+struct signode_s {
+    GHashTable  *children;                     /* atom -> child node */
+    signode_t   *any;                          /* wildcard child */
+    list_hook_t  signals;                      /* handlers (at the leaves) */
+};
+
+
+/*
+ * a D-BUS match rule (shared by handlers asking for the same signals)
  */
 
 typedef struct {
-    char        *key;                          /* signal lookup key */
-    char        *rule;                         /* signal D-BUS match rule */
-    list_hook_t  signals;                      /* signal handlers */
-} siglist_t;
+    char *rule;                                /* signal D-BUS match rule */
+    int   refcnt;                              /* number of handlers */
+} match_t;
 
 
 /*
@@ -42,27 +70,48 @@ typedef struct {
  */
 
 typedef struct {
-    char                          *signature;  /* expected signature if any */
-    char                          *path;       /* expected path if any */
-    char                          *sender;     /* expected sender if any */
+    bus_t                         *bus;        /* bus we listen on */
+    atom_t                        *atoms[LEVEL_MAX]; /* where in the trie */
+    atom_t                        *signature;  /* expected signature if any */
+    match_t                       *match;      /* match rule on the bus */
     DBusObjectPathMessageFunction  handler;    /* signal handler */
     void                          *data;       /* opaque handler data */
+    int                            dead;       /* deleted while dispatching */
     list_hook_t                    hook;       /* more handlers */
 } signal_t;
 
 
+/*
+ * dispatching state of a signal
+ */
+
+typedef struct {
+    DBusConnection *conn;                      /* connection of the signal */
+    DBusMessage    *msg;                       /* the signal itself */
+    atom_t         *signature;                 /* signature atom if any */
+    int             handled;                   /* handled by someone */
+} dispatch_t;
+
+
+static int         dispatching;                /* dispatch nesting level */
+static int         purge_needed;               /* handlers died meanwhile */
+
 static int signal_add_filter(bus_t *bus);
 static void signal_del_filter(bus_t *bus);
 static DBusHandlerResult signal_dispatch(DBusConnection *c, DBusMessage *msg,
                                          void *data);
 
-static siglist_t *siglist_add(bus_t *bus, const char *key, const char *rule);
-static int        siglist_del(bus_t *bus, siglist_t *siglist);
-static siglist_t *siglist_lookup(bus_t *bus, const char *key);
-static void siglist_purge(void *ptr);
+static signode_t *node_create(void);
+static void       node_destroy(void *ptr);
+static signode_t *node_find(signode_t *node, atom_t **keys, int create);
+static int        node_prune(signode_t *node, atom_t **keys, int level);
+static int        node_purge(signode_t *node, int level);
+static void       node_dispatch(signode_t *node, atom_t **keys, int level,
+                                dispatch_t *d);
 
-static void siglist_add_match(bus_t *bus, siglist_t *siglist);
-static void siglist_del_match(bus_t *bus, siglist_t *siglist);
+static match_t *match_get(bus_t *bus, const char *rule);
+static void     match_put(bus_t *bus, match_t *match);
+static void     match_purge(void *ptr);
 
 static void session_bus_event(bus_t *, int, void *);
 
@@ -78,9 +127,10 @@ signal_init(void)
     system  = bus_by_type(DBUS_BUS_SYSTEM);
 
     if (system != NULL) {
-        system->signals  = hash_table_create(NULL, siglist_purge);
+        system->signals  = hash_table_create(NULL, match_purge);
+        system->dispatch = node_create();
         
-        if (system->signals == NULL) {
+        if (system->signals == NULL || system->dispatch == NULL) {
             OHM_ERROR("dbus: failed to create signal tables");
             signal_exit();
             return FALSE;
@@ -97,9 +147,10 @@ signal_init(void)
     session = bus_by_type(DBUS_BUS_SESSION);
 
     if (session != NULL) {
-        session->signals = hash_table_create(NULL, siglist_purge);
+        session->signals  = hash_table_create(NULL, match_purge);
+        session->dispatch = node_create();
 
-        if (session->signals == NULL) {
+        if (session->signals == NULL || session->dispatch == NULL) {
             OHM_ERROR("dbus: failed to create signal tables");
             signal_exit();
             return FALSE;
@@ -131,6 +182,11 @@ signal_exit(void)
     if (system != NULL) {
         signal_del_filter(system);
 
+        if (system->dispatch) {
+            node_destroy(system->dispatch);
+            system->dispatch = NULL;
+        }
+
         if (system->signals) {
             hash_table_destroy(system->signals);
             system->signals = NULL;
@@ -142,6 +198,11 @@ signal_exit(void)
 
         bus_watch_del(session, session_bus_event, NULL);
 
+        if (session->dispatch) {
+            node_destroy(session->dispatch);
+            session->dispatch = NULL;
+        }
+
         if (session->signals) {
             hash_table_destroy(session->signals);
             session->signals = NULL;
@@ -176,20 +237,6 @@ signal_del_filter(bus_t *bus)
 }
 
 
-/********************
- * signal_key
- ********************/
-static inline char *
-signal_key(char *buf, size_t size, const char *interface, const char *member)
-{
-    snprintf(buf, size, "%s.%s",
-             interface ? interface : "",
-             member    ? member    : "");
-    
-    return buf;
-}
-
-
 /********************
  * signal_rule
  ********************/
@@ -197,7 +244,8 @@ static inline char *
 signal_rule(char *buf, size_t size,
             const char *interface, const char *member, const char *path)
 {
-    int n;
+    char *rule = buf;
+    int   n;
 
     n = snprintf(buf, size, "type='signal'");
     if (n < 0 || n >= (int)size)
@@ -220,25 +268,11 @@ signal_rule(char *buf, size_t size,
     MATCH(member);
     MATCH(path);
 
-    return buf;
+    return rule;
 
  overflow:
     OHM_WARNING("dbus: insufficient buffer space for match rule");
-    return buf;
-}
-
-
-/********************
- * signal_matches
- ********************/
-static inline int
-signal_matches(signal_t *sig, const char *signature, const char *path,
-               const char *sender)
-{
-
-#define MATCHES(field) (!sig->field || !field || !strcmp(sig->field, field))
-    return MATCHES(signature) && MATCHES(path) && MATCHES(sender);
-#undef MATCHES
+    return rule;
 }
 
 
@@ -248,10 +282,16 @@ signal_matches(signal_t *sig, const char *signature, const char *path,
 static void
 signal_purge(signal_t *sig)
 {
+    int i;
+
     if (sig) {
-        FREE(sig->signature);
-        FREE(sig->path);
-        FREE(sig->sender);
+        for (i = 0; i < LEVEL_MAX; i++)
+            atom_put(sig->atoms[i]);
+        atom_put(sig->signature);
+
+        if (sig->match != NULL)
+            match_put(sig->bus, sig->match);
+
         FREE(sig);
     }
 }
@@ -267,33 +307,36 @@ signal_add(DBusBusType type, const char *path, const char *interface,
 {
     bus_t      *bus;
     signal_t   *sig;
-    siglist_t  *siglist;
-    char        key[1024], rule[1024];
+    signode_t  *leaf;
+    char        rule[1024];
 
-    if ((bus = bus_by_type(type)) == NULL)
+    if ((bus = bus_by_type(type)) == NULL || bus->dispatch == NULL)
         return FALSE;
 
     if (ALLOC_OBJ(sig) == NULL)
         return FALSE;
     
     list_init(&sig->hook);
-    sig->signature = signature ? STRDUP(signature) : NULL;
-    sig->path      = path      ? STRDUP(path)      : NULL;
-    sig->sender    = sender    ? STRDUP(sender)    : NULL;
-    sig->handler   = handler;
-    sig->data      = data;
+    sig->bus     = bus;
+    sig->handler = handler;
+    sig->data    = data;
 
-    signal_key(key, sizeof(key), interface, member);
     signal_rule(rule, sizeof(rule), interface, member, path);
 
-    if ((siglist = siglist_lookup(bus, key))    == NULL &&
-        (siglist = siglist_add(bus, key, rule)) == NULL) {
+    if ((interface && !(sig->atoms[LEVEL_INTERFACE] = atom_get(interface))) ||
+        (member    && !(sig->atoms[LEVEL_MEMBER]    = atom_get(member)))    ||
+        (path      && !(sig->atoms[LEVEL_PATH]      = atom_get(path)))      ||
+        (sender    && !(sig->atoms[LEVEL_SENDER]    = atom_get(sender)))    ||
+        (signature && !(sig->signature              = atom_get(signature))) ||
+        (sig->match = match_get(bus, rule)) == NULL                         ||
+        (leaf = node_find(bus->dispatch, sig->atoms, TRUE)) == NULL) {
+        node_prune(bus->dispatch, sig->atoms, 0);
         signal_purge(sig);
         OHM_WARNING("dbus: error setting the signal match");
         return FALSE;
     }
         
-    list_append(&siglist->signals, &sig->hook);
+    list_append(&leaf->signals, &sig->hook);
     return TRUE;
 }
 
@@ -307,33 +350,50 @@ signal_del(DBusBusType type, const char *path, const char *interface,
            DBusObjectPathMessageFunction handler, void *data)
 {
     bus_t       *bus;
-    siglist_t   *siglist;
+    signode_t   *leaf;
     signal_t    *sig;
+    atom_t      *keys[LEVEL_MAX], *sigatom;
     list_hook_t *p, *n;
-    char         key[1024];
 
-    (void)sender;
+    if ((bus = bus_by_type(type)) == NULL || bus->dispatch == NULL)
+        return FALSE;
 
-    if ((bus = bus_by_type(type)) == NULL)
+    keys[LEVEL_INTERFACE] = interface ? atom_lookup(interface) : NULL;
+    keys[LEVEL_MEMBER]    = member    ? atom_lookup(member)    : NULL;
+    keys[LEVEL_PATH]      = path      ? atom_lookup(path)      : NULL;
+    keys[LEVEL_SENDER]    = sender    ? atom_lookup(sender)    : NULL;
+    sigatom               = signature ? atom_lookup(signature) : NULL;
+
+    if ((interface && !keys[LEVEL_INTERFACE]) ||
+        (member    && !keys[LEVEL_MEMBER])    ||
+        (path      && !keys[LEVEL_PATH])      ||
+        (sender    && !keys[LEVEL_SENDER]))
         return FALSE;
 
-    signal_key(key, sizeof(key), interface, member);
+    if ((leaf = node_find(bus->dispatch, keys, FALSE)) == NULL)
+        return FALSE;
 
-    if ((siglist = siglist_lookup(bus, key)) != NULL) {
-        list_foreach(&siglist->signals, p, n) {
-            sig = list_entry(p, signal_t, hook);
+    list_foreach(&leaf->signals, p, n) {
+        sig = list_entry(p, signal_t, hook);
 
-            if (signal_matches(sig, signature, path, sender) &&
-                sig->handler == handler && sig->data == data) {
-                list_delete(&sig->hook);
-                signal_purge(sig);
-                
-                if (list_empty(&siglist->signals))
-                    siglist_del(bus, siglist);
-    
-                return TRUE;
-            }
+        if (sig->dead || sig->handler != handler || sig->data != data)
+            continue;
+
+        if (signature && sig->signature && sig->signature != sigatom)
+            continue;
+
+        if (dispatching) {
+            /* the handler list may be walked right now, just mark it */
+            sig->dead    = TRUE;
+            purge_needed = TRUE;
+        }
+        else {
+            list_delete(&sig->hook);
+            node_prune(bus->dispatch, sig->atoms, 0);
+            signal_purge(sig);
         }
+        
+        return TRUE;
     }
 
     return FALSE;
@@ -346,174 +406,321 @@ signal_del(DBusBusType type, const char *path, const char *interface,
 static DBusHandlerResult
 signal_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
 {
-    const char   *path      = dbus_message_get_path(msg);
-    const char   *interface = dbus_message_get_interface(msg);
-    const char   *member    = dbus_message_get_member(msg);
-    const char   *signature = dbus_message_get_signature(msg);
-    const char   *sender    = dbus_message_get_sender(msg);
-    bus_t        *bus       = bus_by_connection(c);
-    siglist_t    *siglist;
-    signal_t     *sig;
-    
-    char          key[1024];
-    list_hook_t  *p, *n;
-    int           handled;
+    bus_t        *bus = bus_by_connection(c);
+    atom_t       *keys[LEVEL_MAX];
+    dispatch_t    d;
+    const char   *path, *interface, *member, *signature, *sender;
+    bus_t        *system, *session;
     
     (void)data;
 
-    if (bus == NULL)
+    if (bus == NULL || bus->dispatch == NULL)
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    OHM_DEBUG(DBG_SIGNAL, "got signal %s.%s(%s) from %s/%s",
-              interface, member, signature, sender, path ? path : "-");
+    if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    handled = FALSE;
-    
-    signal_key(key, sizeof(key), interface, member);
+    path      = dbus_message_get_path(msg);
+    interface = dbus_message_get_interface(msg);
+    member    = dbus_message_get_member(msg);
+    signature = dbus_message_get_signature(msg);
+    sender    = dbus_message_get_sender(msg);
 
-    if ((siglist = siglist_lookup(bus, key)) != NULL) {
-        list_foreach(&siglist->signals, p, n) {
-            sig = list_entry(p, signal_t, hook);
-            
-            if (signal_matches(sig, signature, path, sender)) {
-                OHM_DEBUG(DBG_SIGNAL, "routing to handler %s %p",
-                          key, sig->handler);
-                
-                handled |= sig->handler(c, msg, sig->data);
-            }
-        }
-    }
-    
-    signal_key(key, sizeof(key), NULL, member);
+    OHM_DEBUG(DBG_SIGNAL, "got signal %s.%s(%s) from %s/%s",
+              interface, member, signature, sender, path ? path : "-");
 
-    if ((siglist = siglist_lookup(bus, key)) != NULL) {
-        list_foreach(&siglist->signals, p, n) {
-            sig = list_entry(p, signal_t, hook);
-            
-            if (signal_matches(sig, signature, path, sender)) {
-                OHM_DEBUG(DBG_SIGNAL, "routing to handler %s %p",
-                          key, sig->handler);
-                
-                handled |= sig->handler(c, msg, sig->data);
-            }
-        }
+    /* a string nobody asked for can only match the wildcards */
+    keys[LEVEL_INTERFACE] = interface ? atom_lookup(interface) : NULL;
+    keys[LEVEL_MEMBER]    = member    ? atom_lookup(member)    : NULL;
+    keys[LEVEL_PATH]      = path      ? atom_lookup(path)      : NULL;
+    keys[LEVEL_SENDER]    = sender    ? atom_lookup(sender)    : NULL;
+
+    d.conn      = c;
+    d.msg       = msg;
+    d.signature = signature ? atom_lookup(signature) : NULL;
+    d.handled   = FALSE;
+
+    bus_batch_begin(bus);
+    dispatching++;
+    node_dispatch(bus->dispatch, keys, 0, &d);
+    dispatching--;
+    bus_batch_end(bus);
+
+    if (!dispatching && purge_needed) {
+        purge_needed = FALSE;
+
+        /* handlers may have been deleted on the other bus as well */
+        if ((system = bus_by_type(DBUS_BUS_SYSTEM)) && system->dispatch)
+            node_purge(system->dispatch, 0);
+        if ((session = bus_by_type(DBUS_BUS_SESSION)) && session->dispatch)
+            node_purge(session->dispatch, 0);
     }
     
-    if (handled)
+    if (d.handled)
         OHM_DEBUG(DBG_SIGNAL, "signal was handled by some handlers");
     
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;     /* let through to others */
-    
-#undef INVOKE_HANDLER
-#undef INVOKE_MATCHING
 }
 
 
 /********************
- * siglist_add
+ * node_create
+ ********************/
+static signode_t *
+node_create(void)
+{
+    signode_t *node;
+
+    if (ALLOC_OBJ(node) != NULL)
+        list_init(&node->signals);
+
+    return node;
+}
+
+
+/********************
+ * node_empty
  ********************/
-static siglist_t *
-siglist_add(bus_t *bus, const char *key, const char *rule)
+static inline int
+node_empty(signode_t *node)
 {
-    siglist_t *siglist;
+    return (node->children == NULL || g_hash_table_size(node->children) == 0)
+        && node->any == NULL && list_empty(&node->signals);
+}
+
 
-    if (ALLOC_OBJ(siglist) == NULL)
-        return NULL;
+/********************
+ * node_destroy
+ ********************/
+static void
+node_destroy(void *ptr)
+{
+    signode_t   *node = (signode_t *)ptr;
+    list_hook_t *p, *n;
+    signal_t    *sig;
+
+    if (node == NULL)
+        return;
 
-    list_init(&siglist->signals);
+    if (node->children != NULL)
+        g_hash_table_destroy(node->children);
 
-    if ((siglist->key  = STRDUP(key))  == NULL ||
-        (siglist->rule = STRDUP(rule)) == NULL ||
-        !hash_table_insert(bus->signals, siglist->key, siglist)) {
-        siglist_purge(siglist);
-        return NULL;
+    node_destroy(node->any);
+
+    list_foreach(&node->signals, p, n) {
+        sig = list_entry(p, signal_t, hook);
+        list_delete(p);
+        signal_purge(sig);
     }
 
-    siglist_add_match(bus, siglist);
+    FREE(node);
+}
+
+
+/********************
+ * node_find
+ ********************/
+static signode_t *
+node_find(signode_t *node, atom_t **keys, int create)
+{
+    signode_t *child;
+    int        level;
 
-    return siglist;
+    for (level = 0; level < LEVEL_MAX; level++, node = child) {
+        if (keys[level] == NULL) {
+            if ((child = node->any) == NULL && create)
+                child = node->any = node_create();
+        }
+        else {
+            child = NULL;
+
+            if (node->children != NULL)
+                child = g_hash_table_lookup(node->children, keys[level]);
+            else if (create)
+                node->children = g_hash_table_new_full(g_direct_hash,
+                                                       g_direct_equal,
+                                                       NULL, node_destroy);
+            
+            if (child == NULL && create && node->children != NULL) {
+                if ((child = node_create()) != NULL)
+                    g_hash_table_insert(node->children, keys[level], child);
+            }
+        }
+
+        if (child == NULL)
+            return NULL;
+    }
+
+    return node;
 }
 
 
 /********************
- * siglist_del
+ * node_prune
  ********************/
 static int
-siglist_del(bus_t *bus, siglist_t *siglist)
+node_prune(signode_t *node, atom_t **keys, int level)
 {
-    siglist_del_match(bus, siglist);
-    return hash_table_remove(bus->signals, siglist->key);
+    signode_t *child;
+
+    if (level < LEVEL_MAX) {
+        if (keys[level] == NULL) {
+            if (node->any != NULL && node_prune(node->any, keys, level + 1)) {
+                node_destroy(node->any);
+                node->any = NULL;
+            }
+        }
+        else if (node->children != NULL) {
+            child = g_hash_table_lookup(node->children, keys[level]);
+
+            if (child != NULL && node_prune(child, keys, level + 1))
+                g_hash_table_remove(node->children, keys[level]);
+        }
+    }
+
+    return node_empty(node);
 }
 
 
 /********************
- * siglist_lookup
+ * purge_child
  ********************/
-static siglist_t *
-siglist_lookup(bus_t *bus, const char *key)
+static gboolean
+purge_child(gpointer key, gpointer value, gpointer data)
 {
-    return hash_table_lookup(bus->signals, key);
+    (void)key;
+
+    return node_purge((signode_t *)value, GPOINTER_TO_INT(data));
 }
 
 
 /********************
- * siglist_purge
+ * node_purge
  ********************/
-static void
-siglist_purge(void *ptr)
+static int
+node_purge(signode_t *node, int level)
 {
-    siglist_t   *siglist = (siglist_t *)ptr;
     list_hook_t *p, *n;
     signal_t    *sig;
 
-    if (siglist) {
-        list_foreach(&siglist->signals, p, n) {
-            list_delete(p);
-            sig = list_entry(p, signal_t, hook);
-            signal_purge(sig);
+    if (level < LEVEL_MAX) {
+        if (node->children != NULL)
+            g_hash_table_foreach_remove(node->children, purge_child,
+                                        GINT_TO_POINTER(level + 1));
+
+        if (node->any != NULL && node_purge(node->any, level + 1)) {
+            node_destroy(node->any);
+            node->any = NULL;
         }
+    }
+    else {
+        list_foreach(&node->signals, p, n) {
+            sig = list_entry(p, signal_t, hook);
 
-        FREE(siglist->key);
-        FREE(siglist->rule);
-        FREE(siglist);
+            if (sig->dead) {
+                list_delete(p);
+                signal_purge(sig);
+            }
+        }
     }
+
+    return node_empty(node);
 }
 
 
 /********************
- * siglist_add_match
+ * node_dispatch
  ********************/
-void
-siglist_add_match(bus_t *bus, siglist_t *siglist)
+static void
+node_dispatch(signode_t *node, atom_t **keys, int level, dispatch_t *d)
 {
-    if (bus->conn)
-        dbus_bus_add_match(bus->conn, siglist->rule, NULL);
+    signode_t   *child;
+    signal_t    *sig;
+    list_hook_t *p, *n;
+
+    if (level == LEVEL_MAX) {
+        list_foreach(&node->signals, p, n) {
+            sig = list_entry(p, signal_t, hook);
+
+            if (sig->dead)
+                continue;
+
+            if (sig->signature != NULL && sig->signature != d->signature)
+                continue;
+
+            OHM_DEBUG(DBG_SIGNAL, "routing to handler %p", sig->handler);
+                
+            d->handled |= sig->handler(d->conn, d->msg, sig->data);
+        }
+
+        return;
+    }
+
+    if (keys[level] != NULL && node->children != NULL &&
+        (child = g_hash_table_lookup(node->children, keys[level])) != NULL)
+        node_dispatch(child, keys, level + 1, d);
+
+    if (node->any != NULL)
+        node_dispatch(node->any, keys, level + 1, d);
 }
 
 
 /********************
- * siglist_del_match
+ * match_get
  ********************/
-void
-siglist_del_match(bus_t *bus, siglist_t *siglist)
+static match_t *
+match_get(bus_t *bus, const char *rule)
 {
-    if (bus->conn && siglist->rule)
-        dbus_bus_remove_match(bus->conn, siglist->rule, NULL);
+    match_t *match;
+
+    if ((match = hash_table_lookup(bus->signals, rule)) == NULL) {
+        if (ALLOC_OBJ(match) == NULL)
+            return NULL;
+
+        if ((match->rule = STRDUP(rule)) == NULL ||
+            !hash_table_insert(bus->signals, match->rule, match)) {
+            match_purge(match);
+            return NULL;
+        }
+
+        busmatch_add(bus->matches, match->rule, NULL, NULL);
+    }
+
+    match->refcnt++;
+
+    return match;
 }
 
 
 /********************
- * add_match
+ * match_put
  ********************/
 static void
-add_match(gpointer key, gpointer value, gpointer data)
+match_put(bus_t *bus, match_t *match)
 {
-    siglist_t *siglist = (siglist_t *)value;
-    bus_t     *bus     = (bus_t *)data;
+    if (--match->refcnt <= 0) {
+        if (bus == NULL || bus->signals == NULL)
+            match_purge(match);
+        else {
+            busmatch_del(bus->matches, match->rule);
+            hash_table_remove(bus->signals, match->rule);
+        }
+    }
+}
 
-    (void)key;
 
-    siglist_add_match(bus, siglist);
+/********************
+ * match_purge
+ ********************/
+static void
+match_purge(void *ptr)
+{
+    match_t *match = (match_t *)ptr;
+
+    if (match) {
+        FREE(match->rule);
+        FREE(match);
+    }
 }
 
 
@@ -525,10 +732,8 @@ session_bus_event(bus_t *bus, int event, void *data)
 {
     (void)data;
     
-    if (event == BUS_EVENT_CONNECTED) {
+    if (event == BUS_EVENT_CONNECTED)
         signal_add_filter(bus);
-        hash_table_foreach(bus->signals, add_match, bus);
-    }
 }
 
 
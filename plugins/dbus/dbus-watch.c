@@ -298,22 +298,11 @@ watch_rule(char *buf, size_t size, const char *name)
 static int
 watchlist_add_match(bus_t *bus, watchlist_t *watchlist)
 {
-    DBusError err;
-    char      rule[1024];
-
-    if (!bus->conn)
-        return TRUE;                         /* will retry once connected */
+    char rule[1024];
 
     watch_rule(rule, sizeof(rule), watchlist->name);
-    dbus_bus_add_match(bus->conn, rule, &err);
-
-    if (dbus_error_is_set(&err)) {
-        OHM_ERROR("dbus: failed to add match \"%s\" (%s)", rule, err.message);
-        dbus_error_free(&err);
-        return FALSE;
-    }
 
-    return TRUE;
+    return busmatch_add(bus->matches, rule, NULL, NULL);
 }
 
 
@@ -325,13 +314,9 @@ watchlist_del_match(bus_t *bus, watchlist_t *watchlist)
 {
     char rule[1024];
 
-    if (!bus->conn)
-        return TRUE;
-
     watch_rule(rule, sizeof(rule), watchlist->name);
-    dbus_bus_remove_match(bus->conn, rule, NULL);
 
-    return TRUE;
+    return busmatch_del(bus->matches, rule);
 }
 
 
@@ -367,6 +352,10 @@ watch_dispatch(DBusConnection *c, DBusMessage *msg, void *data)
         return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
     }
 
+    /* only the daemon can tell, do not let anyone spoof the peer cache */
+    if (dbus_message_has_sender(msg, DBUS_SERVICE_DBUS))
+        peer_owner_changed(bus, name, previous, current);
+
     if ((watchlist = watchlist_lookup(bus, name)) != NULL) {
         list_foreach(&watchlist->watches, p, n) {
             watch = list_entry(p, watch_t, hook);
@@ -402,21 +391,6 @@ watchlist_del_filter(bus_t *bus)
 }
 
 
-/********************
- * add_match
- ********************/
-static void
-add_match(gpointer key, gpointer value, gpointer data)
-{
-    watchlist_t *watchlist = (watchlist_t *)value;
-    bus_t       *bus       = (bus_t *)data;
-    
-    (void)key;
-
-    watchlist_add_match(bus, watchlist);
-}
-
-
 /********************
  * session_bus_event
  ********************/
@@ -425,10 +399,8 @@ session_bus_event(bus_t *bus, int event, void *data)
 {
     (void)data;
     
-    if (event == BUS_EVENT_CONNECTED) {
+    if (event == BUS_EVENT_CONNECTED)
         watchlist_add_filter(bus);
-        hash_table_foreach(bus->watches, add_match, bus);
-    }
 }
 
 
@@ -40,6 +40,7 @@ USA.
 #include "fsif.h"
 #include "request.h"
 #include "timer.h"
+#include "snapshot.h"
 
 
 static int DBG_REQUEST, DBG_TIMER, DBG_EVENT, DBG_FS;
@@ -62,6 +63,7 @@ static void plugin_init(OhmPlugin *plugin)
     fsif_init(plugin);
     request_init(plugin);
     timer_init(plugin);
+    snapshot_init(plugin);
 }
 
 
@@ -69,6 +71,8 @@ static void plugin_exit(OhmPlugin *plugin)
 {
     OHM_INFO("delay: exit ...");
 
+    snapshot_exit(plugin);
+    timer_exit(plugin);
     fsif_exit(plugin);
 }
 
@@ -78,10 +82,12 @@ static void plugin_exit(OhmPlugin *plugin)
 #include "fsif.c"
 #include "request.c"
 #include "timer.c"
+#include "snapshot.c"
 
-OHM_PLUGIN_PROVIDES_METHODS(delay, 2,
+OHM_PLUGIN_PROVIDES_METHODS(delay, 3,
     OHM_EXPORT(delay_execution, "delay_execution"),
-    OHM_EXPORT(delay_cancel   , "delay_cancel")
+    OHM_EXPORT(delay_cancel   , "delay_cancel"),
+    OHM_EXPORT(delay_export   , "delay_export")
 );
 
 
@@ -27,23 +27,23 @@ OHM_EXPORTABLE(int, delay_execution, (unsigned long delay, char *id,
                                       int restart, char *cb_name,delay_cb_t cb,
                                       char *argt, void **argv))
 {
-    fsif_entry_t *entry;
-    int           success;
+    delay_timer_t *timer;
+    int            success;
 
     OHM_DEBUG(DBG_REQUEST, "%s(delay=%u id='%s', restart=%d, cb='%s', "
               "argt='%s', argv=%p)", __FUNCTION__, delay, id, restart,
               cb_name, argt, argv);
 
-    entry = timer_lookup(id);
+    timer = timer_lookup(id);
 
     if (restart) {
-        if (entry == NULL)
+        if (timer == NULL)
             success = timer_add(id, delay, cb_name,cb, argt,argv);
         else
-            success = timer_restart(entry, delay, cb_name,cb, argt,argv);
+            success = timer_restart(timer, delay, cb_name,cb, argt,argv);
     }
     else {
-        if (entry == NULL)
+        if (timer == NULL)
             success = timer_add(id, delay, cb_name,cb, argt,argv);
         else
             success = FALSE;
@@ -54,20 +54,27 @@ OHM_EXPORTABLE(int, delay_execution, (unsigned long delay, char *id,
 
 OHM_EXPORTABLE(int, delay_cancel, (char *id))
 {
-    fsif_entry_t *entry;
-    int           success;
+    delay_timer_t *timer;
+    int            success;
 
     OHM_DEBUG(DBG_REQUEST, "%s(id='%s')", __FUNCTION__, id);
 
-    if ((entry = timer_lookup(id)) == NULL)
+    if ((timer = timer_lookup(id)) == NULL)
         success = FALSE;
     else
-        success = timer_stop(entry);
+        success = timer_stop(timer);
 
 
     return success;
 }
 
+OHM_EXPORTABLE(int, delay_export, (void))
+{
+    OHM_DEBUG(DBG_REQUEST, "%s()", __FUNCTION__);
+
+    return timer_export();
+}
+
 
 /* 
  * Local Variables:
@@ -0,0 +1,547 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Active timers are saved to a snapshot file so that an ohmd restart
+ * does not lose them. The file is rewritten at most once in every
+ * snapshot-interval seconds, and only if the timers changed since the
+ * last write. It is built in a buffer that is kept between snapshots,
+ * written with a single write() and renamed over the previous one.
+ *
+ * Expiry is saved as wall clock time, since the monotonic clock does
+ * not survive a reboot. On startup the timers are restored with the
+ * delay that remains, and overdue timers run right away unless they are
+ * overdue by more than snapshot-max-stale seconds; those are dropped,
+ * as acting on them that late would do more harm than good. The restore
+ * is done in one go from the main loop, so that the callbacks, which
+ * are looked up by name, can live in plugins loaded after us.
+ *
+ * A timer record is, in host byte order:
+ *
+ *     uint64   expiry in msecs since the epoch
+ *     uint8    number of arguments
+ *     uint8    length of the id, with the terminating zero
+ *     uint8    length of the callback name, with the terminating zero
+ *     char     signature, 's' or 'i' for each argument
+ *     char     id
+ *     char     callback name
+ *
+ * followed by an int32 for an integer argument, or a uint16 length,
+ * again with the terminating zero, and the bytes of a string one.
+ */
+
+typedef struct {
+    unsigned char *data;
+    size_t         size;
+    size_t         used;
+} snapshot_buf_t;
+
+static char           *snapshot_path;
+static unsigned int    snapshot_interval = SNAPSHOT_INTERVAL;
+static unsigned int    snapshot_max_stale = SNAPSHOT_MAX_STALE;
+static guint           snapshot_srcid;
+static guint           restore_srcid;
+static int             snapshot_dirty;
+static snapshot_buf_t  snapshot_buf;
+
+static int      snapshot_write(void);
+static gboolean snapshot_cb(gpointer);
+static void     snapshot_restore(void);
+static gboolean restore_cb(gpointer);
+static int      restore_timer(unsigned char **, unsigned char *, uint64_t,
+                              uint64_t);
+static int      put_timer(snapshot_buf_t *, delay_timer_t *, uint64_t);
+static int      reserve(snapshot_buf_t *, size_t);
+static void     put(snapshot_buf_t *, const void *, size_t);
+static int      get(unsigned char **, unsigned char *, void *, size_t);
+static char    *get_string(unsigned char **, unsigned char *, size_t);
+
+
+static void snapshot_init(OhmPlugin *plugin)
+{
+    const char    *path;
+    const char    *interval;
+    const char    *stale;
+    char          *end;
+    unsigned long  val;
+
+    if ((path = ohm_plugin_get_param(plugin, "snapshot-file")) == NULL)
+        path = SNAPSHOT_PATH;
+
+    if (!path[0] || !strcmp(path, "none")) {
+        OHM_INFO("delay: timer snapshots disabled");
+        return;
+    }
+
+    if ((interval = ohm_plugin_get_param(plugin, "snapshot-interval"))) {
+        val = strtoul(interval, &end, 10);
+
+        if (*end || val == 0 || val > G_MAXUINT)
+            OHM_ERROR("delay: invalid snapshot-interval '%s'", interval);
+        else
+            snapshot_interval = val;
+    }
+
+    if ((stale = ohm_plugin_get_param(plugin, "snapshot-max-stale"))) {
+        val = strtoul(stale, &end, 10);
+
+        if (*end || val > G_MAXUINT)
+            OHM_ERROR("delay: invalid snapshot-max-stale '%s'", stale);
+        else
+            snapshot_max_stale = val;
+    }
+
+    if ((snapshot_path = strdup(path)) == NULL)
+        return;
+
+    /* We could remove this if installing ohm created /var/lib/ohm. */
+    if (!strcmp(path, SNAPSHOT_PATH))
+        mkdir(SNAPSHOT_DIR, 0755);
+
+    restore_srcid = g_idle_add(restore_cb, NULL);
+}
+
+static void snapshot_exit(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    if (snapshot_srcid != 0) {
+        g_source_remove(snapshot_srcid);
+        snapshot_srcid = 0;
+    }
+
+    /* never overwrite a snapshot we have not restored yet */
+    if (restore_srcid != 0) {
+        g_source_remove(restore_srcid);
+        restore_srcid = 0;
+    }
+    else if (snapshot_dirty)
+        snapshot_write();
+
+    free(snapshot_buf.data);
+    memset(&snapshot_buf, 0, sizeof(snapshot_buf));
+
+    free(snapshot_path);
+    snapshot_path = NULL;
+}
+
+static void snapshot_schedule(void)
+{
+    if (snapshot_path == NULL)
+        return;
+
+    snapshot_dirty = TRUE;
+
+    if (!snapshot_srcid && !restore_srcid) {
+        snapshot_srcid = g_timeout_add_seconds(snapshot_interval,
+                                               snapshot_cb, NULL);
+    }
+}
+
+
+static int snapshot_write(void)
+{
+    snapshot_buf_t    *buf = &snapshot_buf;
+    snapshot_header_t  hdr;
+    GHashTableIter     it;
+    gpointer           value;
+    delay_timer_t     *t;
+    uint64_t           offset;
+    char               tmp[PATH_MAX];
+    size_t             done;
+    ssize_t            len;
+    int                fd;
+
+    snapshot_dirty = FALSE;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic   = SNAPSHOT_MAGIC;
+    hdr.version = SNAPSHOT_VERSION;
+
+    buf->used = 0;
+
+    if (!reserve(buf, sizeof(hdr)))
+        goto no_memory;
+
+    put(buf, &hdr, sizeof(hdr));
+
+    /* wall clock minus monotonic time, in msecs */
+    offset = realtime_ms() - monotonic_ms();
+
+    g_hash_table_iter_init(&it, timers);
+
+    while (g_hash_table_iter_next(&it, NULL, &value)) {
+        t = (delay_timer_t *)value;
+
+        if (t->state != tmstate_active)
+            continue;
+
+        switch (put_timer(buf, t, t->expire + offset)) {
+        case -1:  goto no_memory;
+        case  0:  OHM_ERROR("delay: timer '%s' is not saved", t->id); break;
+        default:  hdr.count++;                                         break;
+        }
+    }
+
+    if (hdr.count == 0) {
+        if (unlink(snapshot_path) < 0 && errno != ENOENT) {
+            OHM_ERROR("delay: failed to remove '%s': %s", snapshot_path,
+                      strerror(errno));
+            return FALSE;
+        }
+
+        return TRUE;
+    }
+
+    hdr.size = buf->used - sizeof(hdr);
+    memcpy(buf->data, &hdr, sizeof(hdr));
+
+    snprintf(tmp, sizeof(tmp), "%s.new", snapshot_path);
+
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+        goto io_error;
+
+    for (done = 0;  done < buf->used;  done += len) {
+        if ((len = write(fd, buf->data + done, buf->used - done)) < 0) {
+            if (errno == EINTR) {
+                len = 0;
+                continue;
+            }
+
+            close(fd);
+            unlink(tmp);
+            goto io_error;
+        }
+    }
+
+    if (close(fd) < 0 || rename(tmp, snapshot_path) < 0) {
+        unlink(tmp);
+        goto io_error;
+    }
+
+    OHM_DEBUG(DBG_TIMER, "saved %u timers (%u bytes) to '%s'",
+              hdr.count, (unsigned int)buf->used, snapshot_path);
+
+    return TRUE;
+
+ no_memory:
+    OHM_ERROR("delay: can't save timers: out of memory");
+    return FALSE;
+
+ io_error:
+    OHM_ERROR("delay: can't save timers to '%s': %s", snapshot_path,
+              strerror(errno));
+    return FALSE;
+}
+
+static gboolean snapshot_cb(gpointer data)
+{
+    (void)data;
+
+    snapshot_srcid = 0;
+
+    if (snapshot_dirty)
+        snapshot_write();
+
+    return FALSE;
+}
+
+static void snapshot_restore(void)
+{
+    snapshot_header_t  hdr;
+    struct stat        st;
+    unsigned char     *data, *p, *end;
+    uint64_t           now, oldest;
+    size_t             done;
+    ssize_t            len;
+    unsigned int       i, restored;
+    int                fd;
+
+    if ((fd = open(snapshot_path, O_RDONLY)) < 0) {
+        if (errno != ENOENT)
+            OHM_ERROR("delay: can't open '%s': %s", snapshot_path,
+                      strerror(errno));
+        return;
+    }
+
+    data = NULL;
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(hdr) ||
+        (data = malloc(st.st_size)) == NULL)
+        goto invalid;
+
+    for (done = 0;  done < (size_t)st.st_size;  done += len) {
+        if ((len = read(fd, data + done, st.st_size - done)) <= 0) {
+            if (len < 0 && errno == EINTR) {
+                len = 0;
+                continue;
+            }
+            goto invalid;
+        }
+    }
+
+    memcpy(&hdr, data, sizeof(hdr));
+
+    if (hdr.magic != SNAPSHOT_MAGIC || hdr.version != SNAPSHOT_VERSION ||
+        hdr.size != st.st_size - sizeof(hdr))
+        goto invalid;
+
+    p   = data + sizeof(hdr);
+    end = p + hdr.size;
+    now = realtime_ms();
+
+    /* 0 means no limit, anything overdue still runs */
+    if (snapshot_max_stale && now > snapshot_max_stale * 1000ULL)
+        oldest = now - snapshot_max_stale * 1000ULL;
+    else
+        oldest = 0;
+
+    restored = 0;
+
+    timer_batch_begin();
+    fsif_transaction_begin();
+
+    for (i = 0;  i < hdr.count;  i++) {
+        switch (restore_timer(&p, end, now, oldest)) {
+        case -1:  i = hdr.count; break;
+        case  0:                 break;
+        default:  restored++;    break;
+        }
+    }
+
+    fsif_transaction_end();
+    timer_batch_end();
+
+    OHM_INFO("delay: restored %u of %u timers from '%s'", restored,
+             hdr.count, snapshot_path);
+
+    if (p != end)
+        OHM_ERROR("delay: '%s' is corrupted", snapshot_path);
+
+    close(fd);
+    free(data);
+
+    return;
+
+ invalid:
+    OHM_ERROR("delay: ignoring invalid snapshot '%s'", snapshot_path);
+    close(fd);
+    free(data);
+}
+
+static gboolean restore_cb(gpointer data)
+{
+    (void)data;
+
+    restore_srcid = 0;
+
+    snapshot_restore();
+
+    /* the snapshot is ours now, bring it up to date */
+    snapshot_schedule();
+
+    return FALSE;
+}
+
+static int restore_timer(unsigned char **p, unsigned char *end, uint64_t now,
+                         uint64_t oldest)
+{
+#define MAX_ARG 64
+
+    uint64_t    expire, left;
+    uint8_t     argc, idlen, cblen;
+    uint16_t    slen;
+    int32_t     ival;
+    char        argt[MAX_ARG + 1];
+    char       *id, *cbname, *sig;
+    void       *argv[MAX_ARG];
+    int         ibuf[MAX_ARG];
+    delay_cb_t  cb;
+    int         i;
+
+    if (!get(p, end, &expire, sizeof(expire))         ||
+        !get(p, end, &argc  , sizeof(argc))           ||
+        !get(p, end, &idlen , sizeof(idlen))          ||
+        !get(p, end, &cblen , sizeof(cblen))          ||
+        argc > MAX_ARG                                ||
+        !get(p, end, argt   , argc)                   ||
+        (id     = get_string(p, end, idlen)) == NULL  ||
+        (cbname = get_string(p, end, cblen)) == NULL)
+        return -1;
+
+    argt[argc] = '\0';
+
+    for (i = 0;  i < argc;  i++) {
+        if (argt[i] == 'i') {
+            if (!get(p, end, &ival, sizeof(ival)))
+                return -1;
+
+            ibuf[i] = ival;
+            argv[i] = ibuf + i;
+        }
+        else {
+            if (!get(p, end, &slen, sizeof(slen)) ||
+                (argv[i] = get_string(p, end, slen)) == NULL)
+                return -1;
+        }
+    }
+
+    if (expire < oldest) {
+        OHM_INFO("delay: timer '%s' is overdue by %llu secs, not restored",
+                 id, (unsigned long long)((now - expire) / 1000));
+        return 0;
+    }
+
+    if (timer_lookup(id) != NULL) {
+        OHM_DEBUG(DBG_TIMER, "timer '%s' was set again, not restored", id);
+        return 0;
+    }
+
+    /* the callbacks are registered by name only, accept any signature */
+    sig = NULL;
+
+    if (!ohm_module_find_method(cbname, &sig, (void **)&cb)) {
+        OHM_ERROR("delay: can't restore timer '%s': no method '%s'",
+                  id, cbname);
+        return 0;
+    }
+
+    left = expire > now ? expire - now : 0;
+
+    if (left > G_MAXUINT)
+        left = G_MAXUINT;
+
+    return timer_add(id, (unsigned int)left, cbname, cb, argt, argv) ? 1 : 0;
+
+#undef MAX_ARG
+}
+
+static int put_timer(snapshot_buf_t *buf, delay_timer_t *t, uint64_t expire)
+{
+    timer_args_t *args = t->args;
+    size_t        idlen, cblen, slen, size;
+    uint8_t       u8;
+    uint16_t      u16;
+    int32_t       i32;
+    int           i;
+
+    idlen = strlen(t->id) + 1;
+    cblen = strlen(t->cbname) + 1;
+
+    if (idlen > 255 || cblen > 255)
+        return 0;
+
+    size = sizeof(expire) + 3 * sizeof(u8) + args->argc + idlen + cblen;
+
+    for (i = 0;  i < args->argc;  i++) {
+        if (args->argt[i] == 'i')
+            size += sizeof(i32);
+        else {
+            if ((slen = strlen((char *)args->argv[i]) + 1) > 65535)
+                return 0;
+
+            size += sizeof(u16) + slen;
+        }
+    }
+
+    if (!reserve(buf, size))
+        return -1;
+
+    put(buf, &expire, sizeof(expire));
+    u8 = args->argc;  put(buf, &u8, sizeof(u8));
+    u8 = idlen;       put(buf, &u8, sizeof(u8));
+    u8 = cblen;       put(buf, &u8, sizeof(u8));
+    put(buf, args->argt, args->argc);
+    put(buf, t->id, idlen);
+    put(buf, t->cbname, cblen);
+
+    for (i = 0;  i < args->argc;  i++) {
+        if (args->argt[i] == 'i') {
+            i32 = *(int *)args->argv[i];
+            put(buf, &i32, sizeof(i32));
+        }
+        else {
+            u16 = strlen((char *)args->argv[i]) + 1;
+            put(buf, &u16, sizeof(u16));
+            put(buf, args->argv[i], u16);
+        }
+    }
+
+    return 1;
+}
+
+static int reserve(snapshot_buf_t *buf, size_t len)
+{
+    unsigned char *data;
+    size_t         size;
+
+    if (buf->used + len <= buf->size)
+        return TRUE;
+
+    for (size = buf->size ? buf->size : 4096;  size < buf->used + len; )
+        size *= 2;
+
+    if ((data = realloc(buf->data, size)) == NULL)
+        return FALSE;
+
+    buf->data = data;
+    buf->size = size;
+
+    return TRUE;
+}
+
+static void put(snapshot_buf_t *buf, const void *ptr, size_t len)
+{
+    memcpy(buf->data + buf->used, ptr, len);
+    buf->used += len;
+}
+
+static int get(unsigned char **p, unsigned char *end, void *dst, size_t len)
+{
+    /* records are packed, copy rather than cast */
+    if ((size_t)(end - *p) < len)
+        return FALSE;
+
+    memcpy(dst, *p, len);
+    *p += len;
+
+    return TRUE;
+}
+
+static char *get_string(unsigned char **p, unsigned char *end, size_t len)
+{
+    char *str;
+
+    if (len == 0 || (size_t)(end - *p) < len || (*p)[len - 1] != '\0')
+        return NULL;
+
+    str = (char *)*p;
+    *p += len;
+
+    return str;
+}
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
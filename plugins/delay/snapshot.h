@@ -0,0 +1,56 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#ifndef __OHM_DELAY_SNAPSHOT_H__
+#define __OHM_DELAY_SNAPSHOT_H__
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_DIR       "/var/lib/ohm"
+#define SNAPSHOT_PATH      SNAPSHOT_DIR "/delay-timers"
+#define SNAPSHOT_INTERVAL  5                    /* seconds */
+#define SNAPSHOT_MAX_STALE 600                  /* seconds */
+#define SNAPSHOT_MAGIC     0x594c4544           /* 'DELY' */
+#define SNAPSHOT_VERSION   1
+
+typedef struct {
+    uint32_t  magic;
+    uint32_t  version;
+    uint32_t  count;            /* number of timers */
+    uint32_t  size;             /* bytes of timer records that follow */
+} snapshot_header_t;
+
+static void snapshot_init(OhmPlugin *);
+static void snapshot_exit(OhmPlugin *);
+static void snapshot_schedule(void);
+
+
+#endif /* __OHM_DELAY_SNAPSHOT_H__ */
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
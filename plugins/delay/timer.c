@@ -18,221 +18,518 @@ USA.
 *************************************************************************/
 
 
-static int build_fldlist(fsif_field_t *, char *, char *, unsigned int,
-                         unsigned int, char *, void *, char *, void **);
-static void calculate_expiration_time(unsigned int, char *,int);
+/*
+ * Timers live in a hierarchical timing wheel with a millisecond tick:
+ * WHEEL_LEVELS levels of WHEEL_SLOTS slots each, so a level covers
+ * WHEEL_SLOTS times the span of the level below and the top level
+ * covers every unsigned int delay. Adding and cancelling a timer is
+ * a list operation. Timers far in the future are moved down a level
+ * whenever the wheel passes the start of their slot. A single main
+ * loop source is kept armed for the next slot that needs attention.
+ *
+ * Timers are found by their id through a hash. They stay there after
+ * they are stopped or run down, like their facts used to, so that a
+ * non-restarting delay_execution() with a used id keeps failing.
+ */
 
-static unsigned int schedule_timer_event(char *, unsigned int);
-static void cancel_timer_event_by_srcid(unsigned int);
-static void cancel_timer_event_by_entry(fsif_entry_t *);
-static int  timer_event_cb(void *);
+#define WHEEL_BITS    8
+#define WHEEL_SLOTS   (1 << WHEEL_BITS)
+#define WHEEL_MASK    (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS  4
+
+#define MAX_ARG       64
+#define FLDLIST_DIM   (MAX_ARG + 10)
+
+typedef struct {
+    uint64_t          now;          /* next tick to process */
+    timer_listhead_t  slot[WHEEL_LEVELS][WHEEL_SLOTS];
+    unsigned int      count[WHEEL_LEVELS];
+    guint             srcid;
+    uint64_t          wakeup;       /* when srcid is due */
+    int               running;
+    int               firing;       /* running the timers of tick now */
+    int               batch;        /* arm once, at timer_batch_end() */
+} timer_wheel_t;
+
+static timer_wheel_t   wheel;
+static GHashTable     *timers;      /* id -> delay_timer_t */
+static timer_export_t  export_mode;
+
+static const char *state_names[] = {
+    [tmstate_none]    = "none",
+    [tmstate_active]  = "active",
+    [tmstate_stopped] = "stopped",
+    [tmstate_rundown] = "rundown",
+};
+
+static int           timer_setup(delay_timer_t *, unsigned int, char *,
+                                 delay_cb_t, char *, void **);
+static void          timer_fire(delay_timer_t *);
+static void          timer_free(gpointer);
+static timer_args_t *copy_args(char *, void **);
+static int           export_timer(delay_timer_t *, int);
+static void          unexport_timer(delay_timer_t *);
+static int           build_fldlist(fsif_field_t *, delay_timer_t *,
+                                   char *, int, char *, int);
+static void          calculate_expiration_time(uint64_t, char *, int);
+
+static uint64_t      monotonic_ms(void);
+static uint64_t      realtime_ms(void);
+static void          wheel_insert(delay_timer_t *);
+static void          wheel_remove(delay_timer_t *);
+static void          wheel_cascade(void);
+static void          wheel_run(uint64_t);
+static uint64_t      wheel_next(void);
+static void          wheel_arm(uint64_t);
+static gboolean      wheel_cb(gpointer);
 
 
 static void timer_init(OhmPlugin *plugin)
+{
+    const char *mode;
+    int         i, j;
+
+    mode = ohm_plugin_get_param(plugin, "timer-facts");
+
+    if (mode == NULL || !strcmp(mode, "always"))
+        export_mode = tmexport_always;
+    else if (!strcmp(mode, "on-demand"))
+        export_mode = tmexport_on_demand;
+    else if (!strcmp(mode, "never"))
+        export_mode = tmexport_never;
+    else {
+        OHM_ERROR("delay: invalid timer-facts '%s', using 'always'", mode);
+        export_mode = tmexport_always;
+    }
+
+    for (i = 0;  i < WHEEL_LEVELS;  i++) {
+        for (j = 0;  j < WHEEL_SLOTS;  j++) {
+            wheel.slot[i][j].next = (delay_timer_t *)&wheel.slot[i][j];
+            wheel.slot[i][j].prev = (delay_timer_t *)&wheel.slot[i][j];
+        }
+    }
+
+    wheel.now = monotonic_ms();
+
+    timers = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, timer_free);
+}
+
+static void timer_exit(OhmPlugin *plugin)
 {
     (void)plugin;
+
+    if (wheel.srcid != 0) {
+        g_source_remove(wheel.srcid);
+        wheel.srcid = 0;
+    }
+
+    if (timers != NULL) {
+        g_hash_table_destroy(timers);
+        timers = NULL;
+    }
 }
 
 static int timer_add(char *id, unsigned int delay, char *cb_name,
                      delay_cb_t cb, char *argt, void **argv)
 {
-#define MAX_ARG      64
-#define MAX_LENGTH   64
-#define FLDLIST_DIM  MAX_ARG + 10
-
-    fsif_field_t  fldlist[FLDLIST_DIM];
-    unsigned int  srcid;
-    int           success;
-    char         *state;
+    delay_timer_t *t;
 
     if (!id || !cb_name || !cb || !argt || strlen(argt) > MAX_ARG)
-        success = FALSE;
-    else {
-        srcid   =  schedule_timer_event(id, delay);
-        success = srcid;
-        state   = srcid ? "active" : "failed";
-
-        if (!build_fldlist(fldlist,id,state,delay,srcid,cb_name,cb,argt,argv)||
-            !fsif_add_factstore_entry(FACTSTORE_TIMER, fldlist)               )
-        {
-            cancel_timer_event_by_srcid(srcid);
-            success = FALSE;            
-        }
+        return FALSE;
+
+    if ((t = calloc(1, sizeof(*t))) == NULL)
+        return FALSE;
+
+    t->level = -1;
+
+    if ((t->id = strdup(id)) == NULL ||
+        !timer_setup(t, delay, cb_name, cb, argt, argv))
+    {
+        timer_free(t);
+        return FALSE;
     }
 
-    return success;
+    g_hash_table_insert(timers, t->id, t);
 
-#undef FLDLIST_DIM
-#undef MAX_LENGTH
-#undef MAX_ARG
+    return TRUE;
 }
 
-static int timer_restart(fsif_entry_t *entry, unsigned int delay,
+static int timer_restart(delay_timer_t *t, unsigned int delay,
                          char *cb_name, delay_cb_t cb, char *argt, void **argv)
 {
-    char *id = 0;
-    
-    if (!entry || !cb_name || !cb || !argt)
-        goto fail;
+    if (!t || !cb_name || !cb || !argt || strlen(argt) > MAX_ARG)
+        return FALSE;
 
-    fsif_get_field_by_entry(entry, fldtype_string, TIMER_ID, &id);
+    wheel_remove(t);
+    unexport_timer(t);
 
-    if (id == NULL)
-        goto fail;
+    if (!timer_setup(t, delay, cb_name, cb, argt, argv)) {
+        t->state = tmstate_stopped;
 
-    cancel_timer_event_by_entry(entry);
+        if (export_mode == tmexport_always)
+            export_timer(t, FALSE);
+
+        return FALSE;
+    }
 
-    if (!fsif_destroy_factstore_entry(entry) ||
-        !timer_add(id, delay, cb_name, cb, argt, argv))
-        goto fail;
-        
     return TRUE;
+}
 
- fail:
-    return FALSE;
+static int timer_stop(delay_timer_t *t)
+{
+    if (t == NULL)
+        return FALSE;
+
+    if (t->state == tmstate_active) {
+        OHM_DEBUG(DBG_EVENT, "timer '%s' stopped", t->id);
+
+        wheel_remove(t);
+        t->state = tmstate_stopped;
+
+        if (export_mode == tmexport_always)
+            export_timer(t, FALSE);
+
+        snapshot_schedule();
+    }
+
+    return TRUE;
 }
 
-static int timer_stop(fsif_entry_t *entry)
+static delay_timer_t *timer_lookup(char *id)
 {
-    int success;
+    if (id == NULL || timers == NULL)
+        return NULL;
 
-    if (entry == NULL)
-        success = FALSE;
-    else {
-        cancel_timer_event_by_entry(entry);
-        success = TRUE;
+    return g_hash_table_lookup(timers, id);
+}
+
+static int timer_export(void)
+{
+    GList *list, *l;
+    int    success;
+
+    if (export_mode == tmexport_never)
+        return FALSE;
+
+    success = TRUE;
+
+    /* fact watches may add timers while we go */
+    list = g_hash_table_get_values(timers);
+
+    fsif_transaction_begin();
+
+    for (l = list;  l != NULL;  l = g_list_next(l)) {
+        if (!export_timer((delay_timer_t *)l->data, TRUE))
+            success = FALSE;
     }
 
+    fsif_transaction_end();
+
+    g_list_free(list);
+
     return success;
 }
 
-static fsif_entry_t *timer_lookup(char *id)
+static void timer_batch_begin(void)
 {
-    fsif_entry_t *fsentry;
+    wheel.batch++;
+}
+
+static void timer_batch_end(void)
+{
+    uint64_t next;
+
+    if (--wheel.batch == 0 && !wheel.running) {
+        if ((next = wheel_next()) != UINT64_MAX)
+            wheel_arm(next);
+    }
+}
+
+
+static int timer_setup(delay_timer_t *t, unsigned int delay, char *cb_name,
+                       delay_cb_t cb, char *argt, void **argv)
+{
+    timer_args_t *args;
+    char         *cbname;
+
+    args   = copy_args(argt, argv);
+    cbname = strdup(cb_name);
+
+    if (args == NULL || cbname == NULL) {
+        free(args);
+        free(cbname);
+        return FALSE;
+    }
+
+    /* the arguments of a running callback are freed when it returns */
+    if (t->args != t->inuse)
+        free(t->args);
+
+    free(t->cbname);
+
+    t->args   = args;
+    t->cbname = cbname;
+    t->cb     = cb;
+    t->delay  = delay;
+    t->expire = monotonic_ms() + delay;
+    t->state  = tmstate_active;
+
+    wheel_insert(t);
+
+    if (export_mode == tmexport_always && !export_timer(t, FALSE)) {
+        wheel_remove(t);
+        return FALSE;
+    }
+
+    OHM_DEBUG(DBG_EVENT, "scheduled timer '%s' in %u msec", t->id, delay);
+
+    snapshot_schedule();
+
+    return TRUE;
+}
+
+static void timer_fire(delay_timer_t *t)
+{
+    timer_args_t *args;
+
+    OHM_DEBUG(DBG_EVENT, "Timer '%s' rundown", t->id);
+
+    t->state = tmstate_rundown;
+
+    if (export_mode == tmexport_always)
+        export_timer(t, FALSE);
+
+    snapshot_schedule();
+
+    /* the callback may well restart us */
+    args = t->inuse = t->args;
+
+    OHM_DEBUG(DBG_EVENT, "signature '%s'", args->argt);
+
+    t->cb(t->id, args->argt, args->argv);
+
+    t->inuse = NULL;
+
+    if (t->args != args)
+        free(args);
+}
+
+static void timer_free(gpointer data)
+{
+    delay_timer_t *t = (delay_timer_t *)data;
+
+    if (t != NULL) {
+        wheel_remove(t);
+
+        free(t->id);
+        free(t->cbname);
+        free(t->args);
+        free(t);
+    }
+}
+
+static timer_args_t *copy_args(char *argt, void **argv)
+{
+    static char  *unsupported = "<unsupported type>";
+
+    timer_args_t *args;
+    int          *ints;
+    char         *str, *p;
+    size_t        size, len;
+    int           argc, i;
+
+    /*
+     * The arguments go to a single block: the descriptor, the argument
+     * pointers, integer storage, the signature and the string copies.
+     * Anything but an integer is passed on as a string, as it was when
+     * the arguments were read back from the fact.
+     */
+
+    argc = strlen(argt);
+    size = sizeof(*args) + argc * (sizeof(void *) + sizeof(int)) + argc + 1;
+
+    for (i = 0;  i < argc;  i++) {
+        if (argt[i] == 's')
+            size += strlen(argv[i] ? (char *)argv[i] : "") + 1;
+        else if (argt[i] != 'i')
+            size += strlen(unsupported) + 1;
+    }
+
+    if ((args = malloc(size)) == NULL)
+        return NULL;
+
+    args->argc = argc;
+    args->argv = (void **)(args + 1);
+    ints       = (int *)(args->argv + argc);
+    args->argt = (char *)(ints + argc);
+    p          = args->argt + argc + 1;
+
+    for (i = 0;  i < argc;  i++) {
+        if (argt[i] == 'i') {
+            ints[i] = *(int *)argv[i];
+            args->argt[i] = 'i';
+            args->argv[i] = ints + i;
+        }
+        else {
+            if (argt[i] == 's')
+                str = argv[i] ? (char *)argv[i] : "";
+            else
+                str = unsupported;
+
+            len = strlen(str) + 1;
+            memcpy(p, str, len);
+
+            args->argt[i] = 's';
+            args->argv[i] = p;
+            p += len;
+        }
+    }
+
+    args->argt[argc] = '\0';
+
+    return args;
+}
+
+/*
+ * Formatting the expiry is left to delay_export(), which is what readers
+ * call for an up to date view; until then the expire field is empty.
+ */
+static int export_timer(delay_timer_t *t, int with_expire)
+{
+    fsif_field_t  fldlist[FLDLIST_DIM];
     fsif_field_t  selist[2];
+    char          expire[64];
+    char          names[MAX_ARG * 8];
+    int           n;
 
-    if (id == NULL)
-        fsentry = NULL;
+    with_expire = with_expire && t->exported_expire != t->expire;
+
+    if (t->exported == t->state && !with_expire)
+        return TRUE;
+
+    if (t->exported == tmstate_none) {
+        if (!build_fldlist(fldlist, t, with_expire ? expire : NULL,
+                           sizeof(expire), names, sizeof(names)) ||
+            !fsif_add_factstore_entry(FACTSTORE_TIMER, fldlist))
+            return FALSE;
+    }
     else {
         memset(selist, 0, sizeof(selist));
         selist[0].type = fldtype_string;
         selist[0].name = TIMER_ID;
-        selist[0].value.string = id;
-        
-        fsentry = fsif_get_entry(FACTSTORE_TIMER, selist);
+        selist[0].value.string = t->id;
+
+        memset(fldlist, 0, 3 * sizeof(fldlist[0]));
+        fldlist[0].type = fldtype_string;
+        fldlist[0].name = TIMER_STATE;
+        fldlist[0].value.string = (char *)state_names[t->state];
+        n = 1;
+
+        if (with_expire) {
+            calculate_expiration_time(t->expire, expire, sizeof(expire));
+
+            fldlist[n].type = fldtype_string;
+            fldlist[n].name = TIMER_EXPIRE;
+            fldlist[n].value.string = expire;
+            n++;
+        }
+
+        if (!fsif_update_factstore_entry(FACTSTORE_TIMER, selist, fldlist))
+            return FALSE;
     }
 
-    return fsentry;
+    t->exported        = t->state;
+    t->exported_expire = with_expire ? t->expire : 0;
+
+    return TRUE;
 }
 
-static int timer_active(fsif_entry_t *entry)
+static void unexport_timer(delay_timer_t *t)
 {
-    char *state = NULL;
-    int   active;
+    fsif_field_t selist[2];
 
-    if (entry == NULL)
-        active = FALSE;
-    else {
-        fsif_get_field_by_entry(entry, fldtype_string, TIMER_STATE, &state);
+    if (t->exported != tmstate_none) {
+        memset(selist, 0, sizeof(selist));
+        selist[0].type = fldtype_string;
+        selist[0].name = TIMER_ID;
+        selist[0].value.string = t->id;
 
-        active = (state && !strcmp(state, "active")) ? TRUE : FALSE;
-    }
+        fsif_delete_factstore_entry(FACTSTORE_TIMER, selist);
 
-    return active;
+        t->exported        = tmstate_none;
+        t->exported_expire = 0;
+    }
 }
 
-static int build_fldlist(fsif_field_t *fldlist, char *id, char *state,
-                         unsigned int delay, unsigned int srcid, 
-                         char *cbname, void *addr, char *argt, void **argv)
+static int build_fldlist(fsif_field_t *fldlist, delay_timer_t *t,
+                         char *expire, int explen, char *buf, int buflen)
 {
-    char  t;
-    int   i, j;
-    char *argname;
-    char  buf[2048];
-    char *bufend;
-    int   len;
-    char  expire[64];
+    timer_args_t *args = t->args;
+    char         *argname;
+    char         *bufend;
+    int           i, j, len;
 
-    calculate_expiration_time(delay, expire, sizeof(expire));
+    if (expire != NULL)
+        calculate_expiration_time(t->expire, expire, explen);
 
     j = 0;
 
-    if (id != NULL) {
-        fldlist[j].type = fldtype_string;
-        fldlist[j].name = TIMER_ID;
-        fldlist[j].value.string = id;
-        j++;
-    }
+    fldlist[j].type = fldtype_string;
+    fldlist[j].name = TIMER_ID;
+    fldlist[j].value.string = t->id;
+    j++;
 
-    if (state != NULL) {
-        fldlist[j].type = fldtype_string;
-        fldlist[j].name = TIMER_STATE;
-        fldlist[j].value.string = state;
-        j++;
-    }
+    fldlist[j].type = fldtype_string;
+    fldlist[j].name = TIMER_STATE;
+    fldlist[j].value.string = (char *)state_names[t->state];
+    j++;
 
     fldlist[j].type = fldtype_unsignd;
     fldlist[j].name = TIMER_DELAY;
-    fldlist[j].value.unsignd = delay;
+    fldlist[j].value.unsignd = t->delay;
     j++;
 
     fldlist[j].type = fldtype_string;
     fldlist[j].name = TIMER_EXPIRE;
-    fldlist[j].value.string = expire;
+    fldlist[j].value.string = expire ? expire : "";
     j++;
 
     fldlist[j].type = fldtype_string;
     fldlist[j].name = TIMER_CALLBACK;
-    fldlist[j].value.string = cbname;
+    fldlist[j].value.string = t->cbname;
     j++;
 
     fldlist[j].type = fldtype_unsignd;
     fldlist[j].name = TIMER_ADDRESS;
-    fldlist[j].value.unsignd = addr;
-    j++;
-
-    fldlist[j].type = fldtype_unsignd;
-    fldlist[j].name = TIMER_SRCID;
-    fldlist[j].value.unsignd = srcid;
+    fldlist[j].value.unsignd = (unsigned long)t->cb;
     j++;
 
     fldlist[j].type = fldtype_unsignd;
     fldlist[j].name = TIMER_ARGC;
-    fldlist[j].value.unsignd = strlen(argt);
+    fldlist[j].value.unsignd = args->argc;
     j++;
 
     argname = buf;
-    bufend  = buf + sizeof(buf);
-
-    for (i = 0;   (t = argt[i]) != '\0';    i++, j++) {
+    bufend  = buf + buflen;
 
+    for (i = 0;  i < args->argc;  i++, j++) {
         len = snprintf(argname, bufend - argname, TIMER_ARGV, i) + 1;
 
+        if (argname + len > bufend)
+            return FALSE;
+
         fldlist[j].name = argname;
 
-        switch (t) {
-            
-        case 'i':
+        if (args->argt[i] == 'i') {
             fldlist[j].type = fldtype_integer;
-            fldlist[j].value.integer = *(int *)argv[i];
-            break;
-
-        case 's':
-            fldlist[j].type = fldtype_string;
-            fldlist[j].value.string = (char *)argv[i];
-            break;
-
-        default:
+            fldlist[j].value.integer = *(int *)args->argv[i];
+        }
+        else {
             fldlist[j].type = fldtype_string;
-            fldlist[j].value.string = "<unsupported type>";
-            break;
-            }
+            fldlist[j].value.string = (char *)args->argv[i];
+        }
 
         argname += len;
-
-        if (argname >= bufend)
-            return FALSE;
-
     }
 
     fldlist[j].type = fldtype_invalid;
@@ -240,18 +537,15 @@ static int build_fldlist(fsif_field_t *fldlist, char *id, char *state,
     return TRUE;
 }
 
-static void calculate_expiration_time(unsigned int delay, char *buf, int len)
+static void calculate_expiration_time(uint64_t expire, char *buf, int len)
 {
-    struct timeval  tv;
     struct tm      *tm;
-    uint64_t        now;
     uint64_t        exp;
     time_t          exp_sec;
     int             exp_ms;
 
-    gettimeofday(&tv, NULL);
-    now = (uint64_t)tv.tv_sec * 1000ULL  + (uint64_t)(tv.tv_usec / 1000);
-    exp = now + (uint64_t)delay;
+    /* expire is monotonic, the string shows the wall clock time */
+    exp = realtime_ms() + expire - monotonic_ms();
 
     exp_sec = exp / 1000ULL;
     exp_ms  = exp % 1000ULL;
@@ -263,121 +557,239 @@ static void calculate_expiration_time(unsigned int delay, char *buf, int len)
 }
 
 
-static unsigned int schedule_timer_event(char *id, unsigned int delay)
+static uint64_t monotonic_ms(void)
 {
-    gpointer      data;
-    unsigned int  srcid;
+    struct timespec ts;
 
-    if (id == NULL) 
-        srcid = 0;
-    else {
-        data = strdup(id);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
 
-        if (!delay)
-            srcid = g_idle_add_full(G_PRIORITY_HIGH, timer_event_cb,data,free);
-        else {
-            srcid = g_timeout_add_full(G_PRIORITY_HIGH, delay,
-                                       timer_event_cb, data, free);
-        }
-    }
+    return (uint64_t)ts.tv_sec * 1000ULL + (uint64_t)(ts.tv_nsec / 1000000);
+}
 
-    if (srcid) {
-        OHM_DEBUG(DBG_EVENT, "sheduled event with %s=%u (id=%s)",
-                  TIMER_SRCID, srcid, id);
+static uint64_t realtime_ms(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (uint64_t)tv.tv_sec * 1000ULL + (uint64_t)(tv.tv_usec / 1000);
+}
+
+static void wheel_insert(delay_timer_t *t)
+{
+    timer_listhead_t *slot;
+    uint64_t          delta, touch;
+    int               level, shift, i;
+
+    /* nothing to catch up with, move to the present */
+    for (i = 0;  i < WHEEL_LEVELS && !wheel.count[i];  i++)
+        ;
+    if (i == WHEEL_LEVELS && !wheel.running)
+        wheel.now = monotonic_ms();
+
+    if (t->expire <= wheel.now) {
+        /* re-armed by a callback of this tick, don't run it again now */
+        touch = wheel.firing ? wheel.now + 1 : wheel.now;
+        level = 0;
+        shift = 0;
+        slot  = &wheel.slot[0][touch & WHEEL_MASK];
     }
     else {
-        OHM_DEBUG(DBG_EVENT, "failed to schedule event (id=%s)", id);
+        delta = t->expire - wheel.now;
+
+        for (level = 0;  level < WHEEL_LEVELS - 1;  level++) {
+            if (delta < (1ULL << (WHEEL_BITS * (level + 1))))
+                break;
+        }
+
+        shift = WHEEL_BITS * level;
+        slot  = &wheel.slot[level][(t->expire >> shift) & WHEEL_MASK];
+        touch = (t->expire >> shift) << shift;
     }
 
-    return srcid;
+    t->level = level;
+    t->next  = (delay_timer_t *)slot;
+    t->prev  = slot->prev;
+    slot->prev->next = t;
+    slot->prev = t;
+
+    wheel.count[level]++;
+
+    /* wheel_cb() and timer_batch_end() arm when they are done */
+    if (!wheel.running && !wheel.batch)
+        wheel_arm(touch);
 }
 
-static void cancel_timer_event_by_srcid(unsigned int srcid)
+static void wheel_remove(delay_timer_t *t)
 {
-    if (srcid != 0) {
-        if (g_source_remove(srcid))
-            OHM_DEBUG(DBG_EVENT, "event with %s=%u removed",
-                      TIMER_SRCID, srcid);
-        else
-            OHM_DEBUG(DBG_EVENT, "Failed to remove event with %s=%u",
-                      TIMER_SRCID, srcid);
+    if (t->level >= 0) {
+        t->prev->next = t->next;
+        t->next->prev = t->prev;
+        t->next = t->prev = NULL;
+
+        wheel.count[t->level]--;
+        t->level = -1;
     }
 }
 
-static void cancel_timer_event_by_entry(fsif_entry_t *entry)
+static void wheel_cascade(void)
 {
-    static char  *stopped = "stopped";
-
-    unsigned int  srcid;
+    timer_listhead_t *slot;
+    timer_listhead_t  list;
+    delay_timer_t    *t;
+    int               level, index;
+
+    for (level = 1;  level < WHEEL_LEVELS;  level++) {
+        index = (wheel.now >> (WHEEL_BITS * level)) & WHEEL_MASK;
+        slot  = &wheel.slot[level][index];
+
+        if (slot->next != (delay_timer_t *)slot) {
+            /* detach first, timers may well end up in the same slot */
+            list = *slot;
+            list.next->prev = (delay_timer_t *)&list;
+            list.prev->next = (delay_timer_t *)&list;
+            slot->next = slot->prev = (delay_timer_t *)slot;
+
+            while ((t = list.next) != (delay_timer_t *)&list) {
+                wheel_remove(t);
+                wheel_insert(t);
+            }
+        }
 
-    if (timer_active(entry)) {
-        fsif_get_field_by_entry(entry, fldtype_unsignd, TIMER_SRCID, &srcid);
-        cancel_timer_event_by_srcid(srcid);
-        fsif_set_field_by_entry(entry, fldtype_string, TIMER_STATE, &stopped);
+        if (index != 0)
+            break;
     }
 }
 
+static void wheel_run(uint64_t target)
+{
+    timer_listhead_t *slot;
+    delay_timer_t    *t;
+    uint64_t          next;
+    int               level, shift;
+
+    while (wheel.now <= target) {
+        if ((wheel.now & WHEEL_MASK) == 0)
+            wheel_cascade();
+
+        if (wheel.count[0] > 0) {
+            slot = &wheel.slot[0][wheel.now & WHEEL_MASK];
+
+            wheel.firing = TRUE;
 
-static int timer_event_cb(void *data)
+            while ((t = slot->next) != (delay_timer_t *)slot) {
+                wheel_remove(t);
+                timer_fire(t);
+            }
+
+            wheel.firing = FALSE;
+
+            wheel.now++;
+            continue;
+        }
+
+        /* skip ahead to the next cascade that can bring anything in */
+        for (level = 1;  level < WHEEL_LEVELS && !wheel.count[level];  level++)
+            ;
+
+        if (level == WHEEL_LEVELS)
+            next = target + 1;
+        else {
+            shift = WHEEL_BITS * level;
+            next  = ((wheel.now >> shift) + 1) << shift;
+        }
+
+        wheel.now = next < target + 1 ? next : target + 1;
+    }
+}
+
+static uint64_t wheel_next(void)
 {
-#define MAX_ARG 64
-
-    static char  *rundown = "rundown";
-
-    char         *id    = (char *)data;
-    fsif_entry_t *entry = NULL;
-    delay_cb_t    cb;
-    int           argc;
-    char          argt[MAX_ARG + 1];
-    void         *argv[MAX_ARG];
-    char          name[64];
-    char         *str;
-    int           ibuf[MAX_ARG];
-    int           i, j;
-
-    if ((entry = timer_lookup(id)) != NULL) {
-        OHM_DEBUG(DBG_EVENT, "Timer '%s' rundown", id);
-
-        fsif_set_field_by_entry(entry, fldtype_string,  TIMER_STATE, &rundown);
-        fsif_get_field_by_entry(entry, fldtype_unsignd, TIMER_ADDRESS, &cb);
-        fsif_get_field_by_entry(entry, fldtype_unsignd, TIMER_ARGC, &argc);
-
-        if (cb != NULL) {
-            memset(argt, 0, sizeof(argt));
-
-            for (i = 0, j = 0;  i < MAX_ARG && i < argc;  i++) {
-                snprintf(name, sizeof(name), TIMER_ARGV, i);
-
-                /* FIXME:
-                 * This is really uggly. should be rewritten when we have
-                 * some time (ie. supporting function in fsif etc)
-                 */
-                                /* first we try as string */
-                fsif_get_field_by_entry(entry, fldtype_string, name, &str);
-
-                if (str != NULL) {
-                    argt[i] = 's';
-                    argv[i] = (void *)str;
-                    continue;
-                }
-                                /* next we assume it is an integer */
-                fsif_get_field_by_entry(entry, fldtype_integer, name, ibuf+j);
-
-                argt[i] = 'i';
-                argv[i] = ibuf+j;
-                j++;
-            } /* for */
-
-            OHM_DEBUG(DBG_EVENT, "signature '%s'", argt);
-
-            cb(id, argt, argv);
+    timer_listhead_t *slot;
+    uint64_t          next, base, when;
+    int               level, shift, index, first, k;
+
+    next = UINT64_MAX;
+
+    for (level = 0;  level < WHEEL_LEVELS;  level++) {
+        if (!wheel.count[level])
+            continue;
+
+        shift = WHEEL_BITS * level;
+        base  = wheel.now >> shift;
+        index = base & WHEEL_MASK;
+
+        /*
+         * The slot of the current tick is due now, unless it has been
+         * cascaded already. That is the case on the levels above 0 once
+         * the wheel has moved past the start of the slot, and then the
+         * slot comes up again only after a full turn.
+         */
+        first = (wheel.now & ((1ULL << shift) - 1)) ? 1 : 0;
+
+        for (k = first;  k <= first + WHEEL_SLOTS - 1;  k++) {
+            slot = &wheel.slot[level][(index + k) & WHEEL_MASK];
+
+            if (slot->next != (delay_timer_t *)slot) {
+                when = (base + k) << shift;
+
+                if (when < next)
+                    next = when;
+                break;
+            }
         }
     }
 
+    return next;
+}
+
+static void wheel_arm(uint64_t when)
+{
+    uint64_t now;
+    guint    interval;
+
+    if (wheel.srcid != 0) {
+        if (wheel.wakeup <= when)
+            return;
+
+        g_source_remove(wheel.srcid);
+    }
+
+    now = monotonic_ms();
+
+    if (when <= now)
+        interval = 0;
+    else if (when - now > G_MAXINT)
+        interval = G_MAXINT;
+    else
+        interval = when - now;
+
+    wheel.wakeup = when;
+    wheel.srcid  = g_timeout_add_full(G_PRIORITY_HIGH, interval,
+                                      wheel_cb, NULL, NULL);
+}
+
+static gboolean wheel_cb(gpointer data)
+{
+    uint64_t next;
+
+    (void)data;
+
+    wheel.srcid   = 0;
+    wheel.running = TRUE;
+
+    wheel_run(monotonic_ms());
+
+    wheel.running = FALSE;
+
+    if ((next = wheel_next()) != UINT64_MAX)
+        wheel_arm(next);
+
     return FALSE;
+}
 
+#undef FLDLIST_DIM
 #undef MAX_ARG
-}
 
 /* 
  * Local Variables:
@@ -31,18 +31,62 @@ USA.
 #define TIMER_EXPIRE    "expire"
 #define TIMER_CALLBACK  "callback"
 #define TIMER_ADDRESS   "address"
-#define TIMER_SRCID     "g_source_id"
 #define TIMER_ARGC      "argc"
 #define TIMER_ARGV      "argv%d"
 
-static void          timer_init(OhmPlugin *);
-static int           timer_add(char *, unsigned int, char *,
-                               delay_cb_t, char *, void **);
-static int           timer_restart(fsif_entry_t *, unsigned int, char *,
-                                   delay_cb_t, char *, void **);
-static int           timer_stop(fsif_entry_t *);
-static fsif_entry_t *timer_lookup(char *);
-static int           timer_active(fsif_entry_t *);
+typedef enum {
+    tmstate_none = 0,           /* not exported to the factstore */
+    tmstate_active,
+    tmstate_stopped,
+    tmstate_rundown,
+} timer_state_t;
+
+typedef enum {
+    tmexport_always = 0,        /* fact created with the timer */
+    tmexport_on_demand,         /* facts written by delay_export() */
+    tmexport_never,
+} timer_export_t;
+
+typedef struct {
+    int    argc;
+    char  *argt;                /* 's' or 'i' for each argument */
+    void **argv;
+} timer_args_t;
+
+typedef struct delay_timer_s delay_timer_t;
+
+typedef struct {
+    delay_timer_t *next;
+    delay_timer_t *prev;
+} timer_listhead_t;
+
+struct delay_timer_s {
+    delay_timer_t *next;        /* wheel slot */
+    delay_timer_t *prev;
+    int            level;       /* wheel level, -1 if not on the wheel */
+    char          *id;
+    timer_state_t  state;
+    unsigned int   delay;
+    uint64_t       expire;      /* monotonic time in msecs */
+    char          *cbname;
+    delay_cb_t     cb;
+    timer_args_t  *args;
+    timer_args_t  *inuse;       /* args of the running callback */
+    timer_state_t  exported;    /* state in the factstore */
+    uint64_t       exported_expire; /* expiry shown there, 0 if none */
+};
+
+static void           timer_init(OhmPlugin *);
+static void           timer_exit(OhmPlugin *);
+static int            timer_add(char *, unsigned int, char *,
+                                delay_cb_t, char *, void **);
+static int            timer_restart(delay_timer_t *, unsigned int, char *,
+                                    delay_cb_t, char *, void **);
+static int            timer_stop(delay_timer_t *);
+static delay_timer_t *timer_lookup(char *);
+static int            timer_export(void);
+static void           timer_batch_begin(void);
+static void           timer_batch_end(void);
 
 
 #endif /* __OHM_DELAY_TIMER_H__ */
@@ -34,6 +34,7 @@ USA.
 #include "mute.h"
 #include "bluetooth.h"
 #include "resource_control.h"
+#include "busqueue.h"
 
 #define DIM(a) (sizeof(a) / sizeof(a[0]))
 
@@ -48,17 +49,11 @@ typedef enum {
     session_bus
 } bus_type_t;
 
-typedef struct msg_queue_s {
-    struct msg_queue_s *next;
-    bus_type_t          bus;
-    DBusMessage        *msg;
-} msg_queue_t;
-
 
 static DBusConnection    *sys_conn;      /* connection for D-Bus system bus */
 static DBusConnection    *sess_conn;     /* connection for D-Bus session bus */
 static int                timeout;       /* message timeout in msec */
-static msg_queue_t       *msg_que;       /* queued messages */
+static busqueue_t        *sess_que;      /* queued session bus messages */
 
 static void system_bus_init(void);
 static void session_bus_init(const char *);
@@ -73,10 +68,7 @@ static DBusMessage *bluetooth_get_message(DBusMessage *);
 static DBusMessage *mute_req_message( DBusMessage *);
 static DBusMessage *mute_get_message(DBusMessage *);
 
-static void send_message(bus_type_t, DBusMessage *, int);
-static void queue_message(bus_type_t, DBusMessage *);
-static void queue_flush(void);
-static void queue_purge(bus_type_t);
+static void send_message(bus_type_t, DBusMessage *, int, int);
 
 /*! \addtogroup pubif
  *  Functions
@@ -105,6 +97,9 @@ void dbusif_init(OhmPlugin *plugin)
 
     OHM_INFO("media: D-Bus message timeout is %dmsec", timeout);
 
+    if ((sess_que = busqueue_create(NULL)) == NULL)
+        OHM_ERROR("media: can't create session bus message queue");
+
     /*
      * Notes: We get only on the system bus here. Session bus initialization
      *   is delayed until we get the correct address of the bus from our
@@ -119,6 +114,9 @@ void dbusif_exit(OhmPlugin *plugin)
 {
 	(void)plugin;
 	resctl_exit();
+
+	busqueue_destroy(sess_que);
+	sess_que = NULL;
 }
 
 DBusHandlerResult dbusif_session_notification(DBusConnection *conn,
@@ -187,7 +185,7 @@ void dbusif_signal_privacy_override(int value, int send_now)
                                            DBUS_TYPE_INVALID);
 
         if (success)
-            send_message(session_bus, msg, send_now);
+            send_message(session_bus, msg, BUSQUEUE_COALESCE, send_now);
         else
             OHM_ERROR("media [%s]: failed to build message", __FUNCTION__);
     }
@@ -213,7 +211,7 @@ void dbusif_signal_bluetooth_override(int value, int send_now)
                                             DBUS_TYPE_INVALID);
 
         if (success)
-            send_message(session_bus, msg, send_now);
+            send_message(session_bus, msg, BUSQUEUE_COALESCE, send_now);
         else
             OHM_ERROR("media [%s]: failed to build message", __FUNCTION__);
     }
@@ -239,7 +237,7 @@ void dbusif_signal_mute(int value, int send_now)
                                            DBUS_TYPE_INVALID);
 
         if (success)
-            send_message(session_bus, msg, send_now);
+            send_message(session_bus, msg, BUSQUEUE_COALESCE, send_now);
         else
             OHM_ERROR("media [%s]: failed to build message", __FUNCTION__);
     }
@@ -390,6 +388,9 @@ static void session_bus_init(const char *addr)
     
         dbus_connection_setup_with_g_main(sess_conn, NULL);
 
+        if (sess_que != NULL)
+            busqueue_set_connection(sess_que, sess_conn);
+
         success = dbus_connection_register_object_path(sess_conn,
                                                        DBUS_MEDIA_MANAGER_PATH,
                                                        &media_method, NULL);
@@ -437,7 +438,8 @@ static void session_bus_cleanup(void)
         dbus_connection_unregister_object_path(sess_conn,
                                                DBUS_MEDIA_MANAGER_PATH);
         
-        queue_purge(DBUS_BUS_SESSION);
+        if (sess_que != NULL)
+            busqueue_set_connection(sess_que, NULL);
         
         dbus_connection_unref(sess_conn);
         sess_conn = NULL;
@@ -567,7 +569,8 @@ static DBusHandlerResult method(DBusConnection *conn,DBusMessage *msg,void *ud)
                 dbus_connection_send(conn, reply, &serial);
                 dbus_message_unref(reply);
 
-                queue_flush();
+                if (sess_que != NULL)
+                    busqueue_flush(sess_que);
 
                 break;
             }
@@ -722,85 +725,39 @@ static DBusMessage *mute_get_message(DBusMessage *msg)
     return reply;    
 }
 
-static void send_message(bus_type_t bus, DBusMessage *msg, int send_now)
+static void send_message(bus_type_t bus, DBusMessage *msg, int flags,
+                         int send_now)
 {
     DBusConnection *conn;
 
-    if (!send_now)
-        queue_message(bus, msg);
-    else {
-        switch (bus) {
-        case system_bus:   conn = sys_conn;    break;
-        case session_bus:  conn = sess_conn;   break;
-        default:           conn = NULL;        break;
-        }
+    /*
+     * flags are the busqueue flags of the message; signals that carry
+     * a full state can ask a superseded queued one to be replaced
+     */
+    if (bus == session_bus && sess_que != NULL) {
+        if (!busqueue_send(sess_que, msg, flags))
+            OHM_ERROR("media: failed to queue D-Bus message");
+        else if (send_now)
+            busqueue_flush(sess_que);
 
-        if (conn == NULL)
-            OHM_ERROR("media: invalid bus for message sending");
-        else {
-            if (!dbus_connection_send(conn, msg, NULL))
-                OHM_ERROR("media: failed to send D-Bus message");
-            
-            dbus_message_unref(msg);
-        }
+        dbus_message_unref(msg);
+        return;
     }
-}
-
-static void queue_message(bus_type_t bus, DBusMessage *msg)
-{
-    msg_queue_t *entry, *last;
 
-    for (last = (msg_queue_t *)&msg_que;  last->next;   last = last->next)
-        ;
+    switch (bus) {
+    case system_bus:   conn = sys_conn;    break;
+    case session_bus:  conn = sess_conn;   break;
+    default:           conn = NULL;        break;
+    }
 
-    if ((entry = malloc(sizeof(msg_queue_t))) == NULL)
-        OHM_ERROR("media: can't get memory to queue D-Bus message");
+    if (conn == NULL)
+        OHM_ERROR("media: invalid bus for message sending");
     else {
-        memset(entry, 0, sizeof(msg_queue_t));
-        entry->bus = bus;
-        entry->msg = msg;
-
-        last->next = entry;
+        if (!dbus_connection_send(conn, msg, NULL))
+            OHM_ERROR("media: failed to send D-Bus message");
     }
-}
 
-static void queue_flush(void)
-{
-    msg_queue_t *entry, *next;
-
-    for (entry = msg_que;   entry;   entry = next) {
-        next = entry->next;
-
-        send_message(entry->bus, entry->msg, DBUSIF_SEND_NOW);
-
-        free(entry);
-    } /* for */
-
-    msg_que = NULL;
-}
-
-static void queue_purge(bus_type_t bus)
-{
-    msg_queue_t *entry = msg_que, *prev = NULL, *next;
-
-    while (entry) {
-        next = entry->next;
-
-        if (entry->bus == bus) {
-            if (entry == msg_que)
-                msg_que = next;
-
-            if (prev)
-                prev->next = next;
-
-            dbus_message_unref(entry->msg);
-            free(entry);
-        } else {
-            prev = entry;
-        }
-
-        entry = next;
-    }
+    dbus_message_unref(msg);
 }
 
 /* 
@@ -21,72 +21,7 @@ USA.
 #ifndef __OHM_MEDIA_FSIF_H__
 #define __OHM_MEDIA_FSIF_H__
 
-/*
- * FIXME:
- * The 'delay', 'timer' and 'resource' plugin share the similar fsif.[hc]
- * However, due to the rush, they are currently duplicated (ie. the same
- * code is duplicated in each directory.
- * Before we fix this pls. pay attention to keep them identical (ie. make
- * identical changes to all copies)
- *
- */
-
-
-#include <sys/time.h>
-
-typedef enum {
-    fact_watch_unknown = 0,
-    fact_watch_insert,
-    fact_watch_remove
-} fsif_fact_watch_e;
-
-typedef enum {
-    fldtype_invalid = 0,
-    fldtype_string,
-    fldtype_integer,
-    fldtype_unsignd,
-    fldtype_floating,
-    fldtype_time,
-} fsif_fldtype_t;
-
-typedef union {
-    /* input field types */
-    char               *string;
-    long                integer;
-    unsigned long       unsignd;
-    double              floating;
-    unsigned long long  time;
-
-    /* output field types */
-    void               *retval;
-} fsif_value_t;
-
-typedef struct {
-    fsif_fldtype_t  type;
-    char           *name;
-    fsif_value_t    value;
-} fsif_field_t;
-
-/* hack to avoid multiple includes */
-typedef struct _OhmPlugin OhmPlugin;
-typedef struct _OhmFact   fsif_entry_t;
-
-typedef void (*fsif_field_watch_cb_t)(fsif_entry_t *, char *, fsif_field_t *,
-                                      void *);
-typedef void (*fsif_fact_watch_cb_t)(fsif_entry_t *, char *, fsif_fact_watch_e,
-                                     void *);
-
-void fsif_init(OhmPlugin *);
-void fsif_exit(OhmPlugin *);
-int  fsif_add_factstore_entry(char *, fsif_field_t *);
-int  fsif_delete_factstore_entry(char *, fsif_field_t *);
-int  fsif_update_factstore_entry(char *, fsif_field_t *,fsif_field_t *);
-void fsif_get_field_by_entry(fsif_entry_t *, fsif_fldtype_t, char *, void *);
-int  fsif_get_field_by_name(const char *, fsif_fldtype_t, char *, void *);
-int  fsif_add_fact_watch(char *,fsif_fact_watch_e,fsif_fact_watch_cb_t,void *);
-int  fsif_add_field_watch(char *, fsif_field_t *, char *,
-                          fsif_field_watch_cb_t, void *);
-
+#include "../common/fsif.h"
 
 #endif /* __OHM_MEDIA_FSIF_H__ */
 
@@ -0,0 +1,426 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+#include <ohm/ohm-plugin.h>
+
+#include "playback.h"
+#include "client.h"
+#include "pbreq.h"
+#include "fsif.h"
+
+#define NDBUS      64           /* D-Bus peers */
+#define NOBJ       8            /* playback objects per peer */
+#define NCLIENT    (NDBUS * NOBJ)
+#define NREQ       4            /* queued requests per client */
+#define ROUNDS     200
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("%s:%d: check '%s' failed\n", __FILE__, __LINE__,    \
+                   #cond);                                              \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+static int DBG_CLIENT, DBG_QUE;
+
+static int       failures;
+static int       nsm;
+static int       nwatch;
+static int       nfact;
+static client_t *clients[NDBUS][NOBJ];
+static int       trids[NDBUS][NOBJ][NREQ];
+
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    (void)level;
+
+    va_start(ap, format);
+    vprintf(format, ap);
+    printf("\n");
+    va_end(ap);
+}
+
+/*
+ * stand-ins for the state machine, D-Bus and factstore interfaces
+ */
+
+static sm_t *sm_create(char *name, void *data)
+{
+    (void)name;
+
+    nsm++;
+
+    return (sm_t *)data;
+}
+
+static int sm_destroy(sm_t *sm)
+{
+    (void)sm;
+
+    nsm--;
+
+    return TRUE;
+}
+
+static int sm_process_event(sm_t *sm, sm_evdata_t *evdata)
+{
+    (void)sm;
+    (void)evdata;
+
+    return TRUE;
+}
+
+static int dbusif_watch_client(const char *dbusid, int watch)
+{
+    (void)dbusid;
+
+    nwatch += watch ? 1 : -1;
+
+    return TRUE;
+}
+
+static void dbusif_get_property(char *dbusid, char *object, char *prname,
+                                get_property_cb_t usercb)
+{
+    (void)dbusid;
+    (void)object;
+    (void)prname;
+    (void)usercb;
+}
+
+static void dbusif_set_property(char *dbusid, char *object, char *prname,
+                                char *prvalue, set_property_cb_t usercb)
+{
+    (void)dbusid;
+    (void)object;
+    (void)prname;
+    (void)prvalue;
+    (void)usercb;
+}
+
+FSIF_API int fsif_add_factstore_entry(char *name, fsif_field_t *fldlist)
+{
+    (void)name;
+    (void)fldlist;
+
+    nfact++;
+
+    return TRUE;
+}
+
+FSIF_API int fsif_delete_factstore_entry(char *name, fsif_field_t *selist)
+{
+    (void)name;
+    (void)selist;
+
+    nfact--;
+
+    return TRUE;
+}
+
+FSIF_API int fsif_update_factstore_entry(char *name, fsif_field_t *selist,
+                                         fsif_field_t *fldlist)
+{
+    (void)name;
+    (void)selist;
+    (void)fldlist;
+
+    return TRUE;
+}
+
+
+#include "client.c"
+#include "pbreq.c"
+
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void names(int d, int o, char *dbusid, char *object,
+                  char *pid, char *stream)
+{
+    sprintf(dbusid, ":1.%d", 100 + d);
+    sprintf(object, "/org/maemo/Playback/player%d", o);
+    sprintf(pid   , "%d", 1000 + d);
+    sprintf(stream, "stream-%d", o);
+}
+
+static void test_create(void)
+{
+    char      dbusid[64], object[64], pid[32], stream[32];
+    client_t *cl;
+    int       d, o;
+
+    for (d = 0;  d < NDBUS;  d++) {
+        for (o = 0;  o < NOBJ;  o++) {
+            names(d, o, dbusid, object, pid, stream);
+
+            cl = client_create(dbusid, object, pid, stream);
+            CHECK(cl != NULL);
+
+            clients[d][o] = cl;
+        }
+    }
+
+    CHECK(nsm == NCLIENT);
+    CHECK(nfact == NCLIENT);
+    CHECK(g_hash_table_size(cl_bydbus) == NDBUS);
+    CHECK(g_hash_table_size(cl_bypid) == NDBUS);
+
+    /* creating an existing client returns the existing one */
+    names(3, 5, dbusid, object, pid, stream);
+    CHECK(client_create(dbusid, object, pid, stream) == clients[3][5]);
+    CHECK(nsm == NCLIENT);
+}
+
+static void test_lookup(void)
+{
+    char      dbusid[64], object[64], pid[32], stream[32];
+    double    start, elapsed;
+    int       d, o, r, bad;
+
+    for (d = 0;  d < NDBUS;  d++) {
+        for (o = 0;  o < NOBJ;  o++) {
+            names(d, o, dbusid, object, pid, stream);
+
+            CHECK(client_find_by_dbus(dbusid, object) == clients[d][o]);
+            CHECK(client_find_by_stream(pid, stream) == clients[d][o]);
+        }
+
+        /* without a stream the oldest client of the process wins */
+        CHECK(client_find_by_stream(pid, NULL) == clients[d][0]);
+    }
+
+    CHECK(client_find_by_dbus(":1.1", "/org/maemo/Playback/player0") == NULL);
+    CHECK(client_find_by_dbus(":1.100", "/no/such/object") == NULL);
+    CHECK(client_find_by_stream("1", NULL) == NULL);
+    CHECK(client_find_by_stream("1000", "no-such-stream") == NULL);
+    CHECK(client_find_by_dbus(NULL, NULL) == NULL);
+    CHECK(client_find_by_stream(NULL, NULL) == NULL);
+
+    bad   = 0;
+    start = now();
+
+    for (r = 0;  r < ROUNDS;  r++) {
+        for (d = 0;  d < NDBUS;  d++) {
+            for (o = 0;  o < NOBJ;  o++) {
+                names(d, o, dbusid, object, pid, stream);
+
+                if (client_find_by_dbus(dbusid, object) != clients[d][o])
+                    bad++;
+            }
+        }
+    }
+
+    elapsed = now() - start;
+
+    CHECK(bad == 0);
+
+    printf("%d clients: %d lookups in %.3f ms, %.0f lookups/s\n", NCLIENT,
+           ROUNDS * NCLIENT, elapsed * 1000.0,
+           elapsed > 0 ? ROUNDS * NCLIENT / elapsed : 0.0);
+}
+
+static void test_requests(DBusMessage *msg)
+{
+    pbreq_t  *req;
+    client_t *cl;
+    int       d, o, i;
+
+    for (d = 0;  d < NDBUS;  d++) {
+        for (o = 0;  o < NOBJ;  o++) {
+            for (i = 0;  i < NREQ;  i++) {
+                req = pbreq_create(clients[d][o], msg);
+                CHECK(req != NULL);
+
+                trids[d][o][i] = req ? req->trid : 0;
+            }
+        }
+    }
+
+    CHECK(g_hash_table_size(rq_bytrid) == NCLIENT * NREQ);
+
+    for (d = 0;  d < NDBUS;  d++) {
+        for (o = 0;  o < NOBJ;  o++) {
+            cl = clients[d][o];
+
+            for (i = 0;  i < NREQ;  i++) {
+                req = pbreq_get_by_trid(trids[d][o][i]);
+                CHECK(req != NULL && req->cl == cl);
+            }
+
+            /* requests are served in arrival order */
+            req = pbreq_get_first(cl);
+            CHECK(req != NULL && req->trid == trids[d][o][0]);
+
+            pbreq_destroy(req);
+
+            req = pbreq_get_first(cl);
+            CHECK(req != NULL && req->trid == trids[d][o][1]);
+            CHECK(pbreq_get_by_trid(trids[d][o][0]) == NULL);
+        }
+    }
+
+    CHECK(g_hash_table_size(rq_bytrid) == NCLIENT * (NREQ - 1));
+    CHECK(pbreq_get_by_trid(0) == NULL);
+}
+
+static void test_restream(void)
+{
+    client_t *cl = clients[7][2];
+
+    /* the player reports a different process and stream */
+    client_set_stream(cl, "1000", "moved");
+
+    CHECK(client_find_by_stream("1000", "moved") == cl);
+    CHECK(client_find_by_stream("1007", "stream-2") == NULL);
+    CHECK(client_find_by_stream("1000", NULL) == clients[0][0]);
+    CHECK(client_find_by_stream("1007", NULL) == clients[7][0]);
+
+    /* the pid may be reset from the client's own fields */
+    client_set_stream(cl, cl->pid, cl->stream);
+    CHECK(client_find_by_stream("1000", "moved") == cl);
+
+    client_set_stream(cl, "1007", "stream-2");
+    CHECK(client_find_by_stream("1007", "stream-2") == cl);
+    CHECK(client_find_by_stream("1000", "moved") == NULL);
+
+    /* moving the oldest client of a process promotes the next one */
+    client_set_stream(clients[9][0], "1010", "stream-0");
+    CHECK(client_find_by_stream("1009", NULL) == clients[9][1]);
+    client_set_stream(clients[9][0], "1009", "stream-0");
+}
+
+static void test_purge(void)
+{
+    char      dbusid[64], object[64], pid[32], stream[32];
+    int       d, o, i;
+
+    /* every other peer goes away */
+    for (d = 0;  d < NDBUS;  d += 2) {
+        names(d, 0, dbusid, object, pid, stream);
+        client_purge(dbusid);
+    }
+
+    CHECK(nsm == NCLIENT / 2);
+    CHECK(nfact == NCLIENT / 2);
+    CHECK(nwatch == NCLIENT / 2);
+    CHECK(g_hash_table_size(cl_bydbus) == NDBUS / 2);
+    CHECK(g_hash_table_size(rq_bytrid) == NCLIENT / 2 * (NREQ - 1));
+
+    for (d = 0;  d < NDBUS;  d++) {
+        for (o = 0;  o < NOBJ;  o++) {
+            names(d, o, dbusid, object, pid, stream);
+
+            if (d % 2 == 0) {
+                CHECK(client_find_by_dbus(dbusid, object) == NULL);
+                CHECK(client_find_by_stream(pid, stream) == NULL);
+
+                for (i = 1;  i < NREQ;  i++)
+                    CHECK(pbreq_get_by_trid(trids[d][o][i]) == NULL);
+            }
+            else {
+                CHECK(client_find_by_dbus(dbusid, object) == clients[d][o]);
+                CHECK(client_find_by_stream(pid, stream) == clients[d][o]);
+
+                for (i = 1;  i < NREQ;  i++)
+                    CHECK(pbreq_get_by_trid(trids[d][o][i]) != NULL);
+            }
+        }
+    }
+
+    /* purging an unknown peer is harmless */
+    client_purge(":1.1");
+    CHECK(nsm == NCLIENT / 2);
+
+    for (d = 1;  d < NDBUS;  d += 2) {
+        for (o = 0;  o < NOBJ;  o++)
+            client_destroy(clients[d][o]);
+    }
+
+    CHECK(nsm == 0);
+    CHECK(nfact == 0);
+    CHECK(g_hash_table_size(cl_bydbus) == 0);
+    CHECK(g_hash_table_size(cl_bypid) == 0);
+    CHECK(g_hash_table_size(rq_bytrid) == 0);
+    CHECK(cl_head.next == (void *)&cl_head);
+}
+
+int main(int argc, char **argv)
+{
+    DBusMessage *msg;
+
+    (void)argc;
+
+    msg = dbus_message_new_method_call(DBUS_PLAYBACK_SERVICE,
+                                       DBUS_PLAYBACK_MANAGER_PATH,
+                                       DBUS_PLAYBACK_MANAGER_INTERFACE,
+                                       DBUS_PLAYBACK_REQ_STATE_METHOD);
+    if (msg == NULL) {
+        printf("%s: can't create D-Bus message\n", argv[0]);
+        return 77;
+    }
+
+    client_init(NULL);
+    pbreq_init(NULL);
+
+    test_create();
+    test_lookup();
+    test_requests(msg);
+    test_restream();
+    test_purge();
+
+    test_create();              /* once more on the emptied indexes */
+    test_lookup();
+
+    dbus_message_unref(msg);
+
+    printf("%s: %s\n", argv[0], failures ? "FAILED" : "passed");
+
+    return failures ? 1 : 0;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -21,7 +21,13 @@ USA.
 #define SELIST_DIM 3
 
 static client_listhead_t  cl_head;
+static GHashTable        *cl_bydbus;   /* dbusid -> (object -> client) */
+static GHashTable        *cl_bypid;    /* pid -> list of clients */
 
+static void index_by_dbus(client_t *);
+static void unindex_by_dbus(client_t *);
+static void index_by_pid(client_t *);
+static void unindex_by_pid(client_t *);
 static int init_selist(client_t *, fsif_field_t *, int);
 
 static void client_init(OhmPlugin *plugin)
@@ -33,6 +39,10 @@ static void client_init(OhmPlugin *plugin)
     cl_head.next = (void *)&cl_head;
     cl_head.prev = (void *)&cl_head;
 
+    cl_bydbus = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                      (GDestroyNotify)g_hash_table_destroy);
+    cl_bypid  = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
     (void)plugin;
 }
 
@@ -66,6 +76,9 @@ static client_t *client_create(char *dbusid, char *object,
                 cl->playhint = strdup("Play");
                 cl->sm       = sm;  
 
+                cl->requests.next = (void *)&cl->requests;
+                cl->requests.prev = (void *)&cl->requests;
+
                 next = (void *)&cl_head;
                 prev = cl_head.prev;
                 
@@ -74,6 +87,9 @@ static client_t *client_create(char *dbusid, char *object,
                 
                 next->prev = cl;
                 cl->prev   = prev;
+
+                index_by_dbus(cl);
+                index_by_pid(cl);
                 
                 dbusif_watch_client(dbusid, TRUE);
 
@@ -111,6 +127,9 @@ static void client_destroy(client_t *cl)
 
         dbusif_watch_client(cl->dbusid, FALSE);
 
+        unindex_by_dbus(cl);
+        unindex_by_pid(cl);
+
         free(cl->dbusid);
         free(cl->object);
         free(cl->pid);
@@ -122,12 +141,6 @@ static void client_destroy(client_t *cl)
         free(cl->playhint);
         free(cl->rqsetst.value);
         free(cl->rqplayhint.value);
-        
-        if (cl->rqsetst.evsrc != 0)
-            g_source_remove(cl->rqsetst.evsrc);
-
-        if (cl->rqplayhint.evsrc != 0)
-            g_source_remove(cl->rqplayhint.evsrc);
 
         next = cl->next;
         prev = cl->prev;
@@ -141,14 +154,11 @@ static void client_destroy(client_t *cl)
 
 static client_t *client_find_by_dbus(char *dbusid, char *object)
 {
-    client_t *cl;
+    GHashTable *objects;
 
     if (dbusid && object) {
-        for (cl = cl_head.next;   cl != (void *)&cl_head;   cl = cl->next){
-            if (cl->dbusid && !strcmp(dbusid, cl->dbusid) &&
-                cl->object && !strcmp(object, cl->object)   )
-                return cl;
-        }
+        if ((objects = g_hash_table_lookup(cl_bydbus, dbusid)) != NULL)
+            return g_hash_table_lookup(objects, object);
     }
     
     return NULL;
@@ -156,33 +166,64 @@ static client_t *client_find_by_dbus(char *dbusid, char *object)
 
 static client_t *client_find_by_stream(char *pid, char *stream)
 {
+    GSList   *l;
     client_t *cl;
 
     if (pid) {
-        for (cl = cl_head.next;   cl != (void *)&cl_head;   cl = cl->next){
-            if (cl->pid && !strcmp(pid, cl->pid)) {
-                if (!stream)
-                    return cl;
+        for (l = g_hash_table_lookup(cl_bypid, pid);  l;  l = l->next) {
+            cl = l->data;
 
-                if (cl->stream && !strcmp(stream, cl->stream))
-                    return cl;
-            }
+            if (!stream)
+                return cl;
+
+            if (cl->stream && !strcmp(stream, cl->stream))
+                return cl;
         }
     }
     
     return NULL;
 }
 
+static void client_set_stream(client_t *cl, char *pid, char *stream)
+{
+    char *new_pid    = pid    ? strdup(pid)    : NULL;
+    char *new_stream = stream ? strdup(stream) : NULL;
+
+    unindex_by_pid(cl);
+
+    free(cl->pid);
+    free(cl->stream);
+
+    cl->pid    = new_pid;
+    cl->stream = new_stream;
+
+    index_by_pid(cl);
+}
+
 static void client_purge(char *dbusid)
 {
-    client_t *cl, *nxcl;
+    GHashTable     *objects;
+    GHashTableIter  it;
+    gpointer        cl;
+    GSList         *victims, *l;
 
-    for (cl = cl_head.next;  cl != (void *)&cl_head;  cl = nxcl) {
-        nxcl = cl->next;
+    if (!dbusid || !(objects = g_hash_table_lookup(cl_bydbus, dbusid)))
+        return;
 
-        if (cl->dbusid && !strcmp(dbusid, cl->dbusid))
-            client_destroy(cl);
-    }
+    /*
+     * destroying the last client of dbusid frees the object table,
+     * so collect the victims before touching any of them
+     */
+    victims = NULL;
+    g_hash_table_iter_init(&it, objects);
+
+    while (g_hash_table_iter_next(&it, NULL, &cl))
+        victims = g_slist_prepend(victims, cl);
+
+    for (l = victims;  l;  l = l->next)
+        client_destroy(l->data);
+
+    g_slist_free(victims);
 }
 
 static int client_add_factstore_entry(char *dbusid, char *object,
@@ -384,6 +425,70 @@ static void client_save_playback_hint(client_t *cl, client_htype_t type,
     }
 }
 
+static void index_by_dbus(client_t *cl)
+{
+    GHashTable *objects;
+
+    if (!cl->dbusid || !cl->object)
+        return;
+
+    if ((objects = g_hash_table_lookup(cl_bydbus, cl->dbusid)) == NULL) {
+        objects = g_hash_table_new(g_str_hash, g_str_equal);
+        g_hash_table_insert(cl_bydbus, g_strdup(cl->dbusid), objects);
+    }
+
+    g_hash_table_insert(objects, cl->object, cl);
+}
+
+static void unindex_by_dbus(client_t *cl)
+{
+    GHashTable *objects;
+
+    if (!cl->dbusid || !cl->object)
+        return;
+
+    if ((objects = g_hash_table_lookup(cl_bydbus, cl->dbusid)) != NULL) {
+        if (g_hash_table_lookup(objects, cl->object) == cl)
+            g_hash_table_remove(objects, cl->object);
+
+        if (g_hash_table_size(objects) == 0)
+            g_hash_table_remove(cl_bydbus, cl->dbusid);
+    }
+}
+
+static void index_by_pid(client_t *cl)
+{
+    GSList *clients;
+
+    if (!cl->pid)
+        return;
+
+    clients = g_hash_table_lookup(cl_bypid, cl->pid);
+
+    /* appending to a non-empty list keeps its head */
+    if (clients == NULL)
+        g_hash_table_insert(cl_bypid, g_strdup(cl->pid),
+                            g_slist_append(NULL, cl));
+    else
+        g_slist_append(clients, cl);
+}
+
+static void unindex_by_pid(client_t *cl)
+{
+    GSList *clients, *rest;
+
+    if (!cl->pid)
+        return;
+
+    clients = g_hash_table_lookup(cl_bypid, cl->pid);
+    rest    = g_slist_remove(clients, cl);
+
+    if (rest == NULL)
+        g_hash_table_remove(cl_bypid, cl->pid);
+    else if (rest != clients)
+        g_hash_table_replace(cl_bypid, g_strdup(cl->pid), rest);
+}
+
 static int init_selist(client_t *cl, fsif_field_t *selist, int dim)
 {
     if (selist != NULL && dim > 0) {
@@ -25,6 +25,7 @@ USA.
 
 #include "sm.h"
 #include "dbusif.h"
+#include "pbreq.h"
 
 
 #define CLIENT_LIST          \
@@ -32,7 +33,7 @@ USA.
     struct client_s  *prev
 
 typedef struct client_evfire_s {
-    unsigned int      evsrc;
+    int               pending;  /* queued on the sm, or -1 to suppress */
     char             *value;
 } client_evfire_t;
 
@@ -51,6 +52,7 @@ typedef struct client_s {
     client_evfire_t   rqsetst;
     client_evfire_t   rqplayhint;
     sm_t             *sm;         /* state machine instance */
+    pbreq_listhead_t  requests;   /* pending requests, oldest first */
 } client_t;
 
 typedef enum {
@@ -79,6 +81,7 @@ static client_t  *client_create(char *, char *, char *, char *);
 static void       client_destroy(client_t *);
 static client_t  *client_find_by_dbus(char *, char *);
 static client_t  *client_find_by_stream(char *, char *);
+static void       client_set_stream(client_t *, char *, char *);
 static void       client_purge(char *);
 
 static int        client_add_factstore_entry(char *, char *, char *, char *);
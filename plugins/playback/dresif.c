@@ -195,7 +195,9 @@ static int dresif_mute_request(int mute, int transid)
 
     vars[++i] = NULL;
 
+    fsif_transaction_begin();
     status = resolve("audio_mute_request", vars);
+    fsif_transaction_end();
 
     if (status < 0)
         OHM_DEBUG(DBG_DRES, "resolve() failed: (%d) %s", status,
@@ -0,0 +1,931 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+
+/*
+ * Load test harness for the playback plugin.
+ *
+ * A private session bus daemon is started (DBUS_DAEMON overrides the
+ * binary to use) and the plugin is connected to it the way ohmd would
+ * connect it to the real session bus, so every message goes through
+ * dbusif.c, pbreq.c and sm.c as is. The simulated media clients are
+ * spread over -p peer connections, each peer playing one process with
+ * several playback objects. They answer the property queries and sets
+ * of the plugin and emit Hello, Goodbye, RequestState and State Notify
+ * traffic in random order, issuing a burst of -b actions between main
+ * loop runs. Some requests change the stream of the client on the fly.
+ *
+ * The dres resolver is replaced by a 'last player wins' policy: a play
+ * request stops the client which was playing in the same group by
+ * writing its setstate field, and the transaction is completed from
+ * the main loop like the real policy enforcement would do.
+ *
+ * At the end the request latency distribution, the state machine
+ * transitions per second, the event queue statistics and the memory
+ * growth of the process are reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "playback.c"
+
+#define DEFAULT_CLIENTS   200
+#define DEFAULT_PEERS     16
+#define DEFAULT_ACTIONS   20000
+#define SETTLE_TIMEOUT    10.0              /* s to wait for the plugin */
+#define DIM(a)            (int)(sizeof(a) / sizeof(a[0]))
+
+typedef struct sim_peer_s sim_peer_t;
+
+typedef struct {
+    sim_peer_t    *peer;
+    char           object[64];
+    char           stream[32];
+    char          *klass;
+    char          *group;
+    char           state[16];               /* what we report as State */
+    char           reqstate[16];            /* what we asked for */
+    int            registered;              /* said Hello, no Goodbye yet */
+    int            ready;                   /* all properties were queried */
+    dbus_uint32_t  reqserial;               /* pending RequestState if any */
+    double         reqstart;
+    int            nstream;
+} sim_client_t;
+
+struct sim_peer_s {
+    DBusConnection *conn;
+    const char     *name;                   /* unique bus name */
+    char            pid[16];
+    GHashTable     *objects;                /* object path -> sim_client_t */
+    GHashTable     *pending;                /* serial -> sim_client_t */
+};
+
+typedef struct {
+    unsigned long  hellos;
+    unsigned long  goodbyes;
+    unsigned long  requests;
+    unsigned long  restreams;
+    unsigned long  notifies;
+    unsigned long  busy;                    /* actions skipped, client busy */
+    unsigned long  replies;
+    unsigned long  errors;
+    unsigned long  gets;
+    unsigned long  sets;
+    unsigned long  resolves;
+    unsigned long  preempts;
+    unsigned long  completions;
+    double        *latency;                 /* request latencies in usecs */
+    unsigned long  nlatency;
+    unsigned long  maxlatency;
+} sim_stats_t;
+
+static pid_t         daemon_pid;
+static char          address[256];
+static sim_peer_t   *peers;
+static int           npeer = DEFAULT_PEERS;
+static sim_client_t *clients;
+static int           nclient = DEFAULT_CLIENTS;
+static GHashTable   *owners;                /* group -> playing client */
+static sim_stats_t   stats;
+static int           verbose;
+
+static char *classes[] = {
+    "Media", "Media", "Media", "Event", "Game", "Background", "Ringtone"
+};
+
+
+static double now(void);
+static long   rss_kbytes(void);
+static int    daemon_start(void);
+static void   daemon_stop(void);
+static int    sim_resolve(char *, char **);
+static int    peer_dispatch(sim_peer_t *);
+static void   pump(void);
+static int    settle(int (*)(void));
+static int    all_ready(void);
+static int    no_pending(void);
+static int    no_plugin_clients(void);
+static void   client_hello(sim_client_t *);
+static void   client_goodbye(sim_client_t *);
+static void   client_request(sim_client_t *, const char *, int);
+static void   client_notify(sim_client_t *, const char *);
+static void   client_act(sim_client_t *);
+static void   report(int, double, unsigned int, long, long, long);
+static int    compare_double(const void *, const void *);
+
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s [-c clients] [-p peers] [-n actions] [-b burst] "
+           "[-s seed] [-v]\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int           actions = DEFAULT_ACTIONS;
+    int           burst   = 16;
+    unsigned      seed    = time(NULL);
+    sim_peer_t   *peer;
+    sim_client_t *cl;
+    double        start, elapsed;
+    unsigned int  transitions;
+    long          rss_start, rss_loaded, rss_end;
+    int           failed, opt, i;
+
+    while ((opt = getopt(argc, argv, "c:p:n:b:s:vh")) != -1) {
+        switch (opt) {
+        case 'c':   nclient = atoi(optarg);               break;
+        case 'p':   npeer   = atoi(optarg);               break;
+        case 'n':   actions = atoi(optarg);               break;
+        case 'b':   burst   = atoi(optarg);               break;
+        case 's':   seed    = strtoul(optarg, NULL, 10);  break;
+        case 'v':   verbose = TRUE;                       break;
+        default:    usage(argv[0]);
+        }
+    }
+
+    if (nclient <= 0 || npeer <= 0 || actions <= 0 || burst <= 0)
+        usage(argv[0]);
+
+    if (npeer > nclient)
+        npeer = nclient;
+
+    srandom(seed);
+
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+    g_type_init();
+#endif
+
+    if (!daemon_start()) {
+        fprintf(stderr, "failed to start a private bus daemon\n");
+        daemon_stop();
+        exit(1);
+    }
+
+    /* the plugin is not loaded by ohmd, hook it up by hand */
+    resolve = sim_resolve;
+    timeout = -1;
+
+    fsif_init(NULL);
+    client_init(NULL);
+    media_init(NULL);
+    pbreq_init(NULL);
+    sm_init(NULL);
+    dresif_init(NULL);
+
+    if (!session_bus_init(address)) {
+        daemon_stop();
+        exit(1);
+    }
+
+    peers   = calloc(npeer, sizeof(sim_peer_t));
+    clients = calloc(nclient, sizeof(sim_client_t));
+    stats.maxlatency = actions;
+    stats.latency    = calloc(stats.maxlatency, sizeof(double));
+    owners  = g_hash_table_new(g_str_hash, g_str_equal);
+
+    if (peers == NULL || clients == NULL || stats.latency == NULL) {
+        fprintf(stderr, "out of memory\n");
+        daemon_stop();
+        exit(1);
+    }
+
+    for (i = 0;  i < npeer;  i++) {
+        peer = peers + i;
+
+        if ((peer->conn = dbus_connection_open_private(address, NULL)) == NULL ||
+            !dbus_bus_register(peer->conn, NULL)) {
+            fprintf(stderr, "failed to connect to %s\n", address);
+            daemon_stop();
+            exit(1);
+        }
+
+        peer->name    = dbus_bus_get_unique_name(peer->conn);
+        peer->objects = g_hash_table_new(g_str_hash, g_str_equal);
+        peer->pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+        snprintf(peer->pid, sizeof(peer->pid), "%d", 2000 + i);
+    }
+
+    for (i = 0;  i < nclient;  i++) {
+        cl = clients + i;
+
+        cl->peer  = peers + (i % npeer);
+        cl->klass = classes[i % DIM(classes)];
+        cl->group = class_to_group(cl->klass);
+        snprintf(cl->object, sizeof(cl->object), "/org/maemo/Playback/%d", i);
+        snprintf(cl->stream, sizeof(cl->stream), "stream-%d", i);
+
+        g_hash_table_insert(cl->peer->objects, cl->object, cl);
+    }
+
+    rss_start = rss_kbytes();
+    failed    = FALSE;
+
+    for (i = 0;  i < nclient;  i++) {
+        client_hello(clients + i);
+
+        if ((i + 1) % burst == 0)
+            pump();
+    }
+
+    if (!settle(all_ready)) {
+        printf("clients failed to get set up\n");
+        failed = TRUE;
+    }
+
+    rss_loaded  = rss_kbytes();
+    transitions = evstats.transitions;
+    start       = now();
+
+    for (i = 0;  i < actions && !failed;  i++) {
+        client_act(clients + (random() % nclient));
+
+        /* let the main loop run after every burst of actions */
+        if ((i + 1) % burst == 0)
+            pump();
+    }
+
+    if (!failed && !settle(no_pending)) {
+        printf("some requests were left unanswered\n");
+        failed = TRUE;
+    }
+
+    elapsed     = now() - start;
+    transitions = evstats.transitions - transitions;
+    rss_end     = rss_kbytes();
+
+    report(actions, elapsed, transitions, rss_start, rss_loaded, rss_end);
+
+    for (i = 0;  i < nclient;  i++) {
+        if (clients[i].registered)
+            client_goodbye(clients + i);
+    }
+
+    if (!settle(no_plugin_clients)) {
+        printf("clients failed to go away\n");
+        failed = TRUE;
+    }
+
+    printf("memory after all clients said goodbye: %ld kB\n", rss_kbytes());
+
+    sm_exit(NULL);
+    fsif_exit(NULL);
+
+    for (i = 0;  i < npeer;  i++) {
+        dbus_connection_close(peers[i].conn);
+        dbus_connection_unref(peers[i].conn);
+        g_hash_table_destroy(peers[i].objects);
+        g_hash_table_destroy(peers[i].pending);
+    }
+
+    g_hash_table_destroy(owners);
+    free(stats.latency);
+    free(clients);
+    free(peers);
+
+    daemon_stop();
+
+    return failed ? 1 : 0;
+}
+
+
+/*
+ * the stand-in for the resolver
+ */
+
+static sim_client_t *sim_client_find(const char *dbusid, const char *object)
+{
+    int i;
+
+    for (i = 0;  i < npeer;  i++) {
+        if (!strcmp(dbusid, peers[i].name))
+            return g_hash_table_lookup(peers[i].objects, object);
+    }
+
+    return NULL;
+}
+
+static void sim_preempt(sim_client_t *cl)
+{
+    fsif_field_t selist[] = {
+        { fldtype_string , "dbusid"  , .value.string = (char *)cl->peer->name },
+        { fldtype_string , "object"  , .value.string = cl->object },
+        { fldtype_invalid, NULL      , .value.string = NULL       }
+    };
+    fsif_field_t fldlist[] = {
+        { fldtype_string , "setstate", .value.string = "stop"     },
+        { fldtype_invalid, NULL      , .value.string = NULL       }
+    };
+
+    stats.preempts++;
+
+    fsif_update_factstore_entry(FACTSTORE_PLAYBACK, selist, fldlist);
+}
+
+static gboolean sim_complete(gpointer data)
+{
+    long  trid    = GPOINTER_TO_INT(data);
+    long  success = TRUE;
+    void *argv[2] = { &trid, &success };
+
+    stats.completions++;
+
+    completion_cb("playback-load-test", "ii", argv);
+
+    return FALSE;
+}
+
+static int sim_resolve(char *goal, char **locals)
+{
+    sim_client_t *cl, *owner;
+    char         *dbusid, *object, *state;
+    int           trid, i;
+
+    stats.resolves++;
+
+    if (strcmp(goal, "playback_request"))
+        return TRUE;
+
+    dbusid = object = state = NULL;
+    trid   = 0;
+
+    /* name, type, value triplets */
+    for (i = 0;  locals != NULL && locals[i] != NULL;  i += 3) {
+        if (!strcmp(locals[i], "playback_dbusid"))
+            dbusid = locals[i + 2];
+        else if (!strcmp(locals[i], "playback_object"))
+            object = locals[i + 2];
+        else if (!strcmp(locals[i], "playback_state"))
+            state = locals[i + 2];
+        else if (!strcmp(locals[i], "transaction_id"))
+            trid = (int)(long)locals[i + 2];
+    }
+
+    if (!dbusid || !object || !state)
+        return FALSE;
+
+    if ((cl = sim_client_find(dbusid, object)) != NULL) {
+        owner = g_hash_table_lookup(owners, cl->group);
+
+        if (!strcmp(state, "play")) {
+            if (owner != NULL && owner != cl)
+                sim_preempt(owner);
+
+            g_hash_table_insert(owners, cl->group, cl);
+        }
+        else if (owner == cl)
+            g_hash_table_remove(owners, cl->group);
+    }
+
+    /* enforcement completes later, from the main loop */
+    if (trid > 0)
+        g_idle_add(sim_complete, GINT_TO_POINTER(trid));
+
+    return TRUE;
+}
+
+
+/*
+ * the simulated clients
+ */
+
+static void client_send(sim_client_t *cl, DBusMessage *msg,
+                        dbus_uint32_t *serial)
+{
+    if (msg != NULL) {
+        dbus_connection_send(cl->peer->conn, msg, serial);
+        dbus_message_unref(msg);
+    }
+}
+
+static void client_hello(sim_client_t *cl)
+{
+    DBusMessage *msg;
+
+    msg = dbus_message_new_signal(cl->object, DBUS_PLAYBACK_INTERFACE,
+                                  DBUS_HELLO_SIGNAL);
+
+    strcpy(cl->state, "Stop");
+    cl->registered = TRUE;
+    cl->ready      = FALSE;
+
+    stats.hellos++;
+
+    client_send(cl, msg, NULL);
+}
+
+static void client_goodbye(sim_client_t *cl)
+{
+    DBusMessage *msg;
+
+    msg = dbus_message_new_signal(cl->object, DBUS_PLAYBACK_INTERFACE,
+                                  DBUS_GOODBYE_SIGNAL);
+
+    if (g_hash_table_lookup(owners, cl->group) == cl)
+        g_hash_table_remove(owners, cl->group);
+
+    cl->registered = FALSE;
+    cl->ready      = FALSE;
+
+    stats.goodbyes++;
+
+    client_send(cl, msg, NULL);
+}
+
+static void client_request(sim_client_t *cl, const char *state, int restream)
+{
+    DBusMessage *msg;
+    const char  *object = cl->object;
+    const char  *pid    = cl->peer->pid;
+    const char  *stream;
+
+    msg = dbus_message_new_method_call(DBUS_PLAYBACK_MANAGER_INTERFACE,
+                                       DBUS_PLAYBACK_MANAGER_PATH,
+                                       DBUS_PLAYBACK_MANAGER_INTERFACE,
+                                       DBUS_PLAYBACK_REQ_STATE_METHOD);
+    if (msg == NULL)
+        return;
+
+    if (restream) {
+        snprintf(cl->stream, sizeof(cl->stream), "stream-%d.%d",
+                 (int)(cl - clients), ++cl->nstream);
+        stats.restreams++;
+    }
+
+    stream = cl->stream;
+
+    dbus_message_append_args(msg,
+                             DBUS_TYPE_OBJECT_PATH, &object,
+                             DBUS_TYPE_STRING     , &state,
+                             DBUS_TYPE_STRING     , &pid,
+                             DBUS_TYPE_STRING     , &stream,
+                             DBUS_TYPE_INVALID);
+
+    strncpy(cl->reqstate, state, sizeof(cl->reqstate) - 1);
+    cl->reqstart = now();
+
+    stats.requests++;
+
+    client_send(cl, msg, &cl->reqserial);
+
+    g_hash_table_insert(cl->peer->pending, GUINT_TO_POINTER(cl->reqserial),
+                        cl);
+}
+
+static void client_notify(sim_client_t *cl, const char *state)
+{
+    DBusMessage *msg;
+    const char  *iface = DBUS_PLAYBACK_INTERFACE;
+    const char  *prop  = "State";
+
+    msg = dbus_message_new_signal(cl->object, DBUS_INTERFACE_PROPERTIES,
+                                  DBUS_NOTIFY_SIGNAL);
+    if (msg == NULL)
+        return;
+
+    dbus_message_append_args(msg,
+                             DBUS_TYPE_STRING, &iface,
+                             DBUS_TYPE_STRING, &prop,
+                             DBUS_TYPE_STRING, &state,
+                             DBUS_TYPE_INVALID);
+
+    strncpy(cl->state, state, sizeof(cl->state) - 1);
+
+    stats.notifies++;
+
+    client_send(cl, msg, NULL);
+}
+
+static void client_act(sim_client_t *cl)
+{
+    int r;
+
+    if (!cl->registered) {
+        client_hello(cl);
+        return;
+    }
+
+    if (!cl->ready || cl->reqserial != 0) {
+        stats.busy++;
+        return;
+    }
+
+    r = random() % 16;
+
+    if (r < 9)
+        client_request(cl, strcmp(cl->state, "Play") ? "Play" : "Stop", FALSE);
+    else if (r < 11)
+        client_request(cl, "Play", TRUE);
+    else if (r < 15)
+        client_notify(cl, (r & 1) ? "Pause" : "Stop");
+    else
+        client_goodbye(cl);
+}
+
+static const char *property_value(sim_client_t *cl, const char *prop)
+{
+    if (!strcmp(prop, "Pid"))
+        return cl->peer->pid;
+    if (!strcmp(prop, "Class"))
+        return cl->klass;
+    if (!strcmp(prop, "State"))
+        return cl->state;
+    if (!strcmp(prop, "Flags"))
+        return "1";                         /* audio playback */
+
+    return NULL;
+}
+
+static void peer_method(sim_peer_t *peer, DBusMessage *msg)
+{
+    DBusMessage     *reply;
+    DBusMessageIter  it;
+    sim_client_t    *cl;
+    const char      *iface, *prop, *value;
+    int              notify;
+
+    cl     = g_hash_table_lookup(peer->objects, dbus_message_get_path(msg));
+    reply  = NULL;
+    notify = FALSE;
+
+    if (cl == NULL)
+        reply = dbus_message_new_error(msg, DBUS_ERROR_UNKNOWN_OBJECT, NULL);
+    else if (dbus_message_is_method_call(msg, DBUS_INTERFACE_PROPERTIES, "Get")){
+        stats.gets++;
+
+        if (dbus_message_get_args(msg, NULL,
+                                  DBUS_TYPE_STRING, &iface,
+                                  DBUS_TYPE_STRING, &prop,
+                                  DBUS_TYPE_INVALID) &&
+            (value = property_value(cl, prop)) != NULL) {
+            reply = dbus_message_new_method_return(msg);
+            dbus_message_append_args(reply, DBUS_TYPE_STRING, &value,
+                                     DBUS_TYPE_INVALID);
+
+            /* Flags is the last one the plugin asks for */
+            if (!strcmp(prop, "Flags"))
+                cl->ready = TRUE;
+        }
+        else
+            reply = dbus_message_new_error(msg, DBUS_ERROR_INVALID_ARGS, NULL);
+    }
+    else if (dbus_message_is_method_call(msg, DBUS_INTERFACE_PROPERTIES, "Set")){
+        stats.sets++;
+
+        /* interface, name and a string or an array of strings */
+        if (dbus_message_iter_init(msg, &it) &&
+            dbus_message_iter_next(&it) &&
+            dbus_message_iter_get_arg_type(&it) == DBUS_TYPE_STRING) {
+            dbus_message_iter_get_basic(&it, &prop);
+
+            if (!strcmp(prop, "State") && dbus_message_iter_next(&it) &&
+                dbus_message_iter_get_arg_type(&it) == DBUS_TYPE_STRING) {
+                dbus_message_iter_get_basic(&it, &value);
+                strncpy(cl->state, value, sizeof(cl->state) - 1);
+                notify = TRUE;
+            }
+        }
+
+        reply = dbus_message_new_method_return(msg);
+    }
+    else
+        reply = dbus_message_new_error(msg, DBUS_ERROR_UNKNOWN_METHOD, NULL);
+
+    if (reply != NULL) {
+        dbus_connection_send(peer->conn, reply, NULL);
+        dbus_message_unref(reply);
+    }
+
+    /* a real player reports the state it was put in */
+    if (notify)
+        client_notify(cl, cl->state);
+}
+
+static void peer_reply(sim_peer_t *peer, DBusMessage *msg)
+{
+    sim_client_t  *cl;
+    gpointer       serial;
+    double         latency;
+
+    serial = GUINT_TO_POINTER(dbus_message_get_reply_serial(msg));
+
+    if ((cl = g_hash_table_lookup(peer->pending, serial)) == NULL)
+        return;
+
+    g_hash_table_remove(peer->pending, serial);
+    cl->reqserial = 0;
+
+    if (dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_ERROR) {
+        stats.errors++;
+        return;
+    }
+
+    stats.replies++;
+
+    latency = (now() - cl->reqstart) * 1.0e6;
+
+    if (stats.nlatency < stats.maxlatency)
+        stats.latency[stats.nlatency++] = latency;
+
+    strncpy(cl->state, cl->reqstate, sizeof(cl->state) - 1);
+}
+
+static int peer_dispatch(sim_peer_t *peer)
+{
+    DBusMessage *msg;
+    int          n;
+
+    dbus_connection_read_write(peer->conn, 0);
+
+    for (n = 0;  (msg = dbus_connection_pop_message(peer->conn)) != NULL;  n++){
+        switch (dbus_message_get_type(msg)) {
+        case DBUS_MESSAGE_TYPE_METHOD_CALL:
+            peer_method(peer, msg);
+            break;
+        case DBUS_MESSAGE_TYPE_METHOD_RETURN:
+        case DBUS_MESSAGE_TYPE_ERROR:
+            peer_reply(peer, msg);
+            break;
+        default:
+            break;
+        }
+
+        dbus_message_unref(msg);
+    }
+
+    dbus_connection_flush(peer->conn);
+
+    return n;
+}
+
+
+/*
+ * the private bus
+ */
+
+static int daemon_start(void)
+{
+    const char *binary;
+    char        fd[32];
+    int         pipefd[2], n, len;
+
+    if ((binary = getenv("DBUS_DAEMON")) == NULL)
+        binary = "dbus-daemon";
+
+    if (pipe(pipefd) < 0)
+        return FALSE;
+
+    switch ((daemon_pid = fork())) {
+    case -1:
+        return FALSE;
+
+    case 0:
+        close(pipefd[0]);
+        snprintf(fd, sizeof(fd), "--print-address=%d", pipefd[1]);
+        execlp(binary, binary, "--session", "--nofork", fd, (char *)NULL);
+        _exit(127);
+
+    default:
+        close(pipefd[1]);
+        break;
+    }
+
+    len = 0;
+    while (len < (int)sizeof(address) - 1 &&
+           (n = read(pipefd[0], address + len, sizeof(address) - 1 - len)) > 0)
+        if (strchr(address, '\n') != NULL)
+            break;
+        else
+            len += n;
+
+    close(pipefd[0]);
+    address[strcspn(address, "\n")] = '\0';
+
+    return address[0] != '\0';
+}
+
+static void daemon_stop(void)
+{
+    if (daemon_pid > 0) {
+        kill(daemon_pid, SIGTERM);
+        waitpid(daemon_pid, NULL, 0);
+    }
+}
+
+static void pump(void)
+{
+    int i, n;
+
+    do {
+        n = 0;
+
+        while (g_main_context_iteration(NULL, FALSE))
+            n++;
+
+        for (i = 0;  i < npeer;  i++)
+            n += peer_dispatch(peers + i);
+    } while (n > 0);
+}
+
+static int settle(int (*done)(void))
+{
+    double start = now();
+
+    /* messages may still be on their way through the daemon */
+    for (;;) {
+        pump();
+
+        if (done())
+            return TRUE;
+
+        if (now() - start > SETTLE_TIMEOUT)
+            return FALSE;
+
+        usleep(100);
+    }
+}
+
+static int all_ready(void)
+{
+    int i;
+
+    for (i = 0;  i < nclient;  i++) {
+        if (clients[i].registered && !clients[i].ready)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int no_pending(void)
+{
+    int i;
+
+    for (i = 0;  i < npeer;  i++) {
+        if (g_hash_table_size(peers[i].pending) > 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static int no_plugin_clients(void)
+{
+    return cl_head.next == (void *)&cl_head;
+}
+
+
+/*
+ * ohmd stand-ins
+ */
+
+int ohm_module_find_method(char *name, char **sig, void **method)
+{
+    (void)name;
+    (void)sig;
+
+    *method = NULL;
+    return FALSE;
+}
+
+const char *ohm_plugin_get_param(OhmPlugin *plugin, const char *key)
+{
+    (void)plugin;
+    (void)key;
+
+    return NULL;
+}
+
+void ohm_restart(int delay)
+{
+    (void)delay;
+
+    fprintf(stderr, "playback-load-test: restart requested\n");
+    exit(1);
+}
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level == OHM_LOG_ERROR || verbose) {
+        va_start(ap, format);
+        vfprintf(stderr, format, ap);
+        fputs("\n", stderr);
+        va_end(ap);
+    }
+}
+
+
+/*
+ * measurement
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+static long rss_kbytes(void)
+{
+    FILE *f;
+    long  size, resident;
+
+    if ((f = fopen("/proc/self/statm", "r")) == NULL)
+        return -1;
+
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+        resident = -1;
+
+    fclose(f);
+
+    return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return (da > db) - (da < db);
+}
+
+static double percentile(double p)
+{
+    unsigned long idx;
+
+    if (stats.nlatency == 0)
+        return 0.0;
+
+    idx = (unsigned long)(p / 100.0 * (stats.nlatency - 1) + 0.5);
+
+    return stats.latency[idx];
+}
+
+static void report(int actions, double elapsed, unsigned int transitions,
+                   long rss_start, long rss_loaded, long rss_end)
+{
+    qsort(stats.latency, stats.nlatency, sizeof(double), compare_double);
+
+    printf("clients:           %d on %d peers\n", nclient, npeer);
+    printf("actions:           %d (%lu skipped, client busy)\n", actions,
+           stats.busy);
+    printf("hello/goodbye:     %lu/%lu\n", stats.hellos, stats.goodbyes);
+    printf("requests:          %lu (%lu new streams, %lu replied, "
+           "%lu failed)\n", stats.requests, stats.restreams, stats.replies,
+           stats.errors);
+    printf("state notifies:    %lu\n", stats.notifies);
+    printf("property get/set:  %lu/%lu\n", stats.gets, stats.sets);
+    printf("policy resolves:   %lu (%lu preemptions, %lu completions)\n",
+           stats.resolves, stats.preempts, stats.completions);
+    printf("event queue:       %u queued, %u coalesced, %u dropped\n",
+           evstats.queued, evstats.coalesced, evstats.dropped);
+    printf("elapsed:           %.3f s\n", elapsed);
+    printf("throughput:        %.0f requests/s, %.0f transitions/s\n",
+           elapsed > 0.0 ? stats.requests / elapsed : 0.0,
+           elapsed > 0.0 ? transitions / elapsed : 0.0);
+    printf("request latency:   p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+           "max %.1f us (%lu samples)\n", percentile(50.0), percentile(90.0),
+           percentile(99.0), percentile(100.0), stats.nlatency);
+    printf("memory:            %ld kB at start, %ld kB with %d clients, "
+           "%ld kB at the end (%+ld kB during churn)\n",
+           rss_start, rss_loaded, nclient, rss_end, rss_end - rss_loaded);
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
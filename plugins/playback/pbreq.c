@@ -18,14 +18,13 @@ USA.
 *************************************************************************/
 
 
-static pbreq_listhead_t  rq_head;
+static GHashTable  *rq_bytrid;     /* trid -> request */
 
 static void pbreq_init(OhmPlugin *plugin)
 {
     (void)plugin;
 
-    rq_head.next = (void *)&rq_head;
-    rq_head.prev = (void *)&rq_head;
+    rq_bytrid = g_hash_table_new(g_direct_hash, g_direct_equal);
 }
 
 static pbreq_t *pbreq_create(client_t *cl, DBusMessage *msg)
@@ -45,8 +44,8 @@ static pbreq_t *pbreq_create(client_t *cl, DBusMessage *msg)
             req->msg  = msg;
             req->trid = trid++;
 
-            next = (void *)&rq_head;
-            prev = rq_head.prev;
+            next = (void *)&cl->requests;
+            prev = cl->requests.prev;
             
             prev->next = req;
             req->next  = next;
@@ -54,6 +53,8 @@ static pbreq_t *pbreq_create(client_t *cl, DBusMessage *msg)
             next->prev = req;
             req->prev  = prev;
 
+            g_hash_table_insert(rq_bytrid, GINT_TO_POINTER(req->trid), req);
+
             OHM_DEBUG(DBG_QUE, "playback request %d created", req->trid);
         }
     }
@@ -69,6 +70,8 @@ static void pbreq_destroy(pbreq_t *req)
         OHM_DEBUG(DBG_QUE, "playback request %d is going to be destroyed",
                   req->trid);
 
+        g_hash_table_remove(rq_bytrid, GINT_TO_POINTER(req->trid));
+
         prev = req->prev;
         next = req->next;
 
@@ -99,37 +102,23 @@ static void pbreq_destroy(pbreq_t *req)
 
 static pbreq_t *pbreq_get_first(client_t *cl)
 {
-    pbreq_t *req;
-
-    for (req = rq_head.next;   req != (void *)&rq_head;   req = req->next) {
-        if (req->cl == cl)
-            return req;
-    }
+    pbreq_t *req = cl->requests.next;
 
-    return NULL;
+    return req != (void *)&cl->requests ? req : NULL;
 }
 
 static pbreq_t *pbreq_get_by_trid(int trid)
 {
-    pbreq_t *req;
-
-    for (req = rq_head.next;   req != (void *)&rq_head;   req = req->next) {
-        if (req->trid == trid)
-            return req;
-    }
-
-    return NULL;
+    return g_hash_table_lookup(rq_bytrid, GINT_TO_POINTER(trid));
 }
 
 static void pbreq_purge(client_t *cl)
 {
     pbreq_t *req, *nxreq;
 
-    for (req = rq_head.next;   req != (void *)&rq_head;   req = nxreq) {
+    for (req = cl->requests.next;  req != (void *)&cl->requests;  req = nxreq){
         nxreq = req->next;
-
-        if (cl == req->cl)
-            pbreq_destroy(req);
+        pbreq_destroy(req);
     }
 }
 
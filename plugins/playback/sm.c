@@ -50,10 +50,12 @@ typedef struct {
 } sm_def_t;
 
 typedef struct {
-    sm_t         *sm;
-    sm_evdata_t  *evdata;
-    sm_evfree_t   evfree;
-} sm_schedule_t;
+    unsigned int  queued;       /* events put on a queue */
+    unsigned int  coalesced;    /* events merged into an already queued one */
+    unsigned int  dropped;      /* events lost to a full queue */
+    unsigned int  processed;    /* events taken off a queue */
+    unsigned int  transitions;  /* events run through a state machine */
+} sm_evstats_t;
 
 
 sm_evdef_t  evdef[evid_max] = {
@@ -261,10 +263,13 @@ sm_def_t  sm_def = {
 
 
 
+static sm_evstats_t  evstats;
+
 static void  verify_state_machine(void);
-static int   fire_scheduled_event(void *);
-static int   fire_setstate_changed_event(void *);
-static int   fire_playhint_changed_event(void *);
+static int   is_coalescable(sm_evid_t);
+static int   fire_scheduled_events(void *);
+static void  fire_setstate_changed_event(client_t *);
+static void  fire_playhint_changed_event(client_t *);
 static void  fire_hello_signal_event(char *, char *);
 static void  fire_client_gone_event(char *, char *);
 static void  fire_state_signal_event(char *, char *, char *, char *);
@@ -279,6 +284,7 @@ static client_t *find_client_by_fact(fsif_entry_t *);
 static char *strncpylower(char *, const char *, int);
 static char *class_to_group(char *);
 static void  schedule_deferred_request(client_t *);
+static void  schedule_watch_event(client_t *, sm_evid_t);
 static void  schedule_fake_setprop_succeeded_event(client_t *, char *, char *);
 
 
@@ -290,6 +296,7 @@ static void sm_init(OhmPlugin *plugin)
         { fldtype_string , "device", .value.string = "microphone" },
         { fldtype_invalid,   NULL  , .value.string = NULL         }
     };
+    static char *mute_fields[] = { "mute", "forced", NULL };
 
     verify_state_machine();
 
@@ -303,11 +310,22 @@ static void sm_init(OhmPlugin *plugin)
     ADD_FIELD_WATCH(FACTSTORE_PLAYBACK , NULL  , "playhint", playhint_cb );
     ADD_FIELD_WATCH(FACTSTORE_PRIVACY  , NULL  , "value"   , privacy_cb  );
     ADD_FIELD_WATCH(FACTSTORE_BLUETOOTH, NULL  , "value"   , bluetooth_cb);
-    ADD_FIELD_WATCH(FACTSTORE_MUTE     , selist, "mute"    , mute_cb     );
-    ADD_FIELD_WATCH(FACTSTORE_MUTE     , selist, "forced"  , mute_cb     );
 
 #undef ADD_FIELD_WATCH
 
+    /* mute and forced usually change together; signal the outcome once */
+    fsif_add_fields_watch(FACTSTORE_MUTE, selist, mute_fields, mute_cb, NULL);
+
+}
+
+static void sm_exit(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    OHM_INFO("playback: scheduled events: %u queued, %u coalesced, "
+             "%u dropped, %u processed; %u transitions", evstats.queued,
+             evstats.coalesced, evstats.dropped, evstats.processed,
+             evstats.transitions);
 }
 
 static sm_t *sm_create(char *name, void *user_data)
@@ -336,6 +354,8 @@ static sm_t *sm_create(char *name, void *user_data)
 
 static int sm_destroy(sm_t *sm)
 {
+    sm_evqueue_t *ev;
+
     if (!sm)
         return FALSE;
 
@@ -349,6 +369,14 @@ static int sm_destroy(sm_t *sm)
     if (sm->sched != 0)
         g_source_remove(sm->sched);
 
+    for (;  sm->evqlen > 0;  sm->evqlen--) {
+        ev = sm->evq + sm->evqhead;
+        sm->evqhead = (sm->evqhead + 1) % SM_EVQUEUE_DIM;
+
+        if (ev->evfree != NULL)
+            ev->evfree(ev->evdata);
+    }
+
     free(sm->name);
     free(sm);
 
@@ -404,6 +432,7 @@ static int sm_process_event(sm_t *sm, sm_evdata_t *evdata)
               sm->name, event->name, state->name);
 
     sm->busy = TRUE;
+    evstats.transitions++;
 
     if (transit->func == NULL)
         next_stid = transit->stid;
@@ -450,51 +479,75 @@ static int sm_process_event(sm_t *sm, sm_evdata_t *evdata)
     return TRUE;
 }
 
-static void sm_schedule_event(sm_t *sm, sm_evdata_t *evdata,sm_evfree_t evfree)
+static int sm_schedule_event(sm_t *sm, sm_evdata_t *evdata,sm_evfree_t evfree)
 {
-    sm_schedule_t *schedule;
+    sm_evqueue_t *ev;
+    int           i;
 
     if (!sm || !evdata) {
         OHM_ERROR("[%s] failed to schedule event: <null> argument",
                   sm ? sm->name : "SM-NULL");
-        return;
+        return FALSE;
     }
 
     if (evdata->evid < 0 || evdata->evid >= evid_max) {
         OHM_ERROR("[%s] failed to schedule event: invalid event ID %d",
                   sm->name, evdata->evid);
-        return;
+        return FALSE;
     }
 
-    if (sm->sched != 0) {
-        OHM_ERROR("[%s] failed to schedule event: multiple requests",sm->name);
-        return;
-    }
+    if (is_coalescable(evdata->evid)) {
+        for (i = 0;  i < sm->evqlen;  i++) {
+            ev = sm->evq + (sm->evqhead + i) % SM_EVQUEUE_DIM;
 
-    if ((schedule = malloc(sizeof(*schedule))) == NULL) {
-        OHM_ERROR("[%s] failed to schedule event: malloc failed", sm->name);
-        return;
-    }
+            if (ev->evdata->evid == evdata->evid) {
+                OHM_DEBUG(DBG_SM, "[%s] event '%s' is already scheduled",
+                          sm->name, evdef[evdata->evid].name);
 
-    schedule->sm     = sm;
-    schedule->evdata = evdata;
-    schedule->evfree = evfree;
+                evstats.coalesced++;
 
-    sm->sched = g_idle_add(fire_scheduled_event, schedule);
+                if (evfree != NULL)
+                    evfree(evdata);
+                return TRUE;
+            }
+        }
+    }
 
-    if (sm->sched == 0) {
-        OHM_ERROR("[%s] failed to schedule event: g_idle_add() failed",
-                  sm->name);
+    if (sm->evqlen >= SM_EVQUEUE_DIM) {
+        OHM_ERROR("[%s] failed to schedule event '%s': queue is full",
+                  sm->name, evdef[evdata->evid].name);
 
-        free(schedule);
+        evstats.dropped++;
 
         if (evfree != NULL)
             evfree(evdata);
+        return FALSE;
     }
-    else {
-        OHM_DEBUG(DBG_SM, "[%s] schedule event '%s'",
-                  sm->name, evdef[evdata->evid].name);
+
+    if (sm->sched == 0) {
+        if ((sm->sched = g_idle_add(fire_scheduled_events, sm)) == 0) {
+            OHM_ERROR("[%s] failed to schedule event: g_idle_add() failed",
+                      sm->name);
+
+            evstats.dropped++;
+
+            if (evfree != NULL)
+                evfree(evdata);
+            return FALSE;
+        }
     }
+
+    ev = sm->evq + (sm->evqhead + sm->evqlen) % SM_EVQUEUE_DIM;
+    ev->evdata = evdata;
+    ev->evfree = evfree;
+
+    sm->evqlen++;
+    evstats.queued++;
+
+    OHM_DEBUG(DBG_SM, "[%s] schedule event '%s' (%d queued)",
+              sm->name, evdef[evdata->evid].name, sm->evqlen);
+
+    return TRUE;
 }
 
 static void sm_free_evdata(sm_evdata_t *evdata)
@@ -586,35 +639,72 @@ static void verify_state_machine()
         exit(EINVAL);
 }
 
-static int fire_scheduled_event(void *data)
+static int is_coalescable(sm_evid_t evid)
+{
+    /*
+     * these events carry no data of their own: the transitions pick up
+     * the latest request from the client, so a second one in the queue
+     * would only rerun the state machine on the same input
+     */
+    switch (evid) {
+    case evid_playback_request:
+    case evid_setstate_changed:
+    case evid_playhint_changed:
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static int fire_scheduled_events(void *data)
 {
-    sm_schedule_t *schedule = (sm_schedule_t *)data;
-    sm_t          *sm       = schedule->sm;
-    sm_evdata_t   *evdata   = schedule->evdata;
+    sm_t         *sm = (sm_t *)data;
+    sm_evqueue_t  ev;
+    int           n;
 
-    sm->sched = 0;
+    OHM_DEBUG(DBG_SM, "[%s] fire %d scheduled event(s)", sm->name,sm->evqlen);
 
-    OHM_DEBUG(DBG_SM, "[%s] fire event", sm->name);
+    /* events scheduled by the transitions wait for the next round */
+    for (n = sm->evqlen;  n > 0 && sm->evqlen > 0;  n--) {
+        ev = sm->evq[sm->evqhead];
 
-    sm_process_event(sm, evdata);
+        sm->evqhead = (sm->evqhead + 1) % SM_EVQUEUE_DIM;
+        sm->evqlen--;
 
-    if (schedule->evfree != NULL)
-        schedule->evfree(evdata);
+        evstats.processed++;
 
-    free(schedule);
+        switch (ev.evdata->evid) {
+        case evid_setstate_changed:
+            fire_setstate_changed_event((client_t *)sm->data);
+            break;
+        case evid_playhint_changed:
+            fire_playhint_changed_event((client_t *)sm->data);
+            break;
+        default:
+            sm_process_event(sm, ev.evdata);
+            break;
+        }
+
+        if (ev.evfree != NULL)
+            ev.evfree(ev.evdata);
+    }
 
-    return FALSE;               /* run only once */
+    if (sm->evqlen > 0)
+        return TRUE;            /* keep draining */
+
+    sm->sched = 0;
+
+    return FALSE;
 }
 
-static int fire_setstate_changed_event(void *data)
+static void fire_setstate_changed_event(client_t *cl)
 {
-    client_t    *cl      = (client_t *)data;
     sm_t        *sm      = cl->sm;
     char        *state   = client_get_state(cl, client_state  , NULL,0);
     char        *rqsetst = client_get_state(cl, client_rqsetst, NULL,0); 
     sm_evdata_t  evdata;
 
-    cl->rqsetst.evsrc = 0;
+    cl->rqsetst.pending = 0;
     
     if (*rqsetst == '\0')
         OHM_ERROR("something went wrong: rqsetst.value == NULL");
@@ -634,14 +724,11 @@ static int fire_setstate_changed_event(void *data)
 
         sm_process_event(sm, &evdata);
     }
-
-    return FALSE;               /* run only once */
 }
 
 
-static int fire_playhint_changed_event(void *data)
+static void fire_playhint_changed_event(client_t *cl)
 {
-    client_t    *cl  = (client_t *)data;
     sm_t        *sm  = cl->sm;
     char        *playhint;
     char        *rqplayhint;
@@ -650,7 +737,7 @@ static int fire_playhint_changed_event(void *data)
     playhint   = client_get_playback_hint(cl, client_playhint,   NULL,0);
     rqplayhint = client_get_playback_hint(cl, client_rqplayhint, NULL,0); 
 
-    cl->rqplayhint.evsrc = 0;
+    cl->rqplayhint.pending = 0;
     
     if (*rqplayhint == '\0')
         OHM_ERROR("something went wrong: rqplayhint.value == NULL");
@@ -670,8 +757,6 @@ static int fire_playhint_changed_event(void *data)
 
         sm_process_event(sm, &evdata);
     }
-
-    return FALSE;               /* run only once */
 }
 
 static void fire_hello_signal_event(char *dbusid, char *object)
@@ -741,7 +826,7 @@ static int save_property(sm_evdata_t *evdata, void *usrdata)
     char        *end;
 
     if (!strcmp(property->name, "Pid")) {
-        cl->pid = strdup(property->value);
+        client_set_stream(cl, property->value, cl->stream);
         client_update_factstore_entry(cl, "pid", cl->pid);
         
         OHM_DEBUG(DBG_TRANS, "[%s] playback pid is set to %s",
@@ -835,7 +920,7 @@ static int save_property(sm_evdata_t *evdata, void *usrdata)
             client_save_state(cl, client_reqstate, state);
             client_update_factstore_entry(cl, "reqstate", state);
             
-            cl->rqsetst.evsrc = -1; /* disable 'setstate changed' event */
+            cl->rqsetst.pending = -1; /* disable 'setstate changed' event */
 
             if (!(state_accepted = dresif_playback_state_request(cl,state,0))){
                 client_save_state(cl, client_rqsetst, "stop");
@@ -843,7 +928,7 @@ static int save_property(sm_evdata_t *evdata, void *usrdata)
                 client_update_factstore_entry(cl, "reqstate", "stop");
             }
 
-            cl->rqsetst.evsrc = 0; /* enable 'setstate changed' event */
+            cl->rqsetst.pending = 0; /* enable 'setstate changed' event */
         }
 
         schedev = state_accepted ? &setup_complete : &state_denied;
@@ -988,11 +1073,7 @@ static int process_pbreq(sm_evdata_t *evdata, void *usrdata)
                                                    old_pid, old_str);
                 }
 
-                if (cl->pid)    free(cl->pid);
-                if (cl->stream) free(cl->stream);
-
-                cl->pid    = pid    ? strdup(pid)    : NULL;
-                cl->stream = stream ? strdup(stream) : NULL;
+                client_set_stream(cl, pid, stream);
 
                 client_update_factstore_entry(cl, "pid", pid);
                 if (stream) {
@@ -1342,12 +1423,11 @@ static void setstate_cb(fsif_entry_t *entry, char *name, fsif_field_t *fld,
     OHM_DEBUG(DBG_QUE, "[%s] rqsetst is set to '%s'",
               sm->name, cl->rqsetst.value);
 
-    if (cl->rqsetst.evsrc == 0 && cl->rqplayhint.evsrc == 0) {
-        OHM_DEBUG(DBG_SM, "[%s] schedule event '%s'", sm->name,
-                  evdef[evid_setstate_changed].name);
-
-        cl->rqsetst.evsrc = g_idle_add(fire_setstate_changed_event, cl);
-    }
+    /* a pending event will pick up the new value */
+    if (cl->rqsetst.pending == 0 && cl->rqplayhint.pending == 0)
+        schedule_watch_event(cl, evid_setstate_changed);
+    else
+        evstats.coalesced++;
 }
 
 static void playhint_cb(fsif_entry_t *entry, char *name, fsif_field_t *fld,
@@ -1382,12 +1462,11 @@ static void playhint_cb(fsif_entry_t *entry, char *name, fsif_field_t *fld,
     OHM_DEBUG(DBG_QUE, "[%s] rqplayhint is set to '%s'",
               sm->name, cl->rqplayhint.value);
 
-    if (cl->rqsetst.evsrc == 0 && cl->rqplayhint.evsrc == 0) {
-        OHM_DEBUG(DBG_SM, "[%s] schedule event '%s'", sm->name,
-                  evdef[evid_playhint_changed].name);
-
-        cl->rqplayhint.evsrc = g_idle_add(fire_playhint_changed_event, cl);
-    }
+    /* a pending event will pick up the new value */
+    if (cl->rqsetst.pending == 0 && cl->rqplayhint.pending == 0)
+        schedule_watch_event(cl, evid_playhint_changed);
+    else
+        evstats.coalesced++;
 }
 
 static void privacy_cb(fsif_entry_t *entry, char *name, fsif_field_t *fld,
@@ -1586,25 +1665,34 @@ static void schedule_deferred_request(client_t *cl)
         return;
     }
 
-    if (cl->rqsetst.value != NULL && cl->rqsetst.evsrc == 0) {
-        OHM_DEBUG(DBG_SM, "[%s] schedule event '%s'", sm->name,
-                  evdef[evid_setstate_changed].name);
-
-        cl->rqsetst.evsrc = g_idle_add(fire_setstate_changed_event, cl);
+    if (cl->rqsetst.value != NULL && cl->rqsetst.pending == 0) {
+        schedule_watch_event(cl, evid_setstate_changed);
         return;
     }
 
-    if (cl->rqplayhint.value != NULL && cl->rqplayhint.evsrc == 0) {
-        OHM_DEBUG(DBG_SM, "[%s] schedule event '%s'", sm->name,
-                  evdef[evid_playhint_changed].name);
-
-        cl->rqplayhint.evsrc = g_idle_add(fire_playhint_changed_event, cl);
+    if (cl->rqplayhint.value != NULL && cl->rqplayhint.pending == 0) {
+        schedule_watch_event(cl, evid_playhint_changed);
         return;
     }
 
     OHM_DEBUG(DBG_SM, "[%s] no deferred request", sm->name);
 }
 
+static void schedule_watch_event(client_t *cl, sm_evid_t evid)
+{
+    static sm_evdata_t  setstate = { .evid = evid_setstate_changed };
+    static sm_evdata_t  playhint = { .evid = evid_playhint_changed };
+
+    /*
+     * the value is left in the client: when the event fires it is
+     * compared with the current one and passed on to the state machine
+     */
+    if (evid == evid_setstate_changed)
+        cl->rqsetst.pending = sm_schedule_event(cl->sm, &setstate, NULL);
+    else
+        cl->rqplayhint.pending = sm_schedule_event(cl->sm, &playhint, NULL);
+}
+
 static void schedule_fake_setprop_succeeded_event(client_t *cl, char *prname,
                                                  char *prvalue)
 {
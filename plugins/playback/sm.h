@@ -53,11 +53,21 @@ typedef enum {
     stid_max
 } sm_stid_t;
 
+#define SM_EVQUEUE_DIM  16   /* max. number of scheduled events per sm */
+
+typedef struct {
+    union sm_evdata_u  *evdata;
+    void              (*evfree)(union sm_evdata_u *);
+} sm_evqueue_t;
+
 typedef struct {
     char         *name;       /* name of the state machine instance */
     sm_stid_t     stid;       /* ID of the current state */
     int           busy;       /* to prevent nested event processing */
-    unsigned int  sched;      /* event source for scheduled event if any */
+    unsigned int  sched;      /* event source draining the event queue */
+    sm_evqueue_t  evq[SM_EVQUEUE_DIM]; /* scheduled events, oldest first */
+    int           evqhead;    /* index of the oldest scheduled event */
+    int           evqlen;     /* number of scheduled events */
     void         *data;       /* passed to trfunc() as second arg */
 } sm_t;
 
@@ -95,11 +105,12 @@ typedef void (*sm_evfree_t)(sm_evdata_t *);
  */
 
 static void  sm_init(OhmPlugin *);
+static void  sm_exit(OhmPlugin *);
 static sm_t *sm_create(char *, void *);
 static int   sm_destroy(sm_t *);
 static void  sm_rename(sm_t *, char *);
 static int   sm_process_event(sm_t *, sm_evdata_t *);
-static void  sm_schedule_event(sm_t *, sm_evdata_t *, sm_evfree_t);
+static int   sm_schedule_event(sm_t *, sm_evdata_t *, sm_evfree_t);
 static void  sm_free_evdata(sm_evdata_t *);
 
 
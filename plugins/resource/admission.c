@@ -0,0 +1,625 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Admission control of the acquire, update and release requests.
+ *
+ * Every client (ie. D-Bus peer) has a token bucket which is refilled
+ * with 'rate-limit' tokens per second up to 'rate-burst' tokens. An
+ * acquire or update costs a token. Requests of a client with an empty
+ * bucket are deferred and served round-robin with the other waiting
+ * clients as their buckets refill, so a client flooding the manager
+ * can't starve the others of policy decisions. Releases are free but
+ * are queued behind the deferred requests of the client to keep the
+ * ordering. A release is never rejected: it cancels the deferred
+ * acquires and all but the latest deferred update of its set, and a
+ * release right behind a deferred release of
+ * the same set is merged into that one and answered once it has run.
+ * Once a client has 'rate-queue' deferred requests any further acquire
+ * or update is rejected with EBUSY.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <dbus/dbus.h>
+
+#include "plugin.h"
+#include "admission.h"
+#include "manager.h"
+
+#define DEFAULT_BURST   10
+#define DEFAULT_QUEUE   32
+#define SWEEP_INTERVAL  256     /* admissions between idle client sweeps */
+
+typedef struct deferred_s {
+    struct deferred_s   *next;
+    resproto_handler_t   handler;
+    int                  costs;         /* consumes a token */
+    resmsg_t             msg;
+    char                *klass;         /* our copy of msg.record.klass */
+    resset_t            *resset;
+    void                *proto_data;
+    struct deferred_s   *merged;        /* releases answered with this one */
+} deferred_t;
+
+typedef struct client_s {
+    struct client_s     *next;          /* next in the round-robin queue */
+    char                *name;
+    double               tokens;
+    double               stamp;         /* when the bucket was refilled */
+    deferred_t          *head;
+    deferred_t          *tail;
+    int                  length;        /* number of deferred requests */
+    int                  scheduled;     /* on the round-robin queue */
+} client_t;
+
+static double             rate;         /* tokens/sec; 0 disables limits */
+static double             burst;        /* size of the buckets */
+static int                qlen;         /* max. deferred requests/client */
+static GHashTable        *clients;
+static client_t          *rr_head;
+static client_t          *rr_tail;
+static int                rr_count;
+static guint              srcid;
+static unsigned int       nadmit;
+static admission_stats_t  stats;
+
+static long       get_param(OhmPlugin *, const char *, long);
+static double     current_time(void);
+static client_t  *client_get(const char *, double);
+static void       client_destroy(gpointer);
+static void       refill(client_t *, double);
+static void       admit(resproto_handler_t, int, resmsg_t *, resset_t *,
+                        void *);
+static void       defer(client_t *, resproto_handler_t, int, resmsg_t *,
+                        resset_t *, void *);
+static deferred_t *deferred_create(resproto_handler_t, int, resmsg_t *,
+                                   resset_t *, void *);
+static void       supersede(client_t *, resset_t *);
+static void       rr_append(client_t *);
+static void       deferred_destroy(deferred_t *);
+static int        serve(client_t *);
+static void       schedule(double);
+static gboolean   dispatch_cb(gpointer);
+static gboolean   idle_client(gpointer, gpointer, gpointer);
+
+
+/*! \addtogroup pubif
+ *  Functions
+ *  @{
+ */
+
+void admission_init(OhmPlugin *plugin)
+{
+    ENTER;
+
+    rate  = get_param(plugin, "rate-limit", 0);
+    burst = get_param(plugin, "rate-burst", DEFAULT_BURST);
+    qlen  = get_param(plugin, "rate-queue", DEFAULT_QUEUE);
+
+    if (burst < 1)
+        burst = 1;
+
+    if (rate <= 0) {
+        rate = 0;
+        OHM_INFO("resource: request rate limiting is disabled");
+    }
+    else {
+        clients = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                        NULL, client_destroy);
+
+        OHM_INFO("resource: request rate is limited to %.0f/sec per client "
+                 "(burst %.0f, queue %d)", rate, burst, qlen);
+    }
+
+    LEAVE;
+}
+
+void admission_exit(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    if (srcid) {
+        g_source_remove(srcid);
+        srcid = 0;
+    }
+
+    rr_head  = rr_tail = NULL;
+    rr_count = 0;
+
+    if (clients != NULL) {
+        OHM_INFO("resource: %lu requests admitted, %lu deferred, "
+                 "%lu dropped", stats.admitted, stats.deferred, stats.dropped);
+
+        g_hash_table_destroy(clients);
+        clients = NULL;
+    }
+}
+
+void admission_update(resmsg_t *msg, resset_t *resset, void *proto_data)
+{
+    admit(manager_update, TRUE, msg, resset, proto_data);
+}
+
+void admission_acquire(resmsg_t *msg, resset_t *resset, void *proto_data)
+{
+    admit(manager_acquire, TRUE, msg, resset, proto_data);
+}
+
+void admission_release(resmsg_t *msg, resset_t *resset, void *proto_data)
+{
+    admit(manager_release, FALSE, msg, resset, proto_data);
+}
+
+void admission_cancel(resset_t *resset)
+{
+    client_t    *cl;
+    deferred_t  *prev;
+    deferred_t  *d;
+
+    if (clients == NULL || resset->peer == NULL ||
+        (cl = g_hash_table_lookup(clients, resset->peer)) == NULL)
+        return;
+
+    for (prev = (deferred_t *)&cl->head;  (d = prev->next) != NULL; ) {
+        if (d->resset != resset)
+            prev = d;
+        else {
+            OHM_DEBUG(DBG_MGR, "canceling deferred request of %s/%u",
+                      resset->peer, resset->id);
+
+            if ((prev->next = d->next) == NULL)
+                cl->tail = (prev == (deferred_t *)&cl->head) ? NULL : prev;
+
+            cl->length--;
+            deferred_destroy(d);
+        }
+    }
+}
+
+void admission_get_stats(admission_stats_t *s)
+{
+    *s = stats;
+}
+
+/*!
+ * @}
+ */
+
+static long get_param(OhmPlugin *plugin, const char *name, long defval)
+{
+    const char *str;
+    char       *e;
+    long        value;
+
+    if ((str = ohm_plugin_get_param(plugin, name)) == NULL)
+        return defval;
+
+    value = strtol(str, &e, 10);
+
+    if (*e != '\0' || value < 0) {
+        OHM_ERROR("resource: invalid value '%s' for '%s'", str, name);
+        return defval;
+    }
+
+    return value;
+}
+
+static double current_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+static client_t *client_get(const char *name, double now)
+{
+    client_t *cl;
+
+    if ((cl = g_hash_table_lookup(clients, name)) == NULL) {
+        if ((cl = calloc(1, sizeof(client_t))) == NULL ||
+            (cl->name = strdup(name)) == NULL)
+        {
+            free(cl);
+            return NULL;
+        }
+
+        cl->tokens = burst;
+        cl->stamp  = now;
+
+        g_hash_table_insert(clients, cl->name, cl);
+    }
+
+    return cl;
+}
+
+static void client_destroy(gpointer data)
+{
+    client_t   *cl = data;
+    deferred_t *d;
+
+    while ((d = cl->head) != NULL) {
+        cl->head = d->next;
+        deferred_destroy(d);
+    }
+
+    free(cl->name);
+    free(cl);
+}
+
+static void refill(client_t *cl, double now)
+{
+    if (now > cl->stamp) {
+        cl->tokens += (now - cl->stamp) * rate;
+
+        if (cl->tokens > burst)
+            cl->tokens = burst;
+
+        cl->stamp = now;
+    }
+}
+
+static void admit(resproto_handler_t  handler,
+                  int                 costs,
+                  resmsg_t           *msg,
+                  resset_t           *resset,
+                  void               *proto_data)
+{
+    client_t   *cl;
+    deferred_t *d;
+    double      now;
+
+    if (!rate || resset->peer == NULL) {
+        handler(msg, resset, proto_data);
+        return;
+    }
+
+    now = current_time();
+
+    if ((cl = client_get(resset->peer, now)) == NULL) {
+        OHM_ERROR("resource: [%s] memory allocation failure; "
+                  "admitting request", __FUNCTION__);
+        handler(msg, resset, proto_data);
+        return;
+    }
+
+    refill(cl, now);
+
+    if (!cl->length && (!costs || cl->tokens >= 1.0)) {
+        if (costs)
+            cl->tokens -= 1.0;
+
+        stats.admitted++;
+        handler(msg, resset, proto_data);
+    }
+    else if (!costs) {
+        /* releases are never dropped, they make room instead */
+        supersede(cl, resset);
+
+        if (cl->tail != NULL && !cl->tail->costs &&
+            cl->tail->resset == resset) {
+            OHM_DEBUG(DBG_MGR, "release of %s/%u is deferred already",
+                      resset->peer, resset->id);
+
+            if ((d = deferred_create(handler, costs, msg, resset,
+                                     proto_data)) != NULL) {
+                d->next          = cl->tail->merged;
+                cl->tail->merged = d;
+            }
+            else
+                handler(msg, resset, proto_data);
+        }
+        else if (!cl->length) {
+            stats.admitted++;
+            handler(msg, resset, proto_data);
+        }
+        else {
+            defer(cl, handler, costs, msg, resset, proto_data);
+            schedule(now);
+        }
+    }
+    else if (cl->length >= qlen) {
+        OHM_DEBUG(DBG_MGR, "dropping request of %s/%u: %d requests "
+                  "deferred already", resset->peer, resset->id, cl->length);
+
+        stats.dropped++;
+        resproto_reply_message(resset, msg, proto_data, EBUSY,strerror(EBUSY));
+    }
+    else {
+        defer(cl, handler, costs, msg, resset, proto_data);
+        schedule(now);
+    }
+
+    if (++nadmit >= SWEEP_INTERVAL) {
+        nadmit = 0;
+        g_hash_table_foreach_remove(clients, idle_client, &now);
+    }
+}
+
+static void defer(client_t           *cl,
+                  resproto_handler_t  handler,
+                  int                 costs,
+                  resmsg_t           *msg,
+                  resset_t           *resset,
+                  void               *proto_data)
+{
+    deferred_t *d;
+
+    if ((d = deferred_create(handler,costs,msg,resset,proto_data)) == NULL) {
+        handler(msg, resset, proto_data);
+        return;
+    }
+
+    if (cl->tail != NULL)
+        cl->tail->next = d;
+    else
+        cl->head = d;
+
+    cl->tail = d;
+    cl->length++;
+
+    stats.deferred++;
+
+    OHM_DEBUG(DBG_MGR, "deferring request of %s/%u (%d deferred)",
+              resset->peer, resset->id, cl->length);
+
+    if (!cl->scheduled)
+        rr_append(cl);
+}
+
+static deferred_t *deferred_create(resproto_handler_t  handler,
+                                   int                 costs,
+                                   resmsg_t           *msg,
+                                   resset_t           *resset,
+                                   void               *proto_data)
+{
+    resconn_t  *resconn = resset->resconn;
+    deferred_t *d;
+
+    if ((d = calloc(1, sizeof(deferred_t))) == NULL) {
+        OHM_ERROR("resource: [%s] memory allocation failure; "
+                  "admitting request", __FUNCTION__);
+        return NULL;
+    }
+
+    memcpy(&d->msg, msg, sizeof(resmsg_t));
+
+    if (msg->type == RESMSG_UPDATE && msg->record.klass != NULL)
+        d->msg.record.klass = d->klass = strdup(msg->record.klass);
+
+    /* the reply is sent later on; keep the method call message around */
+    if (proto_data != NULL && resconn->any.transp == RESPROTO_TRANSPORT_DBUS)
+        dbus_message_ref((DBusMessage *)proto_data);
+
+    d->handler    = handler;
+    d->costs      = costs;
+    d->resset     = resset;
+    d->proto_data = proto_data;
+
+    stats.waiting++;
+
+    return d;
+}
+
+/*
+ * A release of a set makes its deferred acquires pointless; they are
+ * acknowledged and dropped. Of its deferred updates only the latest one
+ * is kept, as every update carries the complete set definition.
+ */
+static void supersede(client_t *cl, resset_t *resset)
+{
+    deferred_t *prev;
+    deferred_t *d;
+    deferred_t *update;
+
+    for (update = NULL, d = cl->head;  d != NULL;  d = d->next) {
+        if (d->resset == resset && d->handler == manager_update)
+            update = d;
+    }
+
+    for (prev = (deferred_t *)&cl->head;  (d = prev->next) != NULL; ) {
+        if (d->resset != resset || !d->costs || d == update)
+            prev = d;
+        else {
+            OHM_DEBUG(DBG_MGR, "deferred %s of %s/%u superseded by release",
+                      d->handler == manager_update ? "update" : "acquire",
+                      resset->peer, resset->id);
+
+            if ((prev->next = d->next) == NULL)
+                cl->tail = (prev == (deferred_t *)&cl->head) ? NULL : prev;
+
+            cl->length--;
+
+            resproto_reply_message(d->resset, &d->msg, d->proto_data,
+                                   0, "OK");
+            deferred_destroy(d);
+        }
+    }
+}
+
+static void rr_append(client_t *cl)
+{
+    cl->scheduled = TRUE;
+    cl->next      = NULL;
+
+    if (rr_tail != NULL)
+        rr_tail->next = cl;
+    else
+        rr_head = cl;
+
+    rr_tail = cl;
+    rr_count++;
+}
+
+static void deferred_destroy(deferred_t *d)
+{
+    resconn_t  *resconn = d->resset->resconn;
+    deferred_t *m;
+
+    while ((m = d->merged) != NULL) {
+        d->merged = m->next;
+        deferred_destroy(m);
+    }
+
+    if (d->proto_data != NULL &&
+        resconn->any.transp == RESPROTO_TRANSPORT_DBUS)
+        dbus_message_unref((DBusMessage *)d->proto_data);
+
+    free(d->klass);
+    free(d);
+
+    stats.waiting--;
+}
+
+/*
+ * pass the oldest deferred request of a client to the manager if the
+ * client can afford it
+ */
+static int serve(client_t *cl)
+{
+    deferred_t *d;
+    deferred_t *m;
+
+    if ((d = cl->head) == NULL)
+        return FALSE;
+
+    if (d->costs) {
+        if (cl->tokens < 1.0)
+            return FALSE;
+
+        cl->tokens -= 1.0;
+    }
+
+    if ((cl->head = d->next) == NULL)
+        cl->tail = NULL;
+
+    cl->length--;
+
+    d->handler(&d->msg, d->resset, d->proto_data);
+
+    /* releases merged into this one are done by now */
+    for (m = d->merged;  m != NULL;  m = m->next)
+        resproto_reply_message(m->resset, &m->msg, m->proto_data, 0, "OK");
+
+    deferred_destroy(d);
+
+    return TRUE;
+}
+
+/*
+ * arm the timer for the earliest moment any of the waiting clients
+ * can be served
+ */
+static void schedule(double now)
+{
+    client_t *cl;
+    double    wait, min;
+
+    if (srcid || rr_head == NULL)
+        return;
+
+    for (min = -1.0, cl = rr_head;  cl != NULL;  cl = cl->next) {
+        refill(cl, now);
+
+        if (cl->head == NULL || !cl->head->costs || cl->tokens >= 1.0)
+            wait = 0.0;
+        else
+            wait = (1.0 - cl->tokens) / rate;
+
+        if (min < 0.0 || wait < min)
+            min = wait;
+    }
+
+    /* round up, so the tokens are there by the time we wake up */
+    srcid = g_timeout_add(min > 0.0 ? (guint)(min * 1000.0) + 1 : 0,
+                          dispatch_cb, NULL);
+}
+
+static gboolean dispatch_cb(gpointer data)
+{
+    client_t *cl;
+    double    now;
+    int       progress;
+    int       i, n;
+
+    (void)data;
+
+    srcid = 0;
+    now   = current_time();
+
+    /* one request per client and round, until nobody can afford more */
+    do {
+        progress = FALSE;
+
+        for (i = 0, n = rr_count;  i < n && rr_head != NULL;  i++) {
+            cl = rr_head;
+
+            if ((rr_head = cl->next) == NULL)
+                rr_tail = NULL;
+
+            rr_count--;
+
+            refill(cl, now);
+
+            if (serve(cl))
+                progress = TRUE;
+
+            cl->scheduled = FALSE;
+
+            if (cl->length > 0)
+                rr_append(cl);
+        }
+    } while (progress && rr_head != NULL);
+
+    schedule(now);
+
+    return FALSE;
+}
+
+static gboolean idle_client(gpointer key, gpointer value, gpointer data)
+{
+    client_t *cl  = value;
+    double    now = *(double *)data;
+
+    (void)key;
+
+    if (cl->scheduled || cl->length > 0)
+        return FALSE;
+
+    refill(cl, now);
+
+    /* a full bucket is as good as a fresh one */
+    return cl->tokens >= burst;
+}
+
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
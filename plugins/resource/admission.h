@@ -0,0 +1,57 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#ifndef __OHM_RESOURCE_ADMISSION_H__
+#define __OHM_RESOURCE_ADMISSION_H__
+
+#include <res-conn.h>
+
+/* hack to avoid multiple includes */
+typedef struct _OhmPlugin OhmPlugin;
+
+typedef struct {
+    unsigned long  admitted;    /* passed straight to the manager */
+    unsigned long  deferred;    /* had to wait for their turn */
+    unsigned long  dropped;     /* rejected as the client's queue was full */
+    unsigned long  waiting;     /* deferred and not served yet */
+} admission_stats_t;
+
+
+void admission_init(OhmPlugin *);
+void admission_exit(OhmPlugin *);
+
+void admission_update(resmsg_t *, resset_t *, void *);
+void admission_acquire(resmsg_t *, resset_t *, void *);
+void admission_release(resmsg_t *, resset_t *, void *);
+
+void admission_cancel(resset_t *);
+
+void admission_get_stats(admission_stats_t *);
+
+
+#endif	/* __OHM_RESOURCE_ADMISSION_H__ */
+
+/* 
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -30,6 +30,7 @@ USA.
 #include "plugin.h"
 #include "dbusif.h"
 #include "manager.h"
+#include "admission.h"
 
 typedef struct {
     char                  *addr;
@@ -37,6 +38,11 @@ typedef struct {
     void                  *data;
 } query_t;
 
+OHM_IMPORTABLE(int, query_peer, (DBusBusType type, const char *name,
+                                 void (*callback)(const char *, pid_t, uid_t,
+                                                  void *),
+                                 void *data));
+
 
 static DBusConnection   *sys_conn;       /* connection for D-Bus system bus */
 static DBusConnection   *sess_conn;      /* connection for D-Bus session bus */
@@ -47,6 +53,8 @@ static resconn_t        *res_conn;       /* resource manager connection */
 static void system_bus_init(void);
 static void session_bus_init(const char *);
 static void res_conn_setup(DBusConnection *);
+static int  peer_cache(void);
+static void peer_queried(const char *, pid_t, uid_t, void *);
 static void pid_queried(DBusPendingCall *, void *);
 
 
@@ -177,7 +185,7 @@ void dbusif_query_pid(char *addr, dbusif_pid_query_cb_t func, void *data)
         return;
 
     do { /* not a loop */
-        if (!conn || !(query = malloc(sizeof(query_t))))
+        if (!(query = malloc(sizeof(query_t))))
             break;
 
         memset(query, 0, sizeof(query_t));
@@ -185,6 +193,15 @@ void dbusif_query_pid(char *addr, dbusif_pid_query_cb_t func, void *data)
         query->func = func;
         query->data = data;
 
+        /* the dbus plugin usually knows the peer already */
+        if (peer_cache() &&
+            query_peer(use_system_bus ? DBUS_BUS_SYSTEM : DBUS_BUS_SESSION,
+                       addr, peer_queried, query))
+            return;
+
+        if (!conn)
+            break;
+
         msg = dbus_message_new_method_call(DBUS_ADMIN_NAME,
                                            DBUS_ADMIN_PATH,
                                            DBUS_ADMIN_INTERFACE,
@@ -317,13 +334,50 @@ static void res_conn_setup(DBusConnection *conn)
 
     resproto_set_handler(res_conn, RESMSG_REGISTER  , manager_register  );
     resproto_set_handler(res_conn, RESMSG_UNREGISTER, manager_unregister);
-    resproto_set_handler(res_conn, RESMSG_UPDATE    , manager_update    );
-    resproto_set_handler(res_conn, RESMSG_ACQUIRE   , manager_acquire   );
-    resproto_set_handler(res_conn, RESMSG_RELEASE   , manager_release   );
+    resproto_set_handler(res_conn, RESMSG_UPDATE    , admission_update  );
+    resproto_set_handler(res_conn, RESMSG_ACQUIRE   , admission_acquire );
+    resproto_set_handler(res_conn, RESMSG_RELEASE   , admission_release );
     resproto_set_handler(res_conn, RESMSG_AUDIO     , manager_audio     );
     resproto_set_handler(res_conn, RESMSG_VIDEO     , manager_video     );
 }
 
+static int peer_cache(void)
+{
+    static int  checked;
+    char       *signature = (char *)query_peer_SIGNATURE;
+
+    if (!checked) {
+        checked = TRUE;
+
+        ohm_module_find_method("dbus.query_peer", &signature,
+                               (void *)&query_peer);
+
+        if (query_peer == NULL)
+            OHM_INFO("resource: no D-Bus peer cache, "
+                     "querying pids from the bus daemon");
+    }
+
+    return query_peer != NULL;
+}
+
+
+static void peer_queried(const char *name, pid_t pid, uid_t uid, void *data)
+{
+    query_t *query = (query_t *)data;
+
+    (void)name;
+    (void)uid;
+
+    OHM_DEBUG(DBG_DBUS, "pid of %s from the peer cache: %u",
+              query->addr, (unsigned)pid);
+
+    query->func(pid, query->data);
+
+    free(query->addr);
+    free(query);
+}
+
+
 static void pid_queried(DBusPendingCall *pend, void *data)
 {
     query_t       *query   = (query_t *)data;
@@ -28,6 +28,7 @@ USA.
 #include "plugin.h"
 #include "dresif.h"
 #include "resource-set.h"
+#include "fsif.h"
 #include "timestamp.h"
 
 #define DRESIF_VARTYPE(t)  (char *)(t)
@@ -67,18 +68,71 @@ int dresif_resource_request(uint32_t  manager_id,
                             uint32_t  client_id,
                             char     *request)
 {
-    char     *vars[48];
-    int       i;
-    int       status;
-    int       success;
+    dresif_request_t req;
+
+    req.manager_id  = manager_id;
+    req.client_name = client_name;
+    req.client_id   = client_id;
+    req.request     = request;
+
+    return dresif_resource_requests(&req, 1);
+}
+
+/*
+ * Resolve a burst of resource requests at once. The request fields of
+ * all the involved resource sets are already in the factstore so one
+ * run of the rules decides all of them. The goal gets manager_id and
+ * request of the most recent request, request_count and, for every
+ * request k of the burst, manager_id_<k> and request_<k>.
+ */
+int dresif_resource_requests(dresif_request_t *reqs, int nreq)
+{
+#define VARNAME_LEN 32
+
+    dresif_request_t *last;
+    char            **vars;
+    char            (*names)[VARNAME_LEN];
+    int               i, k;
+    int               status;
+    int               success;
+
+    if (reqs == NULL || nreq <= 0)
+        return TRUE;
+
+    last  = reqs + (nreq - 1);
+    vars  = malloc((3 * (3 + 2 * nreq) + 1) * sizeof(vars[0]));
+    names = malloc(2 * nreq * sizeof(names[0]));
+
+    if (vars == NULL || names == NULL) {
+        OHM_ERROR("resource: [%s] memory allocation failure", __FUNCTION__);
+        free(vars);
+        free(names);
+        return FALSE;
+    }
 
     vars[i=0] = "manager_id";
     vars[++i] = DRESIF_VARTYPE('i');
-    vars[++i] = DRESIF_VARVALUE(manager_id);
+    vars[++i] = DRESIF_VARVALUE(last->manager_id);
 
     vars[++i] = "request";
     vars[++i] = DRESIF_VARTYPE('s');
-    vars[++i] = DRESIF_VARVALUE(request);
+    vars[++i] = DRESIF_VARVALUE(last->request);
+
+    vars[++i] = "request_count";
+    vars[++i] = DRESIF_VARTYPE('i');
+    vars[++i] = DRESIF_VARVALUE(nreq);
+
+    for (k = 0;  k < nreq;  k++) {
+        snprintf(names[2*k], VARNAME_LEN, "manager_id_%d", k);
+        vars[++i] = names[2*k];
+        vars[++i] = DRESIF_VARTYPE('i');
+        vars[++i] = DRESIF_VARVALUE(reqs[k].manager_id);
+
+        snprintf(names[2*k+1], VARNAME_LEN, "request_%d", k);
+        vars[++i] = names[2*k+1];
+        vars[++i] = DRESIF_VARTYPE('s');
+        vars[++i] = DRESIF_VARVALUE(reqs[k].request);
+    }
 
 #if 0
     if (transid > 0) {
@@ -93,31 +147,48 @@ int dresif_resource_request(uint32_t  manager_id,
 #endif
     vars[++i] = NULL;
 
+    if (nreq > 1) {
+        for (i = 0;  i < nreq;  i++) {
+            OHM_DEBUG(DBG_DRES, "batched %s request for %s/%u (manager id %u)",
+                      reqs[i].request, reqs[i].client_name,
+                      reqs[i].client_id, reqs[i].manager_id);
+        }
+    }
+
     timestamp_add("resource request -- resolving start");
+    fsif_transaction_begin();
     status = resolve("resource_request", vars);
+    fsif_transaction_end();
     timestamp_add("resource request -- resolving end");
+
+    free(vars);
+    free(names);
     
     if (status < 0) {
         OHM_DEBUG(DBG_DRES, "resolving resource_request for %s/%d "
-                  "(manager id %u) failed: (%d) %s",
-                  client_name, client_id, manager_id,
-                  status, strerror(-status));
+                  "(manager id %u) and %d other(s) failed: (%d) %s",
+                  last->client_name, last->client_id, last->manager_id,
+                  nreq - 1, status, strerror(-status));
         success = FALSE;
     }
     else if (status == 0) {
         OHM_DEBUG(DBG_DRES, "resolving resource_request for %s/%u "
-                  "(manager id %u) failed",
-                  client_name, client_id, manager_id);
+                  "(manager id %u) and %d other(s) failed",
+                  last->client_name, last->client_id, last->manager_id,
+                  nreq - 1);
         success = FALSE;
     }
     else {
         OHM_DEBUG(DBG_DRES, "successfully resolved resource_request for %s/%u "
-                  "(manager id %u)",
-                  client_name, client_id, manager_id);
+                  "(manager id %u) and %d other(s)",
+                  last->client_name, last->client_id, last->manager_id,
+                  nreq - 1);
         success = TRUE;
     }
     
     return success;
+
+#undef VARNAME_LEN
 }
 
 /*!
@@ -26,8 +26,16 @@ USA.
 /* hack to avoid multiple includes */
 typedef struct _OhmPlugin OhmPlugin;
 
+typedef struct {
+    uint32_t  manager_id;
+    char     *client_name;
+    uint32_t  client_id;
+    char     *request;
+} dresif_request_t;
+
 void dresif_init(OhmPlugin *);
 int  dresif_resource_request(uint32_t, char *, uint32_t, char *);
+int  dresif_resource_requests(dresif_request_t *, int);
 
 
 #endif /* __OHM_RESOURCE_DRESIF_H__ */
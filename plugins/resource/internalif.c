@@ -28,6 +28,7 @@ USA.
 #include "plugin.h"
 #include "internalif.h"
 #include "manager.h"
+#include "admission.h"
 
 static resconn_t         *res_conn;      /* resource manager connection */
 
@@ -54,9 +55,9 @@ void internalif_init(OhmPlugin *plugin)
     else {
         resproto_set_handler(res_conn, RESMSG_REGISTER  , manager_register  );
         resproto_set_handler(res_conn, RESMSG_UNREGISTER, manager_unregister);
-        resproto_set_handler(res_conn, RESMSG_UPDATE    , manager_update    );
-        resproto_set_handler(res_conn, RESMSG_ACQUIRE   , manager_acquire   );
-        resproto_set_handler(res_conn, RESMSG_RELEASE   , manager_release   );
+        resproto_set_handler(res_conn, RESMSG_UPDATE    , admission_update  );
+        resproto_set_handler(res_conn, RESMSG_ACQUIRE   , admission_acquire );
+        resproto_set_handler(res_conn, RESMSG_RELEASE   , admission_release );
         resproto_set_handler(res_conn, RESMSG_AUDIO     , manager_audio     );
         resproto_set_handler(res_conn, RESMSG_VIDEO     , manager_video     );
 
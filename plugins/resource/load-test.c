@@ -0,0 +1,788 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Load test for the resource manager.
+ *
+ * The manager, admission, resource set, resource spec, transaction and
+ * factstore code of the plugin is linked in as is. Everything else is replaced
+ * by stand-ins living in this file:
+ *
+ *   - libresource: messages the manager sends or replies to are not
+ *     transported anywhere but delivered straight to the simulated
+ *     clients,
+ *   - dres: a trivial 'last acquirer wins' policy writes the granted
+ *     and advice fields of the resource set facts,
+ *   - auth and rule interfaces accept everything.
+ *
+ * The simulated clients register resource sets and then do randomized
+ * acquire/release/update churn, issuing a burst of requests (-b) within
+ * every main loop iteration. With -t clients toggle, ie. acquire and
+ * release in quick succession, which should not amplify into a backlog
+ * of stale grants. With -r the requests of the clients are rate limited
+ * and -a turns the first client into an adversary flooding the manager
+ * with acquire/release requests; its grants are left out of the latency
+ * figures. At the end requests/sec, grant latency percentiles and the
+ * memory growth of the process are reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+
+#include "plugin.h"
+#include "manager.h"
+#include "admission.h"
+#include "resource-set.h"
+#include "resource-spec.h"
+#include "transaction.h"
+#include "fsif.h"
+#include "dbusif.h"
+#include "dresif.h"
+#include "ruleif.h"
+#include "auth.h"
+
+#define DEFAULT_CLIENTS     200
+#define DEFAULT_REQUESTS    100000
+#define MAX_RESOURCES       32
+#define DIM(a)              (int)(sizeof(a) / sizeof(a[0]))
+
+typedef struct {
+    resset_t       resset;          /* must be the first */
+    char           name[32];
+    uint32_t       reqno;
+    uint32_t       acqno;           /* reqno of the pending acquire if any */
+    double         acqstart;        /* when the pending acquire was sent */
+    uint32_t       granted;
+    int            must_release;    /* manager asked us to release */
+} client_t;
+
+typedef struct {
+    unsigned long  requests;
+    unsigned long  replies;
+    unsigned long  errors;
+    unsigned long  grants;
+    unsigned long  advices;
+    unsigned long  releases;        /* release requests from the manager */
+    unsigned long  resolves;
+    double        *latency;         /* grant latencies in usecs */
+    unsigned long  nlatency;
+} stats_t;
+
+
+int DBG_INIT, DBG_MGR, DBG_SET, DBG_DBUS, DBG_INTERNAL;
+int DBG_DRES, DBG_FS, DBG_QUE, DBG_TRANSACT, DBG_MEDIA, DBG_AUTH;
+
+static resconn_t  resconn;
+static client_t  *clients;
+static int        nclient = DEFAULT_CLIENTS;
+static stats_t    stats;
+static uint32_t   owner[MAX_RESOURCES]; /* manager_id + 1 of the owner */
+static int        verbose;
+static char      *rate_limit = "0";
+static int        adversary;
+
+static char *classes[] = {
+    "player", "call", "ringtone", "navigator", "game", "alarm", "event"
+};
+
+static uint32_t resources[] = {
+    RESMSG_AUDIO_PLAYBACK, RESMSG_VIDEO_PLAYBACK,
+    RESMSG_AUDIO_RECORDING, RESMSG_VIDEO_RECORDING
+};
+
+static double now(void);
+static long   rss_kbytes(void);
+static void   run_mainloop(void);
+static int    admission_pending(void);
+static void   client_register(client_t *);
+static void   client_unregister(client_t *);
+static void   client_acquire(client_t *);
+static void   client_release(client_t *);
+static void   client_update(client_t *);
+static void   report(int, double, long, long, long);
+static int    compare_double(const void *, const void *);
+static int    auth_request_stub(char *, void *, char *, void *,
+                                void (*)(int, char *, void *), void *);
+
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s [-c clients] [-n requests] [-b burst] [-t] "
+           "[-r rate [-a]] [-s seed] [-v]\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int       requests = DEFAULT_REQUESTS;
+    int       burst    = 1;
+    int       toggle   = FALSE;
+    unsigned  seed     = time(NULL);
+    client_t *cl;
+    double    start, elapsed;
+    long      rss_start, rss_loaded, rss_end;
+    int       opt, i;
+
+    while ((opt = getopt(argc, argv, "c:n:b:tr:as:vh")) != -1) {
+        switch (opt) {
+        case 'c':   nclient  = atoi(optarg);              break;
+        case 'n':   requests = atoi(optarg);              break;
+        case 'b':   burst    = atoi(optarg);              break;
+        case 't':   toggle   = TRUE;                      break;
+        case 'r':   rate_limit = optarg;                  break;
+        case 'a':   adversary  = TRUE;                    break;
+        case 's':   seed     = strtoul(optarg, NULL, 10); break;
+        case 'v':   verbose  = TRUE;                      break;
+        default:    usage(argv[0]);
+        }
+    }
+
+    if (nclient <= 0 || requests <= 0 || burst <= 0)
+        usage(argv[0]);
+
+    srandom(seed);
+
+    g_type_init();
+
+    fsif_init(NULL);
+    manager_init(NULL);
+    admission_init(NULL);
+    resource_set_init(NULL);
+    resource_spec_init(NULL);
+    transaction_init(NULL);
+
+    resconn.any.transp = RESPROTO_TRANSPORT_INTERNAL;
+
+    clients = calloc(nclient, sizeof(client_t));
+    stats.latency = calloc(requests, sizeof(double));
+
+    if (clients == NULL || stats.latency == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    rss_start = rss_kbytes();
+
+    for (i = 0;  i < nclient;  i++) {
+        cl = clients + i;
+        snprintf(cl->name, sizeof(cl->name), ":1.%d", i + 100);
+        client_register(cl);
+    }
+
+    run_mainloop();
+
+    rss_loaded = rss_kbytes();
+    start      = now();
+
+    for (i = 0;  i < requests;  i++) {
+        cl = clients + (random() % nclient);
+
+        if (cl->must_release)
+            client_release(cl);
+        else if (toggle) {
+            client_acquire(cl);
+            client_release(cl);
+            client_acquire(cl);
+        }
+        else {
+            switch (random() % 8) {
+            case 0: case 1: case 2:  client_acquire(cl);  break;
+            case 3: case 4: case 5:  client_release(cl);  break;
+            default:                 client_update(cl);   break;
+            }
+        }
+
+        if (adversary) {
+            client_acquire(clients);
+            client_release(clients);
+        }
+
+        /* let the main loop run after every burst of requests */
+        if ((i + 1) % burst == 0)
+            run_mainloop();
+    }
+
+    run_mainloop();
+
+    /* wait until the rate limited requests get through */
+    while (admission_pending())
+        g_main_context_iteration(NULL, TRUE);
+
+    run_mainloop();
+
+    elapsed = now() - start;
+    rss_end = rss_kbytes();
+
+    report(requests, elapsed, rss_start, rss_loaded, rss_end);
+
+    for (i = 0;  i < nclient;  i++)
+        client_unregister(clients + i);
+
+    run_mainloop();
+
+    printf("memory after unregistering all clients: %ld kB\n", rss_kbytes());
+
+    manager_exit(NULL);
+    admission_exit(NULL);
+    resource_set_exit(NULL);
+    fsif_exit(NULL);
+
+    free(stats.latency);
+    free(clients);
+
+    return 0;
+}
+
+
+/*
+ * simulated clients
+ */
+
+static void client_register(client_t *cl)
+{
+    resset_t *resset = &cl->resset;
+    resmsg_t  msg;
+    uint32_t  all, opt;
+    int       i;
+
+    for (all = 0;  all == 0; ) {
+        for (i = 0;  i < DIM(resources);  i++) {
+            if (random() & 1)
+                all |= resources[i];
+        }
+    }
+
+    opt = (random() & 1) ? all & ~RESMSG_AUDIO_PLAYBACK : 0;
+
+    resset->resconn     = &resconn;
+    resset->peer        = cl->name;
+    resset->id          = 1;
+    resset->klass       = classes[random() % DIM(classes)];
+    resset->mode        = (random() & 1) ? RESMSG_MODE_AUTO_RELEASE : 0;
+    resset->flags.all   = all;
+    resset->flags.opt   = opt;
+    resset->flags.share = 0;
+    resset->flags.mask  = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.record.type       = RESMSG_REGISTER;
+    msg.record.id         = resset->id;
+    msg.record.reqno      = ++cl->reqno;
+    msg.record.rset.all   = all;
+    msg.record.rset.opt   = opt;
+    msg.record.klass      = resset->klass;
+    msg.record.mode       = resset->mode;
+
+    stats.requests++;
+    manager_register(&msg, resset, NULL);
+}
+
+static void client_unregister(client_t *cl)
+{
+    resmsg_t msg;
+
+    if (cl->resset.userdata == NULL)
+        return;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.possess.type  = RESMSG_UNREGISTER;
+    msg.possess.id    = cl->resset.id;
+    msg.possess.reqno = ++cl->reqno;
+
+    stats.requests++;
+    manager_unregister(&msg, &cl->resset, NULL);
+}
+
+static void client_acquire(client_t *cl)
+{
+    resmsg_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.possess.type  = RESMSG_ACQUIRE;
+    msg.possess.id    = cl->resset.id;
+    msg.possess.reqno = ++cl->reqno;
+
+    cl->acqno    = msg.possess.reqno;
+    cl->acqstart = now();
+
+    stats.requests++;
+    admission_acquire(&msg, &cl->resset, NULL);
+}
+
+static void client_release(client_t *cl)
+{
+    resmsg_t msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.possess.type  = RESMSG_RELEASE;
+    msg.possess.id    = cl->resset.id;
+    msg.possess.reqno = ++cl->reqno;
+
+    cl->must_release = FALSE;
+
+    stats.requests++;
+    admission_release(&msg, &cl->resset, NULL);
+}
+
+static void client_update(client_t *cl)
+{
+    resset_t *resset = &cl->resset;
+    resmsg_t  msg;
+    uint32_t  opt;
+
+    /* toggle one of the optional resources */
+    opt  = resources[random() % DIM(resources)] & ~RESMSG_AUDIO_PLAYBACK;
+    opt ^= resset->flags.opt;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.record.type       = RESMSG_UPDATE;
+    msg.record.id         = resset->id;
+    msg.record.reqno      = ++cl->reqno;
+    msg.record.rset.all   = resset->flags.all | opt;
+    msg.record.rset.opt   = opt;
+    msg.record.rset.share = resset->flags.share;
+    msg.record.klass      = resset->klass;
+    msg.record.mode       = resset->mode;
+
+    stats.requests++;
+    admission_update(&msg, resset, NULL);
+}
+
+
+/*
+ * libresource stand-in
+ */
+
+int resproto_send_message(resset_t *resset, resmsg_t *msg,
+                          resproto_status_t status)
+{
+    client_t *cl = (client_t *)resset;
+
+    (void)status;
+
+    switch (msg->type) {
+
+    case RESMSG_GRANT:
+        stats.grants++;
+        cl->granted = msg->notify.resrc;
+
+        if (cl->acqno && msg->notify.reqno == cl->acqno) {
+            if (!adversary || cl != clients)
+                stats.latency[stats.nlatency++] =
+                    (now() - cl->acqstart) * 1.0e6;
+            cl->acqno = 0;
+        }
+        break;
+
+    case RESMSG_ADVICE:
+        stats.advices++;
+        break;
+
+    case RESMSG_RELEASE:
+        stats.releases++;
+        cl->must_release = TRUE;
+        break;
+
+    default:
+        break;
+    }
+
+    return TRUE;
+}
+
+int resproto_reply_message(resset_t *resset, resmsg_t *msg, void *data,
+                           int32_t errcod, const char *errmsg)
+{
+    (void)resset;
+    (void)msg;
+    (void)data;
+
+    stats.replies++;
+
+    if (errcod) {
+        stats.errors++;
+
+        if (verbose)
+            printf("request failed: %d (%s)\n", errcod, errmsg);
+    }
+
+    return TRUE;
+}
+
+char *resmsg_res_str(uint32_t res, char *buf, int len)
+{
+    snprintf(buf, len, "0x%x", res);
+    return buf;
+}
+
+char *resmsg_type_str(resmsg_type_t type)
+{
+    static char buf[32];
+
+    snprintf(buf, sizeof(buf), "%d", type);
+    return buf;
+}
+
+char *resmsg_match_method_str(resmsg_match_method_t method)
+{
+    return method == resmsg_method_equals ? "equals" : "other";
+}
+
+char *resmsg_dump_message(resmsg_t *msg, int indent, char *buf, int len)
+{
+    (void)indent;
+
+    snprintf(buf, len, "message type %d", msg->type);
+    return buf;
+}
+
+
+/*
+ * dres stand-in: whoever acquires last gets the resources
+ */
+
+static void set_output(uint32_t manager_id, uint32_t granted, uint32_t advice)
+{
+    fsif_field_t selist[] = {
+        { fldtype_integer, "manager_id", .value.integer = manager_id },
+        { fldtype_invalid, NULL        , .value.integer = 0          }
+    };
+    fsif_field_t fldlist[] = {
+        { fldtype_integer, "granted"   , .value.integer = granted    },
+        { fldtype_integer, "advice"    , .value.integer = advice     },
+        { fldtype_invalid, NULL        , .value.integer = 0          }
+    };
+
+    fsif_update_factstore_entry(FACTSTORE_RESOURCE_SET, selist, fldlist);
+}
+
+static uint32_t get_granted(uint32_t manager_id)
+{
+    fsif_field_t selist[] = {
+        { fldtype_integer, "manager_id", .value.integer = manager_id },
+        { fldtype_invalid, NULL        , .value.integer = 0          }
+    };
+    fsif_entry_t *entry;
+    long          granted = 0;
+
+    if ((entry = fsif_get_entry(FACTSTORE_RESOURCE_SET, selist)) != NULL)
+        fsif_get_field_by_entry(entry, fldtype_integer, "granted", &granted);
+
+    return granted;
+}
+
+static void policy_request(uint32_t manager_id, char *request)
+{
+    fsif_field_t  selist[] = {
+        { fldtype_integer, "manager_id", .value.integer = manager_id },
+        { fldtype_invalid, NULL        , .value.integer = 0          }
+    };
+    fsif_entry_t *entry;
+    long          mandatory = 0;
+    long          optional  = 0;
+    uint32_t      wanted, bit, prev;
+    int           i;
+
+    if (!strcmp(request, "release") || !strcmp(request, "unregister")) {
+        for (i = 0;  i < MAX_RESOURCES;  i++) {
+            if (owner[i] == manager_id + 1)
+                owner[i] = 0;
+        }
+
+        if (strcmp(request, "unregister"))
+            set_output(manager_id, 0, 0);
+    }
+    else if ((entry = fsif_get_entry(FACTSTORE_RESOURCE_SET, selist))) {
+        fsif_get_field_by_entry(entry, fldtype_integer, "mandatory",&mandatory);
+        fsif_get_field_by_entry(entry, fldtype_integer, "optional", &optional);
+
+        wanted = mandatory | optional;
+
+        if (!strcmp(request, "acquire")) {
+            for (i = 0;  i < MAX_RESOURCES;  i++) {
+                bit = 1U << i;
+
+                if (!(wanted & bit))
+                    continue;
+
+                if ((prev = owner[i]) && prev != manager_id + 1)
+                    set_output(prev - 1, get_granted(prev - 1) & ~bit, 0);
+
+                owner[i] = manager_id + 1;
+            }
+
+            set_output(manager_id, wanted, wanted);
+        }
+        else
+            set_output(manager_id, get_granted(manager_id) & wanted, wanted);
+    }
+}
+
+int dresif_resource_requests(dresif_request_t *reqs, int nreq)
+{
+    int i;
+
+    stats.resolves++;
+
+    fsif_transaction_begin();
+
+    for (i = 0;  i < nreq;  i++)
+        policy_request(reqs[i].manager_id, reqs[i].request);
+
+    fsif_transaction_end();
+
+    return TRUE;
+}
+
+int dresif_resource_request(uint32_t  manager_id,
+                            char     *client_name,
+                            uint32_t  client_id,
+                            char     *request)
+{
+    dresif_request_t req;
+
+    req.manager_id  = manager_id;
+    req.client_name = client_name;
+    req.client_id   = client_id;
+    req.request     = request;
+
+    return dresif_resource_requests(&req, 1);
+}
+
+
+/*
+ * auth, rule and D-Bus stand-ins
+ */
+
+int ohm_module_find_method(char *name, char **sig, void **method)
+{
+    (void)sig;
+
+    if (!strcmp(name, "auth.request")) {
+        *method = (void *)auth_request_stub;
+        return TRUE;
+    }
+
+    *method = NULL;
+    return FALSE;
+}
+
+static int auth_request_stub(char *id_type, void *id,
+                             char *req_type, void *req,
+                             void (*callback)(int, char *, void *),
+                             void *data)
+{
+    (void)id_type;
+    (void)id;
+    (void)req_type;
+    (void)req;
+
+    callback(TRUE, "OK", data);
+
+    return TRUE;
+}
+
+void auth_query(const char *klass, char **method, char **arg)
+{
+    (void)klass;
+
+    *method = NULL;
+    *arg    = NULL;
+}
+
+auth_policy_t auth_get_default_policy()
+{
+    return auth_accept;
+}
+
+int ruleif_valid_resource_request(const char *klass,
+                                  int         mandatory,
+                                  int         optional,
+                                  ...)
+{
+    va_list  ap;
+    char    *name;
+    int      type;
+    void    *value;
+
+    (void)klass;
+
+    va_start(ap, optional);
+
+    while ((name = va_arg(ap, char *)) != NULL) {
+        type  = va_arg(ap, int);
+        value = va_arg(ap, void *);
+
+        if (type != 'i')
+            continue;
+
+        if (!strcmp(name, "mandatory"))
+            *(uint32_t *)value = mandatory;
+        else if (!strcmp(name, "optional"))
+            *(uint32_t *)value = optional;
+    }
+
+    va_end(ap);
+
+    return TRUE;
+}
+
+void dbusif_query_pid(char *peer, dbusif_pid_query_cb_t callback, void *data)
+{
+    (void)peer;
+
+    callback(getpid(), data);
+}
+
+const char *ohm_plugin_get_param(OhmPlugin *plugin, const char *key)
+{
+    (void)plugin;
+
+    return strcmp(key, "rate-limit") ? NULL : rate_limit;
+}
+
+void plugin_print_timestamp(const char *function, const char *phase)
+{
+    (void)function;
+    (void)phase;
+}
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level == OHM_LOG_ERROR || verbose) {
+        va_start(ap, format);
+        vfprintf(stderr, format, ap);
+        fputs("\n", stderr);
+        va_end(ap);
+    }
+}
+
+
+/*
+ * measurement
+ */
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1.0e6;
+}
+
+static long rss_kbytes(void)
+{
+    FILE *f;
+    long  size, resident;
+
+    if ((f = fopen("/proc/self/statm", "r")) == NULL)
+        return -1;
+
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+        resident = -1;
+
+    fclose(f);
+
+    return resident < 0 ? -1 : resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void run_mainloop(void)
+{
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+
+    return (da > db) - (da < db);
+}
+
+static double percentile(double p)
+{
+    unsigned long idx;
+
+    if (stats.nlatency == 0)
+        return 0.0;
+
+    idx = (unsigned long)(p / 100.0 * (stats.nlatency - 1) + 0.5);
+
+    return stats.latency[idx];
+}
+
+static int admission_pending(void)
+{
+    admission_stats_t as;
+
+    admission_get_stats(&as);
+
+    return as.waiting > 0;
+}
+
+static void report(int requests, double elapsed, long rss_start,
+                   long rss_loaded, long rss_end)
+{
+    admission_stats_t as;
+
+    admission_get_stats(&as);
+
+    qsort(stats.latency, stats.nlatency, sizeof(double), compare_double);
+
+    printf("clients:           %d\n", nclient);
+    printf("requests:          %lu (%d churn, %lu failed)\n", stats.requests,
+           requests, stats.errors);
+    printf("policy resolves:   %lu\n", stats.resolves);
+    printf("grants/advices:    %lu/%lu (%.2f messages per policy run)\n",
+           stats.grants, stats.advices, stats.resolves ?
+           (double)(stats.grants + stats.advices) / stats.resolves : 0.0);
+    printf("release requests:  %lu\n", stats.releases);
+    printf("admission:         %lu admitted, %lu deferred, %lu dropped\n",
+           as.admitted, as.deferred, as.dropped);
+    printf("elapsed:           %.3f s\n", elapsed);
+    printf("throughput:        %.0f requests/s\n",
+           elapsed > 0.0 ? requests / elapsed : 0.0);
+    printf("grant latency:     p50 %.1f us, p90 %.1f us, p99 %.1f us, "
+           "max %.1f us (%lu samples)\n", percentile(50.0), percentile(90.0),
+           percentile(99.0), percentile(100.0), stats.nlatency);
+    printf("memory:            %ld kB at start, %ld kB with %d clients, "
+           "%ld kB at the end (%+ld kB during churn)\n",
+           rss_start, rss_loaded, nclient, rss_end, rss_end - rss_loaded);
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
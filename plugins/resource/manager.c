@@ -30,6 +30,7 @@ USA.
 
 #include "plugin.h"
 #include "manager.h"
+#include "admission.h"
 #include "resource-spec.h"
 #include "fsif.h"
 #include "dresif.h"
@@ -52,6 +53,19 @@ typedef struct reg_data_s {
     char              *arg;
 } reg_data_t;
 
+typedef struct {
+    uint32_t           reqno;       /* reqno of the request, if any */
+    int                reply;       /* always reply with a grant */
+} pending_ctl_t;
+
+typedef struct {
+    int                length;
+    int                size;
+    dresif_request_t  *reqs;        /* what goes to dresif */
+    pending_ctl_t     *ctls;        /* what we need to complete them */
+    guint              srcid;       /* idle source to resolve the burst */
+} pending_t;
+
 typedef void (*auth_request_cb_t)(int, char *, void *);
 
 OHM_IMPORTABLE(int, auth_request, (char *id_type,  void *id,
@@ -60,6 +74,8 @@ OHM_IMPORTABLE(int, auth_request, (char *id_type,  void *id,
 
 static uint32_t     trans_id;
 static reg_data_t  *reg_reqs;
+static pending_t    pending;
+static pending_t    resolving;      /* the burst in the rules right now */
 
 static void forced_auto_release(resource_set_t *);
 
@@ -68,6 +84,7 @@ static void keyword_list(char *, char **, int);
 static void pid_cb(pid_t, void *);
 static void authorize_cb(int, char *, void *);
 static void register_cb(int, reg_data_t *);
+static void resource_set_cb(fsif_entry_t *, char *, fsif_field_t *, void *);
 static void granted_cb(fsif_entry_t *, char *, fsif_field_t *, void *);
 static void advice_cb(fsif_entry_t *, char *, fsif_field_t *, void *);
 static void request_cb(fsif_entry_t *, char *, fsif_field_t *, void *);
@@ -77,6 +94,12 @@ static int  reg_request_create(resmsg_t *, resset_t *, void *);
 static void reg_request_destroy(reg_data_t *);
 static void reg_request_cancel(resset_t *);
 
+static void resolve_request(uint32_t, char *, uint32_t, char *,
+                            uint32_t, int);
+static gboolean resolve_pending(gpointer);
+static void queue_granted(resource_set_t *);
+static void pending_purge(void);
+
 static void transaction_start(resource_set_t *, resmsg_t *);
 static void transaction_end(resource_set_t *);
 static void transaction_complete(uint32_t *, int, uint32_t, void *);
@@ -90,11 +113,10 @@ static void transaction_complete(uint32_t *, int, uint32_t, void *);
 
 void manager_init(OhmPlugin *plugin)
 {
-#define ADD_FIELD_WATCH(n,cb) \
-    fsif_add_field_watch(FACTSTORE_RESOURCE_SET,NULL, n, cb, NULL)
-
     (void)plugin;
 
+    static char *fields[] = { "granted", "advice", "request", "block", NULL };
+
     char *name      = "auth.request";
     char *signature = (char *)auth_request_SIGNATURE; 
 
@@ -107,14 +129,21 @@ void manager_init(OhmPlugin *plugin)
         exit(1);
     }
 
-    ADD_FIELD_WATCH("granted", granted_cb);
-    ADD_FIELD_WATCH("advice" , advice_cb );
-    ADD_FIELD_WATCH("request", request_cb);
-    ADD_FIELD_WATCH("block"  , block_cb  );
+    fsif_add_fields_watch(FACTSTORE_RESOURCE_SET, NULL, fields,
+                          resource_set_cb, NULL);
 
     LEAVE;
+}
+
+void manager_exit(OhmPlugin *plugin)
+{
+    (void)plugin;
+
+    ENTER;
+
+    pending_purge();
 
-#undef ADD_FIELD_WATCH
+    LEAVE;
 }
 
 void manager_register(resmsg_t *msg, resset_t *resset, void *proto_data)
@@ -159,14 +188,13 @@ void manager_unregister(resmsg_t *msg, resset_t *resset, void *proto_data)
     }
 
     reg_request_cancel(resset);
+    admission_cancel(resset);
 
     if (rs)
         resource_set_destroy(resset);
 
-    if (manager_id) {
-        dresif_resource_request(manager_id, client_name, client_id,
-                                "unregister");
-    }
+    if (manager_id)
+        resolve_request(manager_id, client_name, client_id, "unregister",0,0);
 
     OHM_DEBUG(DBG_MGR, "message replied with %d '%s'", errcod, errmsg);
 
@@ -237,14 +265,13 @@ void manager_update(resmsg_t *msg, resset_t *resset, void *proto_data)
     resset->flags.opt   = record->rset.opt;
     resset->flags.share = record->rset.share;
 
-    transaction_start(rs, msg);
-
     resource_set_update_factstore(resset, update_flags);
     if (rs->request && !strcmp(rs->request, "acquire") &&
         rs->granted.client != 0)
         resource_set_update_factstore(resset, update_request);
 
-    dresif_resource_request(rs->manager_id, resset->peer, resset->id, "update");
+    resolve_request(rs->manager_id, resset->peer, resset->id, "update",
+                    record->reqno, resset->mode & RESMSG_MODE_ALWAYS_REPLY);
 
  reply_message:
     OHM_DEBUG(DBG_MGR, "message replied with %d '%s'", errcod, errmsg);
@@ -275,8 +302,6 @@ void manager_acquire(resmsg_t *msg, resset_t *resset, void *proto_data)
         errmsg = strerror(errcod);
     }
     else {
-        transaction_start(rs, msg);
-
         if (!rs->request || strcmp(rs->request, "acquire")) {
             acquire = TRUE;
 
@@ -292,9 +317,12 @@ void manager_acquire(resmsg_t *msg, resset_t *resset, void *proto_data)
 
         if (acquire) {
             resource_set_update_factstore(resset, update_request);
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "acquire");
+            resolve_request(rs->manager_id, resset->peer, resset->id,
+                            "acquire", msg->any.reqno,
+                            resset->mode & RESMSG_MODE_ALWAYS_REPLY);
         }
+        else
+            transaction_start(rs, msg);
     }
 
     OHM_DEBUG(DBG_MGR, "message replied with %d '%s'", errcod, errmsg);
@@ -327,8 +355,6 @@ void manager_release(resmsg_t *msg, resset_t *resset, void *proto_data)
         errmsg = strerror(errcod);
     }
     else {
-        transaction_start(rs, msg);
-
         if (!rs->request || strcmp(rs->request, "release")) {
             release = TRUE;
 
@@ -348,9 +374,12 @@ void manager_release(resmsg_t *msg, resset_t *resset, void *proto_data)
 
         if (release) {
             resource_set_update_factstore(resset, update_request);
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "release");
+            resolve_request(rs->manager_id, resset->peer, resset->id,
+                            "release", msg->any.reqno,
+                            resset->mode & RESMSG_MODE_ALWAYS_REPLY);
         }
+        else
+            transaction_start(rs, msg);
     }
 
     OHM_DEBUG(DBG_MGR, "message replied with %d '%s'", errcod, errmsg);
@@ -394,8 +423,8 @@ void manager_audio(resmsg_t *msg, resset_t *resset, void *proto_data)
                                         propnam, method,pattern);
 
         if (success) {
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "audio");
+            resolve_request(rs->manager_id, resset->peer, resset->id,
+                            "audio", 0, FALSE);
         }
     }
 
@@ -429,8 +458,8 @@ void manager_video(resmsg_t *msg, resset_t *resset, void *proto_data)
         success = resource_set_add_spec(resset, resource_video, pid);
 
         if (success) {
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "video");
+            resolve_request(rs->manager_id, resset->peer, resset->id,
+                            "video", 0, FALSE);
         }
     }
 
@@ -446,8 +475,6 @@ void manager_video(resmsg_t *msg, resset_t *resset, void *proto_data)
 
 static void forced_auto_release(resource_set_t *rs)
 {
-    static resmsg_t zeromsg;
-
     resset_t *resset;
 
     if (rs && (resset = rs->resset) && rs->block) {
@@ -457,8 +484,6 @@ static void forced_auto_release(resource_set_t *rs)
             OHM_DEBUG(DBG_MGR, "release resource set %s/%u (manager id %u)",
                       resset->peer, resset->id, rs->manager_id);
 
-            transaction_start(rs, &zeromsg);
-
             free(rs->request);
             rs->request = strdup("release");
             rs->block   = 0;
@@ -466,10 +491,8 @@ static void forced_auto_release(resource_set_t *rs)
             resource_set_update_factstore(resset, update_block);
             resource_set_update_factstore(resset, update_request);
 
-            dresif_resource_request(rs->manager_id, resset->peer,
-                                    resset->id, "release");
-
-            transaction_end(rs);
+            resolve_request(rs->manager_id, resset->peer, resset->id,
+                            "release", 0, FALSE);
         }
     }
 }
@@ -566,20 +589,52 @@ static void register_cb(int32_t errcod, reg_data_t *regreq)
         goto reply_message;
     }
 
-    transaction_start(rs, msg);
-    dresif_resource_request(rs->manager_id, resset->peer, resset->id, "register");
+    resolve_request(rs->manager_id, resset->peer, resset->id, "register",
+                    msg->any.reqno, FALSE);
 
  reply_message:
     OHM_DEBUG(DBG_MGR, "message replied with %d '%s'", errcod, errmsg);
     resproto_reply_message(resset, msg, proto_data, errcod, errmsg);
 
-    if (rs)
-        transaction_end(rs);
-
  request_destroy:
     reg_request_destroy(regreq);
 }
 
+static void resource_set_cb(fsif_entry_t *entry,
+                            char         *name,
+                            fsif_field_t *flds,
+                            void         *ud)
+{
+    resource_set_t *rs;
+    fsif_field_t   *fld;
+    int             own_transaction;
+
+    /*
+     * all the changes of a resource set made by a single policy decision
+     * arrive here together so they end up in one transaction
+     */
+    own_transaction = (trans_id == NO_TRANSACTION);
+
+    if (own_transaction) {
+        rs = resource_set_find(entry);
+        transaction_start(rs, NULL);
+    }
+
+    for (fld = flds;  fld->type != fldtype_invalid;  fld++) {
+        if (!strcmp(fld->name, "granted"))
+            granted_cb(entry, name, fld, ud);
+        else if (!strcmp(fld->name, "advice"))
+            advice_cb(entry, name, fld, ud);
+        else if (!strcmp(fld->name, "request"))
+            request_cb(entry, name, fld, ud);
+        else if (!strcmp(fld->name, "block"))
+            block_cb(entry, name, fld, ud);
+    }
+
+    if (own_transaction)
+        transaction_end(rs);
+}
+
 static void granted_cb(fsif_entry_t *entry,
                        char         *name,
                        fsif_field_t *fld,
@@ -609,7 +664,9 @@ static void granted_cb(fsif_entry_t *entry,
 
         rs->granted.factstore = granted;
         
-        if (!(resset->mode & RESMSG_MODE_ALWAYS_REPLY) || !rs->reqno) {
+        if (resolving.length > 0 && trans_id != NO_TRANSACTION)
+            queue_granted(rs);
+        else if (!(resset->mode & RESMSG_MODE_ALWAYS_REPLY) || !rs->reqno) {
             if (trans_id != NO_TRANSACTION)
                 resource_set_queue_change(rs, trans_id, rs->reqno, 
                                           resource_set_granted);
@@ -853,6 +910,158 @@ static void reg_request_cancel(resset_t *resset)
     }
 }
 
+/*
+ * Requests are not resolved one by one. They are collected and resolved
+ * in one go when the main loop gets idle, so a burst of requests (say at
+ * boot or when a call comes in) costs a single run of the policy rules.
+ * The rules get the variables of every request of the burst, and a grant
+ * change of a resource set is fanned out to every request of the set,
+ * all in one transaction.
+ */
+static void resolve_request(uint32_t  manager_id,
+                            char     *client_name,
+                            uint32_t  client_id,
+                            char     *request,
+                            uint32_t  reqno,
+                            int       reply)
+{
+    dresif_request_t *reqs;
+    pending_ctl_t    *ctls;
+    dresif_request_t *req;
+    pending_ctl_t    *ctl;
+    int               size;
+
+    if (pending.length >= pending.size) {
+        size = pending.size ? pending.size * 2 : 16;
+
+        reqs = realloc(pending.reqs, size * sizeof(dresif_request_t));
+        if (reqs != NULL)
+            pending.reqs = reqs;
+
+        ctls = realloc(pending.ctls, size * sizeof(pending_ctl_t));
+        if (ctls != NULL)
+            pending.ctls = ctls;
+
+        if (reqs == NULL || ctls == NULL) {
+            OHM_ERROR("resource: [%s] memory allocation failure; "
+                      "resolving request immediately", __FUNCTION__);
+            dresif_resource_request(manager_id, client_name, client_id,
+                                    request);
+            return;
+        }
+
+        pending.size = size;
+    }
+
+    req = pending.reqs + pending.length;
+    ctl = pending.ctls + pending.length;
+
+    req->manager_id  = manager_id;
+    req->client_name = strdup(client_name ? client_name : "<unknown>");
+    req->client_id   = client_id;
+    req->request     = request;
+
+    ctl->reqno = reqno;
+    ctl->reply = reply ? TRUE : FALSE;
+
+    pending.length++;
+
+    OHM_DEBUG(DBG_MGR, "%s request of %s/%u (manager id %u) queued for "
+              "resolving (%d pending)", request, req->client_name, client_id,
+              manager_id, pending.length);
+
+    if (!pending.srcid)
+        pending.srcid = g_idle_add(resolve_pending, NULL);
+}
+
+static gboolean resolve_pending(gpointer data)
+{
+    dresif_request_t *reqs   = pending.reqs;
+    pending_ctl_t    *ctls   = pending.ctls;
+    int               length = pending.length;
+    resource_set_t   *rs;
+    int               i;
+
+    (void)data;
+
+    /* requests made while resolving go to the next burst */
+    memset(&pending, 0, sizeof(pending));
+
+    if (length > 0) {
+        OHM_DEBUG(DBG_MGR, "resolving %d request(s) at once", length);
+
+        transaction_start(NULL, NULL);
+
+        resolving.reqs   = reqs;
+        resolving.ctls   = ctls;
+        resolving.length = length;
+
+        dresif_resource_requests(reqs, length);
+
+        memset(&resolving, 0, sizeof(resolving));
+
+        for (i = 0;  i < length;  i++) {
+            if (ctls[i].reply && trans_id != NO_TRANSACTION &&
+                (rs = resource_set_find_by_manager_id(reqs[i].manager_id)))
+                resource_set_queue_change(rs, trans_id, ctls[i].reqno,
+                                          resource_set_granted);
+        }
+
+        transaction_end(NULL);
+
+        for (i = 0;  i < length;  i++)
+            free(reqs[i].client_name);
+    }
+
+    free(reqs);
+    free(ctls);
+
+    return FALSE;
+}
+
+/*
+ * Queue a grant change of a set for every request of the set that is
+ * being resolved, so each of them is answered with its own reqno.
+ * Requests asking for a reply regardless get it in resolve_pending.
+ */
+static void queue_granted(resource_set_t *rs)
+{
+    resset_t *resset = rs->resset;
+    int       always = resset->mode & RESMSG_MODE_ALWAYS_REPLY;
+    int       queued = FALSE;
+    int       i;
+
+    for (i = 0;  i < resolving.length;  i++) {
+        if (resolving.reqs[i].manager_id != rs->manager_id ||
+            !resolving.ctls[i].reqno)
+            continue;
+
+        if (!always)
+            resource_set_queue_change(rs, trans_id, resolving.ctls[i].reqno,
+                                      resource_set_granted);
+        queued = TRUE;
+    }
+
+    if (!queued)
+        resource_set_queue_change(rs, trans_id, 0, resource_set_granted);
+}
+
+static void pending_purge(void)
+{
+    int i;
+
+    if (pending.srcid)
+        g_source_remove(pending.srcid);
+
+    for (i = 0;  i < pending.length;  i++)
+        free(pending.reqs[i].client_name);
+
+    free(pending.reqs);
+    free(pending.ctls);
+
+    memset(&pending, 0, sizeof(pending));
+}
+
 static void transaction_start(resource_set_t *rs, resmsg_t *msg)
 {
     trans_id = transaction_create(transaction_complete, NULL);
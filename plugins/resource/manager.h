@@ -27,6 +27,7 @@ USA.
 typedef struct _OhmPlugin OhmPlugin;
 
 void manager_init(OhmPlugin *);
+void manager_exit(OhmPlugin *);
 
 void manager_register(resmsg_t *, resset_t *, void *);
 void manager_unregister(resmsg_t *, resset_t *, void *);
@@ -30,6 +30,7 @@ USA.
 #include "dbusif.h"
 #include "internalif.h"
 #include "manager.h"
+#include "admission.h"
 #include "resource-spec.h"
 #include "transaction.h"
 #include "fsif.h"
@@ -96,6 +97,7 @@ static void plugin_init(OhmPlugin *plugin)
     fsif_init(plugin);
     dresif_init(plugin);
     manager_init(plugin);
+    admission_init(plugin);
     resource_set_init(plugin);
     resource_spec_init(plugin);
     transaction_init(plugin);
@@ -111,6 +113,9 @@ static void plugin_init(OhmPlugin *plugin)
 
 static void plugin_destroy(OhmPlugin *plugin)
 {
+    manager_exit(plugin);
+    admission_exit(plugin);
+    resource_set_exit(plugin);
     auth_exit(plugin);
     fsif_exit(plugin);
 }
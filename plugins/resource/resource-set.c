@@ -22,6 +22,7 @@ USA.
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include <stdarg.h>
 #include <errno.h>
 
@@ -32,10 +33,7 @@ USA.
 #include "fsif.h"
 #include "transaction.h"
 
-#define HASH_BITS      8
-#define HASH_DIM       (1 << HASH_BITS)
-#define HASH_MASK      (HASH_DIM - 1)
-#define HASH_INDEX(i)  ((i) & HASH_MASK)
+#define QENTRY_SLAB    64      /* queue entries allocated at once */
 
 #define INTEGER_FIELD(n,v) { fldtype_integer, n, .value.integer = v }
 #define STRING_FIELD(n,v)  { fldtype_string , n, .value.string  = v ? v : "" }
@@ -43,7 +41,11 @@ USA.
 
 #define SELIST_DIM  2
 
-static resource_set_t  *hash_table[HASH_DIM];
+static GHashTable           *id_index;      /* manager_id -> set */
+static GHashTable           *pid_index;     /* client pid -> list of sets */
+static GHashTable           *peer_index;    /* peer address -> list of sets */
+static resource_set_queue_t *qentry_pool;   /* free queue entries */
+static GSList               *qentry_slabs;  /* for freeing them on exit */
 
 static gboolean idle_task(gpointer);
 
@@ -60,9 +62,14 @@ static int update_factstore_block(resource_set_t *);
 static int update_factstore_audio(resource_set_t *, resource_audio_stream_t *);
 static int update_factstore_video(resource_set_t *, resource_video_stream_t *);
 
+static resource_set_queue_t *qentry_alloc(void);
+static void qentry_free(resource_set_queue_t *);
+
 static void add_to_hash_table(resource_set_t *);
 static void delete_from_hash_table(resource_set_t *);
 static resource_set_t *find_in_hash_table(uint32_t);
+static void list_add(GHashTable *, gpointer, int, resource_set_t *, size_t);
+static void list_delete(GHashTable *, gpointer, int, resource_set_t *, size_t);
 
 
 /*! \addtogroup pubif
@@ -76,6 +83,43 @@ void resource_set_init(OhmPlugin *plugin)
 
     ENTER;
 
+    id_index   = g_hash_table_new(g_direct_hash, g_direct_equal);
+    pid_index  = g_hash_table_new(g_direct_hash, g_direct_equal);
+    peer_index = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    LEAVE;
+}
+
+void resource_set_exit(OhmPlugin *plugin)
+{
+    GSList *l;
+
+    (void)plugin;
+
+    ENTER;
+
+    if (id_index != NULL) {
+        g_hash_table_destroy(id_index);
+        id_index = NULL;
+    }
+
+    if (pid_index != NULL) {
+        g_hash_table_destroy(pid_index);
+        pid_index = NULL;
+    }
+
+    if (peer_index != NULL) {
+        g_hash_table_destroy(peer_index);
+        peer_index = NULL;
+    }
+
+    for (l = qentry_slabs;  l != NULL;  l = l->next)
+        free(l->data);
+
+    g_slist_free(qentry_slabs);
+    qentry_slabs = NULL;
+    qentry_pool  = NULL;
+
     LEAVE;
 }
 
@@ -148,6 +192,7 @@ void resource_set_destroy(resset_t *resset)
             delete_from_hash_table(rs);
 
             free(rs->request);
+            free(rs->peer);
             free(rs);
 
             resset->userdata=NULL;
@@ -331,6 +376,50 @@ resource_set_t *resource_set_find(fsif_entry_t *entry)
     return rs;
 }
 
+resource_set_t *resource_set_find_by_manager_id(uint32_t manager_id)
+{
+    return find_in_hash_table(manager_id);
+}
+
+/*
+ * Call iter for every resource set of a client, eg. when the client is
+ * gone. The iterator may destroy the set it was called with.
+ */
+int resource_set_foreach_by_pid(pid_t pid, resource_set_iter_t iter, void *data)
+{
+    resource_set_t *rs, *next;
+    int             n = 0;
+
+    rs = g_hash_table_lookup(pid_index, GINT_TO_POINTER(pid));
+
+    for ( ;  rs != NULL;  rs = next, n++) {
+        next = rs->by_pid.next;
+        iter(rs, data);
+    }
+
+    return n;
+}
+
+int resource_set_foreach_by_peer(const char          *peer,
+                                 resource_set_iter_t  iter,
+                                 void                *data)
+{
+    resource_set_t *rs, *next;
+    int             n = 0;
+
+    if (peer == NULL)
+        return 0;
+
+    rs = g_hash_table_lookup(peer_index, peer);
+
+    for ( ;  rs != NULL;  rs = next, n++) {
+        next = rs->by_peer.next;
+        iter(rs, data);
+    }
+
+    return n;
+}
+
 void resource_set_dump_message(resmsg_t *msg,resset_t *resset,const char *dir)
 {
     resconn_t *rconn = resset->resconn;
@@ -432,7 +521,7 @@ static void enqueue_send_request(resource_set_t          *rs,
     default:                                                           return;
     }
 
-    if ((qentry = malloc(sizeof(resource_set_queue_t))) == NULL)
+    if ((qentry = qentry_alloc()) == NULL)
         OHM_ERROR("resource: [%s] memory allocation failure", __FUNCTION__);
     else {
         qhead = &value->queue;
@@ -450,6 +539,42 @@ static void enqueue_send_request(resource_set_t          *rs,
     }
 }
 
+static int send_output(resource_set_t *rs, resmsg_type_t type,
+                       uint32_t resrc, uint32_t reqno)
+{
+    resset_t *resset = rs->resset;
+    resmsg_t  msg;
+    char      buf[128];
+
+    if (rs->block && type == RESMSG_GRANT) {
+        OHM_DEBUG(DBG_SET, "%s/%u (manager_id %u) dequed but not "
+                  "sent %s value %s", resset->peer, resset->id,
+                  rs->manager_id, resmsg_type_str(type),
+                  resmsg_res_str(resrc, buf, sizeof(buf)));
+        return FALSE;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.notify.type  = type;
+    msg.notify.id    = resset->id;
+    msg.notify.reqno = reqno;
+    msg.notify.resrc = resrc;
+                
+    if (!resproto_send_message(resset, &msg, NULL)) {
+        OHM_ERROR("resource: failed to send %s message to "
+                  "%s/%u (manager id %u)", resmsg_type_str(type),
+                  resset->peer, resset->id, rs->manager_id);
+        return FALSE;
+    }
+
+    OHM_DEBUG(DBG_SET, "%s/%u (manager_id %u) dequed and sent %s value %s "
+              "(reqno %u)", resset->peer, resset->id, rs->manager_id,
+              resmsg_type_str(type), resmsg_res_str(resrc, buf, sizeof(buf)),
+              reqno);
+
+    return TRUE;
+}
+
 static void dequeue_and_send(resource_set_t          *rs,
                              resource_set_field_id_t  what,
                              uint32_t                 txid)
@@ -459,9 +584,11 @@ static void dequeue_and_send(resource_set_t          *rs,
     resource_set_output_t *value;
     resource_set_qhead_t  *qhead;
     resource_set_queue_t  *qentry;
-    int32_t                block;
-    resmsg_t               msg;
-    char                   buf[128];
+    resource_set_queue_t  *batch, *last, *next;
+    uint32_t               final;
+    uint32_t               sent_reqno;
+    int                    replied;
+    int                    dropped;
 
     if (rs == NULL || (resset = rs->resset) == NULL) {
         OHM_ERROR("resource: refuse to deque and send field: argument error");
@@ -475,58 +602,79 @@ static void dequeue_and_send(resource_set_t          *rs,
     }
 
     qhead = &value->queue;
-    block = rs->block;
 
     /*
      * we assume that the queue contains strictly monoton increasing txid's
-     * and this function is called with strictly monoton txid's
+     * and this function is called with strictly monoton txid's. Pick the
+     * entries of this transaction; anything older is out of order.
      */
-    while ((qentry = queue_pop_head(qhead)) != NULL) {
-        if (qentry->txid > txid)
-            return;             /* nothing to send */
-
-        if (qentry->txid == txid) {
-            if (qentry->reqno || value->client != qentry->value) {
-                if (block && type == RESMSG_GRANT) {
-                    OHM_DEBUG(DBG_SET, "%s/%u (manager_id %u) dequed but not "
-                              "sent %s value %s", resset->peer, resset->id,
-                              rs->manager_id, resmsg_type_str(type),
-                              resmsg_res_str(value->client,buf,sizeof(buf)));
-                }
-                else {
-                    memset(&msg, 0, sizeof(msg));
-                    msg.notify.type  = type;
-                    msg.notify.id    = resset->id;
-                    msg.notify.reqno = qentry->reqno;
-                    msg.notify.resrc = qentry->value;
-                
-                    if (resproto_send_message(resset, &msg, NULL)) {
-                        value->client = qentry->value;
-
-                        OHM_DEBUG(DBG_SET, "%s/%u (manager_id %u) dequed and "
-                                  "sent %s value %s", resset->peer, resset->id,
-                                  rs->manager_id, resmsg_type_str(type),
-                                  resmsg_res_str(value->client,buf,sizeof(buf))
-                                 );
-                    }
-                    else {
-                        OHM_ERROR("resource: failed to send %s message to "
-                                  "%s/%u (manager id %u)",
-                                  resmsg_type_str(type), resset->peer,
-                                  resset->id, rs->manager_id);
-                    }
-                } /* if !block */
-            }
-        }
-        else {
+    batch = last = NULL;
+
+    while ((qentry = qhead->head) != NULL && qentry->txid <= txid) {
+        queue_pop_head(qhead);
+
+        if (qentry->txid < txid) {
             OHM_ERROR("resource: deleting out-of-order '%s' transaction "
                       "%u for %s/%u (manager id %u: expected transaction %u)",
                       resmsg_type_str(type), qentry->txid,
                       resset->peer, resset->id, rs->manager_id, txid);
+            qentry_free(qentry);
+            continue;
         }
 
-        free(qentry);
-    } /* while */
+        qentry->next = NULL;
+
+        if (last != NULL)
+            last->next = qentry;
+        else
+            batch = qentry;
+
+        last = qentry;
+    }
+
+    if (batch == NULL)
+        return;             /* nothing to send */
+
+    /*
+     * Only the last value of the transaction is relevant. Every request
+     * that waits for a reply gets one message carrying that value; the
+     * unsolicited intermediate values are collapsed into at most one
+     * message, sent only if the client does not know the value yet.
+     */
+    final      = last->value;
+    sent_reqno = 0;
+    replied    = FALSE;
+    dropped    = 0;
+
+    for (qentry = batch;  qentry != NULL;  qentry = qentry->next) {
+        if (qentry->reqno && qentry->reqno != sent_reqno) {
+            if (send_output(rs, type, final, qentry->reqno))
+                value->client = final;
+
+            sent_reqno = qentry->reqno;
+            replied    = TRUE;
+        }
+        else
+            dropped++;
+    }
+
+    if (!replied && value->client != final) {
+        if (send_output(rs, type, final, 0))
+            value->client = final;
+
+        dropped--;
+    }
+
+    if (dropped > 0) {
+        OHM_DEBUG(DBG_SET, "%s/%u (manager_id %u) %d %s value(s) of "
+                  "transaction %u collapsed", resset->peer, resset->id,
+                  rs->manager_id, dropped, resmsg_type_str(type), txid);
+    }
+
+    for (qentry = batch;  qentry != NULL;  qentry = next) {
+        next = qentry->next;
+        qentry_free(qentry);
+    }
 }
 
 static void destroy_queue(resource_set_t *rs, resource_set_field_id_t what)
@@ -541,7 +689,7 @@ static void destroy_queue(resource_set_t *rs, resource_set_field_id_t what)
     }
 
     while ((qentry = queue_pop_head(qhead)) != NULL)
-        free(qentry);
+        qentry_free(qentry);
 }
 
 
@@ -705,43 +853,128 @@ static int update_factstore_video(resource_set_t          *rs,
 }
 
 
-static void add_to_hash_table(resource_set_t *rs)
+static resource_set_queue_t *qentry_alloc(void)
 {
-    int index = HASH_INDEX(rs->manager_id);
+    resource_set_queue_t *qentry;
+    resource_set_queue_t *slab;
+    int                   i;
+
+    /*
+     * queue entries are carved out of slabs and recycled through a free
+     * list instead of being malloc'd and freed for every output
+     */
+    if (qentry_pool == NULL) {
+        if ((slab = malloc(QENTRY_SLAB * sizeof(*slab))) == NULL)
+            return NULL;
 
-    rs->next = hash_table[index];
-    hash_table[index] = rs;
+        for (i = 0;  i < QENTRY_SLAB - 1;  i++)
+            slab[i].next = slab + i + 1;
+        slab[i].next = NULL;
+
+        qentry_pool  = slab;
+        qentry_slabs = g_slist_prepend(qentry_slabs, slab);
+    }
+
+    qentry = qentry_pool;
+    qentry_pool = qentry->next;
+
+    return qentry;
 }
 
-static void delete_from_hash_table(resource_set_t *rs)
+static void qentry_free(resource_set_queue_t *qentry)
 {
-    int              index  = HASH_INDEX(rs->manager_id);
-    resset_t        *resset = rs->resset;
-    resource_set_t  *prev;
+    if (qentry != NULL) {
+        qentry->next = qentry_pool;
+        qentry_pool  = qentry;
+    }
+}
 
-    for (prev = (void *)&hash_table[index];   prev->next;  prev = prev->next) {
-        if (prev->next == rs) {
-            prev->next = rs->next;
-            return;
-        }
+#define LINK(rs, offs) ((resource_set_link_t *)((char *)(rs) + (offs)))
+
+static void list_add(GHashTable     *index,
+                     gpointer        key,
+                     int             strkey,
+                     resource_set_t *rs,
+                     size_t          offs)
+{
+    resource_set_t *head = g_hash_table_lookup(index, key);
+
+    LINK(rs, offs)->prev = NULL;
+    LINK(rs, offs)->next = head;
+
+    if (head != NULL)
+        LINK(head, offs)->prev = rs;
+
+    g_hash_table_insert(index, strkey ? g_strdup(key) : key, rs);
+}
+
+static void list_delete(GHashTable     *index,
+                        gpointer        key,
+                        int             strkey,
+                        resource_set_t *rs,
+                        size_t          offs)
+{
+    resource_set_t *prev = LINK(rs, offs)->prev;
+    resource_set_t *next = LINK(rs, offs)->next;
+
+    if (prev != NULL)
+        LINK(prev, offs)->next = next;
+    else if (g_hash_table_lookup(index, key) == rs) {
+        if (next != NULL)
+            g_hash_table_insert(index, strkey ? g_strdup(key) : key, next);
+        else
+            g_hash_table_remove(index, key);
     }
 
-    OHM_ERROR("resource: failed to remove resource %s/%u (manager id %u) "
-              "from hash table: not found",
-              resset->peer, resset->id, rs->manager_id); 
+    if (next != NULL)
+        LINK(next, offs)->prev = prev;
+
+    LINK(rs, offs)->prev = LINK(rs, offs)->next = NULL;
 }
 
-static resource_set_t *find_in_hash_table(uint32_t manager_id)
+/*
+ * The peer address is copied to the set: the lists are keyed by it and
+ * have to be found again on destruction, whatever became of the resset.
+ */
+static void add_to_hash_table(resource_set_t *rs)
 {
-    int index = HASH_INDEX(manager_id);
-    resource_set_t *rs;
+    char *peer = rs->resset->peer;
+
+    g_hash_table_insert(id_index, GUINT_TO_POINTER(rs->manager_id), rs);
 
-    for (rs = hash_table[index];   rs != NULL;   rs = rs->next) {
-        if (manager_id == rs->manager_id)
-            break;
+    list_add(pid_index, GINT_TO_POINTER(rs->client_pid), FALSE,
+             rs, offsetof(resource_set_t, by_pid));
+
+    if (peer != NULL && (rs->peer = strdup(peer)) != NULL)
+        list_add(peer_index, rs->peer, TRUE, rs,
+                 offsetof(resource_set_t, by_peer));
+}
+
+static void delete_from_hash_table(resource_set_t *rs)
+{
+    resset_t *resset = rs->resset;
+
+    /* unlink from the client lists even if the id index is confused */
+    list_delete(pid_index, GINT_TO_POINTER(rs->client_pid), FALSE,
+                rs, offsetof(resource_set_t, by_pid));
+
+    if (rs->peer != NULL)
+        list_delete(peer_index, rs->peer, TRUE, rs,
+                    offsetof(resource_set_t, by_peer));
+
+    if (g_hash_table_lookup(id_index, GUINT_TO_POINTER(rs->manager_id)) != rs) {
+        OHM_ERROR("resource: failed to remove resource %s/%u (manager id %u) "
+                  "from hash table: not found",
+                  resset->peer, resset->id, rs->manager_id); 
+        return;
     }
 
-    return rs;
+    g_hash_table_remove(id_index, GUINT_TO_POINTER(rs->manager_id));
+}
+
+static resource_set_t *find_in_hash_table(uint32_t manager_id)
+{
+    return g_hash_table_lookup(id_index, GUINT_TO_POINTER(manager_id));
 }
 
 /* 
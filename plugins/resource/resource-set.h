@@ -35,6 +35,7 @@ struct resource_set_s;
 union resource_spec_u;
 
 typedef void (*resource_set_task_t)(struct resource_set_s *);
+typedef void (*resource_set_iter_t)(struct resource_set_s *, void *);
 
 typedef enum {
     resource_set_unknown_field = 0,
@@ -68,8 +69,15 @@ typedef struct {
 } __attribute__((__may_alias__)) resource_set_output_t;
 
 
-typedef struct resource_set_s {
+typedef struct {
     struct resource_set_s   *next;
+    struct resource_set_s   *prev;
+} resource_set_link_t;
+
+typedef struct resource_set_s {
+    resource_set_link_t      by_pid;     /* sets of the same client pid */
+    resource_set_link_t      by_peer;    /* sets of the same peer address */
+    char                    *peer;       /* peer_index key, if any */
     pid_t                    client_pid; /* pid of the resource client */
     uint32_t                 manager_id; /* resource-set generated unique ID */
     resset_t                *resset;     /* link to libresource */
@@ -96,6 +104,7 @@ typedef enum {
 
 
 void resource_set_init(OhmPlugin *);
+void resource_set_exit(OhmPlugin *);
 
 resource_set_t *resource_set_create(pid_t, resset_t *);
 void resource_set_destroy(resset_t *);
@@ -107,6 +116,9 @@ void resource_set_send_queued_changes(uint32_t, uint32_t);
 void resource_set_send_release_request(resource_set_t *);
 int  resource_set_add_idle_task(resource_set_t *, resource_set_task_t);
 resource_set_t *resource_set_find(struct _OhmFact *);
+resource_set_t *resource_set_find_by_manager_id(uint32_t);
+int  resource_set_foreach_by_pid(pid_t, resource_set_iter_t, void *);
+int  resource_set_foreach_by_peer(const char *, resource_set_iter_t, void *);
 
 void resource_set_dump_message(resmsg_t *, resset_t *, const char *);
 
@@ -0,0 +1,241 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "plugin.h"
+#include "transaction.h"
+
+#define INFLIGHT   5000
+#define RSETS      3
+#define LARGE      20000
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("%s:%d: check '%s' failed\n", __FILE__, __LINE__,    \
+                   #cond);                                              \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+int DBG_TRANSACT;
+
+static int       failures;
+static uint32_t  completed[INFLIGHT + 1];
+static int       ncompleted;
+static uint32_t  lastid;
+static int       bad_order;
+static int       bad_rsets;
+
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    (void)level;
+
+    va_start(ap, format);
+    vprintf(format, ap);
+    printf("\n");
+    va_end(ap);
+}
+
+void plugin_print_timestamp(const char *function, const char *phase)
+{
+    (void)function;
+    (void)phase;
+}
+
+static void inflight_cb(uint32_t *ids, int nid, uint32_t txid, void *data)
+{
+    uint32_t base = (uint32_t)(unsigned long)data;
+    int      i;
+
+    if (txid <= lastid)
+        bad_order++;
+
+    lastid = txid;
+
+    if (nid != RSETS)
+        bad_rsets++;
+    else {
+        for (i = 0;  i < nid;  i++) {
+            if (ids[i] != base + i)
+                bad_rsets++;
+        }
+    }
+
+    if (ncompleted < INFLIGHT)
+        completed[ncompleted] = txid;
+
+    ncompleted++;
+}
+
+static void test_inflight(void)
+{
+    uint32_t  txids[INFLIGHT];
+    int       order[INFLIGHT];
+    int       i, j, tmp;
+
+    ncompleted = 0;
+    lastid     = 0;
+
+    for (i = 0;  i < INFLIGHT;  i++) {
+        txids[i] = transaction_create(inflight_cb, (void *)(unsigned long)i);
+        CHECK(txids[i] != NO_TRANSACTION);
+
+        /* every set twice: duplicates must be dropped */
+        for (j = 0;  j < RSETS * 2;  j++)
+            CHECK(transaction_add_resource_set(txids[i], i + j % RSETS));
+
+        order[i] = i;
+    }
+
+    CHECK(ncompleted == 0);
+
+    /* release them in random order, but the oldest one last */
+    for (i = INFLIGHT - 1;  i > 1;  i--) {
+        j = 1 + random() % i;
+        tmp = order[i]; order[i] = order[j]; order[j] = tmp;
+    }
+
+    for (i = 1;  i < INFLIGHT;  i++)
+        CHECK(transaction_unref(txids[order[i]]));
+
+    CHECK(ncompleted == 0);
+
+    CHECK(transaction_unref(txids[0]));
+
+    CHECK(ncompleted == INFLIGHT);
+    CHECK(bad_order == 0);
+    CHECK(bad_rsets == 0);
+
+    for (i = 0;  i < INFLIGHT && i < ncompleted;  i++)
+        CHECK(completed[i] == txids[i]);
+
+    /* completed transactions are gone */
+    CHECK(!transaction_ref(txids[0]));
+    CHECK(!transaction_unref(txids[INFLIGHT - 1]));
+}
+
+static void large_cb(uint32_t *ids, int nid, uint32_t txid, void *data)
+{
+    int i;
+
+    (void)txid;
+    (void)data;
+
+    if (nid != LARGE)
+        bad_rsets++;
+    else {
+        for (i = 0;  i < nid;  i++) {
+            if (ids[i] != (uint32_t)(LARGE - 1 - i))
+                bad_rsets++;
+        }
+    }
+
+    ncompleted++;
+}
+
+static void test_large(void)
+{
+    uint32_t txid;
+    int      i;
+
+    ncompleted = 0;
+    bad_rsets  = 0;
+
+    txid = transaction_create(large_cb, NULL);
+    CHECK(txid != NO_TRANSACTION);
+
+    for (i = LARGE - 1;  i >= 0;  i--)
+        CHECK(transaction_add_resource_set(txid, i));
+
+    for (i = 0;  i < LARGE;  i++)
+        CHECK(transaction_add_resource_set(txid, i));
+
+    CHECK(transaction_unref(txid));
+
+    CHECK(ncompleted == 1);
+    CHECK(bad_rsets == 0);
+}
+
+static void count_cb(uint32_t *ids, int nid, uint32_t txid, void *data)
+{
+    (void)ids;
+    (void)nid;
+    (void)txid;
+    (void)data;
+
+    ncompleted++;
+}
+
+static void test_refcount(void)
+{
+    uint32_t tx1, tx2;
+
+    ncompleted = 0;
+
+    tx1 = transaction_create(count_cb, NULL);
+    tx2 = transaction_create(count_cb, NULL);
+
+    CHECK(transaction_ref(tx1));
+    CHECK(transaction_unref(tx2));
+    CHECK(ncompleted == 0);     /* tx1 is still open */
+
+    CHECK(transaction_unref(tx1));
+    CHECK(ncompleted == 0);     /* tx1 is still referenced */
+
+    CHECK(transaction_unref(tx1));
+    CHECK(ncompleted == 2);
+
+    CHECK(!transaction_unref(tx1));
+}
+
+int main(int argc, char **argv)
+{
+    (void)argc;
+
+    srandom(1);
+
+    transaction_init(NULL);
+
+    test_inflight();
+    test_large();
+    test_refcount();
+    test_inflight();            /* once more on the grown ring */
+
+    printf("%s: %s\n", argv[0], failures ? "FAILED" : "passed");
+
+    return failures ? 1 : 0;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -28,19 +28,28 @@ USA.
 #include "plugin.h"
 #include "transaction.h"
 
-#define HASH_BITS      10
-#define HASH_DIM       (1 << HASH_BITS)
-#define HASH_MASK      (HASH_DIM - 1)
-#define HASH_INDEX(i)  ((i) & HASH_MASK)
+#define RING_MIN       64          /* initial number of transaction slots */
+#define TABLE_MIN      16          /* initial size of resource set tables */
+#define SET_LIMIT      16          /* above this use a hash set for dedup */
 
-#define ALLOC_DIM      1024
-#define ALLOC_JUNK     (ALLOC_DIM * sizeof(uint32_t))
+#define SET_EMPTY      (~(uint32_t)0)
 
+/* the ID after id; IDs wrap around but never become NO_TRANSACTION */
+#define NEXT_ID(id)    ((id) + 1 != NO_TRANSACTION ? (id) + 1 : (id) + 2)
 
+
+/*
+ * The resource sets of a transaction. The table keeps the order of
+ * addition for the completion callback. Once the table gets longer than
+ * SET_LIMIT an open addressing hash set is maintained alongside so that
+ * duplicate checks remain constant time.
+ */
 typedef struct {
-    int       junks;
     int       length;
-    uint32_t *table;    
+    int       size;
+    uint32_t *table;
+    uint32_t  mask;      /* hash set size - 1 */
+    uint32_t *set;
 } resset_table_t;
 
 typedef struct {
@@ -56,13 +65,25 @@ typedef struct {
 } transaction_t;
 
 
-static transaction_t   transactions[HASH_DIM];
+/*
+ * Transactions in flight always have consecutive IDs between txread and
+ * txwrite. They are kept in a ring indexed by (txid & ring_mask) which is
+ * grown whenever it would get full, so slots never alias. Transactions
+ * must complete in ID order; the ones whose refcount has dropped to zero
+ * are waiting at the head of the ring until every older one is done.
+ * IDs wrap around, skipping NO_TRANSACTION.
+ */
+static transaction_t  *ring;
+static uint32_t        ring_mask;
 static uint32_t        txwrite;
 static uint32_t        txread = 1;
 
 static transaction_t *find_transaction(uint32_t);
-static int add_resource_set(transaction_t *, uint32_t);
-static void complete_transaction(uint32_t);
+static int  grow_ring(void);
+static int  add_resource_set(transaction_t *, uint32_t);
+static int  set_insert(resset_table_t *, uint32_t);
+static void set_remove(resset_table_t *, uint32_t);
+static void complete_transactions(void);
 
 
 /*! \addtogroup pubif
@@ -81,28 +102,29 @@ void transaction_init(OhmPlugin *plugin)
 
 uint32_t transaction_create(transaction_callback_t callback, void *user_data)
 {
-    static uint32_t  count = NO_TRANSACTION;
-
-    uint32_t       txid = ++count;
-    int            idx  = HASH_INDEX(txid);
-    transaction_t *tx   = transactions + idx;
+    uint32_t       txid = NEXT_ID(txwrite);
+    transaction_t *tx;
 
-    if (tx->id != NO_TRANSACTION) {
-        OHM_ERROR("resource: transaction table overflow: transaction %u",txid);
-        txid = NO_TRANSACTION;
+    if (ring == NULL || txid - txread > ring_mask) {
+        if (!grow_ring()) {
+            OHM_ERROR("resource: can't create transaction %u: "
+                      "out of memory", txid);
+            return NO_TRANSACTION;
+        }
     }
-    else {
-        memset(tx, 0, sizeof(transaction_t));
-        tx->id     = txid;
-        tx->refcnt = 1;
 
-        tx->completion.function  = callback;
-        tx->completion.user_data = user_data;
+    tx = ring + (txid & ring_mask);
 
-        txwrite = txid;
+    memset(tx, 0, sizeof(transaction_t));
+    tx->id     = txid;
+    tx->refcnt = 1;
 
-        OHM_DEBUG(DBG_TRANSACT, "transaction %u created", txid);
-    }
+    tx->completion.function  = callback;
+    tx->completion.user_data = user_data;
+
+    txwrite = txid;
+
+    OHM_DEBUG(DBG_TRANSACT, "transaction %u created", txid);
 
     return txid;
 }
@@ -157,8 +179,8 @@ int transaction_unref(uint32_t txid)
         OHM_DEBUG(DBG_TRANSACT, "transaction unreferenced (refcnt is %u)",
                   tx->refcnt);
 
-        if (tx->refcnt <= 0)
-            complete_transaction(txid);
+        if (tx->refcnt <= 0 && txid == txread)
+            complete_transactions();
     }
 
     return success;
@@ -171,71 +193,201 @@ int transaction_unref(uint32_t txid)
 
 static transaction_t *find_transaction(uint32_t txid)
 {
-    int            idx = HASH_INDEX(txid);
-    transaction_t *tx  = transactions + idx;
+    transaction_t *tx;
+
+    if (ring == NULL || txid == NO_TRANSACTION)
+        return NULL;
 
-    return (txid != NO_TRANSACTION && txid == tx->id) ? tx : NULL;
+    tx = ring + (txid & ring_mask);
+
+    return (txid == tx->id) ? tx : NULL;
 }
 
+static int grow_ring(void)
+{
+    uint32_t       size = ring ? (ring_mask + 1) * 2 : RING_MIN;
+    uint32_t       mask = size - 1;
+    transaction_t *new;
+    uint32_t       id;
+
+    if (size == 0 || (new = calloc(size, sizeof(transaction_t))) == NULL)
+        return FALSE;
+
+    if (ring != NULL) {
+        for (id = txread;  id != NEXT_ID(txwrite);  id = NEXT_ID(id))
+            new[id & mask] = ring[id & ring_mask];
+
+        free(ring);
+    }
+
+    OHM_DEBUG(DBG_TRANSACT, "transaction ring grown to %u slots", size);
+
+    ring      = new;
+    ring_mask = mask;
+
+    return TRUE;
+}
 
 static int add_resource_set(transaction_t *tx, uint32_t rsid)
 {
-    int   idx   = tx->resset.length;
-    int   junks;
-    int   size;
-    void *mem;
-    int   i;
-
-    for (i = 0;    i < tx->resset.length;   i++) {
-        if (tx->resset.table[i] == rsid)
+    resset_table_t *rt = &tx->resset;
+    uint32_t       *table;
+    int             size;
+    int             i;
+
+    if (rt->set != NULL) {
+        if (!set_insert(rt, rsid))
             return TRUE;        /* it is already there */
     }
+    else {
+        for (i = 0;    i < rt->length;   i++) {
+            if (rt->table[i] == rsid)
+                return TRUE;    /* it is already there */
+        }
+    }
     
-    if ((junks = (idx + ALLOC_JUNK) / ALLOC_JUNK) > tx->resset.junks) {
-        size = junks * ALLOC_JUNK * sizeof(uint32_t *);
-        mem  = realloc(tx->resset.table, size);
+    if (rt->length >= rt->size) {
+        size  = rt->size ? rt->size * 2 : TABLE_MIN;
+        table = realloc(rt->table, size * sizeof(uint32_t));
         
-        if (mem == NULL)
+        if (table == NULL) {
+            if (rt->set != NULL)
+                set_remove(rt, rsid);
             return FALSE;
+        }
 
-        tx->resset.junks = junks;
-        tx->resset.table = mem;
+        rt->size  = size;
+        rt->table = table;
     }
 
-    tx->resset.length = idx + 1;
-    tx->resset.table[idx] = rsid;
+    rt->table[rt->length++] = rsid;
+
+    if (rt->set == NULL && rt->length > SET_LIMIT) {
+        rt->mask = (SET_LIMIT * 4) - 1;
+
+        if ((rt->set = malloc((rt->mask + 1) * sizeof(uint32_t))) != NULL) {
+            memset(rt->set, 0xff, (rt->mask + 1) * sizeof(uint32_t));
+
+            for (i = 0;  i < rt->length;  i++)
+                set_insert(rt, rt->table[i]);
+        }
+    }
 
     return TRUE;
 }
 
-static void complete_transaction(uint32_t txid)
+/*
+ * Insert an ID to the hash set of the table. Returns FALSE if the ID was
+ * already there. The set is kept at most half full.
+ */
+static int set_insert(resset_table_t *rt, uint32_t rsid)
 {
-    transaction_t *tx;
-    uint32_t       id;
+    uint32_t *set;
+    uint32_t  mask;
+    uint32_t  i, j;
 
-    if (txid == txread) {
-        for (id = txread;  id <= txwrite;   id++)  {
-            if ((tx = find_transaction(id)) == NULL) {
-                OHM_ERROR("resource: wants to complete transaction %u "
-                          "but can't find it", id);
-                continue;
-            }
+    for (i = (rsid * 2654435761U) & rt->mask;  ;  i = (i + 1) & rt->mask) {
+        if (rt->set[i] == rsid)
+            return FALSE;
+        if (rt->set[i] == SET_EMPTY)
+            break;
+    }
+
+    rt->set[i] = rsid;
 
-            if (tx->refcnt > 0)
-                break;
+    if ((uint32_t)rt->length * 2 > rt->mask) {
+        mask = (rt->mask + 1) * 2 - 1;
 
-            OHM_DEBUG(DBG_TRANSACT, "completing transaction %u", tx->id);
+        if ((set = malloc((mask + 1) * sizeof(uint32_t))) != NULL) {
+            memset(set, 0xff, (mask + 1) * sizeof(uint32_t));
 
-            if (tx->completion.function != NULL) {
-                tx->completion.function(tx->resset.table, tx->resset.length,
-                                        tx->id, tx->completion.user_data);
+            for (j = 0;  j <= rt->mask;  j++) {
+                if (rt->set[j] == SET_EMPTY)
+                    continue;
+
+                for (i = (rt->set[j] * 2654435761U) & mask;
+                     set[i] != SET_EMPTY;
+                     i = (i + 1) & mask)
+                    ;
+
+                set[i] = rt->set[j];
             }
-        
-            free(tx->resset.table);
-            memset(tx, 0, sizeof(*tx));
-            
-            txread = id + 1;
+
+            free(rt->set);
+
+            rt->set  = set;
+            rt->mask = mask;
+        }
+    }
+
+    return TRUE;
+}
+
+/*
+ * Remove an ID from the hash set of the table. The entries following it
+ * in the same probe run are moved up so lookups still find them.
+ */
+static void set_remove(resset_table_t *rt, uint32_t rsid)
+{
+    uint32_t i, j, k;
+
+    for (i = (rsid * 2654435761U) & rt->mask;  ;  i = (i + 1) & rt->mask) {
+        if (rt->set[i] == SET_EMPTY)
+            return;
+        if (rt->set[i] == rsid)
+            break;
+    }
+
+    for (j = (i + 1) & rt->mask;  rt->set[j] != SET_EMPTY;
+         j = (j + 1) & rt->mask) {
+        k = (rt->set[j] * 2654435761U) & rt->mask;
+
+        /* leave the entry alone if its home slot lies in (i, j] */
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+            continue;
+
+        rt->set[i] = rt->set[j];
+        i = j;
+    }
+
+    rt->set[i] = SET_EMPTY;
+}
+
+static void complete_transactions(void)
+{
+    transaction_t *tx;
+    transaction_t  done;
+    
+    while (txread != NEXT_ID(txwrite)) {
+        tx = ring + (txread & ring_mask);
+
+        if (tx->id != txread) {
+            OHM_ERROR("resource: wants to complete transaction %u "
+                      "but can't find it", txread);
+            txread = NEXT_ID(txread);
+            continue;
         }
+
+        if (tx->refcnt > 0)
+            break;
+
+        OHM_DEBUG(DBG_TRANSACT, "completing transaction %u", tx->id);
+
+        /*
+         * the slot is released before calling back, so the callback is
+         * free to create new transactions
+         */
+        done = *tx;
+        memset(tx, 0, sizeof(*tx));
+        txread = NEXT_ID(txread);
+
+        if (done.completion.function != NULL) {
+            done.completion.function(done.resset.table, done.resset.length,
+                                     done.id, done.completion.user_data);
+        }
+        
+        free(done.resset.table);
+        free(done.resset.set);
     }
 }
 
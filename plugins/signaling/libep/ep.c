@@ -24,7 +24,6 @@ USA.
 /* globals */
 
 static DBusConnection *connection = NULL;
-static struct ep_list_head_s cb_list;
 static struct ep_list_head_s transaction_list;
 
 struct transaction_data {
@@ -52,6 +51,22 @@ struct ep_list_head_s {
     struct ep_list_node_s *last;
 };
 
+/* interned signal names, each carrying the list of filters registered
+ * for it; incoming signals are dispatched with a single hash lookup */
+
+#define EP_SIGNAL_TABLE_MIN 16
+
+struct ep_signal_s {
+    struct ep_signal_s    *next;
+    unsigned int           hash;
+    char                  *name;
+    struct ep_list_head_s  cbs;
+};
+
+static struct ep_signal_s **signal_table = NULL;
+static unsigned int         signal_table_size = 0;
+static unsigned int         signal_count = 0;
+
 static int ep_list_empty (struct ep_list_head_s *head)
 {
     return head->last ? FALSE : TRUE;
@@ -165,6 +180,94 @@ static void ** ep_list_convert_to_array(struct ep_list_head_s *head) {
     return retval;
 }
 
+static unsigned int ep_hash_string (const char *str)
+{
+    unsigned int h = 5381;
+
+    while (*str)
+        h = (h << 5) + h + (unsigned char) *str++;
+
+    return h;
+}
+
+static int ep_signal_table_grow (void)
+{
+    struct ep_signal_s **table, *sig, *next;
+    unsigned int size, i, idx;
+
+    size = signal_table_size ? signal_table_size * 2 : EP_SIGNAL_TABLE_MIN;
+
+    table = calloc(size, sizeof(struct ep_signal_s *));
+
+    if (table == NULL)
+        return FALSE;
+
+    for (i = 0; i < signal_table_size; i++) {
+        for (sig = signal_table[i]; sig != NULL; sig = next) {
+            next = sig->next;
+            idx  = sig->hash & (size - 1);
+            sig->next  = table[idx];
+            table[idx] = sig;
+        }
+    }
+
+    free(signal_table);
+
+    signal_table      = table;
+    signal_table_size = size;
+
+    return TRUE;
+}
+
+static struct ep_signal_s * ep_lookup_signal (const char *name)
+{
+    struct ep_signal_s *sig;
+    unsigned int hash;
+
+    if (name == NULL || signal_table == NULL)
+        return NULL;
+
+    hash = ep_hash_string(name);
+
+    for (sig = signal_table[hash & (signal_table_size - 1)]; sig; sig = sig->next) {
+        if (sig->hash == hash && strcmp(sig->name, name) == 0)
+            return sig;
+    }
+
+    return NULL;
+}
+
+static struct ep_signal_s * ep_intern_signal (const char *name)
+{
+    struct ep_signal_s *sig;
+    unsigned int idx;
+
+    if ((sig = ep_lookup_signal(name)) != NULL)
+        return sig;
+
+    if (signal_count >= signal_table_size && !ep_signal_table_grow())
+        return NULL;
+
+    sig = calloc(1, sizeof(struct ep_signal_s));
+
+    if (sig == NULL)
+        return NULL;
+
+    if ((sig->name = strdup(name)) == NULL) {
+        free(sig);
+        return NULL;
+    }
+
+    sig->hash = ep_hash_string(name);
+    idx = sig->hash & (signal_table_size - 1);
+
+    sig->next = signal_table[idx];
+    signal_table[idx] = sig;
+    signal_count++;
+
+    return sig;
+}
+
 static struct transaction_data * ep_get_transaction(int txid) {
     
     /* check if it is still valid -- need to be in the list */
@@ -609,24 +712,25 @@ static DBusHandlerResult filter (DBusConnection *conn, DBusMessage *msg,
     (void) conn;
     (void) arg;
 
-    struct ep_list_head_s *head = &cb_list;
+    struct ep_signal_s *sig;
     struct ep_list_node_s *node = NULL;
-    struct cb_data *data = NULL;
+    const char *interface;
 
     /* printf("libep: policy event received\n"); */
 
-    if (ep_list_empty(head))
+    if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
         goto end;
 
-    node = head->first;
-    
-    while (node) {
-        data = node->data;
-        if (dbus_message_is_signal(msg, POLICY_DBUS_INTERFACE, data->signal)) {
-            handle_message(msg, data);
-        }
-        node = node->next;
-    }
+    interface = dbus_message_get_interface(msg);
+
+    if (interface == NULL || strcmp(interface, POLICY_DBUS_INTERFACE) != 0)
+        goto end;
+
+    if ((sig = ep_lookup_signal(dbus_message_get_member(msg))) == NULL)
+        goto end;
+
+    for (node = sig->cbs.first; node != NULL; node = node->next)
+        handle_message(msg, node->data);
 
 end:
     return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
@@ -762,25 +866,26 @@ static void free_cb (struct cb_data *data)
     if (data == NULL)
         return;
 
-    for (tmp = data->decision_names; tmp != NULL; tmp++) {
-        free(*tmp);
+    if (data->decision_names) {
+        for (tmp = data->decision_names; *tmp != NULL; tmp++) {
+            free(*tmp);
+        }
     }
     free(data->decision_names);
-    free(data->signal);
     free(data);
 
     return;
 }
 
-int ep_filter (const char **names, const char *signal, 
+static struct cb_data * create_cb (const char **names, const char *signal,
         ep_decision_cb cb, void *user_data)
 {
-
     struct cb_data *data = calloc(1, sizeof(struct cb_data));
+    struct ep_signal_s *sig;
     char **tmp = NULL;
     int names_len = 0, i;
 
-    if (!data)
+    if (!data || !signal)
         goto failed;
 
     data->user_data = user_data;
@@ -804,20 +909,85 @@ int ep_filter (const char **names, const char *signal,
             goto failed;
     }
 
-    data->signal = strdup(signal);
-    if (!data->signal)
+    /* the signal name is owned by the interned signal table */
+    if ((sig = ep_intern_signal(signal)) == NULL)
         goto failed;
 
+    data->signal = sig->name;
     data->cb = cb;
 
-    if (!ep_list_append(&cb_list, data))
-        goto failed;
-
-    return 1;
+    return data;
 
 failed:
 
     free_cb(data);
+    return NULL;
+}
+
+int ep_filter (const char **names, const char *signal, 
+        ep_decision_cb cb, void *user_data)
+{
+    struct ep_filter_spec spec[2];
+
+    /* a NULL signal would terminate the bulk list right away */
+    if (signal == NULL) {
+        printf("libep: refusing to add a filter without a signal\n");
+        return 0;
+    }
+
+    memset(spec, 0, sizeof(spec));
+
+    spec[0].decision_names = names;
+    spec[0].signal         = signal;
+    spec[0].cb             = cb;
+    spec[0].user_data      = user_data;
+
+    return ep_filter_bulk(spec);
+}
+
+int ep_filter_bulk (const struct ep_filter_spec *filters)
+{
+    const struct ep_filter_spec *f;
+    struct ep_signal_s *sig;
+    struct cb_data **data;
+    int n, i;
+
+    for (n = 0; filters[n].signal != NULL; n++)
+        ;
+
+    if ((data = calloc(n + 1, sizeof(struct cb_data *))) == NULL)
+        return 0;
+
+    /* compile every filter before subscribing any of them, so that
+     * a failure leaves the already installed set untouched */
+
+    for (i = 0; i < n; i++) {
+        f = filters + i;
+        data[i] = create_cb(f->decision_names, f->signal, f->cb, f->user_data);
+
+        if (data[i] == NULL)
+            goto failed;
+    }
+
+    for (i = 0; i < n; i++) {
+        sig = ep_lookup_signal(data[i]->signal);
+
+        if (!ep_list_append(&sig->cbs, data[i])) {
+            while (--i >= 0) {
+                sig = ep_lookup_signal(data[i]->signal);
+                ep_list_remove(&sig->cbs, data[i]);
+            }
+            goto failed;
+        }
+    }
+
+    free(data);
+    return 1;
+
+ failed:
+    for (i = 0; i < n; i++)
+        free_cb(data[i]);
+    free(data);
     return 0;
 }
 
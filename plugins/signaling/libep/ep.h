@@ -74,11 +74,23 @@ int ep_register     (DBusConnection *connection, const char *name, const char **
 int ep_unregister   (DBusConnection *connection);
 
 
-/* function for setting up the policy decision filter */
+/* functions for setting up the policy decision filters */
 
-int ep_filter   (const char **decision_names, const char *signal, 
+struct ep_filter_spec {
+    const char     **decision_names;
+    const char      *signal;
+    ep_decision_cb   cb;
+    void            *user_data;
+};
+
+int ep_filter       (const char **decision_names, const char *signal, 
         ep_decision_cb cb, void *user_data);
 
+/* subscribe a whole set of filters at once, the array is terminated by
+ * an entry with a NULL signal; either all of them or none get installed */
+
+int ep_filter_bulk  (const struct ep_filter_spec *filters);
+
 
 /* functions for handling the decision structures */
 
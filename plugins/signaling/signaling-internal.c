@@ -27,6 +27,7 @@ USA.
  */
 
 #include "signaling.h"
+#include "busqueue.h"
 
 #define ONLY_ONE_TRANSACTION 1
 
@@ -40,6 +41,7 @@ GHashTable     *signal_queues;
 #endif
 
 static OhmFactStore *store;
+static busqueue_t   *outq;             /* outgoing decision signals */
 static gboolean ecosystem_ready;
 
     
@@ -93,6 +95,13 @@ gboolean init_signaling(DBusConnection *c, int flag_signaling, int flag_facts)
 
     connection = c;
 
+    if (outq != NULL)
+        busqueue_set_connection(outq, c);
+    else if ((outq = busqueue_create(c)) == NULL) {
+        g_error("Failed to create outgoing message queue.");
+        return FALSE;
+    }
+
     return TRUE;
 }
 
@@ -118,6 +127,10 @@ gboolean deinit_signaling()
         g_hash_table_destroy(signal_queues);
 #endif
 
+    /* sends whatever decisions are still queued */
+    busqueue_destroy(outq);
+    outq = NULL;
+
     store = NULL;
 
     return TRUE;
@@ -790,7 +803,8 @@ static gboolean send_ipc_signal(gpointer data)
     /* close command_array_iter */
     dbus_message_iter_close_container(&message_iter, &command_array_iter);
 
-    if (!dbus_connection_send(connection, dbus_signal, NULL))
+    /* decisions to all EPs of a transaction leave as one batch */
+    if (!busqueue_send(outq, dbus_signal, 0))
         goto end;
 
 end:
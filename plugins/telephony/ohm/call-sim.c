@@ -0,0 +1,909 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Call-flow simulator and latency benchmark.
+ *
+ * A private session bus daemon is started (DBUS_DAEMON overrides the
+ * binary to use) and the plugin is connected to it as it would be to
+ * the real session bus. A second connection plays the telepathy side:
+ * it emits the scripted connection, channel, group, stream, hold and
+ * conference signal sequences of the incoming, outgoing, hold,
+ * conference and emergency scenarios and acknowledges every method call
+ * the plugin makes to it. The dres resolver is replaced by a stand-in
+ * policy that grants the requested call state and autoholds the other
+ * active calls, so every step goes all the way to an enforced decision.
+ *
+ * Every scenario is run -n times, then -s incoming calls are set up and
+ * torn down interleaved as a call storm. For every step the bus latency
+ * and the time spent in dispatch_signal, resolving, enforcing and
+ * replaying deferred events are reported, along with the number of
+ * events deferred, taken from the plugin's own timestamping hooks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "telephony.c"
+
+#define DEFAULT_ROUNDS  100
+#define SIM_TIMEOUT     5.0                    /* s to wait for a step */
+#define MAX_CHANNELS    256
+#define MAX_MARKS       512
+#define SIM_DIM(a)      (int)(sizeof(a) / sizeof(a[0]))
+
+#define H_NONE          0                      /* no handle */
+#define H_SELF          1                      /* our own handle */
+#define H_PEER          2                      /* handle of the peer */
+#define SELF_HANDLE     1
+#define PEER_HANDLE(ch) (100 + (ch))
+
+#define NEW_OUTGOING    0x01
+#define NEW_EMERGENCY   0x02
+#define NEW_CONFERENCE  0x04
+
+typedef enum {
+    STEP_NEW_CHANNEL,                          /* NewChannels */
+    STEP_MEMBERS,                              /* MembersChanged */
+    STEP_STREAM,                               /* StreamAdded */
+    STEP_HOLD,                                 /* HoldStateChanged */
+    STEP_CLOSED,                               /* Closed */
+    STEP_JOIN,                                 /* MemberChannelAdded */
+    STEP_EMERGENCY,                            /* emergency_call_active */
+} step_type_t;
+
+typedef struct {
+    step_type_t  type;
+    const char  *name;                         /* for the report */
+    int          ch;                           /* channel of the step */
+    int          arg;                          /* flags, state or type */
+    int          added;                        /* MembersChanged handles */
+    int          removed;
+    int          localpend;
+    int          remotepend;
+    int          actor;
+    int          members;                      /* mask of channels */
+} step_t;
+
+#define NEW(n, ch, flags)         { STEP_NEW_CHANNEL, n, ch, flags }
+#define CONF(n, ch, mask)                                               \
+    { STEP_NEW_CHANNEL, n, ch, NEW_OUTGOING | NEW_CONFERENCE, .members = mask }
+#define MEMBERS(n, ch, a, r, l, rp, actor)                              \
+    { STEP_MEMBERS, n, ch, 0, a, r, l, rp, actor }
+#define STREAM(n, ch, type)       { STEP_STREAM, n, ch, type }
+#define HOLD(n, ch, state)        { STEP_HOLD, n, ch, state }
+#define CLOSED(n, ch)             { STEP_CLOSED, n, ch }
+#define JOIN(n, conf, ch)         { STEP_JOIN, n, conf, .members = 1 << (ch) }
+#define EMERGENCY(n, on)          { STEP_EMERGENCY, n, 0, on }
+
+typedef struct {
+    double sum;
+    double max;
+} sim_lat_t;
+
+typedef struct {
+    int       n;                               /* times run */
+    sim_lat_t bus;                             /* send to filter */
+    sim_lat_t dispatch;                        /* in dispatch_signal */
+    sim_lat_t resolve;                         /* resolving the request */
+    sim_lat_t enforce;                         /* enforcing the decision */
+    sim_lat_t replay;                          /* replaying deferred events */
+    int       deferred;                        /* events deferred */
+} sim_stat_t;
+
+typedef struct {
+    const char *name;
+    step_t     *steps;
+    int         nstep;
+    sim_stat_t *stats;
+} scenario_t;
+
+
+/*
+ * the scripted call flows
+ */
+
+static step_t incoming[] = {
+    STREAM ("stream before channel", 0, TP_STREAM_TYPE_AUDIO),
+    NEW    ("new incoming channel" , 0, 0),
+    MEMBERS("ringing"              , 0, H_PEER, H_NONE, H_SELF, H_NONE, 0),
+    MEMBERS("accepted"             , 0, H_SELF, H_NONE, H_NONE, H_NONE, 0),
+    HOLD   ("held"                 , 0, TP_HELD),
+    HOLD   ("unheld"               , 0, TP_UNHELD),
+    MEMBERS("peer hung up"         , 0, H_NONE, H_PEER, H_NONE, H_NONE, H_PEER),
+    CLOSED ("closed"               , 0),
+};
+
+static step_t outgoing[] = {
+    NEW    ("new outgoing channel" , 0, NEW_OUTGOING),
+    MEMBERS("remote pending"       , 0, H_SELF, H_NONE, H_NONE, H_PEER, 0),
+    STREAM ("stream added"         , 0, TP_STREAM_TYPE_AUDIO),
+    MEMBERS("answered"             , 0, H_PEER, H_NONE, H_NONE, H_NONE, 0),
+    MEMBERS("local hangup"         , 0, H_NONE, H_SELF, H_NONE, H_NONE, H_SELF),
+    CLOSED ("closed"               , 0),
+};
+
+static step_t hold[] = {
+    NEW    ("A: outgoing channel"  , 0, NEW_OUTGOING),
+    MEMBERS("A: answered"          , 0, H_PEER, H_NONE, H_NONE, H_NONE, 0),
+    NEW    ("B: incoming channel"  , 1, 0),
+    MEMBERS("B: ringing"           , 1, H_PEER, H_NONE, H_SELF, H_NONE, 0),
+    MEMBERS("B: accepted"          , 1, H_SELF, H_NONE, H_NONE, H_NONE, 0),
+    HOLD   ("A: held"              , 0, TP_HELD),
+    MEMBERS("B: peer hung up"      , 1, H_NONE, H_PEER, H_NONE, H_NONE, H_PEER),
+    CLOSED ("B: closed"            , 1),
+    HOLD   ("A: unheld"            , 0, TP_UNHELD),
+    MEMBERS("A: local hangup"      , 0, H_NONE, H_SELF, H_NONE, H_NONE, H_SELF),
+    CLOSED ("A: closed"            , 0),
+};
+
+static step_t conference[] = {
+    NEW    ("A: outgoing channel"  , 0, NEW_OUTGOING),
+    MEMBERS("A: answered"          , 0, H_PEER, H_NONE, H_NONE, H_NONE, 0),
+    NEW    ("B: outgoing channel"  , 1, NEW_OUTGOING),
+    MEMBERS("B: answered"          , 1, H_PEER, H_NONE, H_NONE, H_NONE, 0),
+    CONF   ("conference channel"   , 2, 0x3),
+    JOIN   ("A: joined"            , 2, 0),
+    JOIN   ("B: joined"            , 2, 1),
+    MEMBERS("conference answered"  , 2, H_PEER, H_NONE, H_NONE, H_NONE, 0),
+    CLOSED ("conference closed"    , 2),
+    CLOSED ("A: closed"            , 0),
+    CLOSED ("B: closed"            , 1),
+};
+
+static step_t emergency_call[] = {
+    EMERGENCY("early emergency on" , TRUE),
+    NEW    ("emergency channel"    , 0, NEW_OUTGOING | NEW_EMERGENCY),
+    MEMBERS("answered"             , 0, H_PEER, H_NONE, H_NONE, H_NONE, 0),
+    MEMBERS("local hangup"         , 0, H_NONE, H_SELF, H_NONE, H_NONE, H_SELF),
+    CLOSED ("closed"               , 0),
+    EMERGENCY("early emergency off", FALSE),
+};
+
+static scenario_t scenarios[] = {
+    { "incoming"  , incoming      , SIM_DIM(incoming)      , NULL },
+    { "outgoing"  , outgoing      , SIM_DIM(outgoing)      , NULL },
+    { "hold"      , hold          , SIM_DIM(hold)          , NULL },
+    { "conference", conference    , SIM_DIM(conference)    , NULL },
+    { "emergency" , emergency_call, SIM_DIM(emergency_call), NULL },
+};
+
+static pid_t           daemon_pid;
+static char            address[256];
+static DBusConnection *tp;                     /* the telepathy side */
+static const char     *tp_name;
+static char            paths[MAX_CHANNELS][128];
+static unsigned int    nchannel;
+static int             verbose;
+
+static struct {
+    const char *step;
+    double      t;
+} marks[MAX_MARKS];
+static int             nmark;
+
+static dbus_uint32_t   handled;                /* last serial dispatched */
+static double          dispatch_start;
+static double          dispatch_end;
+
+
+void ohm_log(OhmLogLevel level, const gchar *format, ...)
+{
+    va_list ap;
+
+    if (level == OHM_LOG_ERROR || verbose) {
+        va_start(ap, format);
+        vfprintf(stderr, format, ap);
+        fputs("\n", stderr);
+        va_end(ap);
+    }
+}
+
+static double sim_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+
+/*
+ * the stand-ins for the resolver and the timestamping plugin
+ */
+
+static void sim_timestamp(const char *step)
+{
+    if (nmark < MAX_MARKS) {
+        marks[nmark].step = step;
+        marks[nmark].t    = sim_now();
+        nmark++;
+    }
+}
+
+static double sim_span(const char *begin, const char *end)
+{
+    double start, sum;
+    int    i;
+
+    start = sum = 0.0;
+    for (i = 0; i < nmark; i++) {
+        if (!strcmp(marks[i].step, begin))
+            start = marks[i].t;
+        else if (!strcmp(marks[i].step, end) && start != 0.0) {
+            sum  += marks[i].t - start;
+            start = 0.0;
+        }
+    }
+
+    return sum;
+}
+
+static int sim_count(const char *step)
+{
+    int i, n;
+
+    for (i = n = 0; i < nmark; i++)
+        if (!strcmp(marks[i].step, step))
+            n++;
+
+    return n;
+}
+
+static void autohold_other(gpointer key, gpointer value, gpointer data)
+{
+    call_t  *call = (call_t *)value;
+    OhmFact *fact = (OhmFact *)data;
+    char     id[16];
+
+    (void)key;
+
+    snprintf(id, sizeof(id), "%d", call->id);
+
+    if (call->state == STATE_ACTIVE && !IS_CONF_MEMBER(call) &&
+        ohm_fact_get(fact, id) == NULL)
+        set_string_field(fact, id, "autohold");
+}
+
+static int sim_resolve(char *goal, char **locals)
+{
+    static struct {
+        const char *state;
+        const char *action;
+    } policy[] = {
+        { "created"     , "created"      },
+        { "callout"     , "created"      },
+        { "active"      , "active"       },
+        { "onhold"      , "onhold"       },
+        { "peerhungup"  , "peerhungup"   },
+        { "localhungup" , "localhungup"  },
+        { "disconnected", "disconnected" },
+        { NULL          , NULL           },
+    };
+
+    const char *id, *state;
+    OhmFact    *fact;
+    int         i;
+
+    if (strcmp(goal, "telephony_request"))
+        return TRUE;
+
+    id = state = NULL;
+    for (i = 0; locals != NULL && locals[i] != NULL; i += 2) {
+        if (!strcmp(locals[i], "call_id"))
+            id = locals[i + 1];
+        else if (!strcmp(locals[i], "call_state"))
+            state = locals[i + 1];
+    }
+
+    if (id == NULL || state == NULL)
+        return FALSE;
+
+    if ((fact = ohm_fact_new(FACT_ACTIONS)) == NULL)
+        return FALSE;
+
+    for (i = 0; policy[i].state != NULL; i++) {
+        if (!strcmp(policy[i].state, state)) {
+            set_string_field(fact, id, policy[i].action);
+            break;
+        }
+    }
+
+    if (!strcmp(state, "active"))
+        call_foreach(autohold_other, fact);
+
+    /* the reference is passed on to policy_enforce, like dres does */
+    ohm_fact_store_insert(store, fact);
+
+    return TRUE;
+}
+
+
+/*
+ * the private bus and the telepathy side
+ */
+
+static int daemon_start(void)
+{
+    const char *binary;
+    char        fd[32];
+    int         pipefd[2], n, len;
+
+    if ((binary = getenv("DBUS_DAEMON")) == NULL)
+        binary = "dbus-daemon";
+
+    if (pipe(pipefd) < 0)
+        return FALSE;
+
+    switch ((daemon_pid = fork())) {
+    case -1:
+        return FALSE;
+
+    case 0:
+        close(pipefd[0]);
+        snprintf(fd, sizeof(fd), "--print-address=%d", pipefd[1]);
+        execlp(binary, binary, "--session", "--nofork", fd, (char *)NULL);
+        _exit(127);
+
+    default:
+        close(pipefd[1]);
+        break;
+    }
+
+    len = 0;
+    while (len < (int)sizeof(address) - 1 &&
+           (n = read(pipefd[0], address + len, sizeof(address) - 1 - len)) > 0)
+        if (strchr(address, '\n') != NULL)
+            break;
+        else
+            len += n;
+
+    close(pipefd[0]);
+    address[strcspn(address, "\n")] = '\0';
+
+    return address[0] != '\0';
+}
+
+static void daemon_stop(void)
+{
+    if (daemon_pid > 0) {
+        kill(daemon_pid, SIGTERM);
+        waitpid(daemon_pid, NULL, 0);
+    }
+}
+
+static void tp_drain(void)
+{
+    DBusMessage *msg, *reply;
+
+    dbus_connection_read_write(tp, 0);
+
+    while ((msg = dbus_connection_pop_message(tp)) != NULL) {
+        if (dbus_message_get_type(msg) == DBUS_MESSAGE_TYPE_METHOD_CALL &&
+            !dbus_message_get_no_reply(msg) &&
+            (reply = dbus_message_new_method_return(msg)) != NULL) {
+            dbus_connection_send(tp, reply, NULL);
+            dbus_message_unref(reply);
+        }
+        dbus_message_unref(msg);
+    }
+
+    dbus_connection_flush(tp);
+}
+
+static DBusHandlerResult sim_filter(DBusConnection *c, DBusMessage *msg,
+                                    void *data)
+{
+    const char        *sender = dbus_message_get_sender(msg);
+    DBusHandlerResult  result;
+
+    if (sender == NULL || strcmp(sender, tp_name))
+        return dispatch_signal(c, msg, data);
+
+    dispatch_start = sim_now();
+
+    if (dbus_message_is_method_call(msg, POLICY_INTERFACE,
+                                    EMERGENCY_CALL_ACTIVE))
+        result = emergency_call_request(c, msg, data);
+    else
+        result = dispatch_signal(c, msg, data);
+
+    dispatch_end = sim_now();
+    handled      = dbus_message_get_serial(msg);
+
+    return result;
+}
+
+
+/*
+ * telepathy messages of the steps
+ */
+
+static void prop_append(DBusMessageIter *props, const char *key, int type,
+                        const void *value)
+{
+    DBusMessageIter entry, variant;
+    char            signature[2] = { (char)type, '\0' };
+
+    dbus_message_iter_open_container(props, DBUS_TYPE_DICT_ENTRY, NULL,
+                                     &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, signature,
+                                     &variant);
+    dbus_message_iter_append_basic(&variant, type, value);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(props, &entry);
+}
+
+static void prop_append_array(DBusMessageIter *props, const char *key,
+                              int type, const char **items, int nitem)
+{
+    DBusMessageIter entry, variant, array;
+    char            signature[3] = { DBUS_TYPE_ARRAY, (char)type, '\0' };
+    int             i;
+
+    dbus_message_iter_open_container(props, DBUS_TYPE_DICT_ENTRY, NULL,
+                                     &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, signature,
+                                     &variant);
+    dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, signature + 1,
+                                     &array);
+    for (i = 0; i < nitem; i++)
+        dbus_message_iter_append_basic(&array, type, items + i);
+    dbus_message_iter_close_container(&variant, &array);
+    dbus_message_iter_close_container(&entry, &variant);
+    dbus_message_iter_close_container(props, &entry);
+}
+
+static DBusMessage *sim_new_channels(step_t *s, int base)
+{
+    static const char *interfaces[] = {
+        TP_CHANNEL_GROUP, TP_CHANNEL_HOLD, TP_CONFERENCE
+    };
+
+    DBusMessage     *msg;
+    DBusMessageIter  imsg, iarr, istruct, iprop;
+    const char      *path, *type, *peer, *service, *members[MAX_CHANNELS];
+    dbus_uint32_t    target, initiator;
+    dbus_bool_t      requested;
+    int              nmember, ch, i;
+
+    msg = dbus_message_new_signal(TP_RING, TP_CONN_IFREQ, NEW_CHANNELS);
+    if (msg == NULL)
+        return NULL;
+
+    ch        = base + s->ch;
+    path      = paths[ch];
+    type      = TP_CHANNEL_MEDIA;
+    peer      = "+358401234567";
+    service   = "sos";
+    requested = (s->arg & NEW_OUTGOING) != 0;
+    target    = PEER_HANDLE(ch);
+    initiator = requested ? SELF_HANDLE : PEER_HANDLE(ch);
+
+    dbus_message_iter_init_append(msg, &imsg);
+    dbus_message_iter_open_container(&imsg, DBUS_TYPE_ARRAY, "(oa{sv})",
+                                     &iarr);
+    dbus_message_iter_open_container(&iarr, DBUS_TYPE_STRUCT, NULL, &istruct);
+    dbus_message_iter_append_basic(&istruct, DBUS_TYPE_OBJECT_PATH, &path);
+    dbus_message_iter_open_container(&istruct, DBUS_TYPE_ARRAY, "{sv}",
+                                     &iprop);
+
+    prop_append(&iprop, PROP_CHANNEL_TYPE, DBUS_TYPE_STRING, &type);
+    prop_append(&iprop, PROP_TARGET_ID, DBUS_TYPE_STRING, &peer);
+    prop_append(&iprop, PROP_TARGET_HANDLE, DBUS_TYPE_UINT32, &target);
+    prop_append(&iprop, PROP_INITIATOR_HANDLE, DBUS_TYPE_UINT32, &initiator);
+    prop_append(&iprop, PROP_REQUESTED, DBUS_TYPE_BOOLEAN, &requested);
+
+    if (s->arg & NEW_EMERGENCY)
+        prop_append(&iprop, PROP_EMERGENCY, DBUS_TYPE_STRING, &service);
+
+    if (s->arg & NEW_CONFERENCE) {
+        for (i = nmember = 0; i < 32; i++)
+            if (s->members & (1 << i))
+                members[nmember++] = paths[base + i];
+
+        prop_append_array(&iprop, PROP_INITIAL_CHANNELS,
+                          DBUS_TYPE_OBJECT_PATH, members, nmember);
+        prop_append_array(&iprop, PROP_INTERFACES, DBUS_TYPE_STRING,
+                          interfaces, 3);
+    }
+    else
+        prop_append_array(&iprop, PROP_INTERFACES, DBUS_TYPE_STRING,
+                          interfaces, 2);
+
+    dbus_message_iter_close_container(&istruct, &iprop);
+    dbus_message_iter_close_container(&iarr, &istruct);
+    dbus_message_iter_close_container(&imsg, &iarr);
+
+    return msg;
+}
+
+static int handles(int which, int ch, dbus_uint32_t *handle)
+{
+    switch (which) {
+    case H_SELF: *handle = SELF_HANDLE;     return 1;
+    case H_PEER: *handle = PEER_HANDLE(ch); return 1;
+    default:                                return 0;
+    }
+}
+
+static DBusMessage *sim_members_changed(step_t *s, int base)
+{
+    DBusMessage   *msg;
+    const char    *message = "";
+    dbus_uint32_t  added, removed, localpend, remotepend, actor, reason;
+    dbus_uint32_t *a, *r, *l, *rp;
+    int            ch, na, nr, nl, nrp;
+
+    ch  = base + s->ch;
+    msg = dbus_message_new_signal(paths[ch], TP_CHANNEL_GROUP,
+                                  MEMBERS_CHANGED);
+    if (msg == NULL)
+        return NULL;
+
+    na  = handles(s->added     , ch, &added);
+    nr  = handles(s->removed   , ch, &removed);
+    nl  = handles(s->localpend , ch, &localpend);
+    nrp = handles(s->remotepend, ch, &remotepend);
+
+    if (!handles(s->actor, ch, &actor))
+        actor = 0;
+    reason = 0;
+
+    a  = &added;
+    r  = &removed;
+    l  = &localpend;
+    rp = &remotepend;
+
+    dbus_message_append_args(msg,
+                             DBUS_TYPE_STRING, &message,
+                             DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &a , na,
+                             DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &r , nr,
+                             DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &l , nl,
+                             DBUS_TYPE_ARRAY, DBUS_TYPE_UINT32, &rp, nrp,
+                             DBUS_TYPE_UINT32, &actor,
+                             DBUS_TYPE_UINT32, &reason,
+                             DBUS_TYPE_INVALID);
+
+    return msg;
+}
+
+static DBusMessage *step_message(step_t *s, int base)
+{
+    DBusMessage   *msg;
+    const char    *member;
+    dbus_uint32_t  id, handle, type, state, reason;
+    dbus_bool_t    active;
+    int            ch, i;
+
+    ch = base + s->ch;
+
+    switch (s->type) {
+    case STEP_NEW_CHANNEL:
+        return sim_new_channels(s, base);
+
+    case STEP_MEMBERS:
+        return sim_members_changed(s, base);
+
+    case STEP_STREAM:
+        msg = dbus_message_new_signal(paths[ch], TP_CHANNEL_MEDIA,
+                                      STREAM_ADDED);
+        id     = 1;
+        handle = PEER_HANDLE(ch);
+        type   = s->arg;
+        if (msg != NULL)
+            dbus_message_append_args(msg,
+                                     DBUS_TYPE_UINT32, &id,
+                                     DBUS_TYPE_UINT32, &handle,
+                                     DBUS_TYPE_UINT32, &type,
+                                     DBUS_TYPE_INVALID);
+        return msg;
+
+    case STEP_HOLD:
+        msg = dbus_message_new_signal(paths[ch], TP_CHANNEL_HOLD,
+                                      HOLD_STATE_CHANGED);
+        state  = s->arg;
+        reason = 0;
+        if (msg != NULL)
+            dbus_message_append_args(msg,
+                                     DBUS_TYPE_UINT32, &state,
+                                     DBUS_TYPE_UINT32, &reason,
+                                     DBUS_TYPE_INVALID);
+        return msg;
+
+    case STEP_CLOSED:
+        return dbus_message_new_signal(paths[ch], TP_CHANNEL, CHANNEL_CLOSED);
+
+    case STEP_JOIN:
+        msg = dbus_message_new_signal(paths[ch], TP_CONFERENCE,
+                                      MEMBER_CHANNEL_ADDED);
+        for (i = 0; i < 31 && !(s->members & (1 << i)); i++)
+            ;
+        member = paths[base + i];
+        if (msg != NULL)
+            dbus_message_append_args(msg,
+                                     DBUS_TYPE_OBJECT_PATH, &member,
+                                     DBUS_TYPE_INVALID);
+        return msg;
+
+    case STEP_EMERGENCY:
+        msg = dbus_message_new_method_call(dbus_bus_get_unique_name(bus),
+                                           POLICY_PATH, POLICY_INTERFACE,
+                                           EMERGENCY_CALL_ACTIVE);
+        active = s->arg;
+        if (msg != NULL)
+            dbus_message_append_args(msg,
+                                     DBUS_TYPE_BOOLEAN, &active,
+                                     DBUS_TYPE_INVALID);
+        return msg;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * running the scenarios
+ */
+
+static void lat_add(sim_lat_t *lat, double t)
+{
+    lat->sum += t;
+    if (t > lat->max)
+        lat->max = t;
+}
+
+static int step_run(step_t *s, int base, sim_stat_t *stat)
+{
+    DBusMessage   *msg;
+    dbus_uint32_t  serial;
+    double         sent;
+
+    if ((msg = step_message(s, base)) == NULL) {
+        printf("failed to create message for step '%s'\n", s->name);
+        return FALSE;
+    }
+
+    nmark   = 0;
+    handled = 0;
+    sent    = sim_now();
+
+    if (!dbus_connection_send(tp, msg, &serial)) {
+        printf("failed to send message for step '%s'\n", s->name);
+        dbus_message_unref(msg);
+        return FALSE;
+    }
+    dbus_connection_flush(tp);
+    dbus_message_unref(msg);
+
+    while (handled != serial) {
+        if (sim_now() - sent > SIM_TIMEOUT) {
+            printf("step '%s' timed out\n", s->name);
+            return FALSE;
+        }
+        dbus_connection_read_write_dispatch(bus, 100);
+    }
+
+    stat->n++;
+    lat_add(&stat->bus     , dispatch_start - sent);
+    lat_add(&stat->dispatch, dispatch_end - dispatch_start);
+    lat_add(&stat->resolve , sim_span("telephony: resolve request",
+                                      "telephony: request resolved"));
+    lat_add(&stat->enforce , sim_span("telephony: enforce policy actions",
+                                      "telephony: enforced policy actions"));
+    lat_add(&stat->replay  , sim_span("telephony: replay deferred events",
+                                      "telephony: replayed deferred events"));
+    stat->deferred += sim_count("telephony: defer event");
+
+    /* acknowledge what the plugin asked from telepathy, run idle work */
+    tp_drain();
+    while (g_main_context_iteration(NULL, FALSE))
+        ;
+
+    return TRUE;
+}
+
+static void channels_alloc(int n)
+{
+    int i;
+
+    /* every run gets fresh channel paths */
+    for (i = 0; i < n && i < MAX_CHANNELS; i++)
+        snprintf(paths[i], sizeof(paths[i]), "%s/sim%u", TP_RING, nchannel++);
+}
+
+static int scenario_channels(scenario_t *sc)
+{
+    int i, n;
+
+    for (i = n = 0; i < sc->nstep; i++)
+        if (sc->steps[i].ch >= n)
+            n = sc->steps[i].ch + 1;
+
+    return n;
+}
+
+static int scenario_run(scenario_t *sc, int calls)
+{
+    int nch, i, k;
+
+    /* storms run the same script for several calls, interleaved */
+    nch = scenario_channels(sc);
+
+    if (nch * calls > MAX_CHANNELS) {
+        printf("too many channels for %s (%d > %d)\n", sc->name,
+               nch * calls, MAX_CHANNELS);
+        return FALSE;
+    }
+
+    channels_alloc(nch * calls);
+
+    for (i = 0; i < sc->nstep; i++)
+        for (k = 0; k < calls; k++)
+            if (!step_run(sc->steps + i, k * nch, sc->stats + i))
+                return FALSE;
+
+    return TRUE;
+}
+
+#define US(t) ((t) * 1.0e6)
+
+static void scenario_report(scenario_t *sc)
+{
+    sim_stat_t *s;
+    double      total;
+    int         i, n;
+
+    printf("\n%s:\n", sc->name);
+    printf("  %-24s %6s %9s %9s %9s %9s %9s %9s %5s\n", "step", "n",
+           "bus", "dispatch", "max", "resolve", "enforce", "replay", "defer");
+
+    total = 0.0;
+    for (i = 0; i < sc->nstep; i++) {
+        s = sc->stats + i;
+        if ((n = s->n) == 0)
+            continue;
+
+        printf("  %-24.24s %6d %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %5d\n",
+               sc->steps[i].name, n, US(s->bus.sum / n),
+               US(s->dispatch.sum / n), US(s->dispatch.max),
+               US(s->resolve.sum / n), US(s->enforce.sum / n),
+               US(s->replay.sum / n), s->deferred);
+
+        total += s->bus.sum + s->dispatch.sum;
+    }
+
+    n = sc->stats[0].n;
+    if (n > 0)
+        printf("  %d runs, %.1f us per call flow, %.0f steps/s\n", n,
+               US(total / n), sc->nstep * n / total);
+}
+
+
+int main(int argc, char **argv)
+{
+    scenario_t  storm;
+    int         rounds, calls, failed, opt, i, j;
+
+    rounds = DEFAULT_ROUNDS;
+    calls  = 0;
+
+    while ((opt = getopt(argc, argv, "n:s:v")) != -1) {
+        switch (opt) {
+        case 'n': rounds  = atoi(optarg); break;
+        case 's': calls   = atoi(optarg); break;
+        case 'v': verbose = TRUE;         break;
+        default:
+            fprintf(stderr, "usage: %s [-n rounds] [-s storm-calls] [-v]\n",
+                    argv[0]);
+            exit(1);
+        }
+    }
+
+#if !GLIB_CHECK_VERSION(2, 36, 0)
+    g_type_init();
+#endif
+
+    if (!daemon_start()) {
+        fprintf(stderr, "failed to start a private bus daemon\n");
+        daemon_stop();
+        exit(1);
+    }
+
+    /* the plugin is not loaded by ohmd, hook it up by hand */
+    resolve         = sim_resolve;
+    timestamp_add   = sim_timestamp;
+    resctl_disabled = TRUE;
+
+    signal_table_init();
+    call_init();
+    policy_init();
+
+    if (!bus_init(address)) {
+        daemon_stop();
+        exit(1);
+    }
+
+    dbus_connection_remove_filter(bus, dispatch_signal, NULL);
+    dbus_connection_add_filter(bus, sim_filter, NULL, NULL);
+
+    if ((tp = dbus_connection_open_private(address, NULL)) == NULL ||
+        !dbus_bus_register(tp, NULL)) {
+        fprintf(stderr, "failed to connect to %s\n", address);
+        daemon_stop();
+        exit(1);
+    }
+    tp_name = dbus_bus_get_unique_name(tp);
+
+    failed = 0;
+
+    for (i = 0; i < SIM_DIM(scenarios); i++) {
+        scenarios[i].stats = calloc(scenarios[i].nstep, sizeof(sim_stat_t));
+
+        for (j = 0; j < rounds && !failed; j++)
+            failed = !scenario_run(scenarios + i, 1);
+
+        scenario_report(scenarios + i);
+    }
+
+    if (calls > 0 && !failed) {
+        storm       = scenarios[0];
+        storm.name  = "call storm";
+        storm.stats = calloc(storm.nstep, sizeof(sim_stat_t));
+
+        failed = !scenario_run(&storm, calls);
+
+        scenario_report(&storm);
+        free(storm.stats);
+    }
+
+    for (i = 0; i < SIM_DIM(scenarios); i++)
+        free(scenarios[i].stats);
+
+    dbus_connection_close(tp);
+    dbus_connection_unref(tp);
+
+    bus_exit();
+    call_exit();
+    policy_exit();
+    signal_table_exit();
+
+    daemon_stop();
+
+    return failed ? 1 : 0;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -35,6 +35,7 @@ USA.
 
 
 static GHashTable *calls;                        /* table of current calls */
+static GHashTable *call_ids;                     /* calls by our call ID */
 static int         ncscall;                      /* number of CS calls */
 static int         nipcall;                      /* number of ohter calls */
 static int         callid;
@@ -60,6 +61,11 @@ call_init(void)
         OHM_ERROR("failed to allocate call table");
         exit(1);
     }
+
+    if ((call_ids = g_hash_table_new(g_direct_hash, g_direct_equal)) == NULL) {
+        OHM_ERROR("failed to allocate call ID table");
+        exit(1);
+    }
 }
 
 
@@ -89,6 +95,7 @@ call_register(const char *path)
     call->state = STATE_PROCEEDING;
 
     g_hash_table_insert(calls, call->path, call);
+    g_hash_table_insert(call_ids, GINT_TO_POINTER(call->id), call);
     
     if (IS_CELLULAR(path))
         ncscall++;
@@ -107,8 +114,13 @@ call_register(const char *path)
 int
 call_unregister(const char *path)
 {
-    if (path == NULL || !g_hash_table_remove(calls, path))
+    call_t *call;
+
+    if (path == NULL || (call = g_hash_table_lookup(calls, path)) == NULL)
         return ENOENT;
+
+    g_hash_table_remove(call_ids, GINT_TO_POINTER(call->id));
+    g_hash_table_remove(calls, path);
     
     OHM_INFO("Call %s (#%d) unregistered.", path, ncscall + nipcall);
 
@@ -132,28 +144,13 @@ call_lookup(const char *path)
 
 
 
-/********************
- * has_id
- ********************/
-static gboolean
-has_id(gpointer key, gpointer value, gpointer data)
-{
-    call_t *call = (call_t *)value;
-    int     id   = (int)data;
-
-    return call->id == id;
-
-    (void)key;
-}
-
-
 /********************
  * call_find
  ********************/
 call_t *
 call_find(int id)
 {
-    return g_hash_table_find(calls, has_id, (gpointer)id);
+    return (call_t *)g_hash_table_lookup(call_ids, GINT_TO_POINTER(id));
 }
 
 
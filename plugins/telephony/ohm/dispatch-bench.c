@@ -0,0 +1,286 @@
+/*************************************************************************
+Copyright (C) 2010 Nokia Corporation.
+
+These OHM Modules are free software; you can redistribute
+it and/or modify it under the terms of the GNU Lesser General Public
+License as published by the Free Software Foundation
+version 2.1 of the License.
+
+This library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public
+License along with this library; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+USA.
+*************************************************************************/
+
+
+/*
+ * Benchmark for the signal dispatcher.
+ *
+ * Recorded sequences of the signals seen on the session bus during
+ * typical telephony scenarios (incoming and outgoing calls, hold,
+ * conference merge, DTMF, hangup) are replayed (-n signals) through the
+ * (interface, member) lookup of the dispatcher. The sequences include
+ * the unrelated signals the filter gets to see as well, these are the
+ * misses. For reference the same sequences are matched by the chain of
+ * string comparisons the dispatcher used to do; the two must pick the
+ * same handler for every signal.
+ */
+
+#include <unistd.h>
+#include <time.h>
+
+#include "telephony.c"
+
+#define DEFAULT_SIGNALS  1000000
+#define DIM(a)           (int)(sizeof(a) / sizeof(a[0]))
+
+typedef struct {
+    const char *interface;
+    const char *member;
+} record_t;
+
+#define NAME_OWNER  { "org.freedesktop.DBus", "NameOwnerChanged" }
+#define PROPERTIES  { "org.freedesktop.DBus.Properties", "PropertiesChanged" }
+#define STATUS      { TP_CONNECTION, "StatusChanged" }
+#define PRESENCE    { TP_CONNECTION".Interface.SimplePresence",         \
+                      "PresencesChanged" }
+#define MCE_DISPLAY { "com.nokia.mce.signal", "display_status_ind" }
+
+/*
+ * the recorded signal sequences
+ */
+
+static record_t incoming[] = {
+    NAME_OWNER, { TP_CONN_IFREQ, NEW_CHANNELS }, { TP_CONNECTION, NEW_CHANNEL },
+    { TP_CHANNEL_GROUP, MEMBERS_CHANGED }, { TP_CHANNEL_STATE,
+    CALL_STATE_CHANGED }, { TP_CHANNEL_MEDIA, STREAM_ADDED }, PROPERTIES,
+    { TP_CHANNEL_MEDIA, STREAM_ADDED }, MCE_DISPLAY, { TP_CHANNEL_GROUP,
+    MEMBERS_CHANGED }, { TP_CHANNEL_STATE, CALL_STATE_CHANGED }, PROPERTIES,
+    PROPERTIES, { TP_CHANNEL_GROUP, MEMBERS_CHANGED }, { TP_CHANNEL_MEDIA,
+    STREAM_REMOVED }, { TP_CHANNEL_MEDIA, STREAM_REMOVED }, { TP_CHANNEL,
+    CHANNEL_CLOSED }, NAME_OWNER,
+};
+
+static record_t outgoing[] = {
+    PRESENCE, { TP_CONN_IFREQ, NEW_CHANNELS },
+    { TP_CHANNEL_CALL_DRAFT, CONTENT_ADDED }, { TP_CHANNEL_CALL_DRAFT,
+    CALL_STATE_CHANGED }, PRESENCE, { TP_CHANNEL_CALL_DRAFT,
+    CALL_STATE_CHANGED }, { TP_CHANNEL_CALL_DRAFT, CALL_STATE_CHANGED },
+    { TP_CHANNEL_GROUP, MEMBERS_CHANGED }, PROPERTIES, { TP_DIALSTRINGS,
+    SENDING_DIALSTRING }, { TP_DIALSTRINGS, STOPPED_DIALSTRING },
+    { TP_DIALSTRINGS, SENDING_DIALSTRING }, { TP_DIALSTRINGS,
+    STOPPED_DIALSTRING }, { TP_CHANNEL_CALL_DRAFT, CONTENT_REMOVED },
+    { TP_CHANNEL_CALL_DRAFT, CALL_STATE_CHANGED }, { TELEPHONY_INTERFACE,
+    CALL_ENDED }, { TP_CHANNEL, CHANNEL_CLOSED },
+};
+
+static record_t hold_merge[] = {
+    { TP_CHANNEL_HOLD, HOLD_STATE_CHANGED }, { TP_CHANNEL_HOLD,
+    HOLD_STATE_CHANGED }, STATUS, { TP_CONN_IFREQ, NEW_CHANNELS },
+    { TP_CHANNEL_CONF, CHANNEL_MERGED }, { TP_CHANNEL_CONF, CHANNEL_MERGED },
+    { TP_CONFERENCE, MEMBER_CHANNEL_ADDED }, { TP_CONFERENCE,
+    MEMBER_CHANNEL_ADDED }, { TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED },
+    PROPERTIES, { TP_CHANNEL_GROUP, MEMBERS_CHANGED }, { TP_CHANNEL_CONF,
+    CHANNEL_REMOVED }, { TP_CONFERENCE, MEMBER_CHANNEL_REMOVED },
+    { TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED }, { TP_CHANNEL_HOLD,
+    HOLD_STATE_CHANGED }, MCE_DISPLAY, { TP_CHANNEL, CHANNEL_CLOSED },
+    { TP_CHANNEL, CHANNEL_CLOSED }, NAME_OWNER,
+};
+
+static record_t idle_noise[] = {
+    NAME_OWNER, NAME_OWNER, PROPERTIES, PRESENCE, MCE_DISPLAY, STATUS,
+    PROPERTIES, NAME_OWNER,
+};
+
+static struct {
+    record_t *records;
+    int       nrecord;
+    int       weight;
+} sequences[] = {
+    { incoming  , DIM(incoming)  , 4 },
+    { outgoing  , DIM(outgoing)  , 3 },
+    { hold_merge, DIM(hold_merge), 1 },
+    { idle_noise, DIM(idle_noise), 2 },
+};
+
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+}
+
+
+/*
+ * the strcmp chain dispatch_signal used to run
+ */
+
+static DBusHandleMessageFunction
+chain_lookup(const char *interface, const char *member)
+{
+#define CHAIN_MATCH(i, m) (!strcmp(interface, (i)) && !strcmp(member, (m)))
+
+    if (CHAIN_MATCH("org.freedesktop.DBus", "NameOwnerChanged"))
+        return name_owner_changed;
+    if (CHAIN_MATCH(TP_CONNECTION, NEW_CHANNEL))
+        return channel_new;
+    if (CHAIN_MATCH(TP_CONN_IFREQ, NEW_CHANNELS))
+        return channels_new;
+    if (CHAIN_MATCH(TP_CHANNEL, CHANNEL_CLOSED))
+        return channel_closed;
+    if (CHAIN_MATCH(TP_CHANNEL_GROUP, MEMBERS_CHANGED))
+        return members_changed;
+    if (CHAIN_MATCH(TP_CHANNEL_MEDIA, STREAM_ADDED))
+        return stream_added;
+    if (CHAIN_MATCH(TP_CHANNEL_MEDIA, STREAM_REMOVED))
+        return stream_removed;
+    if (CHAIN_MATCH(TP_CHANNEL_CALL_DRAFT, CONTENT_ADDED))
+        return content_added;
+    if (CHAIN_MATCH(TP_CHANNEL_CALL_DRAFT, CONTENT_REMOVED))
+        return content_removed;
+    if (CHAIN_MATCH(TP_CHANNEL_HOLD, HOLD_STATE_CHANGED))
+        return hold_state_changed;
+    if (CHAIN_MATCH(TP_CHANNEL_STATE, CALL_STATE_CHANGED))
+        return call_state_changed;
+    if (CHAIN_MATCH(TP_CHANNEL_CALL_DRAFT, CALL_STATE_CHANGED))
+        return call_draft_state_changed;
+    if (CHAIN_MATCH(TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED))
+        return channel_merged;
+    if (CHAIN_MATCH(TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED))
+        return channel_removed;
+    if (CHAIN_MATCH(TP_CHANNEL_CONF, CHANNEL_MERGED))
+        return channel_merged;
+    if (CHAIN_MATCH(TP_CHANNEL_CONF, CHANNEL_REMOVED))
+        return channel_removed;
+    if (CHAIN_MATCH(TP_CONFERENCE, MEMBER_CHANNEL_ADDED))
+        return member_channel_added;
+    if (CHAIN_MATCH(TP_CONFERENCE, MEMBER_CHANNEL_REMOVED))
+        return member_channel_removed;
+    if (CHAIN_MATCH(TELEPHONY_INTERFACE, CALL_ENDED))
+        return call_end;
+    if (CHAIN_MATCH(TP_DIALSTRINGS, SENDING_DIALSTRING))
+        return sending_dialstring;
+    if (CHAIN_MATCH(TP_DIALSTRINGS, STOPPED_DIALSTRING))
+        return stopped_dialstring;
+
+    return NULL;
+
+#undef CHAIN_MATCH
+}
+
+
+/*
+ * Build the replayed stream: whole sequences picked by weight, with
+ * the strings copied like they would be in a demarshalled message.
+ */
+static record_t *
+replay_build(int n)
+{
+    record_t *stream;
+    int       total, i, j, k, w;
+
+    total = 0;
+    for (i = 0; i < DIM(sequences); i++)
+        total += sequences[i].weight;
+
+    if ((stream = calloc(n, sizeof(*stream))) == NULL) {
+        fprintf(stderr, "failed to allocate %d signals\n", n);
+        exit(1);
+    }
+
+    for (k = 0; k < n; ) {
+        w = random() % total;
+        for (i = 0; w >= sequences[i].weight; i++)
+            w -= sequences[i].weight;
+
+        for (j = 0; j < sequences[i].nrecord && k < n; j++, k++) {
+            stream[k].interface = strdup(sequences[i].records[j].interface);
+            stream[k].member    = strdup(sequences[i].records[j].member);
+        }
+    }
+
+    return stream;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    DBusHandleMessageFunction  h;
+    record_t                  *stream;
+    unsigned long              hits, chain_hits, mismatch;
+    double                     start, table_time, chain_time;
+    int                        n, i, opt;
+
+    n = DEFAULT_SIGNALS;
+
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n': n = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: %s [-n signals]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    srandom(1);
+    stream = replay_build(n);
+    signal_table_init();
+
+    hits  = 0;
+    start = now();
+    for (i = 0; i < n; i++)
+        if (signal_lookup(stream[i].interface, stream[i].member) != NULL)
+            hits++;
+    table_time = now() - start;
+
+    chain_hits = 0;
+    start = now();
+    for (i = 0; i < n; i++)
+        if (chain_lookup(stream[i].interface, stream[i].member) != NULL)
+            chain_hits++;
+    chain_time = now() - start;
+
+    mismatch = 0;
+    for (i = 0; i < n; i++) {
+        h = signal_lookup(stream[i].interface, stream[i].member);
+        if (h != chain_lookup(stream[i].interface, stream[i].member))
+            mismatch++;
+    }
+
+    printf("%d signals, %lu handled, %lu not for us\n", n, hits, n - hits);
+    printf("table: %.3f s, %.0f signals/s\n", table_time, n / table_time);
+    printf("chain: %.3f s, %.0f signals/s\n", chain_time, n / chain_time);
+
+    if (hits != chain_hits || mismatch != 0) {
+        printf("MISMATCH: %lu signals dispatched differently\n", mismatch);
+        return 1;
+    }
+
+    signal_table_exit();
+
+    for (i = 0; i < n; i++) {
+        free((char *)stream[i].interface);
+        free((char *)stream[i].member);
+    }
+    free(stream);
+
+    return 0;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ * vim:set expandtab shiftwidth=4:
+ */
@@ -22,6 +22,7 @@ USA.
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 
 #include <glib.h>
 #include <dbus/dbus.h>
@@ -51,6 +52,8 @@ USA.
 
 #define CALL_TIMEOUT  (30 * 1000)
 #define EVENT_TIMEOUT (10 * 1000)
+#define EVENT_QLEN    16                   /* max. deferred events per path */
+#define EVENT_QMAX    32                   /* max. paths with deferred events */
 
 static int DBG_CALL;
 static int bt_ui_kludge;
@@ -112,6 +115,44 @@ DBUS_METHOD_HANDLER(dtmf_stop_request);
 DBUS_SIGNAL_HANDLER(name_owner_changed);
 
 
+typedef struct {
+    const char                *interface;
+    const char                *member;
+    DBusHandleMessageFunction  handler;
+} signal_handler_t;
+
+static signal_handler_t signal_handlers[] = {
+    { "org.freedesktop.DBus", "NameOwnerChanged", name_owner_changed       },
+    { TP_CONNECTION        , NEW_CHANNEL         , channel_new              },
+    { TP_CONN_IFREQ        , NEW_CHANNELS        , channels_new             },
+    { TP_CHANNEL           , CHANNEL_CLOSED      , channel_closed           },
+    { TP_CHANNEL_GROUP     , MEMBERS_CHANGED     , members_changed          },
+    { TP_CHANNEL_MEDIA     , STREAM_ADDED        , stream_added             },
+    { TP_CHANNEL_MEDIA     , STREAM_REMOVED      , stream_removed           },
+    { TP_CHANNEL_CALL_DRAFT, CONTENT_ADDED       , content_added            },
+    { TP_CHANNEL_CALL_DRAFT, CONTENT_REMOVED     , content_removed          },
+    { TP_CHANNEL_HOLD      , HOLD_STATE_CHANGED  , hold_state_changed       },
+    { TP_CHANNEL_STATE     , CALL_STATE_CHANGED  , call_state_changed       },
+    { TP_CHANNEL_CALL_DRAFT, CALL_STATE_CHANGED  , call_draft_state_changed },
+    { TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED      , channel_merged           },
+    { TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED     , channel_removed          },
+    { TP_CHANNEL_CONF      , CHANNEL_MERGED      , channel_merged           },
+    { TP_CHANNEL_CONF      , CHANNEL_REMOVED     , channel_removed          },
+    { TP_CONFERENCE        , MEMBER_CHANNEL_ADDED, member_channel_added     },
+    { TP_CONFERENCE        , MEMBER_CHANNEL_REMOVED, member_channel_removed },
+    { TELEPHONY_INTERFACE  , CALL_ENDED          , call_end                 },
+    { TP_DIALSTRINGS       , SENDING_DIALSTRING  , sending_dialstring       },
+    { TP_DIALSTRINGS       , STOPPED_DIALSTRING  , stopped_dialstring       },
+    { NULL, NULL, NULL }
+};
+
+static GHashTable *signal_table;              /* (interface, member) table */
+
+static void signal_table_init(void);
+static void signal_table_exit(void);
+static DBusHandleMessageFunction signal_lookup(const char *interface,
+                                               const char *member);
+
 static int tp_start_dtmf(call_t *call, unsigned int stream, int tone);
 static int tp_stop_dtmf (call_t *call, unsigned int stream);
 
@@ -141,6 +182,7 @@ static inline int need_video(void);
  */
 
 static GHashTable *calls;                       /* table of current calls */
+static GHashTable *call_ids;                    /* calls by our call ID */
 static int         ncscall;                     /* number of CS calls */
 static int         nipcall;                     /* number of ohter calls */
 static int         nvideo;                      /* number of calls with video */
@@ -157,6 +199,7 @@ call_t *call_register(call_type_t type, const char *path, const char *name,
 call_t *call_lookup(const char *path);
 void    call_destroy(call_t *call);
 void    call_foreach(GHFunc callback, gpointer data);
+void    call_set_parent(call_t *call, call_t *parent);
 
 static inline const char *state_name(int state);
 
@@ -186,22 +229,44 @@ int     policy_enforce(event_t *event);
 
 int     policy_audio_update(void);
 
+/*
+ * deferred bus events
+ *
+ * Signals for channels we do not know about yet are queued per channel
+ * path and replayed once the channel appears. Each path has a bounded
+ * ring of message references and all queues share a single timer that
+ * expires the events nobody claimed within EVENT_TIMEOUT.
+ */
+
 typedef struct {
-    list_hook_t     hook;
-    char           *path;
-    DBusConnection *c;
-    DBusMessage    *msg;
-    void           *data;
-    guint           timeout;
-} bus_event_t;
+    DBusMessage    *msg;                         /* deferred message */
+    guint64         deadline;                    /* expiry time (in ms) */
+} deferred_msg_t;
+
+typedef struct {
+    char           *path;                        /* channel object path */
+    DBusConnection *c;                           /* connection of events */
+    void           *data;                        /* filter user data */
+    deferred_msg_t  ring[EVENT_QLEN];            /* deferred messages */
+    int             head;                        /* oldest message */
+    int             count;                       /* number of messages */
+} event_queue_t;
 
 
 static void event_enqueue(const char *path,
                           DBusConnection *c, DBusMessage *msg, void *data);
 static void event_dequeue(char *path);
-static void event_destroy(bus_event_t *events);
+static void event_destroy(event_queue_t *q);
 
-static GHashTable *deferred;                     /* deferred events */
+static GHashTable *deferred;                     /* deferred event queues */
+static guint       event_timer;                  /* shared expiry timer */
+
+static struct {
+    unsigned int deferred;                       /* events deferred */
+    unsigned int replayed;                       /* events replayed */
+    unsigned int expired;                        /* events timed out */
+    unsigned int dropped;                        /* events over the limits */
+} event_stats;
 
 
 /*
@@ -224,8 +289,21 @@ static GHashTable *deferred;                     /* deferred events */
 
 int set_string_field(OhmFact *fact, const char *field, const char *value);
 
+static int  update_string_field(OhmFact *fact, const char *field,
+                                const char *value);
+static int  update_int_field(OhmFact *fact, const char *field, int value);
+static void clear_field(OhmFact *fact, const char *field);
+static void fact_batch_begin(void);
+static void fact_batch_end(void);
+
 
 static OhmFactStore *store;
+static int           fact_batch;                /* factstore batch depth */
+
+static struct {
+    unsigned int written;                        /* call fact fields written */
+    unsigned int unchanged;                      /* writes found redundant */
+} fact_stats;
 
 
 /*
@@ -889,88 +967,104 @@ short_path(const char *path)
 
 
 /********************
- * dispatch_signal
+ * signal_hash
  ********************/
-static DBusHandlerResult
-dispatch_signal(DBusConnection *c, DBusMessage *msg, void *data)
+static guint
+signal_hash(gconstpointer key)
 {
-#define MATCHES(i, m) (!strcmp(interface, (i)) && !strcmp(member, (m)))
+    const signal_handler_t *h = (const signal_handler_t *)key;
 
-    const char *interface = dbus_message_get_interface(msg);
-    const char *member    = dbus_message_get_member(msg);
-
-    if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-
-    if (!interface || !member)
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    return g_str_hash(h->interface) * 31 + g_str_hash(h->member);
+}
 
-    if (MATCHES("org.freedesktop.DBus", "NameOwnerChanged"))
-        return name_owner_changed(c, msg, data);
 
-    if (MATCHES(TP_CONNECTION, NEW_CHANNEL))
-        return channel_new(c, msg, data);
+/********************
+ * signal_equal
+ ********************/
+static gboolean
+signal_equal(gconstpointer a, gconstpointer b)
+{
+    const signal_handler_t *ha = (const signal_handler_t *)a;
+    const signal_handler_t *hb = (const signal_handler_t *)b;
 
-    if (MATCHES(TP_CONN_IFREQ, NEW_CHANNELS))
-        return channels_new(c, msg, data);
+    return !strcmp(ha->member, hb->member) &&
+        !strcmp(ha->interface, hb->interface);
+}
 
-    if (MATCHES(TP_CHANNEL, CHANNEL_CLOSED))
-        return channel_closed(c, msg, data);
 
-    if (MATCHES(TP_CHANNEL_GROUP, MEMBERS_CHANGED))
-        return members_changed(c, msg, data);
+/********************
+ * signal_table_init
+ ********************/
+static void
+signal_table_init(void)
+{
+    signal_handler_t *h;
 
-    if (MATCHES(TP_CHANNEL_MEDIA, STREAM_ADDED))
-        return stream_added(c, msg, data);
+    if (signal_table != NULL)
+        return;
 
-    if (MATCHES(TP_CHANNEL_MEDIA, STREAM_REMOVED))
-        return stream_removed(c, msg, data);
+    /* the table entries are their own keys */
+    signal_table = g_hash_table_new(signal_hash, signal_equal);
 
-    if (MATCHES(TP_CHANNEL_CALL_DRAFT, CONTENT_ADDED))
-        return content_added(c, msg, data);
+    for (h = signal_handlers; h->interface != NULL; h++)
+        g_hash_table_insert(signal_table, h, h);
+}
 
-    if (MATCHES(TP_CHANNEL_CALL_DRAFT, CONTENT_REMOVED))
-        return content_removed(c, msg, data);
-    
-    if (MATCHES(TP_CHANNEL_HOLD, HOLD_STATE_CHANGED))
-        return hold_state_changed(c, msg, data);
 
-    if (MATCHES(TP_CHANNEL_STATE, CALL_STATE_CHANGED))
-        return call_state_changed(c, msg, data);
+/********************
+ * signal_table_exit
+ ********************/
+static void
+signal_table_exit(void)
+{
+    if (signal_table != NULL) {
+        g_hash_table_destroy(signal_table);
+        signal_table = NULL;
+    }
+}
 
-    if (MATCHES(TP_CHANNEL_CALL_DRAFT, CALL_STATE_CHANGED))
-        return call_draft_state_changed(c, msg, data);
 
-    if (MATCHES(TP_CHANNEL_CONF_DRAFT, CHANNEL_MERGED))
-        return channel_merged(c, msg, data);
+/********************
+ * signal_lookup
+ ********************/
+static DBusHandleMessageFunction
+signal_lookup(const char *interface, const char *member)
+{
+    signal_handler_t key, *h;
 
-    if (MATCHES(TP_CHANNEL_CONF_DRAFT, CHANNEL_REMOVED))
-        return channel_removed(c, msg, data);
+    if (signal_table == NULL)
+        return NULL;
 
-    if (MATCHES(TP_CHANNEL_CONF, CHANNEL_MERGED))
-        return channel_merged(c, msg, data);
+    key.interface = interface;
+    key.member    = member;
 
-    if (MATCHES(TP_CHANNEL_CONF, CHANNEL_REMOVED))
-        return channel_removed(c, msg, data);
+    if ((h = g_hash_table_lookup(signal_table, &key)) != NULL)
+        return h->handler;
+    else
+        return NULL;
+}
 
-    if (MATCHES(TP_CONFERENCE, MEMBER_CHANNEL_ADDED))
-        return member_channel_added(c, msg, data);
 
-    if (MATCHES(TP_CONFERENCE, MEMBER_CHANNEL_REMOVED))
-        return member_channel_removed(c, msg, data);
-    
-    if (MATCHES(TELEPHONY_INTERFACE, CALL_ENDED))
-        return call_end(c, msg, data);
+/********************
+ * dispatch_signal
+ ********************/
+static DBusHandlerResult
+dispatch_signal(DBusConnection *c, DBusMessage *msg, void *data)
+{
+    const char                *interface = dbus_message_get_interface(msg);
+    const char                *member    = dbus_message_get_member(msg);
+    DBusHandleMessageFunction  handler;
 
-    if (MATCHES(TP_DIALSTRINGS, SENDING_DIALSTRING))
-        return sending_dialstring(c, msg, data);
+    if (dbus_message_get_type(msg) != DBUS_MESSAGE_TYPE_SIGNAL)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    if (MATCHES(TP_DIALSTRINGS, STOPPED_DIALSTRING))
-        return stopped_dialstring(c, msg, data);
-        
-    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    if (!interface || !member)
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-#undef MATCHES
+    if ((handler = signal_lookup(interface, member)) != NULL)
+        return handler(c, msg, data);
+    else
+        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
 
@@ -1918,7 +2012,7 @@ channel_merged(DBusConnection *c, DBusMessage *msg, void *data)
     
     member->conf_state = member->state;
     member->state      = STATE_CONFERENCE;
-    member->parent     = parent;
+    call_set_parent(member, parent);
 
     OHM_INFO("Call %s is now in conference %s.",
              short_path(member->path), short_path(parent->path));
@@ -1955,7 +2049,7 @@ channel_removed(DBusConnection *c, DBusMessage *msg, void *data)
     }
 
     member->state = member->conf_state;
-    member->parent = NULL;
+    call_set_parent(member, NULL);
     OHM_INFO("Call %s has left conference %s, restoring state to %s.",
              short_path(member->path), short_path(parent->path),
              state_name(member->state));
@@ -1993,7 +2087,7 @@ member_channel_added(DBusConnection *c, DBusMessage *msg, void *data)
     
     member->conf_state = member->state;
     member->state      = STATE_CONFERENCE;
-    member->parent     = parent;
+    call_set_parent(member, parent);
 
     OHM_INFO("Call %s is now in conference %s.",
              short_path(member->path), short_path(parent->path));
@@ -2030,7 +2124,7 @@ member_channel_removed(DBusConnection *c, DBusMessage *msg, void *data)
     }
     
     member->state  = member->conf_state;
-    member->parent = NULL;
+    call_set_parent(member, NULL);
     OHM_INFO("Call %s has left conference %s, restoring state to %s.",
              short_path(member->path), short_path(parent->path),
              state_name(member->state));
@@ -2677,7 +2771,7 @@ event_handler(event_t *event)
                     return;
                 }
                 member->state  = STATE_CONFERENCE;
-                member->parent = call;
+                call_set_parent(member, call);
                 OHM_INFO("call %s is now in conference %s",
                          member->path, call->path);
                 policy_call_update(member, UPDATE_STATE | UPDATE_PARENT);
@@ -2790,7 +2884,9 @@ event_handler(event_t *event)
         return;
     }
     else {
+        TIMESTAMP_ADD("telephony: enforce policy actions");
         policy_enforce(event);
+        TIMESTAMP_ADD("telephony: enforced policy actions");
         policy_audio_update();
     }
     
@@ -2799,17 +2895,61 @@ event_handler(event_t *event)
 
 
 /********************
- * event_free
+ * event_now
  ********************/
-static void
-event_free(bus_event_t *e)
+static guint64
+event_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (guint64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+/********************
+ * event_drop
+ ********************/
+static DBusMessage *
+event_drop(event_queue_t *q)
+{
+    DBusMessage *msg;
+
+    msg = q->ring[q->head].msg;
+    q->ring[q->head].msg = NULL;
+    q->head = (q->head + 1) % EVENT_QLEN;
+    q->count--;
+
+    return msg;
+}
+
+
+/********************
+ * event_expire
+ ********************/
+static gboolean
+event_expire(gpointer key, gpointer value, gpointer data)
 {
-    if (e) {
-        dbus_connection_unref(e->c);
-        dbus_message_unref(e->msg);
-        g_free(e->path);
-        g_free(e);
+    event_queue_t *q    = (event_queue_t *)value;
+    guint64       *next = (guint64 *)data;
+    guint64        now  = next[0];
+
+    (void)key;
+
+    while (q->count > 0 && q->ring[q->head].deadline <= now) {
+        OHM_DEBUG(DBG_CALL, "Deferred event for %s timed out...", q->path);
+        dbus_message_unref(event_drop(q));
+        event_stats.expired++;
     }
+
+    if (q->count == 0)
+        return TRUE;
+
+    if (next[1] == 0 || q->ring[q->head].deadline < next[1])
+        next[1] = q->ring[q->head].deadline;
+
+    return FALSE;
 }
 
 
@@ -2819,72 +2959,96 @@ event_free(bus_event_t *e)
 static gboolean
 event_timeout(gpointer data)
 {
-    bus_event_t *events, *e;
-    
-    e = (bus_event_t *)data;
+    guint64 next[2];
 
-    OHM_DEBUG(DBG_CALL, "Deferred event for %s timed out...", e->path);
-    
-    if ((events = g_hash_table_lookup(deferred, e->path)) == NULL)
-        OHM_ERROR("Failed to look up deferred events for %s.", e->path);
-    else {
-        g_hash_table_steal(deferred, e->path);
-        
-        if (!list_empty(&e->hook)) {
-            events = list_entry(e->hook.next, bus_event_t, hook);
-            list_delete(&e->hook);
-            g_hash_table_insert(deferred, events->path, events);
-        }
-    }
+    (void)data;
+
+    next[0] = event_now();
+    next[1] = 0;
+
+    g_hash_table_foreach_remove(deferred, event_expire, next);
+
+    /*
+     * Deadlines are handed out in increasing order, so the timer only
+     * ever needs to move forward to the oldest remaining event.
+     */
 
-    event_free(e);
+    if (next[1] != 0)
+        event_timer = g_timeout_add((guint)(next[1] - next[0]),
+                                    event_timeout, NULL);
+    else
+        event_timer = 0;
     
     return FALSE;
 }
 
 
+/********************
+ * find_oldest
+ ********************/
+static void
+find_oldest(gpointer key, gpointer value, gpointer data)
+{
+    event_queue_t  *q      = (event_queue_t *)value;
+    event_queue_t **oldest = (event_queue_t **)data;
+
+    (void)key;
+
+    if (*oldest == NULL ||
+        q->ring[q->head].deadline < (*oldest)->ring[(*oldest)->head].deadline)
+        *oldest = q;
+}
+
+
 /********************
  * event_enqueue
  ********************/
 static void
 event_enqueue(const char *path, DBusConnection *c, DBusMessage *msg, void *data)
 {
-    bus_event_t *events, *e;
+    event_queue_t *q;
+    int            i;
     
     OHM_DEBUG(DBG_CALL, "Delaying event for %s...", path);
-    
-    if ((e = g_new0(bus_event_t, 1)) == NULL ||
-        (e->path = g_strdup(path)) == NULL) {
-        OHM_ERROR("Failed to allocate delyed DBUS event.");
-        goto fail;
+
+    TIMESTAMP_ADD("telephony: defer event");
+
+    if ((q = g_hash_table_lookup(deferred, path)) == NULL) {
+        if (g_hash_table_size(deferred) >= EVENT_QMAX) {
+            g_hash_table_foreach(deferred, find_oldest, &q);
+            OHM_WARNING("Too many deferred channels, dropping %s.", q->path);
+            event_stats.dropped += q->count;
+            g_hash_table_remove(deferred, q->path);
+        }
+
+        if ((q = g_new0(event_queue_t, 1)) == NULL ||
+            (q->path = g_strdup(path)) == NULL) {
+            OHM_ERROR("Failed to allocate delyed DBUS event.");
+            g_free(q);
+            return;
+        }
+
+        q->c    = dbus_connection_ref(c);
+        q->data = data;
+        
+        g_hash_table_insert(deferred, q->path, q);
     }
 
-    list_init(&e->hook);
-    e->c    = dbus_connection_ref(c);
-    e->msg  = dbus_message_ref(msg);
-    e->data = data;
-    
-    e->timeout = g_timeout_add_full(G_PRIORITY_DEFAULT, EVENT_TIMEOUT,
-                                    event_timeout, e, NULL);
+    if (q->count == EVENT_QLEN) {
+        OHM_WARNING("Too many deferred events for %s.", path);
+        dbus_message_unref(event_drop(q));
+        event_stats.dropped++;
+    }
 
-    if ((events = g_hash_table_lookup(deferred, path)) != NULL)
-        list_append(&events->hook, &e->hook);
-    else
-        g_hash_table_insert(deferred, e->path, e);
-    
-    return;
-    
+    i = (q->head + q->count) % EVENT_QLEN;
+    q->ring[i].msg      = dbus_message_ref(msg);
+    q->ring[i].deadline = event_now() + EVENT_TIMEOUT;
+    q->count++;
+
+    event_stats.deferred++;
     
- fail:
-    if (e) {
-        if (e->path)
-            g_free(e->path);
-        if (e->c)
-            dbus_connection_unref(e->c);
-        if (e->msg)
-            dbus_message_unref(e->msg);
-        g_free(e);
-    }
+    if (!event_timer)
+        event_timer = g_timeout_add(EVENT_TIMEOUT, event_timeout, NULL);
 }
 
 
@@ -2894,28 +3058,33 @@ event_enqueue(const char *path, DBusConnection *c, DBusMessage *msg, void *data)
 static void
 event_dequeue(char *path)
 {
-    bus_event_t *events, *e;
-    list_hook_t *p, *n;
+    event_queue_t *q;
+    DBusMessage   *msg;
 
     OHM_DEBUG(DBG_CALL, "Processing deferred events for %s...", path);
 
-    if ((events = g_hash_table_lookup(deferred, path)) != NULL) {
-        g_hash_table_steal(deferred, path);
-        
-        g_source_remove(events->timeout);
-        dispatch_signal(events->c, events->msg, events->data);
-        
-        list_foreach(&events->hook, p, n) {
-            e = list_entry(p, bus_event_t, hook);
-            list_delete(&e->hook);
+    /*
+     * Notes:
+     *    The queue is taken out of the table before replaying, so events
+     *    that still cannot be handled get deferred again to a new queue.
+     *    The shared timer is left alone, it rearms itself when it fires.
+     */
 
-            g_source_remove(e->timeout);
-            dispatch_signal(e->c, e->msg, e->data);
+    if ((q = g_hash_table_lookup(deferred, path)) != NULL) {
+        g_hash_table_steal(deferred, path);
 
-            event_free(e);
+        TIMESTAMP_ADD("telephony: replay deferred events");
+        
+        while (q->count > 0) {
+            msg = event_drop(q);
+            dispatch_signal(q->c, msg, q->data);
+            dbus_message_unref(msg);
+            event_stats.replayed++;
         }
 
-        event_free(events);
+        TIMESTAMP_ADD("telephony: replayed deferred events");
+
+        event_destroy(q);
     }
 }
 
@@ -2924,22 +3093,14 @@ event_dequeue(char *path)
  * event_destroy
  ********************/
 static void
-event_destroy(bus_event_t *events)
+event_destroy(event_queue_t *q)
 {
-    bus_event_t *e;
-    list_hook_t *p, *n;
-    
-    OHM_DEBUG(DBG_CALL, "Destroying deferred events...");
-    
-    g_source_remove(events->timeout);
-    list_foreach(&events->hook, p, n) {
-        e = list_entry(p, bus_event_t, hook);
-        list_delete(&e->hook);
-        g_source_remove(e->timeout);
-        event_free(e);
-    }
+    while (q->count > 0)
+        dbus_message_unref(event_drop(q));
 
-    event_free(events);
+    dbus_connection_unref(q->c);
+    g_free(q->path);
+    g_free(q);
 }
 
 
@@ -2969,6 +3130,11 @@ call_init(void)
         exit(1);
     }
 
+    if ((call_ids = g_hash_table_new(g_direct_hash, g_direct_equal)) == NULL) {
+        OHM_ERROR("failed to allocate call ID table");
+        exit(1);
+    }
+
     fptr = (GDestroyNotify)event_destroy;
     if ((deferred = g_hash_table_new_full(hptr, eptr, NULL, fptr)) == NULL) {
         OHM_ERROR("failed to allocate delayed event table");
@@ -2985,13 +3151,25 @@ call_init(void)
 void
 call_exit(void)
 {
+    if (call_ids != NULL)
+        g_hash_table_destroy(call_ids);
+
     if (calls != NULL)
         g_hash_table_destroy(calls);
 
+    if (event_timer != 0) {
+        g_source_remove(event_timer);
+        event_timer = 0;
+    }
+
     if (deferred != NULL)
         g_hash_table_destroy(deferred);
 
-    calls = deferred = NULL;
+    OHM_INFO("telephony: %u bus events deferred, %u replayed, %u expired, "
+             "%u dropped.", event_stats.deferred, event_stats.replayed,
+             event_stats.expired, event_stats.dropped);
+
+    calls = call_ids = deferred = NULL;
     ncscall = 0;
     nipcall = 0;
 }
@@ -3077,7 +3255,10 @@ call_register(call_type_t type, const char *path, const char *name,
 
     if (has_interface(interfaces, TP_CONFERENCE))
         conference = TRUE;
-    
+
+    list_init(&call->conf_members);
+    list_init(&call->conf_hook);
+
     if (conference)
         call->parent = call;
 
@@ -3096,6 +3277,7 @@ call_register(call_type_t type, const char *path, const char *name,
     call->state = STATE_UNKNOWN;
 
     g_hash_table_insert(calls, call->path, call);
+    g_hash_table_insert(call_ids, GINT_TO_POINTER(call->id), call);
     
     if (IS_CELLULAR(path))
         ncscall++;
@@ -3144,6 +3326,7 @@ call_unregister(const char *path)
     
     cs = !strncmp(path, TP_RING, sizeof(TP_RING) - 1);
 
+    g_hash_table_remove(call_ids, GINT_TO_POINTER(call->id));
     g_hash_table_remove(calls, path);
     
     if (cs)
@@ -3171,28 +3354,13 @@ call_lookup(const char *path)
 
 
 
-/********************
- * has_id
- ********************/
-static gboolean
-has_id(gpointer key, gpointer value, gpointer data)
-{
-    call_t *call = (call_t *)value;
-    int     id   = (int)data;
-
-    (void)key;
-
-    return call->id == id;
-}
-
-
 /********************
  * call_find
  ********************/
 call_t *
 call_find(int id)
 {
-    return g_hash_table_find(calls, has_id, (gpointer)id);
+    return (call_t *)g_hash_table_lookup(call_ids, GINT_TO_POINTER(id));
 }
 
 
@@ -3206,14 +3374,39 @@ call_foreach(GHFunc callback, gpointer data)
 }
 
 
+/********************
+ * call_set_parent
+ ********************/
+void
+call_set_parent(call_t *call, call_t *parent)
+{
+    list_delete(&call->conf_hook);
+
+    call->parent = parent;
+
+    if (parent != NULL && parent != call)
+        list_append(&parent->conf_members, &call->conf_hook);
+}
+
+
 /********************
  * call_destroy
  ********************/
 void
 call_destroy(call_t *call)
 {
+    list_hook_t *p, *n;
+    call_t      *member;
+
     if (call != NULL) {
         OHM_INFO("Destroying call %s.", short_path(call->path));
+
+        list_foreach(&call->conf_members, p, n) {
+            member = list_entry(p, call_t, conf_hook);
+            call_set_parent(member, NULL);
+        }
+        list_delete(&call->conf_hook);
+
         g_free(call->name);
         g_free(call->path);
         g_free(call->peer);
@@ -3385,35 +3578,34 @@ tp_disconnect(call_t *call, const char *action)
 /********************
  * remove_parent
  ********************/
-static gboolean
-remove_parent(gpointer key, gpointer value, gpointer data)
+static void
+remove_parent(call_t *parent)
 {
-    call_t *parent = (call_t *)data;
-    call_t *call   = (call_t *)value;
-    int     update = UPDATE_NONE;
+    list_hook_t *p, *n;
+    call_t      *call;
+    int          update;
 
-    (void)key;
+    fact_batch_begin();
+
+    list_foreach(&parent->conf_members, p, n) {
+        call   = list_entry(p, call_t, conf_hook);
+        update = UPDATE_PARENT;
 
-    if (call->parent == parent && call->parent != call) {
         OHM_INFO("Clearing parent of conference member %s.",
                  short_path(call->path));
-        call->parent = NULL;
-        update |= UPDATE_PARENT;
-    }
+        call_set_parent(call, NULL);
 
-    if (IS_CONF_PARENT(parent)) {
         if (call->state == STATE_POST_CONFERENCE) {
             OHM_INFO("Restoring post-conference state of %s to %s.",
                      short_path(call->path), state_name(call->conf_state));
             call->state = call->conf_state;
             update |= UPDATE_STATE;
         }
-    }
 
-    if (update)
         policy_call_update(call, update);
-    
-    return TRUE;
+    }
+
+    fact_batch_end();
 }
 
 
@@ -3452,7 +3644,7 @@ call_disconnect(call_t *call, const char *action, event_t *event)
     if (call == event->any.call) {
         
         if (IS_CONF_PARENT(call))
-            call_foreach((GHFunc)remove_parent, call);
+            remove_parent(call);
 
         switch (event->any.state) {
         case STATE_CREATED:
@@ -3923,6 +4115,9 @@ policy_init()
 void
 policy_exit(void)
 {
+    OHM_INFO("telephony: %u call fact fields written, %u unchanged.",
+             fact_stats.written, fact_stats.unchanged);
+
     store = NULL;
 }
 
@@ -4187,6 +4382,85 @@ set_int_field(OhmFact *fact, const char *field, int value)
 }
 
 
+/********************
+ * update_string_field
+ ********************/
+static int
+update_string_field(OhmFact *fact, const char *field, const char *value)
+{
+    GValue     *gval = ohm_fact_get(fact, field);
+    const char *old;
+
+    if (gval != NULL && G_VALUE_TYPE(gval) == G_TYPE_STRING) {
+        old = g_value_get_string(gval);
+
+        if (old != NULL && !strcmp(old, value)) {
+            fact_stats.unchanged++;
+            return TRUE;
+        }
+    }
+
+    fact_stats.written++;
+    return set_string_field(fact, field, value);
+}
+
+
+/********************
+ * update_int_field
+ ********************/
+static int
+update_int_field(OhmFact *fact, const char *field, int value)
+{
+    GValue *gval = ohm_fact_get(fact, field);
+
+    if (gval != NULL && G_VALUE_TYPE(gval) == G_TYPE_INT &&
+        g_value_get_int(gval) == value) {
+        fact_stats.unchanged++;
+        return TRUE;
+    }
+
+    fact_stats.written++;
+    return set_int_field(fact, field, value);
+}
+
+
+/********************
+ * clear_field
+ ********************/
+static void
+clear_field(OhmFact *fact, const char *field)
+{
+    if (ohm_fact_get(fact, field) != NULL) {
+        fact_stats.written++;
+        ohm_fact_set(fact, field, NULL);
+    }
+    else
+        fact_stats.unchanged++;
+}
+
+
+/********************
+ * fact_batch_begin
+ ********************/
+static void
+fact_batch_begin(void)
+{
+    if (fact_batch++ == 0)
+        ohm_fact_store_transaction_push(store);
+}
+
+
+/********************
+ * fact_batch_end
+ ********************/
+static void
+fact_batch_end(void)
+{
+    if (fact_batch > 0 && --fact_batch == 0)
+        ohm_fact_store_transaction_pop(store, FALSE);
+}
+
+
 /********************
  * policy_call_export
  ********************/
@@ -4227,8 +4501,7 @@ policy_call_export(call_t *call)
         !set_string_field(fact, FACT_FIELD_VIDEO, video) ||
         !set_string_field(fact, FACT_FIELD_HOLD , hold)  ||
         (parent[0] && !set_string_field(fact, FACT_FIELD_PARENT, parent)) ||
-        (call->emergency && !set_string_field(fact, FACT_FIELD_EMERG, "yes")) ||
-        (call->video && !set_string_field(fact, FACT_FIELD_VIDEO, "yes"))) {
+        (call->emergency && !set_string_field(fact, FACT_FIELD_EMERG, "yes"))) {
         OHM_ERROR("Failed to export call %s to factstore.", path);
         g_object_unref(fact);
         return FALSE;
@@ -4272,9 +4545,17 @@ policy_call_update(call_t *call, int fields)
     conn   = (fields & UPDATE_CONNECT) ? call->connected : 0;
     video  = (fields & UPDATE_VIDEO)   ? (call->video ? "yes" : "no") : NULL;
 
+    /*
+     * Only fields that really changed are written, and all of them in a
+     * single factstore transaction, so the policy engine gets notified
+     * once per update instead of once per field.
+     */
+
+    fact_batch_begin();
+
     if (fields & UPDATE_PARENT) {
         if (call->parent == NULL) {
-            ohm_fact_set(fact, FACT_FIELD_PARENT, NULL);
+            clear_field(fact, FACT_FIELD_PARENT);
             parent = NULL;
         }
         else {
@@ -4285,24 +4566,19 @@ policy_call_update(call_t *call, int fields)
     else
         parent = NULL;
     
-    if ((state  && !set_string_field(fact, FACT_FIELD_STATE    , state))  ||
-        (dir    && !set_string_field(fact, FACT_FIELD_DIR      , dir))    ||
-        (parent && !set_string_field(fact, FACT_FIELD_PARENT   , parent)) ||
-        (order  && !set_int_field   (fact, FACT_FIELD_ORDER    , order))  ||
-        (conn   && !set_string_field(fact, FACT_FIELD_CONNECTED, "yes"))) {
-        OHM_ERROR("Failed to update fact for call %s", short_path(call->path));
-        return FALSE;
-    }
-    
-    if (emerg && !set_string_field(fact, FACT_FIELD_EMERG, "yes")) {
+    if ((state  && !update_string_field(fact, FACT_FIELD_STATE    , state))  ||
+        (dir    && !update_string_field(fact, FACT_FIELD_DIR      , dir))    ||
+        (parent && !update_string_field(fact, FACT_FIELD_PARENT   , parent)) ||
+        (order  && !update_int_field   (fact, FACT_FIELD_ORDER    , order))  ||
+        (conn   && !update_string_field(fact, FACT_FIELD_CONNECTED, "yes")) ||
+        (emerg  && !update_string_field(fact, FACT_FIELD_EMERG    , "yes")) ||
+        (video  && !update_string_field(fact, FACT_FIELD_VIDEO    , video))) {
         OHM_ERROR("Failed to update fact for call %s", short_path(call->path));
+        fact_batch_end();
         return FALSE;
     }
 
-    if (video && !set_string_field(fact, FACT_FIELD_VIDEO, video)) {
-        OHM_ERROR("Failed to update fact for call %s", short_path(call->path));
-        return FALSE;
-    }
+    fact_batch_end();
     
     return TRUE;
 }
@@ -4742,6 +5018,7 @@ plugin_init(OhmPlugin *plugin)
      *        address of the bus from ohm-session-agent.
      */
     
+    signal_table_init();
     call_init();
     policy_init();
     timestamp_init();
@@ -4769,6 +5046,7 @@ plugin_exit(OhmPlugin *plugin)
     bus_exit();
     call_exit();
     policy_exit();
+    signal_table_exit();
 }
 
 
@@ -21,6 +21,7 @@ USA.
 #ifndef __OHM_PLUGIN_TELEPHONY_H__
 #define __OHM_PLUGIN_TELEPHONY_H__
 
+#include "list.h"
 
 
 /*
@@ -193,6 +194,8 @@ struct call_s {
     call_state_t  conf_state;                  /* state while in conference */
     int           order;                       /* autohold order */
     call_t       *parent;                      /* hosting conference if any */
+    list_hook_t   conf_members;                /* members if a conference */
+    list_hook_t   conf_hook;                   /* to parent->conf_members */
     int           connected;                   /* whether has been connected */
     OhmFact      *fact;                        /* this call in fact store */
     char         *audio;                       /* audio stream/content or 0 */